@@ -0,0 +1,212 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // for pthread_key_t, sched_yield
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "CSE333.h"
+#include "Epoch.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Internal structures and helper functions.
+//
+// Each registered thread owns one Participant.  Its "state" is 0 outside a
+// critical section and (epoch << 1) | 1 inside one, and it keeps a list of
+// the things it has retired, newest first, each tagged with the epoch it
+// was retired in.
+
+// How many retires a thread does between attempts to advance the epoch and
+// free its old garbage.
+#define EPOCH_RETIRE_BATCH 64
+
+typedef struct retired {
+  struct retired *next;     // next (older) retired pointer
+  void           *ptr;      // what to free
+  EpochFreeFnPtr  free_fn;  // how to free it
+  uint64_t        epoch;    // the global epoch when it was retired
+} Retired;
+
+typedef struct participant {
+  _Atomic uint64_t  state    // (epoch << 1) | 1 while in a section, else 0
+    __attribute__((aligned(64)));
+  atomic_bool       in_use;  // is some thread registered in this slot?
+  int               depth;   // critical section nesting depth
+  int               num_retired;  // retires since the last collection
+  Retired          *limbo;   // retired but not yet freed, newest first
+} Participant;
+
+static _Atomic uint64_t global_epoch = 1;
+static Participant participants[EPOCH_MAX_THREADS];
+static _Atomic int num_slots;  // slots [0, num_slots) have ever been used
+
+// Garbage left behind by threads that have exited.
+static pthread_mutex_t orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static Retired *orphans = NULL;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t self_key;
+static _Thread_local Participant *self = NULL;
+
+// Free everything on *list that was retired at least two epochs ago.
+static void Collect(Retired **list) {
+  uint64_t epoch = atomic_load(&global_epoch);
+  Retired **prev = list;
+
+  while (*prev != NULL) {
+    Retired *r = *prev;
+    if (r->epoch + 2 <= epoch) {
+      *prev = r->next;
+      r->free_fn(r->ptr);
+      free(r);
+    } else {
+      prev = &r->next;
+    }
+  }
+}
+
+// Move the epoch on by one if every thread in a critical section has seen
+// the current one.
+static void TryAdvance(void) {
+  uint64_t epoch = atomic_load(&global_epoch);
+  int n = atomic_load(&num_slots);
+  int i;
+
+  for (i = 0; i < n; i++) {
+    uint64_t state = atomic_load(&participants[i].state);
+    if ((state & 1) != 0 && (state >> 1) != epoch) {
+      return;
+    }
+  }
+  atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+}
+
+// Called when a registered thread exits: give its garbage to the orphan
+// list and free up its slot.
+static void Unregister(void *arg) {
+  Participant *p = (Participant *) arg;
+  Retired *tail;
+
+  atomic_store(&p->state, 0);
+  if (p->limbo != NULL) {
+    for (tail = p->limbo; tail->next != NULL; tail = tail->next) { }
+    pthread_mutex_lock(&orphan_lock);
+    tail->next = orphans;
+    orphans = p->limbo;
+    pthread_mutex_unlock(&orphan_lock);
+    p->limbo = NULL;
+  }
+  atomic_store(&p->in_use, false);
+}
+
+static void MakeKey(void) {
+  Verify333(pthread_key_create(&self_key, &Unregister) == 0);
+}
+
+// Return this thread's Participant, registering it on first use.
+static Participant *Self(void) {
+  int i;
+
+  if (self != NULL) {
+    return self;
+  }
+  pthread_once(&key_once, &MakeKey);
+  for (i = 0; i < EPOCH_MAX_THREADS; i++) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&participants[i].in_use, &expected,
+                                       true)) {
+      break;
+    }
+  }
+  Verify333(i < EPOCH_MAX_THREADS);
+
+  // Make sure TryAdvance looks at our slot.
+  int n = atomic_load(&num_slots);
+  while (n <= i && !atomic_compare_exchange_weak(&num_slots, &n, i + 1)) { }
+
+  self = &participants[i];
+  self->depth = 0;
+  self->num_retired = 0;
+  self->limbo = NULL;
+  Verify333(pthread_setspecific(self_key, self) == 0);
+  return self;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Epoch implementation.
+
+void Epoch_Enter(void) {
+  Participant *p = Self();
+
+  if (p->depth++ > 0) {
+    return;
+  }
+  // The store must be visible before we read anything shared, which the
+  // (default) sequentially consistent store and load guarantee.  If the
+  // epoch moved on while we were announcing, announce the new one so that
+  // we don't hold the next advance up.
+  uint64_t epoch = atomic_load(&global_epoch);
+  atomic_store(&p->state, (epoch << 1) | 1);
+  if (atomic_load(&global_epoch) != epoch) {
+    atomic_store(&p->state, (atomic_load(&global_epoch) << 1) | 1);
+  }
+}
+
+void Epoch_Exit(void) {
+  Participant *p = Self();
+
+  Verify333(p->depth > 0);
+  if (--p->depth == 0) {
+    atomic_store_explicit(&p->state, 0, memory_order_release);
+  }
+}
+
+void Epoch_Retire(void *ptr, EpochFreeFnPtr free_fn) {
+  Participant *p = Self();
+  Retired *r = (Retired *) malloc(sizeof(Retired));
+
+  Verify333(r != NULL);
+  r->ptr = ptr;
+  r->free_fn = free_fn;
+  r->epoch = atomic_load(&global_epoch);
+  r->next = p->limbo;
+  p->limbo = r;
+
+  if (++p->num_retired >= EPOCH_RETIRE_BATCH) {
+    p->num_retired = 0;
+    TryAdvance();
+    Collect(&p->limbo);
+  }
+}
+
+void Epoch_Barrier(void) {
+  Participant *p = Self();
+  uint64_t target = atomic_load(&global_epoch) + 2;
+
+  Verify333(p->depth == 0);
+  while (atomic_load(&global_epoch) < target) {
+    TryAdvance();
+    if (atomic_load(&global_epoch) < target) {
+      sched_yield();
+    }
+  }
+  Collect(&p->limbo);
+  pthread_mutex_lock(&orphan_lock);
+  Collect(&orphans);
+  pthread_mutex_unlock(&orphan_lock);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_EPOCH_H_
+#define HW1_EPOCH_H_
+
+///////////////////////////////////////////////////////////////////////////////
+// Epoch-based memory reclamation.
+//
+// Lock-free data structures can't free a node as soon as it is unlinked,
+// since another thread may still be looking at it.  Instead, every thread
+// wraps its accesses in Epoch_Enter()/Epoch_Exit(), and a thread that
+// unlinks a node hands it to Epoch_Retire() rather than freeing it.  A
+// retired node is only really freed once every thread that was inside a
+// critical section when it was retired has left it.
+//
+// Under the hood there is one global epoch counter.  A thread announces
+// the epoch it saw when it entered, and the counter can only move on once
+// every thread in a critical section has announced the current epoch.
+// Something retired in epoch e is freed once the counter reaches e + 2.
+//
+// Threads register themselves on their first call and are unregistered
+// automatically when they exit; whatever they had retired is handed over
+// to the threads that stay behind.  At most EPOCH_MAX_THREADS threads may
+// be registered at once.
+#define EPOCH_MAX_THREADS 128
+
+// A function that frees a retired pointer.
+typedef void (*EpochFreeFnPtr)(void *ptr);
+
+// Enter a critical section.  Pointers read from a shared structure inside
+// the section stay valid until the matching Epoch_Exit.  Sections may
+// nest; only the outermost pair has any effect.
+void Epoch_Enter(void);
+
+// Leave a critical section.
+void Epoch_Exit(void);
+
+// Arrange for free_fn(ptr) to be called once no thread can still be
+// looking at ptr.  The caller must already have made ptr unreachable for
+// threads that enter a critical section from now on.
+void Epoch_Retire(void *ptr, EpochFreeFnPtr free_fn);
+
+// Wait until everything this thread (and any thread that has exited) has
+// retired so far can be freed, and free it.  Must not be called from
+// inside a critical section.  Useful when tearing a structure down, and to
+// keep leak checkers quiet.
+void Epoch_Barrier(void);
+
+#endif  // HW1_EPOCH_H_
@@ -0,0 +1,263 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HTHash.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// xxHash64.
+//
+// Keys of 32 bytes or more go through four accumulators, each fed every
+// fourth 8-byte word, which are then merged.  Whatever is left over (or
+// the whole key, if it is shorter) is folded in 8, then 4, then 1 byte at
+// a time, and the result is finished with an avalanche of shifts and
+// multiplies.  Words are read little-endian, so the hash is the same on
+// every machine.
+
+static const uint64_t HH_P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t HH_P2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t HH_P3 = 0x165667B19E3779F9ULL;
+static const uint64_t HH_P4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t HH_P5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t HHRotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t HHRead64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline uint32_t HHRead32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static inline uint64_t HHRound(uint64_t acc, uint64_t input) {
+  acc += input * HH_P2;
+  acc = HHRotl(acc, 31);
+  return acc * HH_P1;
+}
+
+static inline uint64_t HHMergeRound(uint64_t acc, uint64_t val) {
+  acc ^= HHRound(0, val);
+  return acc * HH_P1 + HH_P4;
+}
+
+static inline void HHInitAcc(uint64_t acc[4], uint64_t seed) {
+  acc[0] = seed + HH_P1 + HH_P2;
+  acc[1] = seed + HH_P2;
+  acc[2] = seed;
+  acc[3] = seed - HH_P1;
+}
+
+// Feed one 32-byte stripe into the accumulators.
+static inline void HHStripe(uint64_t acc[4], const unsigned char *p) {
+  acc[0] = HHRound(acc[0], HHRead64(p));
+  acc[1] = HHRound(acc[1], HHRead64(p + 8));
+  acc[2] = HHRound(acc[2], HHRead64(p + 16));
+  acc[3] = HHRound(acc[3], HHRead64(p + 24));
+}
+
+static inline uint64_t HHMergeAcc(const uint64_t acc[4]) {
+  uint64_t h = HHRotl(acc[0], 1) + HHRotl(acc[1], 7) +
+               HHRotl(acc[2], 12) + HHRotl(acc[3], 18);
+  h = HHMergeRound(h, acc[0]);
+  h = HHMergeRound(h, acc[1]);
+  h = HHMergeRound(h, acc[2]);
+  return HHMergeRound(h, acc[3]);
+}
+
+// Fold one leftover 8-byte word into h.
+static inline uint64_t HHWord(uint64_t h, uint64_t word) {
+  h ^= HHRound(0, word);
+  return HHRotl(h, 27) * HH_P1 + HH_P4;
+}
+
+// Fold the last len (< 8) bytes into h.
+static inline uint64_t HHBytes(uint64_t h, const unsigned char *p,
+                               size_t len) {
+  if (len >= 4) {
+    h ^= (uint64_t) HHRead32(p) * HH_P1;
+    h = HHRotl(h, 23) * HH_P2 + HH_P3;
+    p += 4;
+    len -= 4;
+  }
+  while (len > 0) {
+    h ^= *p++ * HH_P5;
+    h = HHRotl(h, 11) * HH_P1;
+    len--;
+  }
+  return h;
+}
+
+static inline uint64_t HHAvalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= HH_P2;
+  h ^= h >> 29;
+  h *= HH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+// Finish a hash, given its start h and its len (< 32) leftover bytes.
+static uint64_t HHFinish(uint64_t h, const unsigned char *p, size_t len) {
+  for (; len >= 8; p += 8, len -= 8) {
+    h = HHWord(h, HHRead64(p));
+  }
+  return HHAvalanche(HHBytes(h, p, len));
+}
+
+HTKey_t HTHash64(const void *buffer, size_t len, uint64_t seed) {
+  const unsigned char *p = (const unsigned char *) buffer;
+  size_t left = len;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t acc[4];
+    HHInitAcc(acc, seed);
+    for (; left >= 32; p += 32, left -= 32) {
+      HHStripe(acc, p);
+    }
+    h = HHMergeAcc(acc);
+  } else {
+    h = seed + HH_P5;
+  }
+  return HHFinish(h + (uint64_t) len, p, left);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Incremental hashing.
+//
+// Whole stripes go straight into the accumulators; a partial stripe waits
+// in buf until the rest of it arrives (or Final treats it as the leftover
+// bytes).
+
+void HTHash64_Init(HTHashState *state, uint64_t seed) {
+  Verify333(state != NULL);
+  HHInitAcc(state->acc, seed);
+  state->total_len = 0;
+  state->seed = seed;
+  state->buf_len = 0;
+}
+
+void HTHash64_Update(HTHashState *state, const void *buffer, size_t len) {
+  const unsigned char *p = (const unsigned char *) buffer;
+
+  Verify333(state != NULL && (buffer != NULL || len == 0));
+  state->total_len += len;
+
+  // Top up a partial stripe first.
+  if (state->buf_len > 0) {
+    size_t take = sizeof(state->buf) - state->buf_len;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(state->buf + state->buf_len, p, take);
+    state->buf_len += take;
+    p += take;
+    len -= take;
+    if (state->buf_len < sizeof(state->buf)) {
+      return;
+    }
+    HHStripe(state->acc, state->buf);
+    state->buf_len = 0;
+  }
+
+  for (; len >= 32; p += 32, len -= 32) {
+    HHStripe(state->acc, p);
+  }
+  memcpy(state->buf, p, len);
+  state->buf_len = len;
+}
+
+HTKey_t HTHash64_Final(const HTHashState *state) {
+  uint64_t h;
+
+  Verify333(state != NULL);
+  if (state->total_len >= 32) {
+    h = HHMergeAcc(state->acc);
+  } else {
+    h = state->seed + HH_P5;
+  }
+  return HHFinish(h + state->total_len, state->buf, state->buf_len);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch hashing.
+//
+// Runs of HT_HASH_LANES keys of the same length under 32 bytes are hashed
+// in lock step, with one variable per lane, so the compiler interleaves
+// the lanes' multiplies instruction by instruction.  Anything else is
+// hashed on its own.
+
+_Static_assert(HT_HASH_LANES == 4, "HHLockStep has four lanes");
+
+// Hash four keys of the same length len (< 32).
+static inline void HHLockStep(const void *const *buffers, size_t len,
+                              uint64_t seed, HTKey_t *out) {
+  const unsigned char *p0 = (const unsigned char *) buffers[0];
+  const unsigned char *p1 = (const unsigned char *) buffers[1];
+  const unsigned char *p2 = (const unsigned char *) buffers[2];
+  const unsigned char *p3 = (const unsigned char *) buffers[3];
+  uint64_t h0, h1, h2, h3;
+  size_t off;
+
+  h0 = h1 = h2 = h3 = seed + HH_P5 + (uint64_t) len;
+  for (off = 0; off + 8 <= len; off += 8) {
+    h0 = HHWord(h0, HHRead64(p0 + off));
+    h1 = HHWord(h1, HHRead64(p1 + off));
+    h2 = HHWord(h2, HHRead64(p2 + off));
+    h3 = HHWord(h3, HHRead64(p3 + off));
+  }
+  out[0] = HHAvalanche(HHBytes(h0, p0 + off, len - off));
+  out[1] = HHAvalanche(HHBytes(h1, p1 + off, len - off));
+  out[2] = HHAvalanche(HHBytes(h2, p2 + off, len - off));
+  out[3] = HHAvalanche(HHBytes(h3, p3 + off, len - off));
+}
+
+void HTHash64_Batch(const void *const *buffers, const size_t *lens,
+                    int num_keys, uint64_t seed, HTKey_t *hashes) {
+  int i = 0;
+
+  Verify333(num_keys >= 0);
+  Verify333(num_keys == 0 ||
+            (buffers != NULL && lens != NULL && hashes != NULL));
+
+  while (i < num_keys) {
+    if (i + HT_HASH_LANES <= num_keys && lens[i] < 32 &&
+        lens[i + 1] == lens[i] && lens[i + 2] == lens[i] &&
+        lens[i + 3] == lens[i]) {
+      HHLockStep(buffers + i, lens[i], seed, hashes + i);
+      i += HT_HASH_LANES;
+    } else {
+      hashes[i] = HTHash64(buffers[i], lens[i], seed);
+      i++;
+    }
+  }
+}
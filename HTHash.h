@@ -0,0 +1,92 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_HTHASH_H_
+#define HW1_HTHASH_H_
+
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint64_t, etc.
+
+#include "./HashTable.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A faster hash for turning bytes into keys.
+//
+// FNVHash64 (see HashTable.h) does one multiply per byte, one after the
+// other, so a long key costs about as many multiply latencies as it has
+// bytes.  HTHash64 is xxHash64 (by Yann Collet; see
+// https://github.com/Cyan4973/xxHash): it reads 8 bytes per multiply, and
+// keys of 32 bytes or more are hashed in 32-byte stripes, as four
+// independent streams of 8-byte words whose multiplies overlap.  Its
+// output is the same as every other xxHash64 implementation's, on any
+// machine.
+//
+// A key can also be hashed a piece at a time as it arrives (with an
+// HTHashState), and many short keys can be hashed at once (with
+// HTHash64_Batch).  Both give exactly the same hash as HTHash64 on the
+// whole key.
+
+// Hash a buffer.
+//
+// Arguments:
+// - buffer: a pointer to len bytes.
+// - len: how many bytes are in the buffer.
+// - seed: picks one of a family of hash functions; use 0 if you don't
+//   care which.
+//
+// Returns a nicely distributed 64-bit hash value suitable for use in an
+// HTKeyValue_t.
+HTKey_t HTHash64(const void *buffer, size_t len, uint64_t seed);
+
+// The state of a hash being computed a piece at a time.  Its fields are
+// private.
+typedef struct {
+  uint64_t       acc[4];     // the four stripe accumulators
+  uint64_t       total_len;  // # of bytes added so far
+  uint64_t       seed;
+  unsigned char  buf[32];    // the bytes of a partial stripe
+  uint32_t       buf_len;    // # of bytes in buf
+} HTHashState;
+
+// Start a new hash.
+void HTHash64_Init(HTHashState *state, uint64_t seed);
+
+// Add the next len bytes of the key.
+void HTHash64_Update(HTHashState *state, const void *buffer, size_t len);
+
+// Returns the hash of all the bytes added so far.  The state isn't
+// changed, so more bytes may still be added.
+HTKey_t HTHash64_Final(const HTHashState *state);
+
+// Hash many keys at once.
+//
+// A short key's hash is one long chain of multiplies, each waiting on the
+// one before, so a short key keeps the multiplier busy only a fraction of
+// the time.  The batch hashes each run of HT_HASH_LANES keys of the same
+// length (under 32 bytes) in lock step, interleaving their chains so that
+// the CPU always has independent work to do.  Other keys are hashed one
+// at a time, so the batch is fastest when keys of the same length are
+// next to each other.
+//
+// Arguments:
+// - buffers: the num_keys keys.
+// - lens: the length of each key.
+// - num_keys: how many keys to hash.
+// - seed: as for HTHash64.
+// - hashes: (output) hashes[i] is set to HTHash64(buffers[i], lens[i],
+//   seed).
+void HTHash64_Batch(const void *const *buffers, const size_t *lens,
+                    int num_keys, uint64_t seed, HTKey_t *hashes);
+
+// How many keys HTHash64_Batch hashes in lock step.
+#define HT_HASH_LANES 4
+
+#endif  // HW1_HTHASH_H_
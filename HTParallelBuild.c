@@ -0,0 +1,243 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "LinkedList.h"
+#include "LinkedList_priv.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Parallel construction of a chained table.
+//
+// The bucket array is cut into R contiguous ranges of about
+// PB_RANGE_BUCKETS buckets (and at least one per worker), and each of the
+// P workers owns a contiguous run of ranges.  The build runs in three
+// phases, each with every worker running at once:
+//
+//  1. Worker w counts how many of the pairs in its slice of the input fall
+//     into each range.
+//  2. After a (serial, P x R) prefix sum over those counts, worker w copies
+//     its pairs into a scratch array grouped by range.  Within a range,
+//     worker 0's pairs come first, then worker 1's, and so on, so each
+//     range holds its pairs in input order.
+//  3. Each worker goes through its own ranges, creating the range's chains
+//     and linking in its pairs.  No other worker touches those buckets, so
+//     no locks are needed.
+//
+// Small ranges help even on one thread: while a range is being filled,
+// its buckets and chains stay in cache, rather than each pair landing in
+// a random spot of the whole table.
+//
+// The calling thread acts as worker 0 in each phase.
+#define PB_RANGE_BUCKETS 16384
+
+typedef struct pb_shared {
+  HashTable           *ht;             // the table being built
+  const HTKeyValue_t  *keyvalues;      // the input pairs
+  int                  num_keyvalues;  // # of input pairs
+  int                  num_workers;    // P
+  int                  num_ranges;     // R
+  int                  bucket_bits;    // log2(ht->num_buckets)
+  int                 *counts;         // P x R: [w * R + r] pairs of w in r
+  int                 *range_start;    // R + 1: first pair of each range
+  HTKeyValue_t        *partitioned;    // the pairs, grouped by range
+  bool                 assume_unique;  // skip the duplicate search?
+  ValueFreeFnPtr       value_free_function;  // for replaced values
+} PBShared;
+
+typedef struct pb_worker {
+  PBShared   *shared;
+  int         id;         // which input slice and run of ranges
+  int         num_added;  // (phase 3) # of distinct keys added
+  pthread_t   thread;
+} PBWorker;
+
+// Which bucket range key's bucket falls into.
+static inline int PBRange(PBShared *s, HTKey_t key) {
+  uint64_t bucket = HTMixKey(key) & (uint64_t) (s->ht->num_buckets - 1);
+  return (int) ((bucket * (uint64_t) s->num_ranges) >> s->bucket_bits);
+}
+
+// The first bucket of range r (or, for r == R, the bucket count): the
+// smallest bucket b with b * R / num_buckets >= r.
+static inline int PBFirstBucket(PBShared *s, int r) {
+  return (int) (((uint64_t) r * (uint64_t) s->ht->num_buckets +
+                 (uint64_t) s->num_ranges - 1) / (uint64_t) s->num_ranges);
+}
+
+// The first range of worker w's run (or, for w == P, R).
+static inline int PBFirstRange(PBShared *s, int w) {
+  return (int) ((int64_t) w * s->num_ranges / s->num_workers);
+}
+
+// The first input pair of worker w's slice (or, for w == P, the end).
+static inline int PBFirstInput(PBShared *s, int w) {
+  return (int) ((int64_t) w * s->num_keyvalues / s->num_workers);
+}
+
+static void *PBCount(void *arg) {
+  PBWorker *me = (PBWorker *) arg;
+  PBShared *s = me->shared;
+  int *counts = s->counts + me->id * s->num_ranges;
+  int i;
+
+  for (i = PBFirstInput(s, me->id); i < PBFirstInput(s, me->id + 1); i++) {
+    counts[PBRange(s, s->keyvalues[i].key)]++;
+  }
+  return NULL;
+}
+
+static void *PBScatter(void *arg) {
+  PBWorker *me = (PBWorker *) arg;
+  PBShared *s = me->shared;
+  int *next = s->counts + me->id * s->num_ranges;  // now write offsets
+  int i;
+
+  for (i = PBFirstInput(s, me->id); i < PBFirstInput(s, me->id + 1); i++) {
+    s->partitioned[next[PBRange(s, s->keyvalues[i].key)]++] = s->keyvalues[i];
+  }
+  return NULL;
+}
+
+static void *PBFill(void *arg) {
+  PBWorker *me = (PBWorker *) arg;
+  PBShared *s = me->shared;
+  HashTable *ht = s->ht;
+  int r, i;
+
+  for (r = PBFirstRange(s, me->id); r < PBFirstRange(s, me->id + 1); r++) {
+    for (i = PBFirstBucket(s, r); i < PBFirstBucket(s, r + 1); i++) {
+      ht->buckets[i] = LinkedList_Allocate();
+    }
+
+    for (i = s->range_start[r]; i < s->range_start[r + 1]; i++) {
+      const HTKeyValue_t *kv = &s->partitioned[i];
+      int b = HashKeyToBucketNum(ht, kv->key);
+      LinkedList *chain = ht->buckets[b];
+      HTEntry *entry;
+      HTValue_t old;
+
+      if (!s->assume_unique && Search_LinkedList(chain, *kv, &old, 2)) {
+        s->value_free_function(old);
+        continue;
+      }
+      entry = (HTEntry *) malloc(sizeof(HTEntry));
+      Verify333(entry != NULL);
+      entry->kv = *kv;
+      entry->node.payload = &entry->kv;
+      LLPushNode(chain, &entry->node);
+      // Neighbouring workers' buckets can share a word of the bitmap.
+      if (chain->num_elements == 1) {
+        __atomic_fetch_or(&ht->occupied[b >> 6], 1ULL << (b & 63),
+                          __ATOMIC_RELAXED);
+      }
+      me->num_added++;
+    }
+  }
+  return NULL;
+}
+
+// Run fn on every worker at once, with worker 0 on the calling thread.
+static void PBRunPhase(PBWorker *workers, int n, void *(*fn)(void *)) {
+  int w;
+
+  for (w = 1; w < n; w++) {
+    Verify333(pthread_create(&workers[w].thread, NULL, fn, &workers[w]) == 0);
+  }
+  fn(&workers[0]);
+  for (w = 1; w < n; w++) {
+    Verify333(pthread_join(workers[w].thread, NULL) == 0);
+  }
+}
+
+HashTable* HashTable_BuildParallel(const HTKeyValue_t *keyvalues,
+                                   int num_keyvalues,
+                                   int num_threads,
+                                   bool assume_unique,
+                                   ValueFreeFnPtr value_free_function) {
+  HashTable *ht = HashTable_Allocate(1);
+  PBShared s;
+  PBWorker *workers;
+  int P = num_threads;
+  int R, r, w, next;
+
+  Verify333(num_keyvalues >= 0);
+  Verify333(num_threads > 0);
+  Verify333(assume_unique || value_free_function != NULL);
+
+  // Swap the table's one bucket (and its bitmap) for an array of the final
+  // size, whose chains the workers create.
+  LinkedList_Free(ht->buckets[0], LLNoOpFree);
+  free(ht->buckets);
+  ht->num_buckets = BucketsForElements(num_keyvalues);
+  ht->min_buckets = ht->num_buckets;
+  ht->buckets = (LinkedList **) malloc(ht->num_buckets * sizeof(LinkedList *));
+  Verify333(ht->buckets != NULL);
+  free(ht->occupied);
+  ht->occupied = HTAllocateOccupancy(ht->num_buckets);
+
+  s.ht = ht;
+  s.keyvalues = keyvalues;
+  s.num_keyvalues = num_keyvalues;
+  R = ht->num_buckets / PB_RANGE_BUCKETS;
+  if (R < P) {
+    R = P;
+  }
+  s.num_workers = P;
+  s.num_ranges = R;
+  s.bucket_bits = __builtin_ctz((unsigned) ht->num_buckets);
+  s.counts = (int *) calloc((size_t) P * R, sizeof(int));
+  s.range_start = (int *) malloc((R + 1) * sizeof(int));
+  s.partitioned =
+    (HTKeyValue_t *) malloc((num_keyvalues + 1) * sizeof(HTKeyValue_t));
+  s.assume_unique = assume_unique;
+  s.value_free_function = value_free_function;
+  workers = (PBWorker *) malloc(P * sizeof(PBWorker));
+  Verify333(s.counts != NULL && s.range_start != NULL &&
+            s.partitioned != NULL && workers != NULL);
+  for (w = 0; w < P; w++) {
+    workers[w].shared = &s;
+    workers[w].id = w;
+    workers[w].num_added = 0;
+  }
+
+  PBRunPhase(workers, P, &PBCount);
+
+  // Turn the counts into each worker's first write offset in each range.
+  next = 0;
+  for (r = 0; r < R; r++) {
+    s.range_start[r] = next;
+    for (w = 0; w < P; w++) {
+      int count = s.counts[w * R + r];
+      s.counts[w * R + r] = next;
+      next += count;
+    }
+  }
+  s.range_start[R] = next;
+
+  PBRunPhase(workers, P, &PBScatter);
+  PBRunPhase(workers, P, &PBFill);
+
+  for (w = 0; w < P; w++) {
+    ht->num_elements += workers[w].num_added;
+  }
+  free(workers);
+  free(s.partitioned);
+  free(s.range_start);
+  free(s.counts);
+  return ht;
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "LinkedList.h"
+#include "LinkedList_priv.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Parallel traversal of a table.
+//
+// The table is cut into chunks of PS_CHUNK buckets (or slots).  A chained
+// table in the middle of a resize has two bucket arrays; each is cut up
+// on its own, so no chunk straddles them.  Workers take the next chunk
+// with an atomic increment of a shared counter and visit every entry in
+// it, so a worker that is stuck in a chunk of long chains simply takes
+// fewer chunks.  That counter is the only thing the workers share.
+//
+// Chunks are a multiple of 64 buckets, so a chunk of a chained table
+// covers whole words of the occupancy bitmap, and the empty buckets are
+// skipped a word at a time just as HTIterator does.
+//
+// The calling thread acts as worker 0.
+#define PS_CHUNK 4096
+#define PS_CACHE_LINE 64
+
+typedef struct ps_shared {
+  HashTable      *ht;             // the table being visited
+  int             old_chunks;     // (chained) # chunks of old_buckets
+  int             num_chunks;     // # chunks in all
+  int             next_chunk;     // the next chunk to hand out
+  HTVisitFnPtr    visit_function;   // (for each) called on each entry
+  HTReduceFnPtr   reduce_function;  // (reduce) called on each entry
+  void           *arg;            // passed through to the callbacks
+} PSShared;
+
+typedef struct ps_worker {
+  PSShared   *shared;
+  void       *acc;     // (reduce) this worker's accumulator
+  pthread_t   thread;
+} PSWorker;
+
+static int PSNumChunks(int num_buckets) {
+  return (num_buckets + PS_CHUNK - 1) / PS_CHUNK;
+}
+
+static inline void PSVisit(PSWorker *me, HTKeyValue_t kv) {
+  PSShared *s = me->shared;
+
+  if (s->reduce_function != NULL) {
+    s->reduce_function(me->acc, kv, s->arg);
+  } else {
+    s->visit_function(kv, s->arg);
+  }
+}
+
+// Visit the chains of buckets [lo, hi) of one bucket array.  lo is a
+// multiple of 64, and bits past the end of the array are clear.
+static void PSVisitChains(PSWorker *me, LinkedList **buckets,
+                          const uint64_t *bits, int lo, int hi) {
+  int w;
+
+  for (w = lo >> 6; w < (hi + 63) >> 6; w++) {
+    uint64_t word = bits[w];
+    for (; word != 0; word &= word - 1) {
+      LinkedListNode *node = buckets[(w << 6) + __builtin_ctzll(word)]->head;
+      for (; node != NULL; node = node->next) {
+        PSVisit(me, ((HTEntry *) node)->kv);
+      }
+    }
+  }
+}
+
+static void PSVisitChunk(PSWorker *me, int c) {
+  HashTable *ht = me->shared->ht;
+  int lo, hi, i;
+
+  if (ht->engine == HT_ENGINE_CHAINED) {
+    if (c < me->shared->old_chunks) {
+      lo = c * PS_CHUNK;
+      hi = lo + PS_CHUNK < ht->old_num_buckets ?
+           lo + PS_CHUNK : ht->old_num_buckets;
+      PSVisitChains(me, ht->old_buckets, ht->old_occupied, lo, hi);
+    } else {
+      lo = (c - me->shared->old_chunks) * PS_CHUNK;
+      hi = lo + PS_CHUNK < ht->num_buckets ? lo + PS_CHUNK : ht->num_buckets;
+      PSVisitChains(me, ht->buckets, ht->occupied, lo, hi);
+    }
+    return;
+  }
+
+  lo = c * PS_CHUNK;
+  hi = lo + PS_CHUNK < ht->num_buckets ? lo + PS_CHUNK : ht->num_buckets;
+  if (ht->engine == HT_ENGINE_ROBINHOOD) {
+    for (i = lo; i < hi; i++) {
+      if (ht->slots[i].dist != 0) {
+        HTKeyValue_t kv = { ht->slots[i].key, ht->slots[i].value };
+        PSVisit(me, kv);
+      }
+    }
+  } else {
+    for (i = lo; i < hi; i++) {
+      if (SWSlotIsFull(ht, i)) {
+        PSVisit(me, ht->entries[i]);
+      }
+    }
+  }
+}
+
+static void *PSWork(void *arg) {
+  PSWorker *me = (PSWorker *) arg;
+  PSShared *s = me->shared;
+  int c;
+
+  while ((c = __atomic_fetch_add(&s->next_chunk, 1, __ATOMIC_RELAXED)) <
+         s->num_chunks) {
+    PSVisitChunk(me, c);
+  }
+  return NULL;
+}
+
+// Run every worker over the table, with worker 0 on the calling thread.
+static void PSRun(PSShared *s, PSWorker *workers, int n) {
+  int w;
+
+  for (w = 0; w < n; w++) {
+    workers[w].shared = s;
+  }
+  for (w = 1; w < n; w++) {
+    Verify333(pthread_create(&workers[w].thread, NULL, &PSWork,
+                             &workers[w]) == 0);
+  }
+  PSWork(&workers[0]);
+  for (w = 1; w < n; w++) {
+    Verify333(pthread_join(workers[w].thread, NULL) == 0);
+  }
+}
+
+// Set up the chunks of a table, and return how many workers are worth
+// starting: there is no point in more workers than chunks.
+static int PSInit(PSShared *s, HashTable *ht, int num_threads) {
+  Verify333(ht != NULL);
+  Verify333(num_threads > 0);
+
+  s->ht = ht;
+  s->old_chunks = 0;
+  if (ht->engine == HT_ENGINE_CHAINED && ht->old_buckets != NULL) {
+    s->old_chunks = PSNumChunks(ht->old_num_buckets);
+  }
+  s->num_chunks = s->old_chunks + PSNumChunks(ht->num_buckets);
+  s->next_chunk = 0;
+  s->visit_function = NULL;
+  s->reduce_function = NULL;
+  return num_threads < s->num_chunks ? num_threads : s->num_chunks;
+}
+
+void HashTable_ParallelForEach(HashTable *table, int num_threads,
+                               HTVisitFnPtr visit_function, void *arg) {
+  PSShared s;
+  PSWorker *workers;
+  int n;
+
+  Verify333(visit_function != NULL);
+  n = PSInit(&s, table, num_threads);
+  s.visit_function = visit_function;
+  s.arg = arg;
+
+  workers = (PSWorker *) malloc(n * sizeof(PSWorker));
+  Verify333(workers != NULL);
+  PSRun(&s, workers, n);
+  free(workers);
+}
+
+void HashTable_ParallelReduce(HashTable *table, int num_threads,
+                              void *result, size_t acc_size,
+                              HTReduceFnPtr reduce_function,
+                              HTCombineFnPtr combine_function, void *arg) {
+  PSShared s;
+  PSWorker *workers;
+  size_t stride;
+  char *accs;
+  int n, w;
+
+  Verify333(result != NULL && acc_size > 0);
+  Verify333(reduce_function != NULL && combine_function != NULL);
+  n = PSInit(&s, table, num_threads);
+  s.reduce_function = reduce_function;
+  s.arg = arg;
+
+  // Each worker starts from its own copy of the identity.  The copies are
+  // a whole number of cache lines apart, so that workers updating their
+  // own accumulators don't fight over a line.
+  stride = (acc_size + PS_CACHE_LINE - 1) / PS_CACHE_LINE * PS_CACHE_LINE;
+  workers = (PSWorker *) malloc(n * sizeof(PSWorker));
+  accs = (char *) aligned_alloc(PS_CACHE_LINE, n * stride);
+  Verify333(workers != NULL && accs != NULL);
+  for (w = 0; w < n; w++) {
+    workers[w].acc = accs + w * stride;
+    memcpy(workers[w].acc, result, acc_size);
+  }
+
+  PSRun(&s, workers, n);
+  for (w = 0; w < n; w++) {
+    combine_function(result, workers[w].acc, arg);
+  }
+  free(accs);
+  free(workers);
+}
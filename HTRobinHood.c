@@ -0,0 +1,357 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "Trace.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Robin Hood hashing.
+//
+// Every key has a "home" slot given by the low bits of its mixed hash.  On
+// insert we walk forward from home; whenever the entry we are carrying is
+// further from its home than the slot's resident, the two swap places and
+// we carry on with the resident ("take from the rich").  This keeps probe
+// sequences short and lets Find stop as soon as it sees a resident that is
+// closer to home than the key it is looking for would be.
+//
+// Deletion uses backward shifting instead of tombstones: the entries after
+// the removed one slide back one slot until we hit an empty slot or an entry
+// that is already at home.
+#define INVALID_IDX -1
+
+// Grow once the table is more than 15/16 full.
+#define RH_MAX_LOAD_NUM 15
+#define RH_MAX_LOAD_DEN 16
+
+static inline int RHHome(HashTable *table, HTKey_t key) {
+  return (int) (HTMixKey(key) & (uint64_t) (table->num_buckets - 1));
+}
+
+static inline int RHNextSlot(HashTable *table, int idx) {
+  return (idx + 1) & (table->num_buckets - 1);
+}
+
+// Place a key we know isn't in the table yet, without checking for
+// duplicates or growing, starting from slot i at distance dist along its
+// probe sequence (its home slot at distance 1, or wherever a lookup for it
+// stopped).  Returns the slot the key ends up in.  Used by RHInsert,
+// RHResize, RHInsertUnique and RHFindOrAdd.
+static int RHPlaceFrom(HashTable *table, int i, uint32_t dist,
+                       HTKey_t key, HTValue_t value) {
+  int placed = INVALID_IDX;
+
+  while (table->slots[i].dist != 0) {
+    RHSlot *s = &table->slots[i];
+    if (s->dist < dist) {
+      if (placed == INVALID_IDX) {
+        placed = i;
+      }
+      // The resident is richer than us; take its slot and keep going
+      // with the resident instead.
+      HTKey_t tk = s->key;
+      HTValue_t tv = s->value;
+      uint32_t td = s->dist;
+      s->key = key;
+      s->value = value;
+      s->dist = dist;
+      key = tk;
+      value = tv;
+      dist = td;
+    }
+    i = RHNextSlot(table, i);
+    dist++;
+  }
+  table->slots[i].key = key;
+  table->slots[i].value = value;
+  table->slots[i].dist = dist;
+  return placed == INVALID_IDX ? i : placed;
+}
+
+static int RHPlace(HashTable *table, HTKey_t key, HTValue_t value) {
+  return RHPlaceFrom(table, RHHome(table, key), 1, key, value);
+}
+
+// Grow, if the table is at its load limit, to make room for one more key.
+// RHPlace relies on there being at least one empty slot, which the load
+// limit guarantees.  Returns whether it grew.
+static bool RHMakeRoom(HashTable *table) {
+  if ((int64_t) (table->num_elements + 1) * RH_MAX_LOAD_DEN <=
+      (int64_t) table->num_buckets * RH_MAX_LOAD_NUM) {
+    return false;
+  }
+  RHResize(table, table->num_buckets * 2);
+  return true;
+}
+
+void RHResize(HashTable *table, int num_slots) {
+  RHSlot *old_slots = table->slots;
+  int old_num = table->num_buckets;
+  uint64_t start = HTNowNs();
+  int i;
+  TRACE_SCOPE(TRACE_HT_RESIZE, num_slots);
+
+  RHAllocate(table, num_slots);
+  for (i = 0; i < old_num; i++) {
+    if (old_slots[i].dist != 0) {
+      RHPlace(table, old_slots[i].key, old_slots[i].value);
+    }
+  }
+  free(old_slots);
+  table->num_resizes++;
+  table->resize_ns += HTNowNs() - start;
+}
+
+// Return the slot holding key, or INVALID_IDX.
+static int RHLookup(HashTable *table, HTKey_t key) {
+  int i = RHHome(table, key);
+  uint32_t dist = 1;
+
+  // Once a resident is closer to home than we would be, the key can't be
+  // any further along.
+  while (table->slots[i].dist >= dist) {
+    if (table->slots[i].key == key) {
+      return i;
+    }
+    i = RHNextSlot(table, i);
+    dist++;
+  }
+  return INVALID_IDX;
+}
+
+// Empty slot idx and backward-shift the entries that follow it.
+static void RHRemoveSlot(HashTable *table, int idx) {
+  int next = RHNextSlot(table, idx);
+
+  while (table->slots[next].dist > 1) {
+    table->slots[idx] = table->slots[next];
+    table->slots[idx].dist--;
+    idx = next;
+    next = RHNextSlot(table, next);
+  }
+  table->slots[idx].dist = 0;
+  table->num_elements--;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Engine entry points.
+
+void RHAllocate(HashTable *table, int num_slots) {
+  int n = RoundUpToPowerOfTwo(num_slots < 2 ? 2 : num_slots);
+
+  table->num_buckets = n;
+  table->slots = (RHSlot *) calloc(n, sizeof(RHSlot));
+  Verify333(table->slots != NULL);
+}
+
+void RHFree(HashTable *table, ValueFreeFnPtr value_free_function) {
+  int i;
+
+  for (i = 0; i < table->num_buckets; i++) {
+    if (table->slots[i].dist != 0) {
+      value_free_function(table->slots[i].value);
+    }
+  }
+  free(table->slots);
+  table->slots = NULL;
+}
+
+bool RHInsert(HashTable *table, HTKeyValue_t newkeyvalue,
+              HTKeyValue_t *oldkeyvalue) {
+  int i = RHLookup(table, newkeyvalue.key);
+
+  if (i != INVALID_IDX) {
+    oldkeyvalue->key = table->slots[i].key;
+    oldkeyvalue->value = table->slots[i].value;
+    table->slots[i].value = newkeyvalue.value;
+    return true;
+  }
+
+  // Only grow when we are actually adding a key.
+  RHMakeRoom(table);
+  RHPlace(table, newkeyvalue.key, newkeyvalue.value);
+  table->num_elements++;
+  return false;
+}
+
+bool RHFind(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue) {
+  int i = RHLookup(table, key);
+
+  if (i == INVALID_IDX) {
+    return false;
+  }
+  keyvalue->key = key;
+  keyvalue->value = table->slots[i].value;
+  return true;
+}
+
+bool RHRemove(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue) {
+  int i = RHLookup(table, key);
+
+  if (i == INVALID_IDX) {
+    return false;
+  }
+  keyvalue->key = key;
+  keyvalue->value = table->slots[i].value;
+  RHRemoveSlot(table, i);
+  return true;
+}
+
+HTValue_t *RHFindOrAdd(HashTable *table, HTKey_t key, HTValue_t value,
+                       bool *added) {
+  int i = RHHome(table, key);
+  uint32_t dist = 1;
+
+  // As RHLookup.  If the key isn't there, the slot the lookup stops at is
+  // exactly where RHPlace would put it, so placing carries on from there.
+  while (table->slots[i].dist >= dist) {
+    if (table->slots[i].key == key) {
+      *added = false;
+      return &table->slots[i].value;
+    }
+    i = RHNextSlot(table, i);
+    dist++;
+  }
+
+  *added = true;
+  if (RHMakeRoom(table)) {
+    i = RHPlace(table, key, value);
+  } else {
+    i = RHPlaceFrom(table, i, dist, key, value);
+  }
+  table->num_elements++;
+  return &table->slots[i].value;
+}
+
+void RHReserve(HashTable *table, int num_elements) {
+  int need = RHSlotsForElements(num_elements);
+
+  if (need > table->num_buckets) {
+    RHResize(table, need);
+  }
+}
+
+int RHSlotsForElements(int num_elements) {
+  // The smallest slot count that keeps num_elements within the load limit.
+  int64_t need = ((int64_t) num_elements * RH_MAX_LOAD_DEN +
+                  RH_MAX_LOAD_NUM - 1) / RH_MAX_LOAD_NUM;
+
+  Verify333(need <= (1 << 30));
+  return RoundUpToPowerOfTwo(need < 2 ? 2 : (int) need);
+}
+
+void RHInsertUnique(HashTable *table, HTKeyValue_t newkeyvalue) {
+  Verify333((int64_t) (table->num_elements + 1) * RH_MAX_LOAD_DEN <=
+            (int64_t) table->num_buckets * RH_MAX_LOAD_NUM);
+  RHPlace(table, newkeyvalue.key, newkeyvalue.value);
+  table->num_elements++;
+}
+
+void RHPrefetch(HashTable *table, HTKey_t key) {
+  __builtin_prefetch(&table->slots[RHHome(table, key)]);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Statistics.
+
+void RHStats(HashTable *table, HTStats *stats) {
+  uint64_t total = 0;
+  int i;
+
+  // An entry's probe length is its dist: its home slot is 1.
+  for (i = 0; i < table->num_buckets; i++) {
+    int dist = (int) table->slots[i].dist;
+    if (dist == 0) {
+      stats->empty_buckets++;
+      continue;
+    }
+    stats->length_hist[dist - 1 < HT_STATS_HIST - 1 ?
+                       dist - 1 : HT_STATS_HIST - 1]++;
+    total += dist;
+    if (dist > stats->max_probe) {
+      stats->max_probe = dist;
+    }
+  }
+  if (table->num_elements > 0) {
+    stats->mean_probe = (double) total / table->num_elements;
+  }
+  stats->bucket_bytes = (size_t) table->num_buckets * sizeof(RHSlot);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Iterator support.
+//
+// A backward shift moves entries one slot towards the front of the array,
+// possibly wrapping from slot 0 to the last slot.  If the iterator simply
+// scanned 0..n-1, HTIterator_Remove could drag an entry it had already
+// visited in front of itself again.  So instead we start the scan just
+// after an empty slot and stop when we get back to it: shifts never cross
+// an empty slot, and that slot stays empty because no entry can ever be
+// shifted into it.
+
+void RHIteratorFirst(HTIterator *iter) {
+  HashTable *table = iter->ht;
+  int i = 0;
+
+  // The load limit guarantees there is an empty slot somewhere.
+  while (table->slots[i].dist != 0) {
+    i++;
+  }
+  iter->stop_idx = i;
+  iter->bucket_idx = i;
+  Verify333(RHIteratorNext(iter));  // the table is non-empty
+}
+
+bool RHIteratorNext(HTIterator *iter) {
+  HashTable *table = iter->ht;
+  int i = iter->bucket_idx;
+
+  if (i == INVALID_IDX) {
+    return false;
+  }
+  do {
+    i = RHNextSlot(table, i);
+    if (i == iter->stop_idx) {
+      iter->bucket_idx = INVALID_IDX;
+      return false;
+    }
+  } while (table->slots[i].dist == 0);
+  iter->bucket_idx = i;
+  return true;
+}
+
+bool RHIteratorRemove(HTIterator *iter, HTKeyValue_t *keyvalue) {
+  HashTable *table = iter->ht;
+  int i = iter->bucket_idx;
+
+  if (i == INVALID_IDX) {
+    return false;
+  }
+  keyvalue->key = table->slots[i].key;
+  keyvalue->value = table->slots[i].value;
+  RHRemoveSlot(table, i);
+
+  // If the shift pulled an unvisited entry into this slot, stay put;
+  // otherwise move on to the next occupied slot.
+  if (table->slots[i].dist != 0) {
+    return true;
+  }
+  RHIteratorNext(iter);
+  return true;
+}
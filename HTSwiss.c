@@ -0,0 +1,431 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(HT_NO_SIMD)
+#include <emmintrin.h>
+#define SW_USE_SSE2 1
+#endif
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "Trace.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Swiss-table style open addressing.
+//
+// Slots are arranged in groups of SW_GROUP_SIZE.  Alongside the slot array
+// we keep one control byte per slot: either SW_EMPTY, SW_DELETED, or (for a
+// full slot) the low 7 bits of the key's mixed hash, its "tag".  A lookup
+// picks a starting group from the rest of the hash and then, for each group
+// it probes, compares all 16 control bytes against the tag at once.  Only
+// slots whose tag matches get their key compared, so most misses never
+// touch the slot array at all.  A probe stops at the first group that has
+// an empty slot.
+//
+// Groups are probed quadratically (1, 2, 3, ... groups apart), which visits
+// every group since the group count is a power of two.
+//
+// Removal leaves a SW_DELETED tombstone unless the slot's group still has
+// an empty slot, in which case no probe can have passed through the group
+// and the slot can go straight back to SW_EMPTY.
+#define INVALID_IDX -1
+
+#define SW_GROUP_SIZE 16
+#define SW_EMPTY   ((uint8_t) 0x80)
+#define SW_DELETED ((uint8_t) 0xFE)
+
+// Full slots have the high control bit clear.
+#define SW_IS_FULL(c) (((c) & 0x80) == 0)
+
+// Rehash once full plus deleted slots exceed 7/8 of the table.
+#define SW_MAX_LOAD_NUM 7
+#define SW_MAX_LOAD_DEN 8
+
+static inline uint8_t SWTag(uint64_t hash) {
+  return (uint8_t) (hash & 0x7F);
+}
+
+static inline int SWFirstGroup(HashTable *table, uint64_t hash) {
+  return (int) ((hash >> 7) &
+                (uint64_t) (table->num_buckets / SW_GROUP_SIZE - 1));
+}
+
+// Bitmask of the slots in a group whose control byte equals c.
+static inline uint32_t SWMatch(const uint8_t *group, uint8_t c) {
+#ifdef SW_USE_SSE2
+  __m128i ctrl = _mm_load_si128((const __m128i *) group);
+  return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c)));
+#else
+  uint32_t mask = 0;
+  int i;
+  for (i = 0; i < SW_GROUP_SIZE; i++) {
+    mask |= (uint32_t) (group[i] == c) << i;
+  }
+  return mask;
+#endif
+}
+
+// Bitmask of the slots in a group that are empty or deleted.
+static inline uint32_t SWMatchFree(const uint8_t *group) {
+#ifdef SW_USE_SSE2
+  // Exactly the free slots have the top bit set.
+  return (uint32_t) _mm_movemask_epi8(
+      _mm_load_si128((const __m128i *) group));
+#else
+  uint32_t mask = 0;
+  int i;
+  for (i = 0; i < SW_GROUP_SIZE; i++) {
+    mask |= (uint32_t) (!SW_IS_FULL(group[i])) << i;
+  }
+  return mask;
+#endif
+}
+
+// Set up fresh (all-empty) control and slot arrays of the given size.
+static void SWInit(HashTable *table, int num_slots) {
+  table->num_buckets = num_slots;
+  table->num_deleted = 0;
+  table->ctrl = (uint8_t *) aligned_alloc(SW_GROUP_SIZE, num_slots);
+  Verify333(table->ctrl != NULL);
+  memset(table->ctrl, SW_EMPTY, num_slots);
+  table->entries =
+    (HTKeyValue_t *) malloc(num_slots * sizeof(HTKeyValue_t));
+  Verify333(table->entries != NULL);
+}
+
+// Put a key we know isn't in the table into the first free slot on its
+// probe sequence.  Returns the slot used.
+static int SWPlace(HashTable *table, uint64_t hash, HTKeyValue_t kv) {
+  int group_mask = table->num_buckets / SW_GROUP_SIZE - 1;
+  int g = SWFirstGroup(table, hash);
+  int step = 0;
+
+  while (true) {
+    uint8_t *ctrl = table->ctrl + g * SW_GROUP_SIZE;
+    uint32_t free_slots = SWMatchFree(ctrl);
+    if (free_slots != 0) {
+      int i = g * SW_GROUP_SIZE + __builtin_ctz(free_slots);
+      if (table->ctrl[i] == SW_DELETED) {
+        table->num_deleted--;
+      }
+      table->ctrl[i] = SWTag(hash);
+      table->entries[i] = kv;
+      return i;
+    }
+    step++;
+    g = (g + step) & group_mask;
+  }
+}
+
+void SWRehash(HashTable *table, int num_slots) {
+  uint8_t *old_ctrl = table->ctrl;
+  HTKeyValue_t *old_entries = table->entries;
+  int old_num = table->num_buckets;
+  uint64_t start = HTNowNs();
+  int i;
+  TRACE_SCOPE(TRACE_HT_RESIZE, num_slots);
+
+  SWInit(table, num_slots);
+  for (i = 0; i < old_num; i++) {
+    if (SW_IS_FULL(old_ctrl[i])) {
+      SWPlace(table, HTMixKey(old_entries[i].key), old_entries[i]);
+    }
+  }
+  free(old_ctrl);
+  free(old_entries);
+  table->num_resizes++;
+  table->resize_ns += HTNowNs() - start;
+}
+
+// Rehash, if full plus deleted slots are at the load limit, to make room
+// for one more key.  If tombstones account for most of the used slots, a
+// same-size rehash reclaims them; otherwise double.  Returns whether it
+// rehashed.
+static bool SWMakeRoom(HashTable *table) {
+  if ((int64_t) (table->num_elements + table->num_deleted + 1) *
+      SW_MAX_LOAD_DEN <= (int64_t) table->num_buckets * SW_MAX_LOAD_NUM) {
+    return false;
+  }
+  if (table->num_elements * 2 < table->num_buckets * SW_MAX_LOAD_NUM /
+      SW_MAX_LOAD_DEN) {
+    SWRehash(table, table->num_buckets);
+  } else {
+    SWRehash(table, table->num_buckets * 2);
+  }
+  return true;
+}
+
+// Return the slot holding key, or INVALID_IDX.
+static int SWLookup(HashTable *table, HTKey_t key, uint64_t hash) {
+  int group_mask = table->num_buckets / SW_GROUP_SIZE - 1;
+  int g = SWFirstGroup(table, hash);
+  uint8_t tag = SWTag(hash);
+  int step = 0;
+
+  while (true) {
+    const uint8_t *ctrl = table->ctrl + g * SW_GROUP_SIZE;
+    uint32_t candidates = SWMatch(ctrl, tag);
+    while (candidates != 0) {
+      int i = g * SW_GROUP_SIZE + __builtin_ctz(candidates);
+      if (table->entries[i].key == key) {
+        return i;
+      }
+      candidates &= candidates - 1;
+    }
+    if (SWMatch(ctrl, SW_EMPTY) != 0) {
+      return INVALID_IDX;
+    }
+    step++;
+    if (step > group_mask) {
+      // Every group has been probed (only possible with no empty slots).
+      return INVALID_IDX;
+    }
+    g = (g + step) & group_mask;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Engine entry points.
+
+void SWAllocate(HashTable *table, int num_slots) {
+  SWInit(table, RoundUpToPowerOfTwo(num_slots < SW_GROUP_SIZE ?
+                                    SW_GROUP_SIZE : num_slots));
+}
+
+void SWFree(HashTable *table, ValueFreeFnPtr value_free_function) {
+  int i;
+
+  for (i = 0; i < table->num_buckets; i++) {
+    if (SW_IS_FULL(table->ctrl[i])) {
+      value_free_function(table->entries[i].value);
+    }
+  }
+  free(table->ctrl);
+  free(table->entries);
+  table->ctrl = NULL;
+  table->entries = NULL;
+}
+
+bool SWInsert(HashTable *table, HTKeyValue_t newkeyvalue,
+              HTKeyValue_t *oldkeyvalue) {
+  uint64_t hash = HTMixKey(newkeyvalue.key);
+  int i = SWLookup(table, newkeyvalue.key, hash);
+
+  if (i != INVALID_IDX) {
+    *oldkeyvalue = table->entries[i];
+    table->entries[i].value = newkeyvalue.value;
+    return true;
+  }
+
+  SWMakeRoom(table);
+  SWPlace(table, hash, newkeyvalue);
+  table->num_elements++;
+  return false;
+}
+
+bool SWFind(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue) {
+  int i = SWLookup(table, key, HTMixKey(key));
+
+  if (i == INVALID_IDX) {
+    return false;
+  }
+  *keyvalue = table->entries[i];
+  return true;
+}
+
+bool SWRemove(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue) {
+  int i = SWLookup(table, key, HTMixKey(key));
+
+  if (i == INVALID_IDX) {
+    return false;
+  }
+  SWRemoveSlot(table, i, keyvalue);
+  return true;
+}
+
+void SWRemoveSlot(HashTable *table, int i, HTKeyValue_t *keyvalue) {
+  const uint8_t *group = table->ctrl + (i / SW_GROUP_SIZE) * SW_GROUP_SIZE;
+
+  *keyvalue = table->entries[i];
+  if (SWMatch(group, SW_EMPTY) != 0) {
+    table->ctrl[i] = SW_EMPTY;
+  } else {
+    table->ctrl[i] = SW_DELETED;
+    table->num_deleted++;
+  }
+  table->num_elements--;
+}
+
+HTValue_t *SWFindOrAdd(HashTable *table, HTKey_t key, HTValue_t value,
+                       bool *added) {
+  uint64_t hash = HTMixKey(key);
+  int group_mask = table->num_buckets / SW_GROUP_SIZE - 1;
+  int g = SWFirstGroup(table, hash);
+  uint8_t tag = SWTag(hash);
+  int step = 0;
+  int free_slot = INVALID_IDX;
+  int i;
+
+  // As SWLookup, also noting the first free slot on the way, which is
+  // where SWPlace would put the key.
+  while (true) {
+    const uint8_t *ctrl = table->ctrl + g * SW_GROUP_SIZE;
+    uint32_t candidates = SWMatch(ctrl, tag);
+    uint32_t free_slots;
+
+    for (; candidates != 0; candidates &= candidates - 1) {
+      i = g * SW_GROUP_SIZE + __builtin_ctz(candidates);
+      if (table->entries[i].key == key) {
+        *added = false;
+        return &table->entries[i].value;
+      }
+    }
+    free_slots = SWMatchFree(ctrl);
+    if (free_slot == INVALID_IDX && free_slots != 0) {
+      free_slot = g * SW_GROUP_SIZE + __builtin_ctz(free_slots);
+    }
+    if (SWMatch(ctrl, SW_EMPTY) != 0 || ++step > group_mask) {
+      break;
+    }
+    g = (g + step) & group_mask;
+  }
+
+  *added = true;
+  if (SWMakeRoom(table)) {
+    HTKeyValue_t kv;
+    kv.key = key;
+    kv.value = value;
+    i = SWPlace(table, hash, kv);
+  } else {
+    // Below the load limit there is always a free slot, and the probe
+    // sequence reaches one before it gives up.
+    Verify333(free_slot != INVALID_IDX);
+    i = free_slot;
+    if (table->ctrl[i] == SW_DELETED) {
+      table->num_deleted--;
+    }
+    table->ctrl[i] = tag;
+    table->entries[i].key = key;
+    table->entries[i].value = value;
+  }
+  table->num_elements++;
+  return &table->entries[i].value;
+}
+
+void SWReserve(HashTable *table, int num_elements) {
+  int need = SWSlotsForElements(num_elements);
+
+  if (need > table->num_buckets) {
+    SWRehash(table, need);
+  }
+}
+
+int SWSlotsForElements(int num_elements) {
+  // The smallest slot count that keeps num_elements within the load limit
+  // once the tombstones are gone.
+  int64_t need = ((int64_t) num_elements * SW_MAX_LOAD_DEN +
+                  SW_MAX_LOAD_NUM - 1) / SW_MAX_LOAD_NUM;
+
+  Verify333(need <= (1 << 30));
+  return RoundUpToPowerOfTwo(need < SW_GROUP_SIZE ? SW_GROUP_SIZE :
+                             (int) need);
+}
+
+void SWInsertUnique(HashTable *table, HTKeyValue_t newkeyvalue) {
+  Verify333((int64_t) (table->num_elements + table->num_deleted + 1) *
+            SW_MAX_LOAD_DEN <= (int64_t) table->num_buckets * SW_MAX_LOAD_NUM);
+  SWPlace(table, HTMixKey(newkeyvalue.key), newkeyvalue);
+  table->num_elements++;
+}
+
+void SWPrefetch(HashTable *table, HTKey_t key) {
+  int first = SWFirstGroup(table, HTMixKey(key)) * SW_GROUP_SIZE;
+
+  __builtin_prefetch(table->ctrl + first);
+  __builtin_prefetch(table->entries + first);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Statistics.
+
+void SWStats(HashTable *table, HTStats *stats) {
+  int group_mask = table->num_buckets / SW_GROUP_SIZE - 1;
+  uint64_t total = 0;
+  int i;
+
+  // Follow each entry's probe sequence from its first group until it gets
+  // to the entry's group, which is usually straight away.
+  for (i = 0; i < table->num_buckets; i++) {
+    int g, step = 0;
+
+    if (!SW_IS_FULL(table->ctrl[i])) {
+      stats->empty_buckets++;
+      continue;
+    }
+    g = SWFirstGroup(table, HTMixKey(table->entries[i].key));
+    while (g != i / SW_GROUP_SIZE) {
+      step++;
+      g = (g + step) & group_mask;
+    }
+    stats->length_hist[step < HT_STATS_HIST - 1 ? step : HT_STATS_HIST - 1]++;
+    total += step + 1;
+    if (step + 1 > stats->max_probe) {
+      stats->max_probe = step + 1;
+    }
+  }
+  if (table->num_elements > 0) {
+    stats->mean_probe = (double) total / table->num_elements;
+  }
+  stats->bucket_bytes = (size_t) table->num_buckets *
+                        (sizeof(uint8_t) + sizeof(HTKeyValue_t));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Iterator support.
+//
+// Removal never moves entries, so a plain front-to-back scan of the control
+// bytes is enough: HTIterator_Remove just empties the current slot with
+// SWRemoveSlot and steps on with SWIteratorNext.
+
+// Move the iterator to the first full slot at or after start.
+static bool SWIteratorScan(HTIterator *iter, int start) {
+  HashTable *table = iter->ht;
+  int i;
+
+  for (i = start; i < table->num_buckets; i++) {
+    if (SW_IS_FULL(table->ctrl[i])) {
+      iter->bucket_idx = i;
+      return true;
+    }
+  }
+  iter->bucket_idx = INVALID_IDX;
+  return false;
+}
+
+void SWIteratorFirst(HTIterator *iter) {
+  Verify333(SWIteratorScan(iter, 0));  // the table is non-empty
+}
+
+bool SWIteratorNext(HTIterator *iter) {
+  if (iter->bucket_idx == INVALID_IDX) {
+    return false;
+  }
+  return SWIteratorScan(iter, iter->bucket_idx + 1);
+}
@@ -9,33 +9,239 @@
  * author.
  */
 
+#define _POSIX_C_SOURCE 200809L  // for clock_gettime
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
 
 #include "CSE333.h"
+#include "Epoch.h"
 #include "HashTable.h"
 #include "LinkedList.h"
+#include "LinkedList_priv.h"
 #include "HashTable_priv.h"
+#include "Trace.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // Internal helper functions.
 //
 #define INVALID_IDX -1
 
+// How many old buckets each Insert/Remove moves while a resize is in
+// progress.
+#define HT_MIGRATE_STEP 8
+
+// A table shrinks once it is HT_SHRINK_RATIO times the size it needs for
+// its elements, down to twice that size.
+#define HT_SHRINK_RATIO 16
+
 // Grows the hashtable (ie, increase the number of buckets) if its load
-// factor has become too high.
+// factor has become too high, and moves a resize that is already under way
+// along by a few buckets.
 static void MaybeResize(HashTable *ht);
 
+// Shrinks the hashtable if removals have left it far bigger than it needs
+// to be.
+static void MaybeShrink(HashTable *ht);
+
+// The table's size (in buckets or slots) for num_elements elements, and
+// resizing it to num_buckets of them right away.
+static int SizeForElements(HashTable *ht, int num_elements);
+static void ResizeNow(HashTable *ht, int num_buckets);
+
+// Move the next ht->migrate_step old buckets (or all of them, if the step
+// is zero) into the new bucket array.
+static void MigrateBuckets(HashTable *ht);
+
+// HashTable_Remove without the migration step.
+static bool ChainedRemove(HashTable *table, HTKey_t key,
+                          HTKeyValue_t *keyvalue);
+
+// HashTable_RemoveIf for a chained table, without the shrink check.
+static int ChainedRemoveIf(HashTable *table, HTPredicateFnPtr predicate,
+                           void *arg, ValueFreeFnPtr value_free_function);
+
+// Start an incremental resize to num_buckets buckets (a power of two
+// other than the current count).
+static void StartResize(HashTable *ht, int num_buckets);
+
+// Finish off any resize that is in progress, all at once.
+static void FinishResize(HashTable *ht);
+
+// Grow a read-mostly table to num_buckets buckets by building a whole new
+// bucket array and swapping it in for the readers.
+static void SwapResize(HashTable *ht, int num_buckets);
+
+// HashTable_Find for a table with a chain policy.
+static bool OrganizingFind(HashTable *ht, LinkedList *chain, HTKey_t key,
+                           HTKeyValue_t *keyvalue);
+
+// HashTable_Find for a read-mostly table.
+static bool ReadMostlyFind(HashTable *ht, HTKey_t key,
+                           HTKeyValue_t *keyvalue);
+
 int HashKeyToBucketNum(HashTable *ht, HTKey_t key) {
-  return key % ht->num_buckets;
+  // num_buckets is a power of two, so masking replaces a 64-bit division.
+  return (int) (HTMixKey(key) & (uint64_t) (ht->num_buckets - 1));
+}
+
+uint64_t HTNowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+uint64_t *HTAllocateOccupancy(int num_buckets) {
+  uint64_t *bits = (uint64_t *) calloc((num_buckets + 63) / 64,
+                                       sizeof(uint64_t));
+  Verify333(bits != NULL);
+  return bits;
+}
+
+int RoundUpToPowerOfTwo(int n) {
+  int p = 1;
+
+  while (p < n) {
+    p *= 2;
+  }
+  return p;
+}
+
+int BucketsForElements(int num_elements) {
+  // MaybeResize grows once an Insert finds the load factor at 3, so
+  // num_elements fit as long as num_elements - 1 < 3 * num_buckets.
+  Verify333(num_elements / 3 < (1 << 30));
+  return RoundUpToPowerOfTwo(num_elements / 3 + 1);
+}
+
+uint64_t HTChecksum(uint64_t sum, const void *buf, size_t len) {
+  const unsigned char *p = (const unsigned char *) buf;
+  size_t i;
+
+  Verify333(len % 8 == 0);
+  for (i = 0; i < len; i += 8) {
+    uint64_t word;
+    memcpy(&word, p + i, sizeof(word));
+    sum = (sum ^ word) * 0x9E3779B97F4A7C15ULL;
+    sum = (sum << 31) | (sum >> 33);
+  }
+  return sum;
+}
+
+// Return the bucket array entry for the chain that holds (or would hold)
+// key.  While a resize is in progress, keys whose old bucket hasn't been
+// migrated yet still live in the old bucket array; everything else is in
+// the new one.
+static LinkedList **ChainSlotForKey(HashTable *ht, HTKey_t key) {
+  uint64_t hash = HTMixKey(key);
+
+  if (ht->old_buckets != NULL) {
+    int old_bucket = (int) (hash & (uint64_t) (ht->old_num_buckets - 1));
+    if (old_bucket >= ht->migrate_idx) {
+      return &ht->old_buckets[old_bucket];
+    }
+  }
+  return &ht->buckets[hash & (uint64_t) (ht->num_buckets - 1)];
+}
+
+// Return the chain that holds (or would hold) key.
+static LinkedList *ChainForKey(HashTable *ht, HTKey_t key) {
+  return *ChainSlotForKey(ht, key);
+}
+
+// The iterator walks the unmigrated old buckets (if any) followed by the
+// new ones, so it numbers them all in one range.  Buckets that have been
+// migrated, or that haven't been created yet, come back as NULL.
+static int NumIterBuckets(HashTable *ht) {
+  return ht->old_num_buckets + ht->num_buckets;
+}
+
+static LinkedList **IterBucketSlot(HashTable *ht, int idx) {
+  if (idx < ht->old_num_buckets) {
+    return &ht->old_buckets[idx];
+  }
+  return &ht->buckets[idx - ht->old_num_buckets];
+}
+
+static LinkedList *IterBucket(HashTable *ht, int idx) {
+  return *IterBucketSlot(ht, idx);
+}
+
+// Return the first set bit at or after "from" in a bitmap of n bits, or n.
+// A word at a time, so a run of 64 empty buckets costs one load.
+static int NextSetBit(const uint64_t *bits, int from, int n) {
+  int w = from >> 6;
+  int num_words = (n + 63) >> 6;
+  uint64_t word;
+
+  if (from >= n) {
+    return n;
+  }
+  word = bits[w] & (~0ULL << (from & 63));
+  while (word == 0) {
+    if (++w == num_words) {
+      return n;
+    }
+    word = bits[w];
+  }
+  return (w << 6) + __builtin_ctzll(word);
+}
+
+// Return the first non-empty bucket at or after idx, in the iterator's
+// numbering, or NumIterBuckets(ht) if there is none.
+static int NextOccupiedBucket(HashTable *ht, int idx) {
+  if (idx < ht->old_num_buckets) {
+    int i = NextSetBit(ht->old_occupied, idx, ht->old_num_buckets);
+    if (i < ht->old_num_buckets) {
+      return i;
+    }
+    idx = ht->old_num_buckets;
+  }
+  return ht->old_num_buckets +
+         NextSetBit(ht->occupied, idx - ht->old_num_buckets, ht->num_buckets);
 }
 
-// Deallocation functions that do nothing.  Useful if we want to deallocate
-// the structure (eg, the linked list) without deallocating its elements or
-// if we know that the structure is empty.
-static void LLNoOpFree(LLPayload_t freeme) { }
-static void HTNoOpFree(HTValue_t freeme) { }
+// Bring the occupancy bit of the chain at *slot (an entry of either bucket
+// array) up to date after something was pushed onto or taken off it.
+static void UpdateOccupied(HashTable *ht, LinkedList **slot) {
+  uintptr_t p = (uintptr_t) slot, old = (uintptr_t) ht->old_buckets;
+  uint64_t *bits;
+  int i;
+
+  // Work out which array slot is in before doing any pointer arithmetic,
+  // since subtracting or comparing pointers into different arrays is
+  // undefined.
+  if (ht->old_buckets != NULL && p >= old &&
+      p < old + ht->old_num_buckets * sizeof(LinkedList *)) {
+    bits = ht->old_occupied;
+    i = (int) (slot - ht->old_buckets);
+  } else {
+    bits = ht->occupied;
+    i = (int) (slot - ht->buckets);
+  }
+  if ((*slot)->num_elements > 0) {
+    HTSetOccupied(bits, i);
+  } else {
+    HTClearOccupied(bits, i);
+  }
+}
+
+// Unlink an entry from the chain at *slot and free it, or retire it if
+// readers may still be walking the chain.  The caller updates the count
+// and the occupancy bit.
+static void ChainedUnlink(HashTable *ht, LinkedList **slot, HTEntry *entry) {
+  LLUnlinkNode(*slot, &entry->node);
+  if (ht->read_mostly) {
+    Epoch_Retire(entry, &free);
+  } else {
+    free(entry);
+  }
+}
+
+void LLNoOpFree(LLPayload_t freeme) { }
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -62,6 +268,10 @@ HTKey_t FNVHash64(unsigned char *buffer, int len) {
 }
 
 HashTable* HashTable_Allocate(int num_buckets) {
+  return HashTable_AllocateEngine(num_buckets, HT_ENGINE_CHAINED);
+}
+
+HashTable* HashTable_AllocateEngine(int num_buckets, HTEngine_t engine) {
   HashTable *ht;
   int i;
 
@@ -71,15 +281,65 @@ HashTable* HashTable_Allocate(int num_buckets) {
   ht = (HashTable *) malloc(sizeof(HashTable));
   Verify333(ht != NULL);
 
-  // Initialize the record.
-  ht->num_buckets = num_buckets;
+  // Initialize the record.  Chained tables round their bucket count up to a
+  // power of two; the other engines do their own rounding.
+  ht->num_buckets = RoundUpToPowerOfTwo(num_buckets);
   ht->num_elements = 0;
-  ht->buckets = (LinkedList **) malloc(num_buckets * sizeof(LinkedList *));
-  Verify333(ht->buckets != NULL);
-  for (i = 0; i < num_buckets; i++) {
-    ht->buckets[i] = LinkedList_Allocate();
+  ht->engine = engine;
+  ht->buckets = NULL;
+  ht->occupied = NULL;
+  ht->old_occupied = NULL;
+  ht->slots = NULL;
+  ht->ctrl = NULL;
+  ht->entries = NULL;
+  ht->num_deleted = 0;
+  ht->old_buckets = NULL;
+  ht->old_num_buckets = 0;
+  ht->migrate_idx = 0;
+  ht->migrate_step = HT_MIGRATE_STEP;
+  ht->min_buckets = 1;
+  ht->chain_policy = HT_CHAIN_FIXED;
+  ht->count_probes = false;
+  ht->num_finds = 0;
+  ht->num_probes = 0;
+  ht->read_mostly = false;
+  ht->snapshot = NULL;
+  ht->log = NULL;
+  ht->num_resizes = 0;
+  ht->resize_ns = 0;
+
+  switch (engine) {
+    case HT_ENGINE_ROBINHOOD:
+      RHAllocate(ht, num_buckets);
+      break;
+    case HT_ENGINE_SWISS:
+      SWAllocate(ht, num_buckets);
+      break;
+    default:
+      Verify333(engine == HT_ENGINE_CHAINED);
+      ht->buckets =
+        (LinkedList **) malloc(ht->num_buckets * sizeof(LinkedList *));
+      Verify333(ht->buckets != NULL);
+      for (i = 0; i < ht->num_buckets; i++) {
+        ht->buckets[i] = LinkedList_Allocate();
+      }
+      ht->occupied = HTAllocateOccupancy(ht->num_buckets);
+      break;
   }
 
+  // The customer asked for this many, so don't shrink below it.
+  ht->min_buckets = ht->num_buckets;
+  return ht;
+}
+
+HashTable* HashTable_AllocateReadMostly(int num_buckets) {
+  HashTable *ht = HashTable_AllocateEngine(num_buckets, HT_ENGINE_CHAINED);
+
+  ht->read_mostly = true;
+  ht->snapshot = (HTSnapshot *) malloc(sizeof(HTSnapshot));
+  Verify333(ht->snapshot != NULL);
+  ht->snapshot->num_buckets = ht->num_buckets;
+  ht->snapshot->buckets = ht->buckets;
   return ht;
 }
 
@@ -89,19 +349,35 @@ void HashTable_Free(HashTable *table,
 
   Verify333(table != NULL);
 
-  // Free each bucket's chain.
-  for (i = 0; i < table->num_buckets; i++) {
-    LinkedList *bucket = table->buckets[i];
-    HTKeyValue_t *kv;
-
-    // Pop elements off the chain list one at a time.  We can't do a single
-    // call to LinkedList_Free since we need to use the passed-in
-    // value_free_function -- which takes a HTValue_t, not an LLPayload_t -- to
-    // free the caller's memory.
-    while (LinkedList_NumElements(bucket) > 0) {
-      Verify333(LinkedList_Pop(bucket, (LLPayload_t *)&kv));
-      value_free_function(kv->value);
-      free(kv);
+  if (table->engine != HT_ENGINE_CHAINED) {
+    if (table->engine == HT_ENGINE_ROBINHOOD) {
+      RHFree(table, value_free_function);
+    } else {
+      SWFree(table, value_free_function);
+    }
+    free(table);
+    return;
+  }
+
+  // Free each bucket's chain, including any old buckets left over from an
+  // unfinished resize.
+  for (i = 0; i < NumIterBuckets(table); i++) {
+    LinkedList *bucket = IterBucket(table, i);
+    LinkedListNode *node;
+
+    if (bucket == NULL) {
+      continue;
+    }
+
+    // Unlink the entries one at a time.  We can't do a single call to
+    // LinkedList_Free since we need to use the passed-in
+    // value_free_function -- which takes a HTValue_t, not an LLPayload_t --
+    // to free the caller's memory, and the payload lives inside the entry.
+    while ((node = bucket->head) != NULL) {
+      HTEntry *entry = (HTEntry *) node;
+      LLUnlinkNode(bucket, node);
+      value_free_function(entry->kv.value);
+      free(entry);
     }
     // The chain is empty, so we can pass in the
     // null free function to LinkedList_Free.
@@ -109,7 +385,16 @@ void HashTable_Free(HashTable *table,
   }
 
   // Free the bucket array within the table, then free the table record itself.
+  free(table->old_buckets);
   free(table->buckets);
+  free(table->old_occupied);
+  free(table->occupied);
+  if (table->read_mostly) {
+    // The snapshot shares the bucket array we just freed.  Entries the
+    // writer removed earlier are still waiting on the readers.
+    free(table->snapshot);
+    Epoch_Barrier();
+  }
   free(table);
 }
 
@@ -123,57 +408,64 @@ int HashTable_NumElements(HashTable *table) {
 // ll then replace with new value and return old value in val.
 // Return true when successful
 // When mode = 0 just return the key's value, when mode = 1 delete the key, and
-// and when mode = 2 replace the key's value with newPayload->value
+// and when mode = 2 replace the key's value with newPayload->value.  Mode 3
+// is mode 1 for a read-mostly table: the entry is retired (see Epoch.h)
+// rather than freed, since a reader may still be standing on it.
 bool Search_LinkedList(LinkedList *ll, HTKeyValue_t newPayload,
                        HTValue_t *oldVal, int mode) {
-  // Initialize iterator for given list
-  LLIterator *iter = LLIterator_Allocate(ll);
-  // If iterator starts invalid immediately then free it and return false because ll is empty
-  if (!LLIterator_IsValid(iter)) {
-    LLIterator_Free(iter);
-    return false;
-  }
-  // Iterator through linked list looking for given key
-  do {
-    // Initialize current node's payload
-    HTKeyValue_t *oldPayload;
-    // Get current node from iterator
-    LLIterator_Get(iter, (LLPayload_t*) &oldPayload);
+  // Walk the chain's nodes directly; each node is the start of an HTEntry,
+  // so the key is right there without a hop through the payload pointer.
+  for (LinkedListNode *node = ll->head; node != NULL; node = node->next) {
+    HTEntry *entry = (HTEntry *) node;
     // If keys are different then continue to next node
-    if (oldPayload->key != newPayload.key) {
+    if (entry->kv.key != newPayload.key) {
       continue;
     }
     // Else if keys are the same then store old value
-    *oldVal = oldPayload->value;
-    // If in delete mode then remove node with LLIterator_Remove()
+    *oldVal = entry->kv.value;
+    // If in delete mode then unlink the entry and free (or retire) it
     if (mode == 1) {
-      LLIterator_Remove(iter, free);
+      LLUnlinkNode(ll, node);
+      free(entry);
+    } else if (mode == 3) {
+      LLUnlinkNode(ll, node);
+      Epoch_Retire(entry, &free);
     } else if (mode == 2) {
-      // If in replace mode then put new value in payload
-      oldPayload->value = newPayload.value;
+      // If in replace mode then put new value in payload.  A single store,
+      // so a concurrent reader sees either the old value or the new one.
+      __atomic_store_n(&entry->kv.value, newPayload.value, __ATOMIC_RELEASE);
     }
-    // Since we found the key we can free the iterator and return true
-    LLIterator_Free(iter);
+    // We found the key so return true
     return true;
-  // If iterator reaches end of list then exit
-  } while (LLIterator_Next(iter));
-  // Free iterator and return false since we didn't find the key
-  LLIterator_Free(iter);
+  }
+  // Return false since we didn't find the key
   return false;
 }
 
 bool HashTable_Insert(HashTable *table,
                       HTKeyValue_t newkeyvalue,
                       HTKeyValue_t *oldkeyvalue) {
-  int bucket;
+  LinkedList **slot;
   LinkedList *chain;
+  TRACE_SCOPE(TRACE_HT_INSERT, newkeyvalue.key);
 
   Verify333(table != NULL);
+  if (table->log != NULL) {
+    HTLogRecord(table->log, HT_LOG_INSERT, newkeyvalue);
+  }
+  switch (table->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      return RHInsert(table, newkeyvalue, oldkeyvalue);
+    case HT_ENGINE_SWISS:
+      return SWInsert(table, newkeyvalue, oldkeyvalue);
+    default:
+      break;
+  }
   MaybeResize(table);
 
   // Calculate which bucket and chain we're inserting into.
-  bucket = HashKeyToBucketNum(table, newkeyvalue.key);
-  chain = table->buckets[bucket];
+  slot = ChainSlotForKey(table, newkeyvalue.key);
+  chain = *slot;
 
   // STEP 1: finish the implementation of InsertHashTable.
   // This is a fairly complex task, so you might decide you want
@@ -190,11 +482,14 @@ bool HashTable_Insert(HashTable *table,
     return true;
   }
   // If key isn't already in chain we have to add it
-  // Malloc new block for newkeyvalue and store it there
-  HTKeyValue_t *payload = malloc(sizeof(HTKeyValue_t));
-  *payload = newkeyvalue;
-  // Push payload to the list
-  LinkedList_Push(chain, payload);
+  // Malloc one block holding both the chain node and newkeyvalue
+  HTEntry *entry = (HTEntry *) malloc(sizeof(HTEntry));
+  Verify333(entry != NULL);
+  entry->kv = newkeyvalue;
+  entry->node.payload = &entry->kv;
+  // Push the entry's node to the list
+  LLPushNode(chain, &entry->node);
+  UpdateOccupied(table, slot);
   // Increment num_elements
   table->num_elements++;
   // Return false since we had to add key
@@ -204,15 +499,32 @@ bool HashTable_Insert(HashTable *table,
 bool HashTable_Find(HashTable *table,
                     HTKey_t key,
                     HTKeyValue_t *keyvalue) {
+  TRACE_SCOPE(TRACE_HT_FIND, key);
+
   Verify333(table != NULL);
+  switch (table->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      return RHFind(table, key, keyvalue);
+    case HT_ENGINE_SWISS:
+      return SWFind(table, key, keyvalue);
+    default:
+      break;
+  }
+
+  if (table->read_mostly) {
+    return ReadMostlyFind(table, key, keyvalue);
+  }
 
   // STEP 2: implement HashTable_Find.
-  int bucket;
+  // Find deliberately doesn't help a resize along: it isn't a mutation, so
+  // it must not move buckets out from under a live iterator.
   LinkedList *chain;
 
   // Calculate which bucket and chain the key would be in.
-  bucket = HashKeyToBucketNum(table, key);
-  chain = table->buckets[bucket];
+  chain = ChainForKey(table, key);
+  if (table->count_probes) {
+    return OrganizingFind(table, chain, key, keyvalue);
+  }
 
   // Initialize HTKeyValue_t struct for Search_LinkedList()
   HTKeyValue_t target;
@@ -231,33 +543,635 @@ bool HashTable_Find(HashTable *table,
 bool HashTable_Remove(HashTable *table,
                       HTKey_t key,
                       HTKeyValue_t *keyvalue) {
+  bool removed;
+  TRACE_SCOPE(TRACE_HT_REMOVE, key);
+
   Verify333(table != NULL);
+  switch (table->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      removed = RHRemove(table, key, keyvalue);
+      break;
+    case HT_ENGINE_SWISS:
+      removed = SWRemove(table, key, keyvalue);
+      break;
+    default:
+      // Keep any resize that's in progress moving along.
+      if (table->old_buckets != NULL) {
+        MigrateBuckets(table);
+      }
+      removed = ChainedRemove(table, key, keyvalue);
+      break;
+  }
 
+  if (removed) {
+    if (table->log != NULL) {
+      HTLogRecord(table->log, HT_LOG_REMOVE, *keyvalue);
+    }
+    MaybeShrink(table);
+  }
+  return removed;
+}
+
+static bool ChainedRemove(HashTable *table, HTKey_t key,
+                          HTKeyValue_t *keyvalue) {
   // STEP 3: implement HashTable_Remove.
-  int bucket;
+  LinkedList **slot;
   LinkedList *chain;
 
   // Calculate which bucket and chain the key would be in.
-  bucket = HashKeyToBucketNum(table, key);
-  chain = table->buckets[bucket];
+  slot = ChainSlotForKey(table, key);
+  chain = *slot;
 
   // Initialize HTKeyValue_t struct for Search_LinkedList()
   HTKeyValue_t target;
   target.key = key;
   target.value = NULL;
   // Search chain for key and delete
-  if (!Search_LinkedList(chain, target, &keyvalue->value, 1)) {
+  if (!Search_LinkedList(chain, target, &keyvalue->value,
+                         table->read_mostly ? 3 : 1)) {
     // Key wasn't found so return false
     return false;
   }
   // Else key was found so copy key to keyvalue,
   // decrement num_elements, and return true
+  UpdateOccupied(table, slot);
   keyvalue->key = key;
   table->num_elements--;
   return true;
 }
 
 
+int HashTable_RemoveIf(HashTable *table, HTPredicateFnPtr predicate,
+                       void *arg, ValueFreeFnPtr value_free_function) {
+  HTIterator *iter;
+  HTKeyValue_t kv;
+  int num_removed = 0;
+  int i;
+
+  Verify333(table != NULL);
+  Verify333(predicate != NULL && value_free_function != NULL);
+  switch (table->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      // Removal shifts later entries back, so let an iterator keep track
+      // of which ones are still to come.
+      iter = HTIterator_Allocate(table);
+      while (HTIterator_Get(iter, &kv)) {
+        if (!predicate(kv, arg)) {
+          HTIterator_Next(iter);
+          continue;
+        }
+        HTIterator_Remove(iter, &kv);
+        value_free_function(kv.value);
+        num_removed++;
+      }
+      HTIterator_Free(iter);
+      break;
+    case HT_ENGINE_SWISS:
+      // Removal never moves anything, so just sweep the slots.
+      for (i = 0; i < table->num_buckets; i++) {
+        if (!SWSlotIsFull(table, i) || !predicate(table->entries[i], arg)) {
+          continue;
+        }
+        SWRemoveSlot(table, i, &kv);
+        if (table->log != NULL) {
+          HTLogRecord(table->log, HT_LOG_REMOVE, kv);
+        }
+        value_free_function(kv.value);
+        num_removed++;
+      }
+      break;
+    default:
+      num_removed = ChainedRemoveIf(table, predicate, arg,
+                                    value_free_function);
+      break;
+  }
+
+  if (num_removed > 0) {
+    MaybeShrink(table);
+  }
+  return num_removed;
+}
+
+static int ChainedRemoveIf(HashTable *table, HTPredicateFnPtr predicate,
+                           void *arg, ValueFreeFnPtr value_free_function) {
+  int num_removed = 0;
+  int i;
+
+  // Visit every non-empty chain of both arrays (while a resize is in
+  // progress), taking the matches out as we walk past them.
+  for (i = NextOccupiedBucket(table, 0); i < NumIterBuckets(table);
+       i = NextOccupiedBucket(table, i + 1)) {
+    LinkedList **slot = IterBucketSlot(table, i);
+    LinkedListNode *node = (*slot)->head;
+
+    while (node != NULL) {
+      HTEntry *entry = (HTEntry *) node;
+      HTKeyValue_t kv = entry->kv;
+
+      node = node->next;
+      if (!predicate(kv, arg)) {
+        continue;
+      }
+      ChainedUnlink(table, slot, entry);
+      if (table->log != NULL) {
+        HTLogRecord(table->log, HT_LOG_REMOVE, kv);
+      }
+      value_free_function(kv.value);
+      num_removed++;
+    }
+    UpdateOccupied(table, slot);
+  }
+  table->num_elements -= num_removed;
+  return num_removed;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Read-modify-write.
+
+// Return key's entry in a chain, or NULL.
+static HTEntry *ChainSearch(LinkedList *chain, HTKey_t key) {
+  LinkedListNode *node;
+
+  for (node = chain->head; node != NULL; node = node->next) {
+    HTEntry *entry = (HTEntry *) node;
+    if (entry->kv.key == key) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+// Add a key that a search has just failed to find to a chained table.
+// The search didn't grow the table, so this does, and then finds the
+// chain again; that is arithmetic, not another walk down a chain.
+static HTEntry *ChainedAdd(HashTable *ht, HTKey_t key, HTValue_t value) {
+  LinkedList **slot;
+  HTEntry *entry;
+
+  MaybeResize(ht);
+  entry = (HTEntry *) malloc(sizeof(HTEntry));
+  Verify333(entry != NULL);
+  entry->kv.key = key;
+  entry->kv.value = value;
+  entry->node.payload = &entry->kv;
+  slot = ChainSlotForKey(ht, key);
+  LLPushNode(*slot, &entry->node);
+  UpdateOccupied(ht, slot);
+  ht->num_elements++;
+  return entry;
+}
+
+bool HashTable_Upsert(HashTable *table, HTKey_t key,
+                      HTUpsertFnPtr upsert_function, void *arg) {
+  HTKeyValue_t kv;
+  HTValue_t *slot;
+  HTEntry *entry;
+  bool added;
+
+  Verify333(table != NULL && upsert_function != NULL);
+  kv.key = key;
+  kv.value = NULL;
+
+  if (table->engine != HT_ENGINE_CHAINED) {
+    if (table->engine == HT_ENGINE_ROBINHOOD) {
+      slot = RHFindOrAdd(table, key, NULL, &added);
+    } else {
+      slot = SWFindOrAdd(table, key, NULL, &added);
+    }
+    upsert_function(slot, !added, arg);
+    if (table->log != NULL) {
+      kv.value = *slot;
+      HTLogRecord(table->log, HT_LOG_INSERT, kv);
+    }
+    return !added;
+  }
+
+  // A chained table may be read-mostly, so work on a copy of the value and
+  // publish the result with a single store, or with the push of a fully
+  // built entry.
+  entry = ChainSearch(ChainForKey(table, key), key);
+  if (entry != NULL) {
+    kv.value = entry->kv.value;
+  }
+  upsert_function(&kv.value, entry != NULL, arg);
+  if (table->log != NULL) {
+    HTLogRecord(table->log, HT_LOG_INSERT, kv);
+  }
+  if (entry != NULL) {
+    __atomic_store_n(&entry->kv.value, kv.value, __ATOMIC_RELEASE);
+    return true;
+  }
+  ChainedAdd(table, key, kv.value);
+  return false;
+}
+
+HTValue_t *HashTable_FindOrInsert(HashTable *table, HTKey_t key,
+                                  HTValue_t value, bool *inserted) {
+  HTEntry *entry;
+
+  Verify333(table != NULL && inserted != NULL);
+  Verify333(!table->read_mostly && table->log == NULL);
+  switch (table->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      return RHFindOrAdd(table, key, value, inserted);
+    case HT_ENGINE_SWISS:
+      return SWFindOrAdd(table, key, value, inserted);
+    default:
+      break;
+  }
+
+  entry = ChainSearch(ChainForKey(table, key), key);
+  *inserted = (entry == NULL);
+  if (entry == NULL) {
+    entry = ChainedAdd(table, key, value);
+  }
+  return &entry->kv.value;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Self-organizing chains.
+
+void HashTable_SetChainPolicy(HashTable *table, HTChainPolicy_t policy) {
+  Verify333(table != NULL);
+  Verify333(table->engine == HT_ENGINE_CHAINED && !table->read_mostly);
+  Verify333(policy == HT_CHAIN_FIXED || policy == HT_CHAIN_MOVE_TO_FRONT ||
+            policy == HT_CHAIN_TRANSPOSE);
+  table->chain_policy = policy;
+  table->count_probes = true;
+}
+
+double HashTable_ProbeDepth(HashTable *table, bool reset) {
+  double depth;
+
+  Verify333(table != NULL);
+  depth = table->num_finds == 0 ? 0.0 :
+          (double) table->num_probes / (double) table->num_finds;
+  if (reset) {
+    table->num_finds = 0;
+    table->num_probes = 0;
+  }
+  return depth;
+}
+
+static bool OrganizingFind(HashTable *ht, LinkedList *chain, HTKey_t key,
+                           HTKeyValue_t *keyvalue) {
+  LinkedListNode *node;
+  uint64_t depth = 0;
+
+  ht->num_finds++;
+  for (node = chain->head; node != NULL; node = node->next) {
+    HTEntry *entry = (HTEntry *) node;
+
+    depth++;
+    if (entry->kv.key != key) {
+      continue;
+    }
+    ht->num_probes += depth;
+    *keyvalue = entry->kv;
+    if (node->prev == NULL) {
+      return true;
+    }
+
+    if (ht->chain_policy == HT_CHAIN_MOVE_TO_FRONT) {
+      LLUnlinkNode(chain, node);
+      LLPushNode(chain, node);
+    } else if (ht->chain_policy == HT_CHAIN_TRANSPOSE) {
+      // Relink the node rather than swapping the two kv's, so that every
+      // value stays in its own entry and FindOrInsert pointers stay good.
+      LinkedListNode *prev = node->prev;
+      LLUnlinkNode(chain, node);
+      LLInsertNodeBefore(chain, prev, node);
+    }
+    return true;
+  }
+  ht->num_probes += depth;
+  return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch operations.
+//
+// Keys are handled HT_BATCH_GROUP at a time.  For a chained table, the
+// group is prefetched in three stages, each run over the whole group before
+// the next one starts: the bucket array entry, then the LinkedList it
+// points to, then the chain's first node.  By the time a stage reads a
+// pointer, the previous stage's prefetch of it has usually arrived, and the
+// whole group's misses are in flight at once.  The open-addressing engines
+// only need each key's first slot (or group) prefetched.
+//
+// Then the group's operations run in order through the single-key
+// functions.  The prefetches are only hints, so if an insert resizes the
+// table part way through a group we waste some prefetches, nothing more.
+#define HT_BATCH_GROUP 16
+
+static void PrefetchKeys(HashTable *ht, const HTKey_t *keys, int n) {
+  LinkedList **slots[HT_BATCH_GROUP];
+  int i;
+
+  switch (ht->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      for (i = 0; i < n; i++) {
+        RHPrefetch(ht, keys[i]);
+      }
+      return;
+    case HT_ENGINE_SWISS:
+      for (i = 0; i < n; i++) {
+        SWPrefetch(ht, keys[i]);
+      }
+      return;
+    default:
+      break;
+  }
+
+  for (i = 0; i < n; i++) {
+    slots[i] = ChainSlotForKey(ht, keys[i]);
+    __builtin_prefetch(slots[i]);
+  }
+  for (i = 0; i < n; i++) {
+    __builtin_prefetch(*slots[i]);
+  }
+  for (i = 0; i < n; i++) {
+    __builtin_prefetch((*slots[i])->head);
+  }
+}
+
+static int BatchGroupSize(int i, int num_keys) {
+  return num_keys - i < HT_BATCH_GROUP ? num_keys - i : HT_BATCH_GROUP;
+}
+
+int HashTable_FindBatch(HashTable *table,
+                        const HTKey_t *keys,
+                        int num_keys,
+                        HTKeyValue_t *keyvalues,
+                        bool *found) {
+  int num_found = 0;
+  int i, j;
+
+  Verify333(table != NULL);
+  for (i = 0; i < num_keys; i += HT_BATCH_GROUP) {
+    int n = BatchGroupSize(i, num_keys);
+    PrefetchKeys(table, keys + i, n);
+    for (j = i; j < i + n; j++) {
+      found[j] = HashTable_Find(table, keys[j], &keyvalues[j]);
+      num_found += found[j];
+    }
+  }
+  return num_found;
+}
+
+int HashTable_InsertBatch(HashTable *table,
+                          const HTKeyValue_t *newkeyvalues,
+                          int num_keys,
+                          HTKeyValue_t *oldkeyvalues,
+                          bool *replaced) {
+  HTKey_t keys[HT_BATCH_GROUP];
+  int num_replaced = 0;
+  int i, j;
+
+  Verify333(table != NULL);
+  for (i = 0; i < num_keys; i += HT_BATCH_GROUP) {
+    int n = BatchGroupSize(i, num_keys);
+    for (j = 0; j < n; j++) {
+      keys[j] = newkeyvalues[i + j].key;
+    }
+    PrefetchKeys(table, keys, n);
+    for (j = i; j < i + n; j++) {
+      replaced[j] = HashTable_Insert(table, newkeyvalues[j],
+                                     &oldkeyvalues[j]);
+      num_replaced += replaced[j];
+    }
+  }
+  return num_replaced;
+}
+
+int HashTable_RemoveBatch(HashTable *table,
+                          const HTKey_t *keys,
+                          int num_keys,
+                          HTKeyValue_t *keyvalues,
+                          bool *removed) {
+  int num_removed = 0;
+  int i, j;
+
+  Verify333(table != NULL);
+  for (i = 0; i < num_keys; i += HT_BATCH_GROUP) {
+    int n = BatchGroupSize(i, num_keys);
+    PrefetchKeys(table, keys + i, n);
+    for (j = i; j < i + n; j++) {
+      removed[j] = HashTable_Remove(table, keys[j], &keyvalues[j]);
+      num_removed += removed[j];
+    }
+  }
+  return num_removed;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Presizing and bulk loading.
+
+void HashTable_Reserve(HashTable *table, int num_elements) {
+  int num_buckets;
+
+  Verify333(table != NULL);
+  Verify333(num_elements >= 0);
+  switch (table->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      RHReserve(table, num_elements);
+      break;
+    case HT_ENGINE_SWISS:
+      SWReserve(table, num_elements);
+      break;
+    default:
+      num_buckets = BucketsForElements(num_elements);
+      if (num_buckets > table->num_buckets) {
+        ResizeNow(table, num_buckets);
+      }
+      break;
+  }
+
+  // The customer expects to fill the space, so keep it.
+  if (table->min_buckets < table->num_buckets) {
+    table->min_buckets = table->num_buckets;
+  }
+}
+
+void HashTable_ShrinkToFit(HashTable *table) {
+  int num_buckets;
+
+  Verify333(table != NULL);
+  num_buckets = SizeForElements(table, table->num_elements);
+  if (table->engine == HT_ENGINE_CHAINED) {
+    FinishResize(table);
+  }
+  if (num_buckets < table->num_buckets ||
+      (table->engine == HT_ENGINE_SWISS && table->num_deleted > 0)) {
+    ResizeNow(table, num_buckets);
+  }
+  table->min_buckets = 1;
+}
+
+HashTable* HashTable_Build(HTEngine_t engine,
+                           const HTKeyValue_t *keyvalues,
+                           int num_keyvalues,
+                           bool assume_unique,
+                           ValueFreeFnPtr value_free_function) {
+  HashTable *ht = HashTable_AllocateEngine(1, engine);
+  HTKeyValue_t oldkv;
+  int i;
+
+  Verify333(num_keyvalues >= 0);
+  Verify333(assume_unique || value_free_function != NULL);
+  HashTable_Reserve(ht, num_keyvalues);
+
+  if (!assume_unique) {
+    // The table is already big enough, so these never resize.
+    for (i = 0; i < num_keyvalues; i++) {
+      if (HashTable_Insert(ht, keyvalues[i], &oldkv)) {
+        value_free_function(oldkv.value);
+      }
+    }
+    return ht;
+  }
+
+  switch (engine) {
+    case HT_ENGINE_ROBINHOOD:
+      for (i = 0; i < num_keyvalues; i++) {
+        RHInsertUnique(ht, keyvalues[i]);
+      }
+      return ht;
+    case HT_ENGINE_SWISS:
+      for (i = 0; i < num_keyvalues; i++) {
+        SWInsertUnique(ht, keyvalues[i]);
+      }
+      return ht;
+    default:
+      break;
+  }
+
+  // Push each entry straight onto its chain, skipping the search.
+  for (i = 0; i < num_keyvalues; i++) {
+    HTEntry *entry = (HTEntry *) malloc(sizeof(HTEntry));
+    int b;
+    Verify333(entry != NULL);
+    entry->kv = keyvalues[i];
+    entry->node.payload = &entry->kv;
+    b = HashKeyToBucketNum(ht, entry->kv.key);
+    LLPushNode(ht->buckets[b], &entry->node);
+    HTSetOccupied(ht->occupied, b);
+  }
+  ht->num_elements = num_keyvalues;
+  return ht;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Introspection.
+
+// The number of LinkedList headers a chained table has allocated.  Part
+// way through a resize, that is the old buckets still to be migrated plus
+// the new buckets the migrated ones have created (see StartResize).
+static int64_t NumChainHeaders(HashTable *ht) {
+  int64_t created;
+
+  if (ht->old_buckets == NULL) {
+    return ht->num_buckets;
+  }
+  if (ht->num_buckets > ht->old_num_buckets) {
+    created = (int64_t) ht->migrate_idx *
+              (ht->num_buckets / ht->old_num_buckets);
+  } else {
+    created = ht->migrate_idx < ht->num_buckets ?
+              ht->migrate_idx : ht->num_buckets;
+  }
+  return ht->old_num_buckets - ht->migrate_idx + created;
+}
+
+// Add the chains of one bucket array to a chained table's stats, reading
+// only the bitmap and the headers of the non-empty chains.
+static void ChainStats(LinkedList **buckets, const uint64_t *bits,
+                       int num_buckets, HTStats *stats, uint64_t *total) {
+  int num_empty = num_buckets;
+  int w;
+
+  for (w = 0; w < (num_buckets + 63) >> 6; w++) {
+    uint64_t word = bits[w];
+    for (; word != 0; word &= word - 1) {
+      LinkedList *chain = buckets[(w << 6) + __builtin_ctzll(word)];
+      int len = chain->num_elements;
+
+      num_empty--;
+      stats->length_hist[len < HT_STATS_HIST - 1 ? len : HT_STATS_HIST - 1]++;
+      // The entries of a chain of len are found after 1, 2, ... len looks.
+      *total += (uint64_t) len * (len + 1) / 2;
+      if (len > stats->max_probe) {
+        stats->max_probe = len;
+      }
+    }
+  }
+  stats->empty_buckets += num_empty;
+  stats->length_hist[0] += num_empty;
+}
+
+void HashTable_GetStats(HashTable *table, HTStats *stats) {
+  uint64_t total = 0;
+
+  Verify333(table != NULL && stats != NULL);
+  memset(stats, 0, sizeof(HTStats));
+  stats->engine = table->engine;
+  stats->num_elements = table->num_elements;
+  stats->num_buckets = table->num_buckets;
+  stats->num_resizes = table->num_resizes;
+  stats->resize_ns = table->resize_ns;
+  stats->table_bytes = sizeof(HashTable);
+
+  switch (table->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      RHStats(table, stats);
+      break;
+    case HT_ENGINE_SWISS:
+      SWStats(table, stats);
+      break;
+    default:
+      ChainStats(table->buckets, table->occupied, table->num_buckets,
+                 stats, &total);
+      stats->bucket_bytes = (size_t) table->num_buckets *
+                            sizeof(LinkedList *) +
+                            (size_t) (table->num_buckets + 63) / 64 * 8;
+      if (table->old_buckets != NULL) {
+        // Count the old array too; the migrated buckets in it are empty.
+        ChainStats(table->old_buckets, table->old_occupied,
+                   table->old_num_buckets, stats, &total);
+        stats->num_buckets += table->old_num_buckets;
+        stats->bucket_bytes += (size_t) table->old_num_buckets *
+                               sizeof(LinkedList *) +
+                               (size_t) (table->old_num_buckets + 63) / 64 * 8;
+      }
+      if (table->num_elements > 0) {
+        stats->mean_probe = (double) total / table->num_elements;
+      }
+      if (table->read_mostly) {
+        stats->table_bytes += sizeof(HTSnapshot);
+      }
+      stats->header_bytes = (size_t) NumChainHeaders(table) *
+                            sizeof(LinkedList);
+      stats->node_bytes = (size_t) table->num_elements *
+                          sizeof(LinkedListNode);
+      stats->kv_bytes = (size_t) table->num_elements * sizeof(HTKeyValue_t);
+      break;
+  }
+
+  stats->total_bytes = stats->table_bytes + stats->bucket_bytes +
+                       stats->header_bytes + stats->node_bytes +
+                       stats->kv_bytes;
+  if (table->num_elements > 0) {
+    stats->bytes_per_entry = (double) stats->total_bytes /
+                             table->num_elements;
+  }
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // HTIterator implementation.
 
@@ -276,20 +1190,31 @@ HTIterator* HTIterator_Allocate(HashTable *table) {
     iter->ht = table;
     iter->bucket_it = NULL;
     iter->bucket_idx = INVALID_IDX;
+    iter->stop_idx = INVALID_IDX;
+    return iter;
+  }
+
+  // The open-addressing engines walk their slot arrays directly.
+  if (table->engine != HT_ENGINE_CHAINED) {
+    iter->ht = table;
+    iter->bucket_it = NULL;
+    iter->stop_idx = INVALID_IDX;
+    if (table->engine == HT_ENGINE_ROBINHOOD) {
+      RHIteratorFirst(iter);
+    } else {
+      SWIteratorFirst(iter);
+    }
     return iter;
   }
 
   // Initialize the iterator.  There is at least one element in the
   // table, so find the first element and point the iterator at it.
   iter->ht = table;
-  for (i = 0; i < table->num_buckets; i++) {
-    if (LinkedList_NumElements(table->buckets[i]) > 0) {
-      iter->bucket_idx = i;
-      break;
-    }
-  }
-  Verify333(i < table->num_buckets);  // make sure we found it.
-  iter->bucket_it = LLIterator_Allocate(table->buckets[iter->bucket_idx]);
+  i = NextOccupiedBucket(table, 0);
+  Verify333(i < NumIterBuckets(table));  // make sure we found it.
+  iter->bucket_idx = i;
+  iter->bucket_it = LLIterator_Allocate(IterBucket(table, iter->bucket_idx));
+  iter->stop_idx = INVALID_IDX;
   return iter;
 }
 
@@ -305,6 +1230,10 @@ void HTIterator_Free(HTIterator *iter) {
 bool HTIterator_IsValid(HTIterator *iter) {
   Verify333(iter != NULL);
 
+  if (iter->ht->engine != HT_ENGINE_CHAINED) {
+    return iter->bucket_idx != INVALID_IDX;
+  }
+
   // STEP 4: Accidentally deleted so didn't grab correct comment
   // If iter->bucket_it is null return false
   if (iter->bucket_it == NULL) {
@@ -319,6 +1248,15 @@ bool HTIterator_IsValid(HTIterator *iter) {
 bool HTIterator_Next(HTIterator *iter) {
   Verify333(iter != NULL);
 
+  switch (iter->ht->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      return RHIteratorNext(iter);
+    case HT_ENGINE_SWISS:
+      return SWIteratorNext(iter);
+    default:
+      break;
+  }
+
   // STEP 5: implement HTIterator_Next.
   // Return false if hash table is empty
   if (iter->ht->num_elements == 0) {
@@ -331,22 +1269,21 @@ bool HTIterator_Next(HTIterator *iter) {
   }
   // If bucket_it was invalidated we need to find the next nonempty bucket and
   // create an iterator of that
-  // Search the hash tables buckets array
-  // for the first one after bucket_idx with elements
-  for (int i = iter->bucket_idx + 1; i < iter->ht->num_buckets; i++) {
-    // If current bucket isn't empty move HTIterator to there
-    if (LinkedList_NumElements(iter->ht->buckets[i]) > 0) {
-      // Change bucket_idx to i
-      iter->bucket_idx = i;
-      // Free the invalidated LLIterator
-      LLIterator_Free(iter->bucket_it);
-      // Create an LLIterator of bucket i
-      iter->bucket_it = LLIterator_Allocate(iter->ht->buckets[i]);
-      // Iterator is successfully iterated so return true
-      return true;
-    }
+  // The occupancy bitmaps find the first one after bucket_idx with
+  // elements without looking at the empty buckets in between
+  int i = NextOccupiedBucket(iter->ht, iter->bucket_idx + 1);
+  // If there is a non-empty bucket move HTIterator to there
+  if (i < NumIterBuckets(iter->ht)) {
+    // Change bucket_idx to i
+    iter->bucket_idx = i;
+    // Free the invalidated LLIterator
+    LLIterator_Free(iter->bucket_it);
+    // Create an LLIterator of bucket i
+    iter->bucket_it = LLIterator_Allocate(IterBucket(iter->ht, i));
+    // Iterator is successfully iterated so return true
+    return true;
   }
-  // If we made it through the loop then all remaining buckets are empty,
+  // If we didn't find one then all remaining buckets are empty,
   // and we need to invalidate iter
   // bucket_it is already invalidated from the LLIterator_Next() call,
   // so we only need to invalidate bucket_idx
@@ -365,6 +1302,17 @@ bool HTIterator_Get(HTIterator *iter, HTKeyValue_t *keyvalue) {
   if (!HTIterator_IsValid(iter)) {
     return false;
   }
+  switch (iter->ht->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      keyvalue->key = iter->ht->slots[iter->bucket_idx].key;
+      keyvalue->value = iter->ht->slots[iter->bucket_idx].value;
+      return true;
+    case HT_ENGINE_SWISS:
+      *keyvalue = iter->ht->entries[iter->bucket_idx];
+      return true;
+    default:
+      break;
+  }
   // Else get payload from LLIterator_Get() and store in keyvalue
   HTKeyValue_t *outputKeyValue;
   LLIterator_Get(iter->bucket_it, (LLPayload_t*) &outputKeyValue);
@@ -374,62 +1322,332 @@ bool HTIterator_Get(HTIterator *iter, HTKeyValue_t *keyvalue) {
 }
 
 bool HTIterator_Remove(HTIterator *iter, HTKeyValue_t *keyvalue) {
-  HTKeyValue_t kv;
+  HashTable *ht;
+  LinkedList **slot;
+  HTEntry *entry;
 
   Verify333(iter != NULL);
-
-  // Try to get what the iterator is pointing to.
-  if (!HTIterator_Get(iter, &kv)) {
-    return false;
+  ht = iter->ht;
+
+  switch (ht->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      // Robin Hood removal shifts entries around, so it needs to keep the
+      // iterator in step itself.
+      if (!RHIteratorRemove(iter, keyvalue)) {
+        return false;
+      }
+      break;
+    case HT_ENGINE_SWISS:
+      // Swiss removal leaves everything else where it is.
+      if (!HTIterator_IsValid(iter)) {
+        return false;
+      }
+      SWRemoveSlot(ht, iter->bucket_idx, keyvalue);
+      SWIteratorNext(iter);
+      break;
+    default:
+      if (!HTIterator_IsValid(iter)) {
+        return false;
+      }
+      // The iterator is standing on the entry, so there is no need to hash
+      // the key and search the chain for it again.  Advance the iterator
+      // first, then unlink the entry right where it is.  This skips the
+      // resize steps of HashTable_Remove so that nothing moves under the
+      // iterator.
+      slot = IterBucketSlot(ht, iter->bucket_idx);
+      entry = (HTEntry *) iter->bucket_it->node;
+      *keyvalue = entry->kv;
+      HTIterator_Next(iter);
+      ChainedUnlink(ht, slot, entry);
+      UpdateOccupied(ht, slot);
+      ht->num_elements--;
+      break;
   }
 
-  // Advance the iterator.  Thanks to the above call to
-  // HTIterator_Get, we know that this iterator is valid (though it
-  // may not be valid after this call to HTIterator_Next).
-  HTIterator_Next(iter);
-
-  // Lastly, remove the element.  Again, we know this call will succeed
-  // due to the successful HTIterator_Get above.
-  Verify333(HashTable_Remove(iter->ht, kv.key, keyvalue));
-  Verify333(kv.key == keyvalue->key);
-  Verify333(kv.value == keyvalue->value);
-
+  if (ht->log != NULL) {
+    HTLogRecord(ht->log, HT_LOG_REMOVE, *keyvalue);
+  }
   return true;
 }
 
 static void MaybeResize(HashTable *ht) {
-  HashTable *newht;
-  HashTable tmp;
-  HTIterator *it;
+  // Keep any resize that's in progress moving along.
+  if (ht->old_buckets != NULL) {
+    MigrateBuckets(ht);
+  }
 
   // Resize if the load factor is > 3.
   if (ht->num_elements < 3 * ht->num_buckets)
     return;
 
-  // This is the resize case.  Allocate a new hashtable,
-  // iterate over the old hashtable, do the surgery on
-  // the old hashtable record and free up the new hashtable
-  // record.
-  newht = HashTable_Allocate(ht->num_buckets * 9);
+  if (ht->read_mostly) {
+    SwapResize(ht, ht->num_buckets * 8);
+    return;
+  }
+
+  // A resize can't normally come due before the previous one finishes,
+  // since each migration step outpaces the inserts.  If it does, just
+  // finish the old one off now.
+  FinishResize(ht);
+
+  // This is the resize case.  Rather than rehashing everything right now,
+  // we set up an empty bucket array 8x the size (keeping it a power of
+  // two) and let subsequent Inserts and Removes migrate the old buckets
+  // over a few at a time.
+  StartResize(ht, ht->num_buckets * 8);
+  MigrateBuckets(ht);
+}
+
+static void MaybeShrink(HashTable *ht) {
+  int need, num_buckets;
+
+  // Let a resize that is under way finish first.
+  if (ht->old_buckets != NULL) {
+    return;
+  }
+
+  need = SizeForElements(ht, ht->num_elements);
+  if (ht->num_buckets / HT_SHRINK_RATIO < need) {
+    return;
+  }
+  num_buckets = 2 * need > ht->min_buckets ? 2 * need : ht->min_buckets;
+  if (num_buckets >= ht->num_buckets) {
+    return;
+  }
+
+  switch (ht->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      RHResize(ht, num_buckets);
+      break;
+    case HT_ENGINE_SWISS:
+      SWRehash(ht, num_buckets);
+      break;
+    default:
+      if (ht->read_mostly) {
+        SwapResize(ht, num_buckets);
+      } else {
+        // Migrate incrementally, just like growing.
+        StartResize(ht, num_buckets);
+        MigrateBuckets(ht);
+      }
+      break;
+  }
+}
+
+static int SizeForElements(HashTable *ht, int num_elements) {
+  switch (ht->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      return RHSlotsForElements(num_elements);
+    case HT_ENGINE_SWISS:
+      return SWSlotsForElements(num_elements);
+    default:
+      return BucketsForElements(num_elements);
+  }
+}
+
+static void ResizeNow(HashTable *ht, int num_buckets) {
+  switch (ht->engine) {
+    case HT_ENGINE_ROBINHOOD:
+      RHResize(ht, num_buckets);
+      return;
+    case HT_ENGINE_SWISS:
+      SWRehash(ht, num_buckets);
+      return;
+    default:
+      break;
+  }
+
+  if (ht->read_mostly) {
+    SwapResize(ht, num_buckets);
+    return;
+  }
+
+  // The customer is asking for the change now, so there is no point
+  // spreading the migration out over later operations.
+  FinishResize(ht);
+  StartResize(ht, num_buckets);
+  FinishResize(ht);
+}
+
+static void StartResize(HashTable *ht, int num_buckets) {
+  // The new array starts out full of NULLs.  Both arrays index with the low
+  // bits of the same mixed hash, so every key in new bucket j comes from
+  // old bucket j % old_num_buckets, and we can create the new LinkedLists
+  // for old bucket i's keys at the moment we migrate bucket i.  That spreads
+  // the allocation cost out just like the rehashing.  When shrinking, new
+  // bucket j is fed by old buckets j, j + num_buckets, ..., so it is created
+  // when old bucket j migrates, before any of the others.
+  uint64_t start = HTNowNs();
+  TRACE_SCOPE(TRACE_HT_RESIZE, num_buckets);
+
+  ht->num_resizes++;
+  ht->old_buckets = ht->buckets;
+  ht->old_occupied = ht->occupied;
+  ht->old_num_buckets = ht->num_buckets;
+  ht->migrate_idx = 0;
+  ht->num_buckets = num_buckets;
+  ht->buckets = (LinkedList **) calloc(ht->num_buckets, sizeof(LinkedList *));
+  Verify333(ht->buckets != NULL);
+  ht->occupied = HTAllocateOccupancy(ht->num_buckets);
+  ht->resize_ns += HTNowNs() - start;
+}
 
-  // Loop through the old ht copying its elements over into the new one.
-  for (it = HTIterator_Allocate(ht);
-       HTIterator_IsValid(it);
-       HTIterator_Next(it)) {
-    HTKeyValue_t item, unused;
+static void FinishResize(HashTable *ht) {
+  int step = ht->migrate_step;
 
-    Verify333(HTIterator_Get(it, &item));
-    HashTable_Insert(newht, item, &unused);
+  if (ht->old_buckets == NULL) {
+    return;
+  }
+  ht->migrate_step = 0;
+  MigrateBuckets(ht);
+  ht->migrate_step = step;
+}
+
+static void MigrateBuckets(HashTable *ht) {
+  int64_t step = ht->migrate_step;
+  int stop = ht->old_num_buckets;
+  uint64_t start = HTNowNs();
+  TRACE_SCOPE(TRACE_HT_RESIZE, ht->num_buckets);
+
+  // A shrink's old buckets are mostly empty, and there are several per new
+  // bucket, so take that many more per step.  The shrink still finishes
+  // within about num_buckets / HT_MIGRATE_STEP operations, long before
+  // the table could need to resize again.
+  if (ht->old_num_buckets > ht->num_buckets) {
+    step *= ht->old_num_buckets / ht->num_buckets;
+  }
+  if (step > 0 && ht->migrate_idx + step < stop) {
+    stop = ht->migrate_idx + (int) step;
   }
 
-  // Swap the new table onto the old, then free the old table (tricky!).  We
-  // use the "no-op free" because we don't actually want to free the elements;
-  // they're owned by the new table.
-  tmp = *ht;
-  *ht = *newht;
-  *newht = tmp;
+  for (; ht->migrate_idx < stop; ht->migrate_idx++) {
+    int i = ht->migrate_idx;
+    LinkedList *old_bucket = ht->old_buckets[i];
+    LinkedListNode *node;
+    int j;
 
-  // Done!  Clean up our iterator and temporary table.
-  HTIterator_Free(it);
-  HashTable_Free(newht, &HTNoOpFree);
+    // Create the new buckets that old bucket i is the first to feed into.
+    for (j = i; j < ht->num_buckets; j += ht->old_num_buckets) {
+      ht->buckets[j] = LinkedList_Allocate();
+    }
+
+    // Move the chain over by relinking its entries; nothing is allocated
+    // or freed.
+    while ((node = old_bucket->head) != NULL) {
+      HTEntry *entry = (HTEntry *) node;
+      int b = HashKeyToBucketNum(ht, entry->kv.key);
+      LLUnlinkNode(old_bucket, node);
+      LLPushNode(ht->buckets[b], node);
+      HTSetOccupied(ht->occupied, b);
+    }
+    LinkedList_Free(old_bucket, LLNoOpFree);
+    ht->old_buckets[i] = NULL;
+    HTClearOccupied(ht->old_occupied, i);
+  }
+
+  // Once every old bucket has been moved, the resize is done.
+  if (ht->migrate_idx == ht->old_num_buckets) {
+    free(ht->old_buckets);
+    free(ht->old_occupied);
+    ht->old_buckets = NULL;
+    ht->old_occupied = NULL;
+    ht->old_num_buckets = 0;
+    ht->migrate_idx = 0;
+  }
+  ht->resize_ns += HTNowNs() - start;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Read-mostly tables.
+//
+// The writer uses the ordinary chained code above, which only ever changes
+// a chain with a single release store (see LLPushNode), and retires removed
+// entries instead of freeing them.  Readers load the current snapshot and
+// walk one chain with acquire loads, all inside an epoch critical section.
+
+// Free a retired snapshot: its chains' entries (which were copied into the
+// new snapshot, values and all), its chains, its array and itself.
+static void FreeSnapshot(void *ptr) {
+  HTSnapshot *snap = (HTSnapshot *) ptr;
+  int i;
+
+  for (i = 0; i < snap->num_buckets; i++) {
+    LinkedList *bucket = snap->buckets[i];
+    LinkedListNode *node;
+    while ((node = bucket->head) != NULL) {
+      LLUnlinkNode(bucket, node);
+      free(node);
+    }
+    LinkedList_Free(bucket, LLNoOpFree);
+  }
+  free(snap->buckets);
+  free(snap);
+}
+
+static void SwapResize(HashTable *ht, int num_buckets) {
+  HTSnapshot *old_snap = ht->snapshot;
+  HTSnapshot *snap = (HTSnapshot *) malloc(sizeof(HTSnapshot));
+  uint64_t start = HTNowNs();
+  int i;
+  TRACE_SCOPE(TRACE_HT_RESIZE, num_buckets);
+
+  Verify333(snap != NULL);
+  snap->num_buckets = num_buckets;
+  snap->buckets =
+    (LinkedList **) malloc(snap->num_buckets * sizeof(LinkedList *));
+  Verify333(snap->buckets != NULL);
+  for (i = 0; i < snap->num_buckets; i++) {
+    snap->buckets[i] = LinkedList_Allocate();
+  }
+  free(ht->occupied);
+  ht->occupied = HTAllocateOccupancy(snap->num_buckets);
+
+  // Readers may be walking the old chains right now, so we can't relink
+  // their entries; copy each one into the new array instead.
+  for (i = 0; i < old_snap->num_buckets; i++) {
+    LinkedListNode *node;
+    for (node = old_snap->buckets[i]->head; node != NULL; node = node->next) {
+      HTEntry *entry = (HTEntry *) malloc(sizeof(HTEntry));
+      Verify333(entry != NULL);
+      entry->kv = ((HTEntry *) node)->kv;
+      int b = (int) (HTMixKey(entry->kv.key) &
+                     (uint64_t) (snap->num_buckets - 1));
+      entry->node.payload = &entry->kv;
+      LLPushNode(snap->buckets[b], &entry->node);
+      HTSetOccupied(ht->occupied, b);
+    }
+  }
+
+  // Publish the new array, then retire the old one.
+  ht->num_buckets = snap->num_buckets;
+  ht->buckets = snap->buckets;
+  __atomic_store_n(&ht->snapshot, snap, __ATOMIC_RELEASE);
+  Epoch_Retire(old_snap, &FreeSnapshot);
+  ht->num_resizes++;
+  ht->resize_ns += HTNowNs() - start;
+}
+
+static bool ReadMostlyFind(HashTable *ht, HTKey_t key,
+                           HTKeyValue_t *keyvalue) {
+  HTSnapshot *snap;
+  LinkedListNode *node;
+  bool found = false;
+
+  Epoch_Enter();
+  snap = __atomic_load_n(&ht->snapshot, __ATOMIC_ACQUIRE);
+  node = __atomic_load_n(
+      &snap->buckets[HTMixKey(key) & (uint64_t) (snap->num_buckets - 1)]->head,
+      __ATOMIC_ACQUIRE);
+  for (; node != NULL; node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) {
+    HTEntry *entry = (HTEntry *) node;
+    if (entry->kv.key == key) {
+      keyvalue->key = key;
+      keyvalue->value = __atomic_load_n(&entry->kv.value, __ATOMIC_ACQUIRE);
+      found = true;
+      break;
+    }
+  }
+  Epoch_Exit();
+  return found;
 }
@@ -12,6 +12,7 @@
 #ifndef HW1_HASHTABLE_H_
 #define HW1_HASHTABLE_H_
 
+#include <stddef.h>     // for size_t
 #include <stdbool.h>    // for bool type (true, false)
 #include <stdint.h>     // for uint64_t, etc.
 
@@ -29,7 +30,15 @@
 // As the load factor approaches 1, linked lists hanging off of each bucket
 // will start to grow.  This implementation will dynamically resize the
 // hashtable when the load factor exceeds 3.  It will multiple the number
-// of buckets in the hashtable by 9, so that post-resize load factor is 1/3.
+// of buckets in the hashtable by 8, so that post-resize load factor is 3/8.
+// Going the other way, once removals leave the table 16 or more times
+// bigger than it needs to be for what it holds, it shrinks to twice the
+// size it needs (but never below the size it was allocated, reserved or
+// built with).  The gap between the two thresholds means a table that
+// hovers around either one never flips back and forth between sizes.
+// Bucket counts are always rounded up to a power of two, and keys are
+// mixed before being mapped to a bucket, so keys with regular structure
+// (sequential IDs, multiples of a large stride) still spread out evenly.
 //
 // To hide the implementation of HashTable, we declare the "struct ht"
 // structure and its associated typedef here, but we *define* the structure
@@ -81,11 +90,71 @@ HTKey_t FNVHash64(unsigned char *buffer, int len);
 //
 // Arguments:
 // - num_buckets: the number of buckets the hash table should
-//   initially contain; MUST be greater than zero.
+//   initially contain (rounded up to a power of two); MUST be greater
+//   than zero.
 //
 // Returns a pointer to the newly allocated HashTable.
 HashTable* HashTable_Allocate(int num_buckets);
 
+// The storage engine behind a HashTable.  Every engine implements the
+// full interface in this file (including the iterator), so customers can
+// switch engines without changing any other code.
+//
+// - HT_ENGINE_CHAINED: an array of LinkedList buckets, as described above.
+//   This is what HashTable_Allocate gives you.
+// - HT_ENGINE_ROBINHOOD: open addressing with Robin Hood probing and
+//   backward-shift deletion.  Keys and values live in a single flat array
+//   of slots, so Insert/Find/Remove never allocate and never chase
+//   pointers.  The slot count is rounded up to a power of two and the
+//   table doubles once it is 15/16 full.
+// - HT_ENGINE_SWISS: open addressing in groups of 16 slots, with a 1-byte
+//   hash tag per slot.  A probe checks a whole group's tags at once (with
+//   SSE2 where available, a plain loop elsewhere), so most misses never
+//   look at a key.  Removal leaves tombstones; the table rehashes once
+//   7/8 of its slots are full or deleted.
+typedef enum {
+  HT_ENGINE_CHAINED = 0,
+  HT_ENGINE_ROBINHOOD,
+  HT_ENGINE_SWISS,
+} HTEngine_t;
+
+// Allocate and return a new HashTable backed by the given engine.
+//
+// Arguments:
+// - num_buckets: the number of buckets (or, for the open-addressing
+//   engines, slots) the hash table should initially contain; MUST be
+//   greater than zero.
+// - engine: which engine to use; see HTEngine_t above.
+//
+// Returns a pointer to the newly allocated HashTable.
+HashTable* HashTable_AllocateEngine(int num_buckets, HTEngine_t engine);
+
+// Allocate and return a new read-mostly HashTable.
+//
+// A read-mostly table is a chained table that one writer thread may modify
+// while any number of reader threads call HashTable_Find on it, with no
+// locking at all.  Readers walk the chains inside an epoch critical section
+// (see Epoch.h; HashTable_Find enters and leaves it for them), the writer
+// publishes each change with a single release store, and entries that the
+// writer removes are only freed once every reader that might still be
+// looking at them has finished.  A resize builds a complete new bucket
+// array and swaps it in, rather than migrating buckets incrementally.
+//
+// Every function may be used by the writer as usual.  Readers may only
+// call HashTable_Find.  If there is more than one writer thread, the
+// writers must serialize themselves (a mutex around the writes is
+// enough; the readers never take it).  As with the other concurrent
+// tables, a value returned to a reader is only a copy, so if the writer
+// frees values it removes or replaces, readers need their own scheme to
+// keep them alive.
+//
+// Arguments:
+// - num_buckets: the number of buckets the hash table should initially
+//   contain (rounded up to a power of two); MUST be greater than zero.
+//
+// Returns a pointer to the newly allocated HashTable.
+HashTable* HashTable_AllocateReadMostly(int num_buckets);
+
 // Free a HashTable and its entries.
 //
 // Arguments:
@@ -170,6 +239,399 @@ bool HashTable_Remove(HashTable *table,
                       HTKey_t key,
                       HTKeyValue_t *keyvalue);
 
+// Called by HashTable_RemoveIf on each (key,value) in the table; returns
+// whether to remove it.  "arg" is HashTable_RemoveIf's arg, passed
+// through.
+typedef bool (*HTPredicateFnPtr)(HTKeyValue_t keyvalue, void *arg);
+
+// Removes every (key,value) for which predicate returns true, in a single
+// sweep over the table, and frees each removed value.  Nothing is looked
+// up again: each entry is removed right where the sweep finds it.
+//
+// predicate MUST NOT call any function on this table.  For a table with a
+// log (see HashTableLog.h), each removal is logged.
+//
+// Arguments:
+// - table: the HashTable.
+// - predicate: says which (key,value)s to remove; see HTPredicateFnPtr.
+// - arg: passed through to predicate.
+// - value_free_function: called on the value of each removed
+//   (key,value).
+//
+// Returns the number of (key,value)s removed.
+int HashTable_RemoveIf(HashTable *table, HTPredicateFnPtr predicate,
+                       void *arg, ValueFreeFnPtr value_free_function);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Read-modify-write
+//
+// Code that aggregates into a table (counting, summing, appending to a
+// per-key list) would otherwise call HashTable_Find and then
+// HashTable_Insert, looking the key up twice.  These look it up once,
+// and only give the table a chance to grow when they actually add a key.
+
+// Called by HashTable_Upsert with a pointer to the key's value.  If
+// "exists" is true, *value is the key's current value, which the function
+// may change or replace; if it is false, the key is new, *value is NULL,
+// and the function sets the value the key is added with.  "arg" is
+// HashTable_Upsert's arg, passed through.
+typedef void (*HTUpsertFnPtr)(HTValue_t *value, bool exists, void *arg);
+
+// Looks up a key and calls upsert_function to create its value (if the
+// key isn't in the table) or update it (if it is), storing the result.
+//
+// upsert_function MUST NOT call any function on this table.  For a
+// read-mostly table, readers see either the old value or the new one.
+// For a table with a log (see HashTableLog.h), the result is logged as an
+// insert.
+//
+// Arguments:
+// - table: the HashTable.
+// - key: the key to create or update.
+// - upsert_function: creates or updates the value; see HTUpsertFnPtr.
+// - arg: passed through to upsert_function.
+//
+// Returns true if the key was already in the table, false if it was added.
+bool HashTable_Upsert(HashTable *table, HTKey_t key,
+                      HTUpsertFnPtr upsert_function, void *arg);
+
+// Looks up a key, adding it with the given value if it isn't in the table,
+// and returns a pointer to where the table keeps the key's value, through
+// which the caller can read or change the value in place.
+//
+// The pointer is only good until the next call that adds or removes keys
+// (Insert, Remove, another FindOrInsert, ...).  Find never invalidates it,
+// even under a chain policy, which reorders a chain by relinking entries
+// and never moves a value.  The table MUST NOT be read-mostly or have a
+// log, since changes made through the pointer can't be published to
+// readers or logged.
+//
+// Arguments:
+// - table: the HashTable.
+// - key: the key to look up.
+// - value: the value to add the key with, if it isn't there.
+// - inserted: (output) set to whether the key was added.
+//
+// Returns a pointer to the key's value.
+HTValue_t *HashTable_FindOrInsert(HashTable *table, HTKey_t key,
+                                  HTValue_t value, bool *inserted);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch operations
+//
+// These behave exactly like calling HashTable_Find/Insert/Remove on each
+// element of an array in order (so a key may appear more than once in a
+// batch), but they are much faster on big tables.  Each batch is worked
+// through a few keys at a time: every key in the group is hashed up front
+// and the memory its lookup will touch is prefetched in stages, so the
+// cache misses of different keys overlap instead of being paid one after
+// another.
+
+// Looks up num_keys keys.
+//
+// Arguments:
+// - table: the HashTable to look in.
+// - keys: the num_keys keys to look up.
+// - keyvalues: for each i, if keys[i] is present a copy of its (key,value)
+//   is returned through keyvalues[i], as with HashTable_Find.
+// - found: for each i, found[i] is set to whether keys[i] was present.
+//
+// Returns the number of keys that were found.
+int HashTable_FindBatch(HashTable *table,
+                        const HTKey_t *keys,
+                        int num_keys,
+                        HTKeyValue_t *keyvalues,
+                        bool *found);
+
+// Inserts num_keys (key,value) pairs, in order.
+//
+// Arguments:
+// - table: the HashTable to insert into.
+// - newkeyvalues: the num_keys HTKeyValue_t's to insert.
+// - oldkeyvalues: for each i, if newkeyvalues[i] replaced an existing
+//   (key,value), the old one is returned through oldkeyvalues[i], as with
+//   HashTable_Insert.  The caller assumes ownership of it.
+// - replaced: for each i, replaced[i] is set to what HashTable_Insert
+//   would have returned for newkeyvalues[i].
+//
+// Returns the number of (key,value) pairs that were replaced.
+int HashTable_InsertBatch(HashTable *table,
+                          const HTKeyValue_t *newkeyvalues,
+                          int num_keys,
+                          HTKeyValue_t *oldkeyvalues,
+                          bool *replaced);
+
+// Removes num_keys keys, in order.
+//
+// Arguments:
+// - table: the HashTable to remove from.
+// - keys: the num_keys keys to remove.
+// - keyvalues: for each i, if keys[i] was present its (key,value) is
+//   returned through keyvalues[i] and removed, as with HashTable_Remove.
+//   The caller is responsible for the memory of keyvalues[i].value.
+// - removed: for each i, removed[i] is set to whether keys[i] was removed.
+//
+// Returns the number of keys that were removed.
+int HashTable_RemoveBatch(HashTable *table,
+                          const HTKey_t *keys,
+                          int num_keys,
+                          HTKeyValue_t *keyvalues,
+                          bool *removed);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Presizing and bulk loading
+//
+// A table that is grown one Insert at a time rehashes (or, for a chained
+// table, migrates) everything it holds several times on the way up.  When
+// the final size is known in advance, these let the table start out big
+// enough instead.
+
+// Grows the table so that it can hold at least num_elements elements
+// without having to grow again.  Never shrinks a table, and the table
+// won't shrink itself below the reserved size either (only
+// HashTable_ShrinkToFit takes it lower).  Any resize that is under way is
+// finished first.
+//
+// Arguments:
+// - table: the HashTable to grow.
+// - num_elements: the number of elements the table should have room for;
+//   MUST be at least zero.
+void HashTable_Reserve(HashTable *table, int num_elements);
+
+// Shrinks the table to the smallest size that holds its elements without
+// having to grow again, dropping any floor set by HashTable_Allocate,
+// HashTable_Reserve or HashTable_Build, so that later removals may shrink
+// it further on their own.  Useful once a table that was filled up has
+// been mostly drained and isn't expected to fill up again.  Any resize
+// that is under way is finished first.
+//
+// Arguments:
+// - table: the HashTable to shrink.
+void HashTable_ShrinkToFit(HashTable *table);
+
+// Allocate and return a new HashTable holding the given (key,value) pairs,
+// sized up front so that it never grows while they are loaded.
+//
+// Arguments:
+// - engine: which engine to use; see HTEngine_t above.
+// - keyvalues: the num_keyvalues (key,value) pairs to load.
+// - num_keyvalues: the number of pairs; MUST be at least zero.
+// - assume_unique: if true, the caller promises that no key appears twice
+//   in keyvalues, and the pairs are placed without looking for an existing
+//   copy of the key.  Breaking the promise leaves duplicate keys in the
+//   table.
+// - value_free_function: if assume_unique is false, a key that appears
+//   more than once ends up with the value of its last pair, exactly as if
+//   the pairs had been inserted in order, and each value that gets
+//   replaced is passed to this function.  It may be NULL if
+//   assume_unique is true.
+//
+// Returns a pointer to the newly allocated HashTable.
+HashTable* HashTable_Build(HTEngine_t engine,
+                           const HTKeyValue_t *keyvalues,
+                           int num_keyvalues,
+                           bool assume_unique,
+                           ValueFreeFnPtr value_free_function);
+
+// As HashTable_Build, but using num_threads threads, for a chained table
+// (the open-addressing engines probe past any range of slots a thread
+// could be given, so they can't be split up this way).
+//
+// The pairs are partitioned by which range of the bucket array they hash
+// into, one range per thread, and then each thread creates the chains of
+// its own range and fills them, without any locking.  The result is an
+// ordinary chained HashTable.  This needs scratch space for a copy of
+// keyvalues while it runs.
+//
+// Arguments:
+// - keyvalues, num_keyvalues, assume_unique: as for HashTable_Build.
+// - num_threads: the number of threads to use (including the calling
+//   thread); MUST be greater than zero.
+// - value_free_function: as for HashTable_Build, except that it may be
+//   called from several threads at once.
+//
+// Returns a pointer to the newly allocated HashTable.
+HashTable* HashTable_BuildParallel(const HTKeyValue_t *keyvalues,
+                                   int num_keyvalues,
+                                   int num_threads,
+                                   bool assume_unique,
+                                   ValueFreeFnPtr value_free_function);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Parallel traversal
+//
+// These visit every (key,value) of a table, like an HTIterator walk, on
+// several threads at once.  The table (buckets for a chained table, slots
+// for the others) is cut into chunks that the threads take one at a time
+// as they finish the last, so a thread that draws a run of long chains
+// doesn't hold up the rest.  The order of visits is undefined.
+//
+// The table MUST NOT be changed by anyone (including the callbacks) for
+// the duration of the call.  The calling thread is one of the threads.
+
+// Called once for each (key,value) in the table.  "arg" is passed through
+// from the caller.  It may run on several threads at once.
+typedef void (*HTVisitFnPtr)(HTKeyValue_t keyvalue, void *arg);
+
+// Called by HashTable_ParallelReduce to fold a (key,value) into a thread's
+// private accumulator "acc".
+typedef void (*HTReduceFnPtr)(void *acc, HTKeyValue_t keyvalue, void *arg);
+
+// Called by HashTable_ParallelReduce to fold the accumulator "other" into
+// "acc".
+typedef void (*HTCombineFnPtr)(void *acc, const void *other, void *arg);
+
+// Calls visit_function on every (key,value) in the table.
+//
+// Arguments:
+// - table: the HashTable.
+// - num_threads: the number of threads to use (including the calling
+//   thread); MUST be greater than zero.
+// - visit_function: called on each (key,value); see HTVisitFnPtr.
+// - arg: passed through to visit_function.
+void HashTable_ParallelForEach(HashTable *table, int num_threads,
+                               HTVisitFnPtr visit_function, void *arg);
+
+// Folds every (key,value) in the table into *result.
+//
+// Each thread gets its own accumulator of acc_size bytes, which starts out
+// as a copy of *result, and reduce_function folds the (key,value)s that
+// thread visits into it, so no state is shared between threads.  At the
+// end, combine_function folds each thread's accumulator into *result in
+// turn, on the calling thread.  *result MUST hold the identity for
+// combine_function (zero for a sum, say) on entry, since every thread
+// starts from it.
+//
+// Arguments:
+// - table: the HashTable.
+// - num_threads: as for HashTable_ParallelForEach.
+// - result: (input/output) the identity on entry, the reduction on exit.
+// - acc_size: the size of *result, in bytes.
+// - reduce_function, combine_function: see HTReduceFnPtr and
+//   HTCombineFnPtr.
+// - arg: passed through to both functions.
+void HashTable_ParallelReduce(HashTable *table, int num_threads,
+                              void *result, size_t acc_size,
+                              HTReduceFnPtr reduce_function,
+                              HTCombineFnPtr combine_function, void *arg);
+
+///////////////////////////////////////////////////////////////////////////////
+// Self-organizing chains
+//
+// A chained table searches each chain from its head, and new entries go
+// on at the head, so with skewed lookups a hot key that was inserted early
+// is found only after walking past everything inserted after it.  A chain
+// policy has each successful HashTable_Find move the key it found toward
+// the head of its chain, so the hot keys gather there.
+//
+// This turns HashTable_Find into a write: with a policy set, Find must not
+// run alongside any other call on the same table (not even another Find),
+// and a Find while iterating may make the iterator skip or repeat an
+// element.  Inserts and Removes leave the order alone.
+
+// What a successful Find does with the entry it found.
+//
+// - HT_CHAIN_FIXED: nothing (the default).
+// - HT_CHAIN_MOVE_TO_FRONT: move it to the head of its chain.  Hot keys
+//   get there after a single hit, but so does every cold key that is hit
+//   once, pushing the hot ones back a step.
+// - HT_CHAIN_TRANSPOSE: move it in front of the entry ahead of it.  A key has
+//   to be hit repeatedly to get to the front, but one-off hits barely
+//   disturb the chain.
+typedef enum {
+  HT_CHAIN_FIXED = 0,
+  HT_CHAIN_MOVE_TO_FRONT,
+  HT_CHAIN_TRANSPOSE,
+} HTChainPolicy_t;
+
+// Set a chained table's chain policy, and start counting probes (see
+// HashTable_ProbeDepth).  The table MUST be a chained, non-read-mostly
+// table.  Setting HT_CHAIN_FIXED keeps chains as they are but still
+// counts probes.
+//
+// Arguments:
+// - table: the HashTable.
+// - policy: the policy to use from now on.
+void HashTable_SetChainPolicy(HashTable *table, HTChainPolicy_t policy);
+
+// Returns the average number of entries HashTable_Find has looked at per
+// call (1 for a hit on the head of a chain, the chain's length for a
+// miss) since HashTable_SetChainPolicy was called, or 0 if Find hasn't
+// been called since then.  Also starts a fresh count if reset is true.
+//
+// Arguments:
+// - table: the HashTable.
+// - reset: whether to start counting again from zero.
+double HashTable_ProbeDepth(HashTable *table, bool reset);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Introspection
+//
+// HashTable_GetStats reports how a table is laid out and how much memory
+// it holds.  It only reads the table, so it may run alongside other calls
+// that only read it (Find without a chain policy, iterators, the parallel
+// traversals), but not alongside anything that changes it; for a table
+// shared between threads, see ShardedHashTable_GetStats.  For a
+// read-mostly table, call it from the writer.
+//
+// It doesn't look at any entries of a chained table: the bucket counts
+// come from the occupancy bitmaps and the chain lengths from the headers
+// of the non-empty chains.  The open-addressing engines need a pass over
+// their slots.
+
+// The number of bins in HTStats.length_hist.
+#define HT_STATS_HIST 16
+
+typedef struct {
+  HTEngine_t  engine;           // which engine the table uses
+  int         num_elements;     // # of (key,value)s
+  int         num_buckets;      // # of buckets or slots (both arrays, in
+                                // the middle of a chained resize)
+  int         empty_buckets;    // # of those with nothing in them
+
+  // For a chained table, length_hist[i] is the number of chains with i
+  // entries in them.  For the open-addressing engines it is the number of
+  // entries i slots (Robin Hood) or i groups (Swiss) past where their
+  // probe starts.  The last bin counts everything from there on up.
+  uint64_t    length_hist[HT_STATS_HIST];
+
+  // How many entries (for a chained table, or slots for Robin Hood, or
+  // groups for Swiss) a successful Find looks at: at worst, and on
+  // average over every entry in the table.
+  int         max_probe;
+  double      mean_probe;
+
+  // How many times the table has been resized (or, for Swiss, rehashed
+  // in place to clear tombstones) since it was allocated, and the total
+  // time spent doing so.  An incremental resize counts once, and its
+  // time is the sum of its migration steps.
+  uint64_t    num_resizes;
+  uint64_t    resize_ns;
+
+  // Memory held by the table, in bytes, as requested from malloc (its
+  // own per-block overhead isn't included).  The open-addressing engines
+  // keep their (key,value)s in their slot arrays, so all of it but the
+  // record is bucket_bytes.
+  size_t      table_bytes;      // the HashTable record
+  size_t      bucket_bytes;     // bucket arrays and bitmaps, or slots
+  size_t      header_bytes;     // (chained) LinkedList headers
+  size_t      node_bytes;       // (chained) LinkedListNodes
+  size_t      kv_bytes;         // (chained) HTKeyValue_t payloads
+  size_t      total_bytes;      // all of the above
+  double      bytes_per_entry;  // total_bytes / num_elements, or 0
+} HTStats;
+
+// Fill in *stats for a table.
+//
+// Arguments:
+// - table: the HashTable.
+// - stats: (output) the table's statistics.
+void HashTable_GetStats(HashTable *table, HTStats *stats);
 
 ///////////////////////////////////////////////////////////////////////////////
 // HashTable iterator
@@ -0,0 +1,384 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // for fdatasync, mmap and clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "HashTableLog.h"
+#include "HashTableSnapshot.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// The log file layout.
+//
+//   LogHeader
+//   records      each a LogRecord followed by the value's bytes (for an
+//                insert), zero-padded to a multiple of 8
+//
+// Each record carries its own checksum (see HTChecksum): that of the
+// LogRecord with its checksum field set to zero, then the padded value,
+// starting from LOG_MAGIC.  A record that is cut short or fails its
+// checksum marks the end of the log.
+
+// "HT333LOG" as a big-endian number; see SNAP_MAGIC.
+#define LOG_MAGIC 0x48543333334C4F47ULL
+#define LOG_VERSION 1
+
+typedef struct log_header {
+  uint64_t  magic;    // LOG_MAGIC
+  uint32_t  version;  // LOG_VERSION
+  uint32_t  unused;   // zero
+} LogHeader;
+
+typedef struct log_record {
+  uint64_t  key;         // the key inserted or removed
+  uint32_t  op;          // HT_LOG_INSERT or HT_LOG_REMOVE
+  uint32_t  value_size;  // # of value bytes (before padding), 0 for removes
+  uint64_t  checksum;    // see above
+} LogRecord;
+
+struct htlog {
+  int                   fd;          // the log file, opened O_APPEND
+  ValueSerializeFnPtr   value_serialize_function;
+  size_t                group_bytes;
+  int64_t               group_ns;
+  unsigned char        *buf;         // records waiting to be written
+  size_t                len;         // # of bytes in buf
+  size_t                cap;         // size of buf
+  int64_t               first_ns;    // when buf's first record was added
+  bool                  failed;      // has any write or sync failed?
+};
+
+static uint64_t RoundUpTo8(uint64_t n) {
+  return (n + 7) & ~(uint64_t) 7;
+}
+
+static int64_t LogNowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t LogRecordChecksum(const LogRecord *rec, const void *value,
+                                  size_t padded_size) {
+  LogRecord copy = *rec;
+
+  copy.checksum = 0;
+  return HTChecksum(HTChecksum(LOG_MAGIC, &copy, sizeof(copy)), value,
+                    padded_size);
+}
+
+// Make sure buf has room for at least need more bytes.
+static void LogReserve(HTLog *log, size_t need) {
+  if (log->cap - log->len >= need) {
+    return;
+  }
+  while (log->cap - log->len < need) {
+    log->cap *= 2;
+  }
+  log->buf = (unsigned char *) realloc(log->buf, log->cap);
+  Verify333(log->buf != NULL);
+}
+
+// Write all len bytes of buf to fd.
+static bool LogWriteAll(int fd, const unsigned char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Writing.
+
+HTLog* HTLog_Open(const char *path,
+                  ValueSerializeFnPtr value_serialize_function,
+                  int group_bytes,
+                  int group_ms) {
+  HTLog *log;
+  LogHeader header;
+  struct stat st;
+  int fd;
+
+  Verify333(value_serialize_function != NULL);
+  Verify333(group_bytes >= 0 && group_ms >= 0);
+  fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  // A new log (or one whose creation was cut short) gets a fresh header;
+  // otherwise, check the header that's there.
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+  if (st.st_size < (off_t) sizeof(header)) {
+    memset(&header, 0, sizeof(header));
+    header.magic = LOG_MAGIC;
+    header.version = LOG_VERSION;
+    if (ftruncate(fd, 0) != 0 ||
+        !LogWriteAll(fd, (const unsigned char *) &header, sizeof(header)) ||
+        fdatasync(fd) != 0) {
+      close(fd);
+      return NULL;
+    }
+  } else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+             header.magic != LOG_MAGIC || header.version != LOG_VERSION) {
+    close(fd);
+    return NULL;
+  }
+
+  log = (HTLog *) malloc(sizeof(HTLog));
+  Verify333(log != NULL);
+  log->fd = fd;
+  log->value_serialize_function = value_serialize_function;
+  log->group_bytes = group_bytes;
+  log->group_ns = (int64_t) group_ms * 1000000;
+  log->cap = 64 * 1024;
+  log->buf = (unsigned char *) malloc(log->cap);
+  Verify333(log->buf != NULL);
+  log->len = 0;
+  log->first_ns = 0;
+  log->failed = false;
+  return log;
+}
+
+void HTLogRecord(HTLog *log, int op, HTKeyValue_t kv) {
+  LogRecord rec;
+  unsigned char *value;
+  size_t size = 0;
+  size_t padded;
+
+  // Serialize the value straight into the buffer, after the record.
+  LogReserve(log, sizeof(rec) + 256);
+  if (op == HT_LOG_INSERT) {
+    value = log->buf + log->len + sizeof(rec);
+    size = log->value_serialize_function(kv.value, value,
+                                         log->cap - log->len - sizeof(rec));
+    if (RoundUpTo8(size) > log->cap - log->len - sizeof(rec)) {
+      LogReserve(log, sizeof(rec) + RoundUpTo8(size));
+      value = log->buf + log->len + sizeof(rec);
+      Verify333(log->value_serialize_function(kv.value, value, size) == size);
+    }
+  }
+  value = log->buf + log->len + sizeof(rec);
+  padded = RoundUpTo8(size);
+  memset(value + size, 0, padded - size);
+
+  rec.key = kv.key;
+  rec.op = op;
+  rec.value_size = (uint32_t) size;
+  rec.checksum = LogRecordChecksum(&rec, value, padded);
+  memcpy(log->buf + log->len, &rec, sizeof(rec));
+
+  if (log->len == 0 && log->group_ns > 0) {
+    log->first_ns = LogNowNs();
+  }
+  log->len += sizeof(rec) + padded;
+
+  if (log->len >= log->group_bytes || log->group_ns == 0 ||
+      LogNowNs() - log->first_ns >= log->group_ns) {
+    HTLog_Sync(log);
+  }
+}
+
+bool HTLog_Sync(HTLog *log) {
+  Verify333(log != NULL);
+  if (log->len > 0) {
+    if (!LogWriteAll(log->fd, log->buf, log->len) || fdatasync(log->fd) != 0) {
+      log->failed = true;
+    }
+    log->len = 0;
+  }
+  return !log->failed;
+}
+
+bool HTLog_Close(HTLog *log) {
+  bool ok = HTLog_Sync(log);
+
+  ok = close(log->fd) == 0 && ok;
+  free(log->buf);
+  free(log);
+  return ok;
+}
+
+void HashTable_AttachLog(HashTable *table, HTLog *log) {
+  Verify333(table != NULL);
+  table->log = log;
+}
+
+bool HTLog_Compact(HTLog *log, HashTable *table, const char *snapshot_path) {
+  Verify333(log != NULL && table != NULL);
+  if (!HashTable_SaveSnapshot(table, snapshot_path,
+                              log->value_serialize_function)) {
+    return false;
+  }
+  // Everything waiting in the buffer is in the snapshot now.
+  log->len = 0;
+  if (ftruncate(log->fd, sizeof(LogHeader)) != 0 || fdatasync(log->fd) != 0) {
+    log->failed = true;
+  }
+  return !log->failed;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Recovery.
+
+// If a whole, intact record starts at offset off of a log of size bytes,
+// return its total size; otherwise return 0.
+static size_t LogValidRecord(const unsigned char *base, size_t size,
+                             size_t off) {
+  const LogRecord *rec = (const LogRecord *) (base + off);
+  size_t padded;
+
+  if (size - off < sizeof(LogRecord)) {
+    return 0;
+  }
+  if (rec->op != HT_LOG_INSERT && rec->op != HT_LOG_REMOVE) {
+    return 0;
+  }
+  padded = RoundUpTo8(rec->value_size);
+  if (size - off - sizeof(LogRecord) < padded) {
+    return 0;
+  }
+  if (LogRecordChecksum(rec, base + off + sizeof(LogRecord), padded) !=
+      rec->checksum) {
+    return 0;
+  }
+  return sizeof(LogRecord) + padded;
+}
+
+HashTable* HTLog_Recover(const char *snapshot_path,
+                         const char *log_path,
+                         HTEngine_t engine,
+                         ValueDeserializeFnPtr value_deserialize_function,
+                         ValueFreeFnPtr value_free_function) {
+  HashTable *table;
+  const unsigned char *base;
+  const LogHeader *header;
+  struct stat st;
+  int64_t num_elements;
+  size_t off, end, n;
+  int fd;
+
+  Verify333(value_deserialize_function != NULL &&
+            value_free_function != NULL);
+
+  if (snapshot_path != NULL && access(snapshot_path, F_OK) == 0) {
+    table = HashTable_LoadSnapshot(snapshot_path, engine,
+                                   value_deserialize_function);
+    if (table == NULL) {
+      return NULL;
+    }
+  } else {
+    table = HashTable_AllocateEngine(1, engine);
+  }
+
+  fd = open(log_path, O_RDONLY);
+  if (fd < 0) {
+    return table;
+  }
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    HashTable_Free(table, value_free_function);
+    return NULL;
+  }
+  // A log whose header never made it to disk has nothing in it.
+  if (st.st_size < (off_t) sizeof(LogHeader)) {
+    close(fd);
+    return table;
+  }
+  base = (const unsigned char *) mmap(NULL, st.st_size, PROT_READ,
+                                      MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    HashTable_Free(table, value_free_function);
+    return NULL;
+  }
+  header = (const LogHeader *) base;
+  if (header->magic != LOG_MAGIC || header->version != LOG_VERSION) {
+    munmap((void *) base, st.st_size);
+    HashTable_Free(table, value_free_function);
+    return NULL;
+  }
+
+  // Pass 1: find the end of the intact records and presize the table for
+  // them.  Removes are only logged when they remove something, but an
+  // Insert is logged whether it adds a key or replaces one, so this is
+  // only an upper bound: a log of many updates to a few keys overshoots
+  // it badly.  The ShrinkToFit after replay takes care of that.
+  num_elements = HashTable_NumElements(table);
+  for (off = sizeof(LogHeader);
+       (n = LogValidRecord(base, st.st_size, off)) > 0; off += n) {
+    num_elements += ((const LogRecord *) (base + off))->op == HT_LOG_INSERT ?
+                    1 : -1;
+  }
+  end = off;
+  if (num_elements > INT32_MAX) {
+    num_elements = INT32_MAX;
+  }
+  if (num_elements > 0) {
+    HashTable_Reserve(table, (int) num_elements);
+  }
+
+  // Pass 2: replay them.
+  for (off = sizeof(LogHeader); off < end;
+       off += sizeof(LogRecord) +
+              RoundUpTo8(((const LogRecord *) (base + off))->value_size)) {
+    const LogRecord *rec = (const LogRecord *) (base + off);
+    HTKeyValue_t kv, old;
+    if (rec->op == HT_LOG_INSERT) {
+      kv.key = rec->key;
+      kv.value = value_deserialize_function(base + off + sizeof(LogRecord),
+                                            rec->value_size);
+      if (HashTable_Insert(table, kv, &old)) {
+        value_free_function(old.value);
+      }
+    } else if (HashTable_Remove(table, rec->key, &old)) {
+      value_free_function(old.value);
+    }
+  }
+
+  munmap((void *) base, st.st_size);
+
+  // Give back whatever the presizing overshot by, and drop the floor the
+  // Reserve set, so the table can shrink later like any other.  When the
+  // records were all new keys, this leaves the table as it is.
+  HashTable_ShrinkToFit(table);
+  if (end < (size_t) st.st_size && truncate(log_path, end) != 0) {
+    HashTable_Free(table, value_free_function);
+    return NULL;
+  }
+  return table;
+}
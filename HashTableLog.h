@@ -0,0 +1,136 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_HASHTABLELOG_H_
+#define HW1_HASHTABLELOG_H_
+
+#include <stdbool.h>    // for bool type (true, false)
+
+#include "./HashTable.h"
+#include "./HashTableSnapshot.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A write-ahead log for a HashTable.
+//
+// Once a log is attached to a table, every HashTable_Insert (including
+// the batch and bulk variants that go through it) and every successful
+// HashTable_Remove or HTIterator_Remove appends a record to the log.  The
+// records are buffered in memory and then written and flushed to disk
+// together with one fdatasync ("group commit"), which is far cheaper than
+// a sync per operation.  The price is that a crash loses the records still
+// in the buffer: at most group_bytes bytes' or group_ms milliseconds'
+// worth.
+//
+// After a crash, HTLog_Recover rebuilds the table from the last baseline
+// snapshot (see HashTableSnapshot.h) plus the log.  To keep the log, and
+// recovery, from growing forever, HTLog_Compact writes the table out as a
+// new baseline and empties the log.
+//
+// A typical life cycle:
+//
+//   table = HTLog_Recover("t.snap", "t.log", engine, deserialize, free);
+//   log = HTLog_Open("t.log", serialize, 64 * 1024, 10);
+//   HashTable_AttachLog(table, log);
+//   ... HashTable_Insert / HashTable_Remove ...
+//   HTLog_Compact(log, table, "t.snap");   // every so often
+//   ...
+//   HTLog_Close(log);
+//
+// A log is no more thread-safe than the table it is attached to.
+typedef struct htlog HTLog;
+
+// Open a log for appending, creating it if it doesn't exist.  After a
+// crash, run HTLog_Recover on the file first: it cuts off any torn record
+// at the end, which appending would otherwise leave in the middle.
+//
+// Arguments:
+// - path: the log file.
+// - value_serialize_function: turns each inserted value into bytes; see
+//   HashTableSnapshot.h.
+// - group_bytes: sync once this many bytes of records are waiting.
+// - group_ms: sync once the oldest waiting record is this many
+//   milliseconds old.  This is checked whenever a record is added, so a
+//   table that goes quiet should call HTLog_Sync.
+//   If either group_bytes or group_ms is 0, every record is synced as soon
+//   as it is added.
+//
+// Returns the log, or NULL if the file couldn't be opened or isn't a log.
+HTLog* HTLog_Open(const char *path,
+                  ValueSerializeFnPtr value_serialize_function,
+                  int group_bytes,
+                  int group_ms);
+
+// Write out and sync every waiting record.
+//
+// Returns false if this or any earlier write or sync to the log failed
+// (records can be lost silently otherwise, since HashTable_Insert and
+// HashTable_Remove have no way to report it).
+bool HTLog_Sync(HTLog *log);
+
+// Sync and close a log.  Any table it is attached to must be detached
+// (or freed) first.
+//
+// Returns as for HTLog_Sync.
+bool HTLog_Close(HTLog *log);
+
+// Attach a log to a table, so that the table's changes from now on are
+// recorded in it, or detach the table's log (if log is NULL).  A log may
+// only be attached to one table at a time.  HashTable_Free doesn't close
+// the log.
+void HashTable_AttachLog(HashTable *table, HTLog *log);
+
+// Save table as a new baseline snapshot and empty the log.  The table
+// must be the one whose changes the log records.
+//
+// If there's a crash part way through, recovery may find the new baseline
+// together with the old log.  That is still right: replaying the old
+// records onto a table that already reflects them leaves each key as its
+// last record left it, which is what the baseline says too.
+//
+// Arguments:
+// - log: the log to empty.
+// - table: the table to save.
+// - snapshot_path: the baseline snapshot to replace.
+//
+// Returns false if the snapshot couldn't be written (in which case the log
+// is left alone) or the log couldn't be emptied.
+bool HTLog_Compact(HTLog *log, HashTable *table, const char *snapshot_path);
+
+// Rebuild a table from a baseline snapshot and a log.
+//
+// The log is read twice: once to check each record's checksum and to
+// count the records, so that the table can be grown just once up front,
+// and once to replay them in order.  Because an Insert record may only
+// replace a value, that count can overshoot, so the table is shrunk to fit
+// its final contents after replay (see HashTable_ShrinkToFit), which also
+// leaves it free to shrink later.  Reading stops at the first record that
+// is incomplete or damaged, which is what a crash part way through a write
+// leaves behind, and the log file is cut back to just before it.
+//
+// Arguments:
+// - snapshot_path: the baseline snapshot.  If it is NULL or the file
+//   doesn't exist, the table starts out empty.
+// - log_path: the log.  If the file doesn't exist, there is nothing to
+//   replay.
+// - engine: which engine the new table should use; see HTEngine_t.
+// - value_deserialize_function: turns saved values back into values.
+// - value_free_function: frees each value that a later record replaces or
+//   removes during the replay.
+//
+// Returns the new table (with no log attached), or NULL if the snapshot
+// or the log exists but isn't valid.
+HashTable* HTLog_Recover(const char *snapshot_path,
+                         const char *log_path,
+                         HTEngine_t engine,
+                         ValueDeserializeFnPtr value_deserialize_function,
+                         ValueFreeFnPtr value_free_function);
+
+#endif  // HW1_HASHTABLELOG_H_
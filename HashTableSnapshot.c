@@ -0,0 +1,548 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // for fileno, fsync, mmap and clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "HashTableSnapshot.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// The file layout.
+//
+//   SnapHeader
+//   values       each value's bytes, zero-padded to a multiple of 8
+//   buckets      num_buckets + 1 uint32_t's: bucket b's entries are
+//                entries[buckets[b]] up to (not including)
+//                entries[buckets[b + 1]]
+//   entries      num_elements SnapEntry's, sorted by bucket
+//
+// Every section starts at a multiple of 8 and the file's size is a
+// multiple of 8.  The bucket of a key is the low bits of HTMixKey(key), as
+// in a chained HashTable, and there are about as many buckets as entries,
+// so a Find usually reads one bucket index, one entry and the value.
+
+// "HT333SNP" as a big-endian number.  Read with the wrong byte order it
+// comes out as a different number, so such files are rejected.
+#define SNAP_MAGIC 0x48543333334E5350ULL
+#define SNAP_VERSION 1
+
+typedef struct snap_header {
+  uint64_t  magic;         // SNAP_MAGIC
+  uint32_t  version;       // SNAP_VERSION
+  uint32_t  header_size;   // sizeof(SnapHeader)
+  uint64_t  file_size;     // the size of the whole file
+  uint64_t  checksum;      // see SnapHeaderChecksum
+  uint64_t  num_elements;  // # of entries
+  uint64_t  num_buckets;   // # of buckets, a power of two
+  uint64_t  buckets_off;   // file offset of the bucket index
+  uint64_t  entries_off;   // file offset of the entries
+} SnapHeader;
+
+typedef struct snap_entry {
+  uint64_t  key;         // the key
+  uint64_t  value_off;   // file offset of the value's bytes
+  uint64_t  value_size;  // # of bytes in the value (before padding)
+} SnapEntry;
+
+struct mht {
+  const unsigned char  *base;     // the mapping
+  size_t                size;     // the mapping's (and file's) size
+  const SnapHeader     *header;   // == base
+  const uint32_t       *buckets;  // the bucket index, in the mapping
+  const SnapEntry      *entries;  // the entries, in the mapping
+};
+
+// The checksum (see HTChecksum) of a file is that of everything after the
+// header, followed by the header itself with its checksum field set to
+// zero, starting from SNAP_MAGIC.  That order lets the writer stream the
+// body out first and fill in the header at the end.
+static uint64_t SnapHeaderChecksum(uint64_t sum, const SnapHeader *header) {
+  SnapHeader copy = *header;
+
+  copy.checksum = 0;
+  return HTChecksum(sum, &copy, sizeof(copy));
+}
+
+static uint64_t RoundUpTo8(uint64_t n) {
+  return (n + 7) & ~(uint64_t) 7;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Saving.
+
+// Writes the body of a snapshot, keeping track of where it is and of the
+// checksum so far.
+typedef struct snap_writer {
+  FILE      *file;
+  uint64_t   offset;    // file offset of the next byte
+  uint64_t   checksum;  // of everything written through SnapWrite
+  bool       ok;        // have all the writes succeeded?
+} SnapWriter;
+
+static void SnapWrite(SnapWriter *w, const void *buf, size_t len) {
+  if (len > 0 && fwrite(buf, 1, len, w->file) != len) {
+    w->ok = false;
+  }
+  w->offset += len;
+  w->checksum = HTChecksum(w->checksum, buf, len);
+}
+
+// Write the whole snapshot of a table whose (key,value)s are in kvs, sorted
+// by bucket, with bucket starts in starts.  The header goes first as a
+// placeholder and is rewritten at the end.
+static bool SnapWriteFile(FILE *file, const HTKeyValue_t *kvs, int n,
+                          const uint32_t *starts, int num_buckets,
+                          ValueSerializeFnPtr value_serialize_function) {
+  SnapWriter w = { file, sizeof(SnapHeader), SNAP_MAGIC, true };
+  SnapHeader header;
+  SnapEntry *entries = (SnapEntry *) malloc((n + 1) * sizeof(SnapEntry));
+  size_t cap = 256;
+  unsigned char *buf = (unsigned char *) malloc(cap);
+  int i;
+
+  Verify333(entries != NULL && buf != NULL);
+  memset(&header, 0, sizeof(header));
+  w.ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  for (i = 0; i < n && w.ok; i++) {
+    size_t size = value_serialize_function(kvs[i].value, buf, cap);
+    if (RoundUpTo8(size) > cap) {
+      cap = RoundUpTo8(size);
+      free(buf);
+      buf = (unsigned char *) malloc(cap);
+      Verify333(buf != NULL);
+      Verify333(value_serialize_function(kvs[i].value, buf, cap) == size);
+    }
+    memset(buf + size, 0, RoundUpTo8(size) - size);
+    entries[i].key = kvs[i].key;
+    entries[i].value_off = w.offset;
+    entries[i].value_size = size;
+    SnapWrite(&w, buf, RoundUpTo8(size));
+  }
+
+  header.buckets_off = w.offset;
+  SnapWrite(&w, starts, RoundUpTo8((num_buckets + 1) * sizeof(uint32_t)));
+  header.entries_off = w.offset;
+  SnapWrite(&w, entries, n * sizeof(SnapEntry));
+
+  header.magic = SNAP_MAGIC;
+  header.version = SNAP_VERSION;
+  header.header_size = sizeof(SnapHeader);
+  header.file_size = w.offset;
+  header.num_elements = n;
+  header.num_buckets = num_buckets;
+  header.checksum = SnapHeaderChecksum(w.checksum, &header);
+  if (w.ok) {
+    w.ok = fseek(file, 0, SEEK_SET) == 0 &&
+           fwrite(&header, sizeof(header), 1, file) == 1;
+  }
+
+  free(buf);
+  free(entries);
+  return w.ok;
+}
+
+bool HashTable_SaveSnapshot(HashTable *table, const char *path,
+                            ValueSerializeFnPtr value_serialize_function) {
+  int n = HashTable_NumElements(table);
+  int num_buckets = RoundUpToPowerOfTwo(n);
+  HTKeyValue_t *kvs = (HTKeyValue_t *) malloc((n + 1) * sizeof(HTKeyValue_t));
+  HTKeyValue_t *sorted =
+    (HTKeyValue_t *) malloc((n + 1) * sizeof(HTKeyValue_t));
+  // One spare slot past the end keeps the padded write in bounds.
+  uint32_t *starts = (uint32_t *) calloc(num_buckets + 2, sizeof(uint32_t));
+  char *tmp_path = (char *) malloc(strlen(path) + 5);
+  HTIterator *it;
+  FILE *file;
+  bool ok;
+  int i, b;
+
+  Verify333(value_serialize_function != NULL);
+  Verify333(kvs != NULL && sorted != NULL && starts != NULL &&
+            tmp_path != NULL);
+
+  // Pull out every (key,value) and counting-sort them by bucket.
+  it = HTIterator_Allocate(table);
+  for (i = 0; HTIterator_IsValid(it); HTIterator_Next(it), i++) {
+    HTIterator_Get(it, &kvs[i]);
+    starts[(HTMixKey(kvs[i].key) & (uint64_t) (num_buckets - 1)) + 1]++;
+  }
+  HTIterator_Free(it);
+  Verify333(i == n);
+  for (b = 0; b < num_buckets; b++) {
+    starts[b + 1] += starts[b];
+  }
+  for (i = 0; i < n; i++) {
+    b = (int) (HTMixKey(kvs[i].key) & (uint64_t) (num_buckets - 1));
+    sorted[starts[b]++] = kvs[i];
+  }
+  // Each start has moved up to the next bucket's; shift them back.
+  for (b = num_buckets; b > 0; b--) {
+    starts[b] = starts[b - 1];
+  }
+  starts[0] = 0;
+
+  snprintf(tmp_path, strlen(path) + 5, "%s.tmp", path);
+  file = fopen(tmp_path, "wb");
+  ok = file != NULL;
+  if (ok) {
+    ok = SnapWriteFile(file, sorted, n, starts, num_buckets,
+                       value_serialize_function);
+    ok = fflush(file) == 0 && ok;
+    ok = fsync(fileno(file)) == 0 && ok;
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok) {
+      remove(tmp_path);
+    }
+  }
+
+  free(tmp_path);
+  free(starts);
+  free(sorted);
+  free(kvs);
+  return ok;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Mapping.
+
+// Check that a mapping of size bytes holds a well-formed snapshot header
+// whose sections all fit inside the mapping.
+static bool SnapCheckHeader(const unsigned char *base, size_t size) {
+  const SnapHeader *h = (const SnapHeader *) base;
+
+  if (size < sizeof(SnapHeader) || size % 8 != 0) {
+    return false;
+  }
+  if (h->magic != SNAP_MAGIC || h->version != SNAP_VERSION ||
+      h->header_size != sizeof(SnapHeader) || h->file_size != size) {
+    return false;
+  }
+  if (h->num_elements > INT32_MAX || h->num_buckets == 0 ||
+      h->num_buckets > ((uint64_t) 1 << 30) ||
+      (h->num_buckets & (h->num_buckets - 1)) != 0) {
+    return false;
+  }
+  if (h->buckets_off < sizeof(SnapHeader) || h->buckets_off % 8 != 0 ||
+      h->buckets_off > size ||
+      (h->num_buckets + 1) * sizeof(uint32_t) > size - h->buckets_off) {
+    return false;
+  }
+  if (h->entries_off < sizeof(SnapHeader) || h->entries_off % 8 != 0 ||
+      h->entries_off > size ||
+      h->num_elements * sizeof(SnapEntry) > size - h->entries_off) {
+    return false;
+  }
+  return true;
+}
+
+MappedHashTable* MappedHashTable_Open(const char *path,
+                                      bool verify_checksum) {
+  MappedHashTable *table;
+  struct stat st;
+  void *base;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SnapHeader)) {
+    close(fd);
+    return NULL;
+  }
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // the mapping keeps the file open
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  table = (MappedHashTable *) malloc(sizeof(MappedHashTable));
+  Verify333(table != NULL);
+  table->base = (const unsigned char *) base;
+  table->size = st.st_size;
+  table->header = (const SnapHeader *) base;
+  if (!SnapCheckHeader(table->base, table->size) ||
+      (verify_checksum &&
+       SnapHeaderChecksum(HTChecksum(SNAP_MAGIC,
+                                       table->base + sizeof(SnapHeader),
+                                       table->size - sizeof(SnapHeader)),
+                          table->header) != table->header->checksum)) {
+    MappedHashTable_Close(table);
+    return NULL;
+  }
+  table->buckets =
+    (const uint32_t *) (table->base + table->header->buckets_off);
+  table->entries =
+    (const SnapEntry *) (table->base + table->header->entries_off);
+  return table;
+}
+
+void MappedHashTable_Close(MappedHashTable *table) {
+  Verify333(table != NULL);
+  munmap((void *) table->base, table->size);
+  free(table);
+}
+
+int MappedHashTable_NumElements(MappedHashTable *table) {
+  Verify333(table != NULL);
+  return (int) table->header->num_elements;
+}
+
+// Whether entry e's value lies inside the mapping.
+static bool SnapValueInBounds(MappedHashTable *table, const SnapEntry *e) {
+  return e->value_off <= table->size &&
+         e->value_size <= table->size - e->value_off;
+}
+
+bool MappedHashTable_Find(MappedHashTable *table,
+                          HTKey_t key,
+                          HTKeyValue_t *keyvalue,
+                          size_t *value_size) {
+  uint64_t b;
+  uint32_t i, stop;
+
+  Verify333(table != NULL);
+  b = HTMixKey(key) & (table->header->num_buckets - 1);
+  i = table->buckets[b];
+  stop = table->buckets[b + 1];
+
+  // The header check guarantees the bucket index and the entries are in
+  // the mapping, but (unless the checksum was checked) not that the index
+  // points inside the entries.
+  if (stop > table->header->num_elements) {
+    stop = (uint32_t) table->header->num_elements;
+  }
+  for (; i < stop; i++) {
+    const SnapEntry *e = &table->entries[i];
+    if (e->key != key) {
+      continue;
+    }
+    if (!SnapValueInBounds(table, e)) {
+      return false;
+    }
+    keyvalue->key = key;
+    keyvalue->value = (HTValue_t) (table->base + e->value_off);
+    if (value_size != NULL) {
+      *value_size = e->value_size;
+    }
+    return true;
+  }
+  return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Loading.
+
+HashTable* HashTable_LoadSnapshot(const char *path, HTEngine_t engine,
+                                  ValueDeserializeFnPtr
+                                  value_deserialize_function) {
+  MappedHashTable *snap = MappedHashTable_Open(path, true);
+  HashTable *table;
+  HTKeyValue_t *kvs;
+  int n, i;
+
+  Verify333(value_deserialize_function != NULL);
+  if (snap == NULL) {
+    return NULL;
+  }
+  n = MappedHashTable_NumElements(snap);
+  for (i = 0; i < n; i++) {
+    if (!SnapValueInBounds(snap, &snap->entries[i])) {
+      MappedHashTable_Close(snap);
+      return NULL;
+    }
+  }
+
+  kvs = (HTKeyValue_t *) malloc((n + 1) * sizeof(HTKeyValue_t));
+  Verify333(kvs != NULL);
+  for (i = 0; i < n; i++) {
+    const SnapEntry *e = &snap->entries[i];
+    kvs[i].key = e->key;
+    kvs[i].value = value_deserialize_function(snap->base + e->value_off,
+                                              e->value_size);
+  }
+  // The snapshot came from a HashTable, so its keys are unique.
+  table = HashTable_Build(engine, kvs, n, true, NULL);
+
+  free(kvs);
+  MappedHashTable_Close(snap);
+  return table;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Background checkpoints.
+
+struct htckpt {
+  pid_t     pid;       // the child
+  int       fd;        // the read end of the child's CkptReport pipe
+  int64_t   start_ns;  // when HashTable_StartCheckpoint was called
+  int64_t   fork_ns;   // how long fork() took
+  bool      exited;    // has the child been reaped?
+  int       status;    // if so, its wait status
+};
+
+// What the child sends back through the pipe just before it exits.
+typedef struct ckpt_report {
+  int64_t   end_ns;     // when the snapshot was in place
+  int64_t   cow_bytes;  // see HTCheckpointStats
+  int32_t   ok;         // did HashTable_SaveSnapshot succeed?
+} CkptReport;
+
+static int64_t CkptNowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// The memory that only this process maps and has written to.  In the
+// child right after the fork that is (almost) nothing; every page that
+// either side writes to afterwards shows up here, since the page the child
+// keeps is no longer shared with anyone.  Returns -1 without Linux's
+// /proc/self/smaps.
+static int64_t CkptPrivateDirtyBytes(void) {
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  char line[256];
+  int64_t kb, total = 0;
+  bool found = false;
+
+  if (f == NULL) {
+    f = fopen("/proc/self/smaps", "r");
+  }
+  if (f == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "Private_Dirty: %" SCNd64 " kB", &kb) == 1) {
+      total += kb;
+      found = true;
+    }
+  }
+  fclose(f);
+  return found ? total * 1024 : -1;
+}
+
+HTCheckpoint* HashTable_StartCheckpoint(HashTable *table, const char *path,
+                                        ValueSerializeFnPtr
+                                        value_serialize_function) {
+  HTCheckpoint *checkpoint;
+  int fds[2];
+  pid_t pid;
+  int64_t start_ns, forked_ns;
+
+  Verify333(table != NULL && value_serialize_function != NULL);
+  if (pipe(fds) != 0) {
+    return NULL;
+  }
+
+  // Anything buffered in stdio would otherwise be written twice.
+  fflush(NULL);
+  start_ns = CkptNowNs();
+  pid = fork();
+  forked_ns = CkptNowNs();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return NULL;
+  }
+
+  if (pid == 0) {
+    // The child.  It must not return into the caller's code, nor run its
+    // atexit handlers, so it leaves with _exit.  The save frees its
+    // working memory before returning, so by the time the child measures
+    // its private memory, what's left is (nearly) all copy on write.
+    CkptReport report;
+
+    close(fds[0]);
+    memset(&report, 0, sizeof(report));
+    report.ok = HashTable_SaveSnapshot(table, path, value_serialize_function);
+    report.end_ns = CkptNowNs();
+    report.cow_bytes = CkptPrivateDirtyBytes();
+    // The report is smaller than PIPE_BUF, so this write is all or
+    // nothing and never blocks.
+    if (write(fds[1], &report, sizeof(report)) != sizeof(report)) {
+      _exit(EXIT_FAILURE);
+    }
+    _exit(report.ok ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+  checkpoint = (HTCheckpoint *) malloc(sizeof(HTCheckpoint));
+  Verify333(checkpoint != NULL);
+  checkpoint->pid = pid;
+  checkpoint->fd = fds[0];
+  checkpoint->start_ns = start_ns;
+  checkpoint->fork_ns = forked_ns - start_ns;
+  checkpoint->exited = false;
+  checkpoint->status = 0;
+  return checkpoint;
+}
+
+bool HTCheckpoint_Done(HTCheckpoint *checkpoint) {
+  Verify333(checkpoint != NULL);
+  if (!checkpoint->exited &&
+      waitpid(checkpoint->pid, &checkpoint->status, WNOHANG) ==
+      checkpoint->pid) {
+    checkpoint->exited = true;
+  }
+  return checkpoint->exited;
+}
+
+bool HTCheckpoint_Finish(HTCheckpoint *checkpoint, HTCheckpointStats *stats) {
+  CkptReport report;
+  bool have_report;
+  bool ok;
+
+  Verify333(checkpoint != NULL);
+  while (!checkpoint->exited) {
+    pid_t r = waitpid(checkpoint->pid, &checkpoint->status, 0);
+    if (r == checkpoint->pid) {
+      checkpoint->exited = true;
+    } else {
+      Verify333(r < 0 && errno == EINTR);
+    }
+  }
+
+  // A child that died before it could report leaves the pipe empty.
+  have_report = read(checkpoint->fd, &report, sizeof(report)) ==
+                sizeof(report);
+  ok = have_report && report.ok && WIFEXITED(checkpoint->status) &&
+       WEXITSTATUS(checkpoint->status) == EXIT_SUCCESS;
+
+  if (stats != NULL) {
+    stats->fork_ns = checkpoint->fork_ns;
+    stats->duration_ns =
+      (have_report ? report.end_ns : CkptNowNs()) - checkpoint->start_ns;
+    stats->cow_bytes = have_report ? report.cow_bytes : -1;
+  }
+  close(checkpoint->fd);
+  free(checkpoint);
+  return ok;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_HASHTABLESNAPSHOT_H_
+#define HW1_HASHTABLESNAPSHOT_H_
+
+#include <stdbool.h>    // for bool type (true, false)
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for int64_t
+
+#include "./HashTable.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// HashTable snapshot files.
+//
+// A snapshot is a file holding every (key,value) of a HashTable, laid out
+// so that it can be searched in place: a header, the serialized values,
+// then a bucket index and the entries sorted by bucket.  Everything in the
+// file refers to everything else by its offset from the start of the file,
+// so the file can be mapped at any address and used without any fixing
+// up.  The header carries a format version and a checksum of the whole
+// file.  Numbers are stored in the writing machine's byte order; a
+// snapshot written on a machine of the other byte order is rejected as
+// not being a snapshot.
+//
+// A snapshot can be turned back into an ordinary HashTable with
+// HashTable_LoadSnapshot, or mapped read-only with MappedHashTable_Open,
+// which does no per-entry work at all: Find reads straight off the mapped
+// pages, and the operating system pages the file in as it is used.
+
+// Values are saved through a customer-supplied function that turns a
+// value into bytes.  Like snprintf, it writes at most "size" bytes to
+// "buf" and returns how many bytes the whole value needs; if that is more
+// than "size", it is called again with a buffer that big.
+typedef size_t (*ValueSerializeFnPtr)(HTValue_t value, void *buf,
+                                      size_t size);
+
+// And loaded through one that turns "size" bytes back into a value.
+typedef HTValue_t (*ValueDeserializeFnPtr)(const void *bytes, size_t size);
+
+// Save a snapshot of a HashTable.
+//
+// The snapshot is written to a temporary file next to "path", flushed to
+// disk, and then renamed over "path", so a crash part way through never
+// leaves a half-written snapshot behind.
+//
+// Arguments:
+// - table: the HashTable to save.  It is not modified.
+// - path: the file to write.
+// - value_serialize_function: turns each value into bytes; see above.
+//
+// Returns false (leaving "path" as it was) if the file couldn't be
+// written, true otherwise.
+bool HashTable_SaveSnapshot(HashTable *table, const char *path,
+                            ValueSerializeFnPtr value_serialize_function);
+
+// Load a snapshot into a new HashTable.  The file's checksum is always
+// verified.
+//
+// Arguments:
+// - path: the snapshot file to read.
+// - engine: which engine the new table should use; see HTEngine_t.
+// - value_deserialize_function: turns each saved value's bytes back into
+//   a value; see above.
+//
+// Returns the new HashTable, or NULL if the file couldn't be read or
+// isn't a valid snapshot.
+HashTable* HashTable_LoadSnapshot(const char *path, HTEngine_t engine,
+                                  ValueDeserializeFnPtr
+                                  value_deserialize_function);
+
+// A read-only hash table that lives in a mapped snapshot file.
+typedef struct mht MappedHashTable;
+
+// Map a snapshot file.
+//
+// The header is always checked.  Checking the checksum means reading the
+// whole file, which is exactly what mapping it is meant to avoid, so it is
+// optional.  Without it, a damaged file may give wrong answers, but Find
+// still never reads outside the mapping.
+//
+// Arguments:
+// - path: the snapshot file to map.
+// - verify_checksum: whether to verify the file's checksum now.
+//
+// Returns the mapped table, or NULL if the file couldn't be mapped or
+// isn't a valid snapshot.
+MappedHashTable* MappedHashTable_Open(const char *path,
+                                      bool verify_checksum);
+
+// Unmap a snapshot.  Values returned by MappedHashTable_Find become
+// invalid.
+void MappedHashTable_Close(MappedHashTable *table);
+
+// Returns the number of elements in the snapshot.
+int MappedHashTable_NumElements(MappedHashTable *table);
+
+// Looks up a key in the snapshot.
+//
+// Arguments:
+// - table: the MappedHashTable to look in.
+// - key: the key to look up.
+// - keyvalue: if the key is present, its key and a pointer to its
+//   serialized bytes (inside the mapping, so read-only, and aligned to 8
+//   bytes) are returned through this parameter.
+// - value_size: if not NULL and the key is present, the number of
+//   serialized bytes is returned through this parameter.
+//
+// Returns whether the key was found.
+bool MappedHashTable_Find(MappedHashTable *table,
+                          HTKey_t key,
+                          HTKeyValue_t *keyvalue,
+                          size_t *value_size);
+
+///////////////////////////////////////////////////////////////////////////////
+// Background checkpoints.
+//
+// Saving a big table takes seconds, during which the table can't change.
+// A checkpoint instead fork()s: the child process sees the table exactly
+// as it was at the fork and saves it with HashTable_SaveSnapshot, while
+// the parent goes on changing its own copy.  The two share the table's
+// memory until one of them writes to a page, at which point the operating
+// system gives the writer its own copy of that page ("copy on write").  So
+// the memory a checkpoint costs is the pages the parent writes to while it
+// runs, plus the child's working memory for the save (about 32 bytes per
+// element, freed before the child exits).
+//
+// Forking copies only the calling thread, so no other thread may be
+// changing the table while HashTable_StartCheckpoint runs.
+typedef struct htckpt HTCheckpoint;
+
+typedef struct ht_checkpoint_stats {
+  int64_t  fork_ns;      // how long fork() held up the caller
+  int64_t  duration_ns;  // from the start until the snapshot was in place
+  int64_t  cow_bytes;    // memory copied on write by the time the child
+                         // finished, or -1 if it couldn't be measured
+} HTCheckpointStats;
+
+// Start saving a snapshot of a table in a child process.
+//
+// Arguments:
+// - table: the HashTable to save.  The caller may go on changing it, and
+//   freeing values it takes out, as soon as this returns; the snapshot
+//   holds the table as it was at the call.
+// - path: the file to write, as for HashTable_SaveSnapshot.  Only one
+//   checkpoint at a time may write to a given path.
+// - value_serialize_function: turns each value into bytes, as for
+//   HashTable_SaveSnapshot.  It runs in the child.
+//
+// Returns the running checkpoint, or NULL if the child couldn't be
+// started.
+HTCheckpoint* HashTable_StartCheckpoint(HashTable *table, const char *path,
+                                        ValueSerializeFnPtr
+                                        value_serialize_function);
+
+// Returns whether a checkpoint's child has finished, without waiting.
+bool HTCheckpoint_Done(HTCheckpoint *checkpoint);
+
+// Wait for a checkpoint to finish and free it.
+//
+// Arguments:
+// - checkpoint: the checkpoint.
+// - stats: if not NULL, the checkpoint's timings and copy-on-write
+//   overhead are returned through this parameter.
+//
+// Returns whether the snapshot was written.
+bool HTCheckpoint_Finish(HTCheckpoint *checkpoint, HTCheckpointStats *stats);
+
+#endif  // HW1_HASHTABLESNAPSHOT_H_
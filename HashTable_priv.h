@@ -12,9 +12,11 @@
 #ifndef HW1_HASHTABLE_PRIV_H_
 #define HW1_HASHTABLE_PRIV_H_
 
+#include <stddef.h>  // for size_t
 #include <stdint.h>  // for uint32_t, etc.
 
 #include "./LinkedList.h"
+#include "./LinkedList_priv.h"
 #include "./HashTable.h"
 
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
@@ -29,25 +31,271 @@
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
 
+// A single slot of a Robin Hood table.
+//
+// "dist" is one more than the slot's distance from the key's home slot, so
+// that a zero dist marks the slot as empty.
+typedef struct rh_slot {
+  HTKey_t     key;    // the key stored in this slot
+  HTValue_t   value;  // the value stored in this slot
+  uint32_t    dist;   // 1 + probe distance from home, or 0 if empty
+} RHSlot;
+
+// An entry in a chained table's bucket.
+//
+// The chain's LinkedListNode is embedded at the start of the entry, and its
+// payload points at the entry's own kv, so each (key,value) costs a single
+// allocation and a lookup reads the key straight out of the node it is
+// walking.  Because the node comes first, the LinkedList code's free(node)
+// releases the whole entry.
+typedef struct ht_entry {
+  LinkedListNode  node;  // the chain links; node.payload == &kv
+  HTKeyValue_t    kv;    // the (key,value) pair
+} HTEntry;
+
+// The bucket array of a read-mostly table, as published to readers.
+//
+// The writer never changes a published snapshot's size or array; a resize
+// builds a new snapshot, swaps it in and retires the old one.  Readers
+// load the snapshot pointer once, so they always see a bucket count and
+// bucket array that belong together.
+typedef struct ht_snapshot {
+  int             num_buckets;  // # of buckets in "buckets"
+  LinkedList    **buckets;      // the array of buckets
+} HTSnapshot;
+
 // The hash table implementation.
 //
-// A hash table is an array of buckets, where each bucket is a linked list
-// of HTKeyValue structs.
+// A chained hash table is an array of buckets, where each bucket is a linked
+// list of HTEntry structs.  The open-addressing engines leave "buckets"
+// NULL and keep their entries in their own arrays instead; for them,
+// "num_buckets" is the number of slots.
+//
+// A chained table resizes incrementally.  While a resize is in progress,
+// "buckets" is the new (bigger) array, in which only the buckets fed by
+// already-migrated old buckets exist (the rest are NULL), and
+// "old_buckets" is the old array, in which buckets [0, migrate_idx) have
+// been migrated and freed (set to NULL).
+//
+// A shrink migrates the same way, except that several old buckets feed
+// each new bucket instead of the other way around.
+//
+// Each bucket array has an occupancy bitmap, "occupied" for "buckets" and
+// "old_occupied" for "old_buckets": bit i is set exactly when bucket i's
+// chain exists and is non-empty.  The iterator uses it to skip straight
+// to the next non-empty bucket instead of visiting every empty one.
+//
+// A read-mostly table never has a resize in progress, and "snapshot"
+// always holds the same "num_buckets" and "buckets" for readers.
 typedef struct ht {
   int             num_buckets;   // # of buckets in this HT?
   int             num_elements;  // # of elements currently in this HT?
   LinkedList    **buckets;       // the array of buckets
+  LinkedList    **old_buckets;   // buckets being migrated away, or NULL
+  uint64_t       *occupied;      // (chained) occupancy bitmap of buckets
+  uint64_t       *old_occupied;  // occupancy bitmap of old_buckets, or NULL
+  int             old_num_buckets;  // # of buckets in old_buckets, or 0
+  int             migrate_idx;   // next old bucket to migrate
+  int             migrate_step;  // # old buckets to migrate per op (0 = all)
+  int             min_buckets;   // never shrink below this many on our own
+  HTEngine_t      engine;        // which engine implements this HT?
+  RHSlot         *slots;         // (robin hood) the array of slots
+  uint8_t        *ctrl;          // (swiss) one control byte per slot
+  HTKeyValue_t   *entries;       // (swiss) the array of slots
+  int             num_deleted;   // (swiss) # of tombstoned slots
+  HTChainPolicy_t chain_policy;  // (chained) how Find reorders chains
+  bool            count_probes;  // (chained) is Find counting probes?
+  uint64_t        num_finds;     // # of Finds counted
+  uint64_t        num_probes;    // # of entries those Finds looked at
+  bool            read_mostly;   // do readers run alongside the writer?
+  HTSnapshot     *snapshot;      // (read-mostly) what readers see
+  struct htlog   *log;           // where changes are logged, or NULL
+  uint64_t        num_resizes;   // # of resizes started so far
+  uint64_t        resize_ns;     // total time spent resizing
 } HashTable;
 
 // The hash table iterator.
+//
+// For a chained table in the middle of a resize, "bucket_idx" counts the
+// old buckets first and then the new ones.  For the open-addressing
+// engines, "bucket_idx" is the current slot and "bucket_it" is always NULL.
 typedef struct ht_it {
   HashTable  *ht;          // the HT we're pointing into
   int         bucket_idx;  // which bucket are we in?
   LLIterator *bucket_it;   // iterator for the bucket, or NULL
+  int         stop_idx;    // (robin hood) empty slot that ends the scan
 } HTIterator;
 
 // This is the internal hash function we use to map from HTKey_t keys to a
-// bucket number.
+// bucket number.  Bucket counts are always powers of two, so this is the
+// low bits of HTMixKey(key).
 int HashKeyToBucketNum(HashTable *ht, HTKey_t key);
 
+// Return the smallest power of two that is >= n (and >= 1).
+int RoundUpToPowerOfTwo(int n);
+
+// Return the number of buckets a chained table needs to hold num_elements
+// elements without resizing.
+int BucketsForElements(int num_elements);
+
+// Deallocation function that does nothing.  Useful if we want to deallocate
+// the structure (eg, the linked list) without deallocating its elements or
+// if we know that the structure is empty.
+void LLNoOpFree(LLPayload_t freeme);
+
+// Allocate an all-clear occupancy bitmap for num_buckets buckets.
+uint64_t *HTAllocateOccupancy(int num_buckets);
+
+// Set or clear bucket i's occupancy bit.
+static inline void HTSetOccupied(uint64_t *bits, int i) {
+  bits[i >> 6] |= 1ULL << (i & 63);
+}
+static inline void HTClearOccupied(uint64_t *bits, int i) {
+  bits[i >> 6] &= ~(1ULL << (i & 63));
+}
+
+// A monotonic timestamp in nanoseconds, for timing resizes.
+uint64_t HTNowNs(void);
+
+// Fold len bytes (a multiple of 8) into a running checksum, 8 bytes at a
+// time, for the on-disk formats.  It is not cryptographic; it is there to
+// catch truncated, overwritten or bit-flipped files.
+uint64_t HTChecksum(uint64_t sum, const void *buf, size_t len);
+
+// Append a record of a change to a table's log (HashTableLog.c).  Inserts
+// are logged before they happen and removes only once they have removed
+// something.
+#define HT_LOG_INSERT 1
+#define HT_LOG_REMOVE 2
+void HTLogRecord(struct htlog *log, int op, HTKeyValue_t kv);
+
+// Look for newPayload.key in a chain and then, depending on mode, just
+// return its value (0), unlink and free it (1), replace its value (2), or
+// unlink and retire it (3).  The old value comes back through oldVal.
+// Returns whether the key was found.
+bool Search_LinkedList(LinkedList *ll, HTKeyValue_t newPayload,
+                       HTValue_t *oldVal, int mode);
+
+// Scramble a key so that every bit of the result depends on every bit of
+// the input.  Every engine masks the low bits of the result to pick a
+// bucket or home slot, which would cluster badly on raw keys that are
+// sequential or multiples of a large stride.  (This is the 64-bit
+// finalizer from MurmurHash3.)
+static inline uint64_t HTMixKey(HTKey_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Robin Hood engine (HTRobinHood.c).
+//
+// These mirror the public HashTable and HTIterator functions; HashTable.c
+// dispatches to them when table->engine == HT_ENGINE_ROBINHOOD.
+
+// Set up the slot array of a freshly allocated table.  num_slots is rounded
+// up to a power of two (of at least 2).
+void RHAllocate(HashTable *table, int num_slots);
+
+// Free every value (with value_free_function) and the slot array.
+void RHFree(HashTable *table, ValueFreeFnPtr value_free_function);
+
+bool RHInsert(HashTable *table, HTKeyValue_t newkeyvalue,
+              HTKeyValue_t *oldkeyvalue);
+bool RHFind(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue);
+bool RHRemove(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue);
+
+// Grow the slot array, if needed, so that num_elements elements fit
+// without growing again.
+void RHReserve(HashTable *table, int num_elements);
+
+// The smallest slot count (a power of two) that num_elements elements fit
+// in without growing.
+int RHSlotsForElements(int num_elements);
+
+// Replace the slot array with one of num_slots slots (a power of two, big
+// enough for every element) and re-place every entry.
+void RHResize(HashTable *table, int num_slots);
+
+// Add a key that isn't in the table yet, without looking for it first.
+// There must already be room for it (see RHReserve).
+void RHInsertUnique(HashTable *table, HTKeyValue_t newkeyvalue);
+
+// Returns a pointer to key's value, first adding key with the given value
+// (growing if need be) if it isn't in the table, and sets *added to say
+// which.  Probes for the key only once either way.
+HTValue_t *RHFindOrAdd(HashTable *table, HTKey_t key, HTValue_t value,
+                       bool *added);
+
+// Prefetch the home slot of key (used by the batch operations).
+void RHPrefetch(HashTable *table, HTKey_t key);
+
+// Fill in the slot-level fields of HashTable_GetStats: empty_buckets,
+// length_hist, max_probe, mean_probe and bucket_bytes.
+void RHStats(HashTable *table, HTStats *stats);
+
+// Point a newly allocated iterator at the first element of a non-empty
+// table.
+void RHIteratorFirst(HTIterator *iter);
+bool RHIteratorNext(HTIterator *iter);
+bool RHIteratorRemove(HTIterator *iter, HTKeyValue_t *keyvalue);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Swiss table engine (HTSwiss.c).
+//
+// As above, for table->engine == HT_ENGINE_SWISS.  Removal never moves
+// entries, so HTIterator_Remove just removes the iterator's slot with
+// SWRemoveSlot and there is no SWIteratorRemove.
+
+// Set up the control and slot arrays of a freshly allocated table.
+// num_slots is rounded up to a power of two of at least one group.
+void SWAllocate(HashTable *table, int num_slots);
+
+// Free every value (with value_free_function) and both arrays.
+void SWFree(HashTable *table, ValueFreeFnPtr value_free_function);
+
+bool SWInsert(HashTable *table, HTKeyValue_t newkeyvalue,
+              HTKeyValue_t *oldkeyvalue);
+bool SWFind(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue);
+bool SWRemove(HashTable *table, HTKey_t key, HTKeyValue_t *keyvalue);
+
+// As RHReserve and RHInsertUnique.  SWReserve also drops any tombstones
+// if it has to rehash.
+void SWReserve(HashTable *table, int num_elements);
+void SWInsertUnique(HashTable *table, HTKeyValue_t newkeyvalue);
+
+// As RHSlotsForElements and RHResize.  SWRehash also drops every
+// tombstone.
+int SWSlotsForElements(int num_elements);
+void SWRehash(HashTable *table, int num_slots);
+
+// As RHFindOrAdd.
+HTValue_t *SWFindOrAdd(HashTable *table, HTKey_t key, HTValue_t value,
+                       bool *added);
+
+// Prefetch the control bytes and slots of key's first group (used by the
+// batch operations).
+void SWPrefetch(HashTable *table, HTKey_t key);
+
+// As RHStats.
+void SWStats(HashTable *table, HTStats *stats);
+
+// Remove the entry in full slot i, which stays where it is, returning it
+// through keyvalue.
+void SWRemoveSlot(HashTable *table, int i, HTKeyValue_t *keyvalue);
+
+void SWIteratorFirst(HTIterator *iter);
+bool SWIteratorNext(HTIterator *iter);
+
+// Is slot i of a Swiss table full?  (Full slots have the high bit of
+// their control byte clear.)
+static inline bool SWSlotIsFull(const HashTable *table, int i) {
+  return (table->ctrl[i] & 0x80) == 0;
+}
+
 #endif  // HW1_HASHTABLE_PRIV_H_
@@ -0,0 +1,240 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // for pthread_rwlock_t
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HTHash.h"
+#include "Interner.h"
+#include "Interner_priv.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Internal helper functions.
+
+// Where an ID's InString is.
+static inline InString *InSlot(Interner *in, InternId id) {
+  uint64_t idx = (uint64_t) id + (1ULL << IN_FIRST_SEGMENT_BITS);
+  int seg = 63 - __builtin_clzll(idx) - IN_FIRST_SEGMENT_BITS;
+  InString *segment = __atomic_load_n(&in->segments[seg], __ATOMIC_ACQUIRE);
+
+  return &segment[idx - (1ULL << (seg + IN_FIRST_SEGMENT_BITS))];
+}
+
+static inline bool InMatches(Interner *in, InternId id, const char *str,
+                             size_t len) {
+  InString *s = InSlot(in, id);
+  return s->len == len && (len == 0 || memcmp(s->str, str, len) == 0);
+}
+
+// Search for a string, starting at its hash, with the lock held.  Returns
+// whether it was found; if so its ID is returned through "id", and if not
+// the key where it would go is returned through "key".
+static bool InSearch(Interner *in, uint64_t hash, const char *str,
+                     size_t len, InternId *id, HTKey_t *key) {
+  HTKeyValue_t kv;
+  HTKey_t k;
+
+  for (k = hash; HashTable_Find(in->table, k, &kv); k++) {
+    if (InMatches(in, (InternId) (uintptr_t) kv.value, str, len)) {
+      *id = (InternId) (uintptr_t) kv.value;
+      return true;
+    }
+  }
+  *key = k;
+  return false;
+}
+
+// Copy len bytes (plus a '\0') into the arena.
+static const char *InCopy(Interner *in, const char *str, size_t len) {
+  InChunk *chunk = in->chunks;
+  char *copy;
+
+  if (chunk == NULL || chunk->size - chunk->used < len + 1) {
+    size_t size = len + 1 > IN_CHUNK_BYTES ? len + 1 : IN_CHUNK_BYTES;
+    chunk = (InChunk *) malloc(sizeof(InChunk) + size);
+    Verify333(chunk != NULL);
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = in->chunks;
+    in->chunks = chunk;
+  }
+  copy = (char *) (chunk + 1) + chunk->used;
+  if (len > 0) {
+    memcpy(copy, str, len);
+  }
+  copy[len] = '\0';
+  chunk->used += len + 1;
+  return copy;
+}
+
+// Add a new string at key, with the write lock held.  Returns its ID.
+static InternId InAdd(Interner *in, HTKey_t key, const char *str,
+                      size_t len) {
+  InternId id = in->num_strings;
+  uint64_t idx = (uint64_t) id + (1ULL << IN_FIRST_SEGMENT_BITS);
+  int seg = 63 - __builtin_clzll(idx) - IN_FIRST_SEGMENT_BITS;
+  HTKeyValue_t kv, old;
+  InString *slot;
+
+  Verify333(id != UINT32_MAX);  // out of IDs
+  if (in->segments[seg] == NULL) {
+    InString *segment = (InString *) malloc(
+        sizeof(InString) << (seg + IN_FIRST_SEGMENT_BITS));
+    Verify333(segment != NULL);
+    __atomic_store_n(&in->segments[seg], segment, __ATOMIC_RELEASE);
+  }
+  slot = InSlot(in, id);
+  slot->str = InCopy(in, str, len);
+  slot->len = len;
+
+  kv.key = key;
+  kv.value = (HTValue_t) (uintptr_t) id;
+  Verify333(!HashTable_Insert(in->table, kv, &old));
+  __atomic_store_n(&in->num_strings, id + 1, __ATOMIC_RELEASE);
+  return id;
+}
+
+static void NoOpFree(HTValue_t value) { }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Interner implementation.
+
+Interner* Interner_Allocate(void) {
+  Interner *in = (Interner *) malloc(sizeof(Interner));
+
+  Verify333(in != NULL);
+  Verify333(pthread_rwlock_init(&in->lock, NULL) == 0);
+  in->table = HashTable_AllocateEngine(16, HT_ENGINE_SWISS);
+  memset(in->segments, 0, sizeof(in->segments));
+  in->num_strings = 0;
+  in->chunks = NULL;
+  return in;
+}
+
+void Interner_Free(Interner *interner) {
+  int i;
+
+  Verify333(interner != NULL);
+  HashTable_Free(interner->table, &NoOpFree);
+  for (i = 0; i < IN_NUM_SEGMENTS; i++) {
+    free(interner->segments[i]);
+  }
+  while (interner->chunks != NULL) {
+    InChunk *next = interner->chunks->next;
+    free(interner->chunks);
+    interner->chunks = next;
+  }
+  pthread_rwlock_destroy(&interner->lock);
+  free(interner);
+}
+
+int Interner_NumStrings(Interner *interner) {
+  Verify333(interner != NULL);
+  return (int) __atomic_load_n(&interner->num_strings, __ATOMIC_ACQUIRE);
+}
+
+InternId Interner_Intern(Interner *interner, const char *str, size_t len) {
+  InternId id;
+
+  Interner_InternBatch(interner, &str, &len, 1, &id);
+  return id;
+}
+
+void Interner_InternBatch(Interner *interner, const char *const *strs,
+                          const size_t *lens, int num_strs, InternId *ids) {
+  HTKey_t hashes[IN_BATCH_GROUP];
+  HTKeyValue_t kvs[IN_BATCH_GROUP];
+  bool found[IN_BATCH_GROUP];
+  int start, n, i, misses;
+
+  Verify333(interner != NULL && num_strs >= 0);
+  Verify333(num_strs == 0 || (strs != NULL && lens != NULL && ids != NULL));
+
+  for (start = 0; start < num_strs; start += n) {
+    const char *const *s = strs + start;
+    const size_t *l = lens + start;
+    InternId *out = ids + start;
+    HTKey_t key;
+
+    n = num_strs - start < IN_BATCH_GROUP ? num_strs - start : IN_BATCH_GROUP;
+    for (i = 0; i < n; i++) {
+      Verify333(s[i] != NULL || l[i] == 0);
+    }
+    HTHash64_Batch((const void *const *) s, l, n, 0, hashes);
+
+    // Most strings in a busy interner are already there, and those only
+    // need the shared lock.  A key that holds some other string's ID (a
+    // hash collision) is resolved by a full search.
+    Verify333(pthread_rwlock_rdlock(&interner->lock) == 0);
+    HashTable_FindBatch(interner->table, hashes, n, kvs, found);
+    misses = 0;
+    for (i = 0; i < n; i++) {
+      if (found[i] && InMatches(interner, (InternId) (uintptr_t) kvs[i].value,
+                                s[i], l[i])) {
+        out[i] = (InternId) (uintptr_t) kvs[i].value;
+        continue;
+      }
+      found[i] = found[i] &&
+                 InSearch(interner, hashes[i], s[i], l[i], &out[i], &key);
+      if (!found[i]) {
+        misses++;
+      }
+    }
+    Verify333(pthread_rwlock_unlock(&interner->lock) == 0);
+    if (misses == 0) {
+      continue;
+    }
+
+    // The rest need the exclusive lock, and another thread (or an earlier
+    // string in this batch) may have added them in the meantime.
+    Verify333(pthread_rwlock_wrlock(&interner->lock) == 0);
+    for (i = 0; i < n; i++) {
+      if (!found[i] &&
+          !InSearch(interner, hashes[i], s[i], l[i], &out[i], &key)) {
+        out[i] = InAdd(interner, key, s[i], l[i]);
+      }
+    }
+    Verify333(pthread_rwlock_unlock(&interner->lock) == 0);
+  }
+}
+
+bool Interner_Find(Interner *interner, const char *str, size_t len,
+                   InternId *id) {
+  HTKey_t key;
+  bool found;
+
+  Verify333(interner != NULL && id != NULL);
+  Verify333(str != NULL || len == 0);
+  Verify333(pthread_rwlock_rdlock(&interner->lock) == 0);
+  found = InSearch(interner, HTHash64(str, len, 0), str, len, id, &key);
+  Verify333(pthread_rwlock_unlock(&interner->lock) == 0);
+  return found;
+}
+
+const char* Interner_String(Interner *interner, InternId id, size_t *len) {
+  InString *s;
+
+  Verify333(interner != NULL);
+  Verify333(id < __atomic_load_n(&interner->num_strings, __ATOMIC_ACQUIRE));
+  s = InSlot(interner, id);
+  if (len != NULL) {
+    *len = s->len;
+  }
+  return s->str;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_INTERNER_H_
+#define HW1_INTERNER_H_
+
+#include <stdbool.h>    // for bool type (true, false)
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint32_t
+
+///////////////////////////////////////////////////////////////////////////////
+// An Interner keeps one copy of each distinct string and names it with a
+// small number.
+//
+// Interning a string returns its ID: the first distinct string interned
+// gets 0, the next 1, and so on, and interning an equal string again
+// returns the same ID.  So two interned strings are equal exactly when
+// their IDs are, and a program can hold and compare 4-byte IDs instead of
+// the strings.  Interner_String turns an ID back into the string in
+// constant time.
+//
+// Each distinct string is copied once into an append-only arena, and
+// never moves or goes away until the Interner is freed, so the pointers
+// Interner_String returns stay valid.  Strings are arbitrary bytes (they
+// may contain '\0') and are passed with their lengths; the arena's copy
+// is followed by a '\0' as well, for convenience.
+//
+// All functions may be called from any number of threads at once, except
+// Interner_Free.  Looking up strings that are already interned only takes
+// a shared lock, and Interner_String takes no lock at all.
+typedef struct interner Interner;
+
+// An interned string's ID.
+typedef uint32_t InternId;
+
+// Allocate and return a new, empty Interner.
+Interner* Interner_Allocate(void);
+
+// Free an Interner and all its strings.
+void Interner_Free(Interner *interner);
+
+// Returns the number of distinct strings interned, which is also the next
+// ID to be handed out.
+int Interner_NumStrings(Interner *interner);
+
+// Intern a string.
+//
+// Arguments:
+// - interner: the Interner.
+// - str, len: the string's bytes.  They are copied if the string is new.
+//
+// Returns the string's ID.
+InternId Interner_Intern(Interner *interner, const char *str, size_t len);
+
+// Intern num_strs strings, with the same results as calling
+// Interner_Intern on each in order, but hashing them all up front (see
+// HTHash64_Batch) and taking each lock once for the whole batch.
+//
+// Arguments:
+// - interner: the Interner.
+// - strs, lens: the strings' bytes and lengths.
+// - num_strs: the number of strings.
+// - ids: (output) ids[i] is set to strs[i]'s ID.
+void Interner_InternBatch(Interner *interner, const char *const *strs,
+                          const size_t *lens, int num_strs, InternId *ids);
+
+// Look up a string without interning it.
+//
+// Returns whether the string has been interned; if so, its ID is returned
+// through "id".
+bool Interner_Find(Interner *interner, const char *str, size_t len,
+                   InternId *id);
+
+// Returns the string with the given ID, which MUST have been handed out by
+// this Interner, and (if "len" isn't NULL) its length through "len".
+const char* Interner_String(Interner *interner, InternId id, size_t *len);
+
+#endif  // HW1_INTERNER_H_
@@ -0,0 +1,71 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_INTERNER_PRIV_H_
+#define HW1_INTERNER_PRIV_H_
+
+#include <pthread.h>  // for pthread_rwlock_t
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uint32_t
+
+#include "./HashTable.h"
+#include "./Interner.h"
+
+// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+// Internal structures for our Interner implementation, broken out so that
+// our unittests can access them.
+//
+// Customers should not include this file or assume anything based on
+// its contents.
+// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+// The strings are found through a HashTable from each string's HTHash64
+// to its ID.  Two different strings may have the same 64-bit hash, so a
+// hash is only where the search starts: if the key holds some other
+// string's ID, the search moves on to key + 1, and so on, until it finds
+// the string or a key that isn't in the table (where a new string goes).
+// Strings are never removed, so no search ever steps over a gap.
+//
+// An ID is turned back into its string through a directory of segments:
+// segment s holds the (pointer, length) of 2^(IN_FIRST_SEGMENT_BITS + s)
+// IDs, so the directory never has to grow or move, and a reader can index
+// it without a lock.
+//
+// The strings themselves are copied into chunks of IN_CHUNK_BYTES, one
+// after another; a string too big for a chunk gets a chunk of its own.
+#define IN_CHUNK_BYTES (1 << 20)
+#define IN_FIRST_SEGMENT_BITS 10
+#define IN_NUM_SEGMENTS (33 - IN_FIRST_SEGMENT_BITS)  // enough for 2^32 IDs
+
+// Interner_InternBatch works on groups of this many strings at a time.
+#define IN_BATCH_GROUP 256
+
+typedef struct in_string {
+  const char  *str;  // the string's copy in the arena
+  size_t       len;  // its length
+} InString;
+
+// A chunk of the arena.  Its "size" bytes follow the header.
+typedef struct in_chunk {
+  struct in_chunk  *next;  // the next older chunk, or NULL
+  size_t            size;  // # of bytes after the header
+  size_t            used;  // # of them handed out
+} InChunk;
+
+struct interner {
+  pthread_rwlock_t  lock;         // readers: lookups; writers: additions
+  HashTable        *table;        // (probed) hash -> ID
+  InString         *segments[IN_NUM_SEGMENTS];  // ID -> string
+  uint32_t          num_strings;  // # of IDs handed out (atomic)
+  InChunk          *chunks;       // the arena, newest chunk first
+};
+
+#endif  // HW1_INTERNER_PRIV_H_
@@ -15,6 +15,7 @@
 #include "CSE333.h"
 #include "LinkedList.h"
 #include "LinkedList_priv.h"
+#include "Trace.h"
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -76,15 +77,26 @@ void LinkedList_Push(LinkedList *list, LLPayload_t payload) {
   // Set the payload
   ln->payload = payload;
 
+  LLPushNode(list, ln);
+}
+
+void LLPushNode(LinkedList *list, LinkedListNode *ln) {
+  Verify333(list != NULL);
+  Verify333(ln != NULL);
+
   // Null out ln->prev
   ln->prev = NULL;
 
+  // The node is filled in before it is published through list->head, so
+  // a lock-free reader walking the list (see LLPushNode in
+  // LinkedList_priv.h) never sees a half-built node.
   if (list->num_elements == 0) {
     // Degenerate case; list is currently empty
     Verify333(list->head == NULL);
     Verify333(list->tail == NULL);
     ln->next = ln->prev = NULL;
-    list->head = list->tail = ln;
+    list->tail = ln;
+    __atomic_store_n(&list->head, ln, __ATOMIC_RELEASE);
     list->num_elements = 1;
   } else {
     // STEP 3: typical case; list has >=1 elements
@@ -93,7 +105,7 @@ void LinkedList_Push(LinkedList *list, LLPayload_t payload) {
     // Set the new nodes next to head
     ln->next = list->head;
     // Change list->head to new node
-    list->head = ln;
+    __atomic_store_n(&list->head, ln, __ATOMIC_RELEASE);
     // Increment num_elements
     list->num_elements++;
   }
@@ -162,8 +174,9 @@ void LinkedList_Append(LinkedList *list, LLPayload_t payload) {
   } else {
     // Set tail's next to the new node
     list->tail->next = ln;
-    // Set the new nodes prev to tail
+    // Set the new nodes prev to tail and null out its next
     ln->prev = list->tail;
+    ln->next = NULL;
     // Change list->tail to new node
     list->tail = ln;
     // Increment num_elements
@@ -174,6 +187,8 @@ void LinkedList_Append(LinkedList *list, LLPayload_t payload) {
 void LinkedList_Sort(LinkedList *list, bool ascending,
                      LLPayloadComparatorFnPtr comparator_function) {
   Verify333(list != NULL);
+  TRACE_SCOPE(TRACE_LL_SORT, list->num_elements);
+
   if (list->num_elements < 2) {
     // No sorting needed.
     return;
@@ -377,3 +392,39 @@ bool LLSlice(LinkedList *list, LLPayload_t *payload_ptr) {
 void LLIteratorRewind(LLIterator *iter) {
   iter->node = iter->list->head;
 }
+
+void LLUnlinkNode(LinkedList *list, LinkedListNode *node) {
+  Verify333(list != NULL);
+  Verify333(node != NULL);
+
+  // Point the neighbors (or the list ends) past the node.  The node's own
+  // links are left alone, so a reader standing on it can still move on.
+  if (node->prev != NULL) {
+    __atomic_store_n(&node->prev->next, node->next, __ATOMIC_RELEASE);
+  } else {
+    __atomic_store_n(&list->head, node->next, __ATOMIC_RELEASE);
+  }
+  if (node->next != NULL) {
+    node->next->prev = node->prev;
+  } else {
+    list->tail = node->prev;
+  }
+  list->num_elements--;
+}
+
+void LLInsertNodeBefore(LinkedList *list, LinkedListNode *next,
+                        LinkedListNode *node) {
+  Verify333(list != NULL);
+  Verify333(next != NULL);
+  Verify333(node != NULL);
+
+  node->next = next;
+  node->prev = next->prev;
+  if (next->prev != NULL) {
+    __atomic_store_n(&next->prev->next, node, __ATOMIC_RELEASE);
+  } else {
+    __atomic_store_n(&list->head, node, __ATOMIC_RELEASE);
+  }
+  next->prev = node;
+  list->num_elements++;
+}
@@ -78,5 +78,45 @@ bool LLSlice(LinkedList *list, LLPayload_t *payload_ptr);
 // - iter: the iterator to rewind.
 void LLIteratorRewind(LLIterator *iter);
 
+// Add a node that the caller has already allocated to the head of the list.
+//
+// This lets a caller embed the LinkedListNode at the start of a bigger
+// malloc'ed struct, so one allocation holds both the links and the data.
+// The list takes ownership of the node just as if LinkedList_Push had
+// allocated it: Pop, LLSlice, LLIterator_Remove and LinkedList_Free all
+// release it with free().
+//
+// The node is fully linked before it is published as the new head (with a
+// release store), and LLUnlinkNode only ever redirects a single pointer,
+// so one thread may push and unlink while others walk the list forwards
+// from list->head with acquire loads, as long as unlinked nodes aren't
+// freed until those readers are done (see Epoch.h).
+//
+// Arguments:
+// - list: the LinkedList to push onto.
+// - node: the node to push; its payload must already be set.
+void LLPushNode(LinkedList *list, LinkedListNode *node);
+
+// Unlink a node from the list without freeing it or its payload.
+// Ownership of the node passes back to the caller.  The node's own next
+// and prev pointers are left as they were.
+//
+// Arguments:
+// - list: the LinkedList the node is in.
+// - node: the node to unlink.
+void LLUnlinkNode(LinkedList *list, LinkedListNode *node);
+
+// Link a node into the list immediately in front of another, taking
+// ownership of it as LLPushNode does.  Like LLPushNode, the node is fully
+// linked before it is published (through its new predecessor's next, or
+// list->head), so lock-free readers are safe.
+//
+// Arguments:
+// - list: the LinkedList to insert into.
+// - next: the node, already in list, to insert in front of.
+// - node: the node to insert; its payload must already be set.
+void LLInsertNodeBefore(LinkedList *list, LinkedListNode *next,
+                        LinkedListNode *node);
+
 
 #endif  // HW1_LINKEDLIST_PRIV_H_
@@ -0,0 +1,382 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "CSE333.h"
+#include "Epoch.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "LockFreeHashTable.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Internal structures and helper functions.
+//
+// The list is ordered by "split-order key".  An entry's is the bit-reversal
+// of its mixed hash with the top bit set, so it is always odd; bucket b's
+// dummy node has the bit-reversal of b, which is always even and sorts
+// just before every entry whose hash has b in its low bits.  Entries whose
+// mixed hashes only differ in the top bit share a split-order key, so ties
+// are broken by the key itself.
+//
+// A node is deleted in three steps, by whoever wins each one:
+// 1. Remove swaps its value for LF_REMOVED.  This is the moment the key
+//    leaves the table, and it hands the old value to exactly one Remove.
+// 2. The mark bit is set in the node's next pointer, so nothing can be
+//    linked in after it.
+// 3. The node is unlinked from its predecessor and retired.
+// Any thread walking the list finishes steps 2 and 3 for nodes it meets.
+
+// A bucket is a pointer to its dummy node, or NULL if it hasn't been set
+// up yet.  The buckets live in segments: segment 0 holds bucket 0, and
+// segment s > 0 holds buckets [2^(s-1), 2^s).  Segments are allocated the
+// first time one of their buckets is used, so growing the table is just a
+// matter of bumping "size".
+#define LF_MAX_SEGMENTS 48  // i.e., at most 2^47 buckets
+#define LF_MAX_LOAD 2       // double the buckets past this load factor
+#define LF_MARK ((uintptr_t) 1)
+
+typedef struct lf_node {
+  uint64_t            so_key;  // split-order key
+  HTKey_t             key;     // the key (0 in dummy nodes)
+  _Atomic(HTValue_t)  value;   // the value, or LF_REMOVED
+  _Atomic(uintptr_t)  next;    // next node, | LF_MARK once deleted
+} LFNode;
+
+typedef _Atomic(LFNode *) LFBucket;
+
+typedef struct lfht {
+  _Atomic(uint64_t)    size;          // # of buckets, a power of two
+  _Atomic(int)         num_elements;  // # of live entries
+  _Atomic(LFBucket *)  segments[LF_MAX_SEGMENTS];
+} LFHashTable;
+
+// No customer value can have this address.
+static char lf_removed;
+#define LF_REMOVED ((HTValue_t) &lf_removed)
+
+static uint64_t ReverseBits(uint64_t x) {
+  x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  return __builtin_bswap64(x);
+}
+
+static uint64_t EntryKey(uint64_t hash) {
+  return ReverseBits(hash | (1ULL << 63));
+}
+
+static LFNode *NextNode(uintptr_t next) {
+  return (LFNode *) (next & ~LF_MARK);
+}
+
+static LFNode *NewNode(uint64_t so_key, HTKey_t key, HTValue_t value) {
+  LFNode *node = (LFNode *) malloc(sizeof(LFNode));
+  Verify333(node != NULL);
+  node->so_key = so_key;
+  node->key = key;
+  atomic_init(&node->value, value);
+  atomic_init(&node->next, (uintptr_t) 0);
+  return node;
+}
+
+// Compare a node with (so_key, key): <0, 0 or >0.
+static int Compare(LFNode *node, uint64_t so_key, HTKey_t key) {
+  if (node->so_key != so_key) {
+    return node->so_key < so_key ? -1 : 1;
+  }
+  if (node->key != key) {
+    return node->key < key ? -1 : 1;
+  }
+  return 0;
+}
+
+// Find where (so_key, key) belongs in the part of the list after start.
+// On return *cur_out is the first node that isn't less than (so_key, key),
+// or NULL, and *prev_out is the link that pointed at it.  Returns whether
+// *cur_out is a live node for (so_key, key).  Deleted nodes found along the
+// way are unlinked and retired.  start must be a dummy node, since those
+// are never deleted.
+static bool ListFind(LFNode *start, uint64_t so_key, HTKey_t key,
+                     _Atomic(uintptr_t) **prev_out, LFNode **cur_out) {
+  _Atomic(uintptr_t) *prev;
+  LFNode *cur;
+
+ retry:
+  prev = &start->next;
+  cur = NextNode(atomic_load(prev));
+  while (cur != NULL) {
+    uintptr_t next = atomic_load(&cur->next);
+    int c;
+
+    if ((next & LF_MARK) != 0) {
+      uintptr_t expected = (uintptr_t) cur;
+      if (!atomic_compare_exchange_strong(prev, &expected, next & ~LF_MARK)) {
+        goto retry;
+      }
+      Epoch_Retire(cur, &free);
+      cur = NextNode(next);
+      continue;
+    }
+    c = Compare(cur, so_key, key);
+    if (c == 0 && atomic_load(&cur->value) == LF_REMOVED) {
+      // A Remove has claimed this node but not marked it yet; help out.
+      atomic_fetch_or(&cur->next, LF_MARK);
+      continue;
+    }
+    if (c >= 0) {
+      *prev_out = prev;
+      *cur_out = cur;
+      return c == 0;
+    }
+    prev = &cur->next;
+    cur = NextNode(next);
+  }
+  *prev_out = prev;
+  *cur_out = NULL;
+  return false;
+}
+
+// Return the slot of bucket b, allocating its segment if need be.
+static LFBucket *BucketSlot(LFHashTable *table, uint64_t b) {
+  int seg = (b == 0) ? 0 : 64 - __builtin_clzll(b);
+  uint64_t base = (seg == 0) ? 0 : 1ULL << (seg - 1);
+  LFBucket *segment = atomic_load(&table->segments[seg]);
+
+  if (segment == NULL) {
+    LFBucket *fresh = (LFBucket *) calloc(seg == 0 ? 1 : base,
+                                          sizeof(LFBucket));
+    Verify333(fresh != NULL);
+    if (atomic_compare_exchange_strong(&table->segments[seg], &segment,
+                                       fresh)) {
+      segment = fresh;
+    } else {
+      free(fresh);
+    }
+  }
+  return &segment[b - base];
+}
+
+static LFNode *GetBucket(LFHashTable *table, uint64_t b);
+
+// Link bucket b's dummy node into the list, after its parent bucket's
+// (b without its top bit), and publish it in the bucket's slot.
+static LFNode *InitializeBucket(LFHashTable *table, uint64_t b,
+                                LFBucket *slot) {
+  uint64_t parent = b & ~(1ULL << (63 - __builtin_clzll(b)));
+  LFNode *start = GetBucket(table, parent);
+  LFNode *dummy = NewNode(ReverseBits(b), 0, NULL);
+  LFNode *expected_dummy = NULL;
+  _Atomic(uintptr_t) *prev;
+  LFNode *cur;
+
+  while (true) {
+    uintptr_t expected;
+    if (ListFind(start, dummy->so_key, 0, &prev, &cur)) {
+      // Another thread got there first.
+      free(dummy);
+      dummy = cur;
+      break;
+    }
+    atomic_store(&dummy->next, (uintptr_t) cur);
+    expected = (uintptr_t) cur;
+    if (atomic_compare_exchange_strong(prev, &expected, (uintptr_t) dummy)) {
+      break;
+    }
+  }
+  atomic_compare_exchange_strong(slot, &expected_dummy, dummy);
+  return dummy;
+}
+
+// Return bucket b's dummy node, setting the bucket up if need be.
+static LFNode *GetBucket(LFHashTable *table, uint64_t b) {
+  LFBucket *slot = BucketSlot(table, b);
+  LFNode *dummy = atomic_load(slot);
+
+  if (dummy == NULL) {
+    dummy = InitializeBucket(table, b, slot);
+  }
+  return dummy;
+}
+
+static LFNode *BucketForHash(LFHashTable *table, uint64_t hash) {
+  return GetBucket(table, hash & (atomic_load(&table->size) - 1));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LFHashTable implementation.
+
+LFHashTable* LFHashTable_Allocate(int num_buckets) {
+  LFHashTable *table;
+  int i;
+
+  Verify333(num_buckets > 0);
+
+  table = (LFHashTable *) malloc(sizeof(LFHashTable));
+  Verify333(table != NULL);
+  atomic_init(&table->size, (uint64_t) RoundUpToPowerOfTwo(num_buckets));
+  atomic_init(&table->num_elements, 0);
+  for (i = 0; i < LF_MAX_SEGMENTS; i++) {
+    atomic_init(&table->segments[i], NULL);
+  }
+
+  // Bucket 0's dummy is the head of the whole list.
+  atomic_store(BucketSlot(table, 0), NewNode(0, 0, NULL));
+  return table;
+}
+
+void LFHashTable_Free(LFHashTable *table, ValueFreeFnPtr value_free_function) {
+  LFNode *node;
+  int i;
+
+  Verify333(table != NULL);
+
+  // Every node still in the list belongs to us; nodes that have been
+  // unlinked were retired, and the epoch code frees those.
+  node = atomic_load(BucketSlot(table, 0));
+  while (node != NULL) {
+    LFNode *next = NextNode(atomic_load(&node->next));
+    if ((node->so_key & 1) != 0) {
+      HTValue_t value = atomic_load(&node->value);
+      if (value != LF_REMOVED) {
+        value_free_function(value);
+      }
+    }
+    free(node);
+    node = next;
+  }
+  for (i = 0; i < LF_MAX_SEGMENTS; i++) {
+    free(atomic_load(&table->segments[i]));
+  }
+  free(table);
+  Epoch_Barrier();
+}
+
+int LFHashTable_NumElements(LFHashTable *table) {
+  Verify333(table != NULL);
+  return atomic_load(&table->num_elements);
+}
+
+bool LFHashTable_Insert(LFHashTable *table,
+                        HTKeyValue_t newkeyvalue,
+                        HTKeyValue_t *oldkeyvalue) {
+  uint64_t hash = HTMixKey(newkeyvalue.key);
+  uint64_t so_key = EntryKey(hash);
+  LFNode *node = NULL;
+  _Atomic(uintptr_t) *prev;
+  LFNode *cur;
+  bool replaced;
+
+  Verify333(table != NULL);
+  Epoch_Enter();
+  LFNode *start = BucketForHash(table, hash);
+  while (true) {
+    if (ListFind(start, so_key, newkeyvalue.key, &prev, &cur)) {
+      // The key is there; swap in the new value, unless a Remove beats us
+      // to it, in which case we start over.
+      HTValue_t old = atomic_load(&cur->value);
+      if (old != LF_REMOVED &&
+          atomic_compare_exchange_strong(&cur->value, &old,
+                                         newkeyvalue.value)) {
+        oldkeyvalue->key = newkeyvalue.key;
+        oldkeyvalue->value = old;
+        replaced = true;
+        break;
+      }
+      continue;
+    }
+
+    // The key isn't there; link a new node in between *prev and cur.
+    uintptr_t expected = (uintptr_t) cur;
+    if (node == NULL) {
+      node = NewNode(so_key, newkeyvalue.key, newkeyvalue.value);
+    }
+    atomic_store(&node->next, (uintptr_t) cur);
+    if (atomic_compare_exchange_strong(prev, &expected, (uintptr_t) node)) {
+      node = NULL;
+      replaced = false;
+      break;
+    }
+  }
+  Epoch_Exit();
+
+  // A node we made but never published can go straight away.
+  free(node);
+
+  if (!replaced) {
+    uint64_t size = atomic_load(&table->size);
+    int n = atomic_fetch_add(&table->num_elements, 1) + 1;
+    if ((uint64_t) n > size * LF_MAX_LOAD &&
+        size < (1ULL << (LF_MAX_SEGMENTS - 1))) {
+      atomic_compare_exchange_strong(&table->size, &size, size * 2);
+    }
+  }
+  return replaced;
+}
+
+bool LFHashTable_Find(LFHashTable *table,
+                      HTKey_t key,
+                      HTKeyValue_t *keyvalue) {
+  uint64_t hash = HTMixKey(key);
+  _Atomic(uintptr_t) *prev;
+  LFNode *cur;
+  bool found = false;
+
+  Verify333(table != NULL);
+  Epoch_Enter();
+  if (ListFind(BucketForHash(table, hash), EntryKey(hash), key, &prev,
+               &cur)) {
+    HTValue_t value = atomic_load(&cur->value);
+    if (value != LF_REMOVED) {
+      keyvalue->key = key;
+      keyvalue->value = value;
+      found = true;
+    }
+  }
+  Epoch_Exit();
+  return found;
+}
+
+bool LFHashTable_Remove(LFHashTable *table,
+                        HTKey_t key,
+                        HTKeyValue_t *keyvalue) {
+  uint64_t hash = HTMixKey(key);
+  uint64_t so_key = EntryKey(hash);
+  _Atomic(uintptr_t) *prev;
+  LFNode *cur;
+  bool removed = false;
+
+  Verify333(table != NULL);
+  Epoch_Enter();
+  LFNode *start = BucketForHash(table, hash);
+  while (ListFind(start, so_key, key, &prev, &cur)) {
+    HTValue_t value = atomic_load(&cur->value);
+    if (value == LF_REMOVED ||
+        !atomic_compare_exchange_strong(&cur->value, &value, LF_REMOVED)) {
+      continue;
+    }
+    // The value is ours.  Mark the node, and let ListFind unlink it.
+    atomic_fetch_or(&cur->next, LF_MARK);
+    ListFind(start, so_key, key, &prev, &cur);
+    keyvalue->key = key;
+    keyvalue->value = value;
+    atomic_fetch_sub(&table->num_elements, 1);
+    removed = true;
+    break;
+  }
+  Epoch_Exit();
+  return removed;
+}
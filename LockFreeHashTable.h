@@ -0,0 +1,78 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_LOCKFREEHASHTABLE_H_
+#define HW1_LOCKFREEHASHTABLE_H_
+
+#include <stdbool.h>    // for bool type (true, false)
+
+#include "./HashTable.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A LFHashTable is a lock-free, automatically-resizing hash table.
+//
+// It is a "split-ordered list" (Shalev and Shavit, "Split-Ordered Lists:
+// Lock-Free Extensible Hash Tables", JACM 2006).  Every entry lives in one
+// sorted, lock-free linked list, ordered by the bit-reversal of its mixed
+// hash.  In that order, the keys of bucket b in a table of 2n buckets are
+// exactly the keys of bucket b in a table of n buckets that come after the
+// point where bucket b + n would start.  So each bucket is just a pointer
+// to a "dummy" node marking where its keys begin in the list, and growing
+// the table only ever adds dummy nodes: entries are never moved, and the
+// new buckets are set up lazily, the first time someone uses them.
+//
+// Insert, Find and Remove never block: they use compare-and-swap on the
+// list and the bucket index, and a thread that finds a half-finished
+// removal helps finish it.  Removed entries are freed through the
+// epoch-based reclamation in Epoch.h, once no thread can still be looking
+// at them.
+//
+// All functions below may be called concurrently from any number of
+// threads, except LFHashTable_Free.  Keys, values and the return
+// conventions are exactly as for HashTable.  As with ShardedHashTable, a
+// value returned by Find is only a copy: if another thread may remove and
+// free it, callers need their own scheme to keep it alive.
+typedef struct lfht LFHashTable;
+
+// Allocate and return a new, empty LFHashTable.
+//
+// Arguments:
+// - num_buckets: the initial number of buckets, rounded up to a power of
+//   two; MUST be greater than zero.  The table doubles its bucket count
+//   whenever the load factor passes 2.
+//
+// Returns a pointer to the newly allocated LFHashTable.
+LFHashTable* LFHashTable_Allocate(int num_buckets);
+
+// Free a LFHashTable and its entries.  No other thread may be using the
+// table, and the caller must not be inside an Epoch_Enter() section.
+//
+// Arguments:
+// - table: the LFHashTable to free.
+// - value_free_function: called on each value in the table.
+void LFHashTable_Free(LFHashTable *table, ValueFreeFnPtr value_free_function);
+
+// Returns the number of elements in the table (a snapshot, if other
+// threads are inserting or removing).
+int LFHashTable_NumElements(LFHashTable *table);
+
+// Like HashTable_Insert, HashTable_Find and HashTable_Remove.
+bool LFHashTable_Insert(LFHashTable *table,
+                        HTKeyValue_t newkeyvalue,
+                        HTKeyValue_t *oldkeyvalue);
+bool LFHashTable_Find(LFHashTable *table,
+                      HTKey_t key,
+                      HTKeyValue_t *keyvalue);
+bool LFHashTable_Remove(LFHashTable *table,
+                        HTKey_t key,
+                        HTKeyValue_t *keyvalue);
+
+#endif  // HW1_LOCKFREEHASHTABLE_H_
@@ -0,0 +1,190 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // for pthread_rwlock_t
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "ShardedHashTable.h"
+#include "ShardedHashTable_priv.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Internal helper functions.
+
+int ShardForKey(ShardedHashTable *table, HTKey_t key) {
+  // A shift by 64 is undefined, so a single shard is a special case.
+  if (table->num_shards == 1) {
+    return 0;
+  }
+  return (int) (HTMixKey(key) >> table->shift);
+}
+
+static SHTShard *ShardFor(ShardedHashTable *table, HTKey_t key) {
+  return &table->shards[ShardForKey(table, key)];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ShardedHashTable implementation.
+
+ShardedHashTable* ShardedHashTable_Allocate(int num_shards, int num_buckets,
+                                            HTEngine_t engine) {
+  ShardedHashTable *table;
+  int bits = 0;
+  int i;
+
+  Verify333(num_shards > 0);
+  Verify333(num_buckets > 0);
+
+  table = (ShardedHashTable *) malloc(sizeof(ShardedHashTable));
+  Verify333(table != NULL);
+
+  table->num_shards = RoundUpToPowerOfTwo(num_shards);
+  while ((1 << bits) < table->num_shards) {
+    bits++;
+  }
+  table->shift = 64 - bits;
+
+  table->shards = (SHTShard *) aligned_alloc(
+      SHT_CACHE_LINE, table->num_shards * sizeof(SHTShard));
+  Verify333(table->shards != NULL);
+  for (i = 0; i < table->num_shards; i++) {
+    Verify333(pthread_rwlock_init(&table->shards[i].lock, NULL) == 0);
+    table->shards[i].table = HashTable_AllocateEngine(num_buckets, engine);
+  }
+  return table;
+}
+
+void ShardedHashTable_Free(ShardedHashTable *table,
+                           ValueFreeFnPtr value_free_function) {
+  int i;
+
+  Verify333(table != NULL);
+  for (i = 0; i < table->num_shards; i++) {
+    HashTable_Free(table->shards[i].table, value_free_function);
+    pthread_rwlock_destroy(&table->shards[i].lock);
+  }
+  free(table->shards);
+  free(table);
+}
+
+int ShardedHashTable_NumElements(ShardedHashTable *table) {
+  int total = 0;
+  int i;
+
+  Verify333(table != NULL);
+  for (i = 0; i < table->num_shards; i++) {
+    SHTShard *shard = &table->shards[i];
+    pthread_rwlock_rdlock(&shard->lock);
+    total += HashTable_NumElements(shard->table);
+    pthread_rwlock_unlock(&shard->lock);
+  }
+  return total;
+}
+
+bool ShardedHashTable_Insert(ShardedHashTable *table,
+                             HTKeyValue_t newkeyvalue,
+                             HTKeyValue_t *oldkeyvalue) {
+  SHTShard *shard;
+  bool replaced;
+
+  Verify333(table != NULL);
+  shard = ShardFor(table, newkeyvalue.key);
+  pthread_rwlock_wrlock(&shard->lock);
+  replaced = HashTable_Insert(shard->table, newkeyvalue, oldkeyvalue);
+  pthread_rwlock_unlock(&shard->lock);
+  return replaced;
+}
+
+bool ShardedHashTable_Find(ShardedHashTable *table,
+                           HTKey_t key,
+                           HTKeyValue_t *keyvalue) {
+  SHTShard *shard;
+  bool found;
+
+  Verify333(table != NULL);
+  // HashTable_Find never modifies the table (a chained table doesn't even
+  // move a resize along), so readers can share the lock.
+  shard = ShardFor(table, key);
+  pthread_rwlock_rdlock(&shard->lock);
+  found = HashTable_Find(shard->table, key, keyvalue);
+  pthread_rwlock_unlock(&shard->lock);
+  return found;
+}
+
+bool ShardedHashTable_Remove(ShardedHashTable *table,
+                             HTKey_t key,
+                             HTKeyValue_t *keyvalue) {
+  SHTShard *shard;
+  bool removed;
+
+  Verify333(table != NULL);
+  shard = ShardFor(table, key);
+  pthread_rwlock_wrlock(&shard->lock);
+  removed = HashTable_Remove(shard->table, key, keyvalue);
+  pthread_rwlock_unlock(&shard->lock);
+  return removed;
+}
+
+void ShardedHashTable_GetStats(ShardedHashTable *table, HTStats *stats) {
+  double total_probe = 0;
+  int i, j;
+
+  Verify333(table != NULL && stats != NULL);
+  memset(stats, 0, sizeof(HTStats));
+  stats->table_bytes = sizeof(ShardedHashTable) +
+                       table->num_shards * sizeof(SHTShard);
+
+  // Each shard is only read-locked while its own stats are taken, so
+  // writers to the other shards carry on.
+  for (i = 0; i < table->num_shards; i++) {
+    SHTShard *shard = &table->shards[i];
+    HTStats s;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    HashTable_GetStats(shard->table, &s);
+    pthread_rwlock_unlock(&shard->lock);
+
+    stats->engine = s.engine;
+    stats->num_elements += s.num_elements;
+    stats->num_buckets += s.num_buckets;
+    stats->empty_buckets += s.empty_buckets;
+    for (j = 0; j < HT_STATS_HIST; j++) {
+      stats->length_hist[j] += s.length_hist[j];
+    }
+    if (s.max_probe > stats->max_probe) {
+      stats->max_probe = s.max_probe;
+    }
+    total_probe += s.mean_probe * s.num_elements;
+    stats->num_resizes += s.num_resizes;
+    stats->resize_ns += s.resize_ns;
+    stats->table_bytes += s.table_bytes;
+    stats->bucket_bytes += s.bucket_bytes;
+    stats->header_bytes += s.header_bytes;
+    stats->node_bytes += s.node_bytes;
+    stats->kv_bytes += s.kv_bytes;
+    stats->total_bytes += s.total_bytes;
+  }
+  stats->total_bytes += sizeof(ShardedHashTable) +
+                        table->num_shards * sizeof(SHTShard);
+  if (stats->num_elements > 0) {
+    stats->mean_probe = total_probe / stats->num_elements;
+    stats->bytes_per_entry = (double) stats->total_bytes /
+                             stats->num_elements;
+  }
+}
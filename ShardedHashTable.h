@@ -0,0 +1,83 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_SHARDEDHASHTABLE_H_
+#define HW1_SHARDEDHASHTABLE_H_
+
+#include <stdbool.h>    // for bool type (true, false)
+
+#include "./HashTable.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A ShardedHashTable is a thread-safe HashTable.
+//
+// It is made of a power-of-two number of independent HashTable "shards",
+// each guarded by its own reader-writer lock.  A key's shard is picked from
+// the high bits of its mixed hash (the shards themselves use the low bits),
+// so operations on different shards never contend, and any number of
+// Finds can run on the same shard at once.  Each shard resizes on its own,
+// under its own lock, so a resize only ever holds up the keys in one shard.
+//
+// All functions below may be called concurrently from any number of
+// threads, except ShardedHashTable_Free.  Keys, values and the return
+// conventions are exactly as for HashTable.  Note that a value returned by
+// Find is only a copy of what was in the table: if another thread may
+// remove (and free) that value, callers need their own scheme to keep it
+// alive.
+typedef struct sht ShardedHashTable;
+
+// Allocate and return a new ShardedHashTable.
+//
+// Arguments:
+// - num_shards: the number of shards, rounded up to a power of two; MUST be
+//   greater than zero.  A few times the number of threads is plenty.
+// - num_buckets: the initial number of buckets (or slots) in each shard;
+//   MUST be greater than zero.
+// - engine: the engine each shard uses; see HTEngine_t.
+//
+// Returns a pointer to the newly allocated ShardedHashTable.
+ShardedHashTable* ShardedHashTable_Allocate(int num_shards, int num_buckets,
+                                            HTEngine_t engine);
+
+// Free a ShardedHashTable and its entries.  No other thread may be using
+// the table.
+//
+// Arguments:
+// - table: the ShardedHashTable to free.
+// - value_free_function: called on each value in the table.
+void ShardedHashTable_Free(ShardedHashTable *table,
+                           ValueFreeFnPtr value_free_function);
+
+// Returns the number of elements in the table.  If other threads are
+// inserting or removing at the same time, this is only a snapshot: each
+// shard is counted at a slightly different moment.
+int ShardedHashTable_NumElements(ShardedHashTable *table);
+
+// Like HashTable_Insert, HashTable_Find and HashTable_Remove.
+bool ShardedHashTable_Insert(ShardedHashTable *table,
+                             HTKeyValue_t newkeyvalue,
+                             HTKeyValue_t *oldkeyvalue);
+bool ShardedHashTable_Find(ShardedHashTable *table,
+                           HTKey_t key,
+                           HTKeyValue_t *keyvalue);
+bool ShardedHashTable_Remove(ShardedHashTable *table,
+                             HTKey_t key,
+                             HTKeyValue_t *keyvalue);
+
+// Like HashTable_GetStats, for the table as a whole: the counts, bins and
+// bytes are summed over the shards (the bytes also include the shard
+// array), max_probe is the worst of any shard and mean_probe is over every
+// entry.  Each shard is read-locked only while it is looked at, so this
+// is safe to call from a metrics thread while others use the table, but
+// like NumElements it is only a snapshot.
+void ShardedHashTable_GetStats(ShardedHashTable *table, HTStats *stats);
+
+#endif  // HW1_SHARDEDHASHTABLE_H_
@@ -0,0 +1,50 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_SHARDEDHASHTABLE_PRIV_H_
+#define HW1_SHARDEDHASHTABLE_PRIV_H_
+
+#include <pthread.h>  // for pthread_rwlock_t
+
+#include "./HashTable.h"
+#include "./ShardedHashTable.h"
+
+// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+// Internal structures and helper functions for our ShardedHashTable
+// implementation, broken out so that our unittests can access them.
+//
+// Customers should not include this file or assume anything based on
+// its contents.
+// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+// The size we pad each shard to, so that two shards' locks never share a
+// cache line.
+#define SHT_CACHE_LINE 64
+
+// One shard: a HashTable and the lock that guards it.
+typedef struct sht_shard {
+  pthread_rwlock_t  lock    // readers: Find; writers: everything else
+    __attribute__((aligned(SHT_CACHE_LINE)));
+  HashTable        *table;  // the shard's entries
+} SHTShard;
+
+// The sharded table.  "shift" is 64 - log2(num_shards), so that
+// HTMixKey(key) >> shift is the key's shard.
+typedef struct sht {
+  int        num_shards;  // # of shards, a power of two
+  int        shift;       // how far to shift a mixed hash to get its shard
+  SHTShard  *shards;      // the array of shards
+} ShardedHashTable;
+
+// Return the index of the shard that holds (or would hold) key.
+int ShardForKey(ShardedHashTable *table, HTKey_t key);
+
+#endif  // HW1_SHARDEDHASHTABLE_PRIV_H_
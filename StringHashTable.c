@@ -0,0 +1,230 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "HTHash.h"
+#include "StringHashTable.h"
+#include "StringHashTable_priv.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Internal helper functions.
+//
+// Every step along a chain is a likely cache miss, so the table doubles
+// once it holds more entries than buckets, keeping chains about one entry
+// long.  Growing relinks the entries by their cached hashes; no key is
+// read, let alone rehashed.
+
+static inline StrEntry **StrBucket(StrHashTable *table, uint64_t hash) {
+  return &table->buckets[hash & (uint64_t) (table->num_buckets - 1)];
+}
+
+// Find key in its chain.  Returns the link that points at key's entry, or
+// the link at the end of the chain (which holds NULL) if key isn't there.
+static StrEntry **StrSearch(StrHashTable *table, uint64_t hash,
+                            const char *key, size_t len) {
+  StrEntry **link = StrBucket(table, hash);
+
+  if (len <= STR_SMALL_KEY) {
+    // Pad the key out the way the small-key slots are, once, and then
+    // compare it two words at a time.
+    unsigned char small[STR_SMALL_KEY] = { 0 };
+    uint64_t w0, w1;
+
+    if (len > 0) {
+      memcpy(small, key, len);
+    }
+    memcpy(&w0, small, sizeof(w0));
+    memcpy(&w1, small + 8, sizeof(w1));
+    for (; *link != NULL; link = &(*link)->next) {
+      StrEntry *e = *link;
+      uint64_t e0, e1;
+
+      if (e->hash != hash || e->len != len) {
+        continue;
+      }
+      memcpy(&e0, StrEntryKey(e), sizeof(e0));
+      memcpy(&e1, StrEntryKey(e) + 8, sizeof(e1));
+      if (e0 == w0 && e1 == w1) {
+        break;
+      }
+    }
+  } else {
+    for (; *link != NULL; link = &(*link)->next) {
+      StrEntry *e = *link;
+
+      if (e->hash == hash && e->len == len &&
+          memcmp(StrEntryKey(e), key, len) == 0) {
+        break;
+      }
+    }
+  }
+  return link;
+}
+
+static void StrGrow(StrHashTable *table) {
+  int new_num_buckets = table->num_buckets * 2;
+  StrEntry **old = table->buckets;
+  int old_num_buckets = table->num_buckets;
+  int i;
+
+  Verify333(new_num_buckets > 0);
+  table->buckets = (StrEntry **) calloc(new_num_buckets, sizeof(StrEntry *));
+  Verify333(table->buckets != NULL);
+  table->num_buckets = new_num_buckets;
+
+  for (i = 0; i < old_num_buckets; i++) {
+    StrEntry *e = old[i];
+    while (e != NULL) {
+      StrEntry *next = e->next;
+      StrEntry **head = StrBucket(table, e->hash);
+      e->next = *head;
+      *head = e;
+      e = next;
+    }
+  }
+  free(old);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// StrHashTable implementation.
+
+StrHashTable* StrHashTable_Allocate(int num_buckets) {
+  StrHashTable *table;
+
+  Verify333(num_buckets > 0);
+  table = (StrHashTable *) malloc(sizeof(StrHashTable));
+  Verify333(table != NULL);
+  table->num_buckets = RoundUpToPowerOfTwo(num_buckets);
+  table->num_elements = 0;
+  table->buckets =
+    (StrEntry **) calloc(table->num_buckets, sizeof(StrEntry *));
+  Verify333(table->buckets != NULL);
+  return table;
+}
+
+void StrHashTable_Free(StrHashTable *table,
+                       ValueFreeFnPtr value_free_function) {
+  int i;
+
+  Verify333(table != NULL);
+  Verify333(value_free_function != NULL);
+  for (i = 0; i < table->num_buckets; i++) {
+    StrEntry *e = table->buckets[i];
+    while (e != NULL) {
+      StrEntry *next = e->next;
+      value_free_function(e->value);
+      free(e);
+      e = next;
+    }
+  }
+  free(table->buckets);
+  free(table);
+}
+
+int StrHashTable_NumElements(StrHashTable *table) {
+  Verify333(table != NULL);
+  return table->num_elements;
+}
+
+uint64_t StrHashTable_Hash(const char *key, size_t len) {
+  return HTHash64(key, len, 0);
+}
+
+bool StrHashTable_Insert(StrHashTable *table, const char *key, size_t len,
+                         HTValue_t value, HTValue_t *old_value) {
+  uint64_t hash;
+  StrEntry **link;
+  StrEntry *e;
+
+  Verify333(table != NULL && old_value != NULL);
+  Verify333(key != NULL || len == 0);
+  Verify333(len <= UINT32_MAX);
+
+  hash = StrHashTable_Hash(key, len);
+  link = StrSearch(table, hash, key, len);
+  if (*link != NULL) {
+    *old_value = (*link)->value;
+    (*link)->value = value;
+    return true;
+  }
+
+  // A short key gets the whole zero-padded small-key slot.
+  e = (StrEntry *) malloc(sizeof(StrEntry) +
+                          (len > STR_SMALL_KEY ? len : STR_SMALL_KEY));
+  Verify333(e != NULL);
+  e->hash = hash;
+  e->value = value;
+  e->len = (uint32_t) len;
+  if (len < STR_SMALL_KEY) {
+    memset(StrEntryKey(e) + len, 0, STR_SMALL_KEY - len);
+  }
+  if (len > 0) {
+    memcpy(StrEntryKey(e), key, len);
+  }
+  // The new entry goes at the end of the chain, where the search stopped.
+  e->next = NULL;
+  *link = e;
+
+  table->num_elements++;
+  if (table->num_elements > table->num_buckets) {
+    StrGrow(table);
+  }
+  return false;
+}
+
+bool StrHashTable_Find(StrHashTable *table, const char *key, size_t len,
+                       HTValue_t *value) {
+  return StrHashTable_FindHashed(table, StrHashTable_Hash(key, len), key,
+                                 len, value);
+}
+
+bool StrHashTable_FindHashed(StrHashTable *table, uint64_t hash,
+                             const char *key, size_t len, HTValue_t *value) {
+  StrEntry *e;
+
+  Verify333(table != NULL && value != NULL);
+  Verify333(key != NULL || len == 0);
+
+  e = *StrSearch(table, hash, key, len);
+  if (e == NULL) {
+    return false;
+  }
+  *value = e->value;
+  return true;
+}
+
+bool StrHashTable_Remove(StrHashTable *table, const char *key, size_t len,
+                         HTValue_t *old_value) {
+  StrEntry **link;
+  StrEntry *e;
+
+  Verify333(table != NULL && old_value != NULL);
+  Verify333(key != NULL || len == 0);
+
+  link = StrSearch(table, StrHashTable_Hash(key, len), key, len);
+  e = *link;
+  if (e == NULL) {
+    return false;
+  }
+  *link = e->next;
+  *old_value = e->value;
+  free(e);
+  table->num_elements--;
+  return true;
+}
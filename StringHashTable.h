@@ -0,0 +1,110 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_STRINGHASHTABLE_H_
+#define HW1_STRINGHASHTABLE_H_
+
+#include <stdbool.h>    // for bool type (true, false)
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint64_t
+
+#include "./HashTable.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A StrHashTable is a chained hash table keyed by byte strings.
+//
+// A HashTable's keys are 64-bit numbers, so string keys have to be hashed
+// down to one, which both needs the strings kept somewhere else and lets
+// two different strings silently share a key.  A StrHashTable keeps a copy
+// of each key's bytes inside its entry (one allocation per entry) and
+// compares keys in full, so different strings are always different keys.
+//
+// Each entry also caches the key's 64-bit hash.  A lookup compares the
+// cached hash (and length) before it looks at any key bytes, so it almost
+// never reads a key that doesn't match, and growing the table never
+// rehashes a key.  Keys of up to 16 bytes sit in a fixed, zero-padded
+// slot, which is compared as two words instead of with memcmp.
+//
+// Keys are arbitrary bytes (they may contain '\0') of up to 4 GB; a key
+// and its length are always passed together.  The table copies the key,
+// so the caller's buffer may be reused as soon as a call returns.  Values
+// are as for HashTable.
+typedef struct strht StrHashTable;
+
+// Allocate and return a new StrHashTable.
+//
+// Arguments:
+// - num_buckets: the initial number of buckets, rounded up to a power of
+//   two; MUST be greater than zero.
+//
+// Returns a pointer to the newly allocated StrHashTable.
+StrHashTable* StrHashTable_Allocate(int num_buckets);
+
+// Free a StrHashTable and its keys.
+//
+// Arguments:
+// - table: the StrHashTable to free.
+// - value_free_function: called on each value in the table.
+void StrHashTable_Free(StrHashTable *table,
+                       ValueFreeFnPtr value_free_function);
+
+// Returns the number of elements in the table.
+int StrHashTable_NumElements(StrHashTable *table);
+
+// Returns the hash the table uses for a key, for StrHashTable_FindHashed.
+// (It is HTHash64(key, len, 0); see HTHash.h.)
+uint64_t StrHashTable_Hash(const char *key, size_t len);
+
+// Inserts a (key,value) into the table, replacing the value of a key that
+// is already there.
+//
+// Arguments:
+// - table: the StrHashTable to insert into.
+// - key, len: the key's bytes, which the table copies.
+// - value: the value to store.
+// - old_value: if the key was already in the table, its old value is
+//   returned through this parameter.
+//
+// Returns false if the key is new, true if it replaced a value.
+bool StrHashTable_Insert(StrHashTable *table, const char *key, size_t len,
+                         HTValue_t value, HTValue_t *old_value);
+
+// Looks up a key.
+//
+// Arguments:
+// - table: the StrHashTable to look in.
+// - key, len: the key's bytes.
+// - value: if the key is found, its value is returned through this
+//   parameter.
+//
+// Returns whether the key was found.
+bool StrHashTable_Find(StrHashTable *table, const char *key, size_t len,
+                       HTValue_t *value);
+
+// Like StrHashTable_Find, for callers that already have the key's hash.
+// hash MUST be StrHashTable_Hash(key, len); with any other hash, the key
+// is simply not found.
+bool StrHashTable_FindHashed(StrHashTable *table, uint64_t hash,
+                             const char *key, size_t len, HTValue_t *value);
+
+// Removes a key from the table and frees the table's copy of it.
+//
+// Arguments:
+// - table: the StrHashTable to remove from.
+// - key, len: the key's bytes.
+// - old_value: if the key was found, its value is returned through this
+//   parameter.
+//
+// Returns whether the key was found (and removed).
+bool StrHashTable_Remove(StrHashTable *table, const char *key, size_t len,
+                         HTValue_t *old_value);
+
+#endif  // HW1_STRINGHASHTABLE_H_
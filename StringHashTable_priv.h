@@ -0,0 +1,56 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_STRINGHASHTABLE_PRIV_H_
+#define HW1_STRINGHASHTABLE_PRIV_H_
+
+#include <stdint.h>  // for uint32_t, etc.
+
+#include "./HashTable.h"
+#include "./StringHashTable.h"
+
+// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+// Internal structures and helper functions for our StrHashTable
+// implementation, broken out so that our unittests can access them.
+//
+// Customers should not include this file or assume anything based on
+// its contents.
+// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+
+// Keys this long or shorter live in the entry's fixed small-key slot.
+#define STR_SMALL_KEY 16
+
+// An entry in a bucket's chain.  The key's bytes follow the entry in the
+// same allocation (see StrEntryKey): a key of up to STR_SMALL_KEY bytes
+// fills a slot of exactly STR_SMALL_KEY bytes (zero-padded), and a longer
+// one takes as many bytes as it needs.
+typedef struct str_entry {
+  struct str_entry  *next;   // the next entry in the chain, or NULL
+  uint64_t           hash;   // StrHashTable_Hash of the key
+  HTValue_t          value;  // the key's value
+  uint32_t           len;    // the key's length in bytes
+} StrEntry;
+
+// Returns the key's bytes, which start right after the entry (and so are
+// aligned to 8 bytes).
+static inline unsigned char *StrEntryKey(StrEntry *e) {
+  return (unsigned char *) (e + 1);
+}
+
+// The table.  Each bucket is the head of a NULL-terminated chain of
+// entries, and a key's bucket is the low bits of its hash.
+typedef struct strht {
+  int         num_buckets;   // # of buckets, a power of two
+  int         num_elements;  // # of entries
+  StrEntry  **buckets;       // the array of chain heads
+} StrHashTable;
+
+#endif  // HW1_STRINGHASHTABLE_PRIV_H_
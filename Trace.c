@@ -0,0 +1,168 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // for clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "CSE333.h"
+#include "Trace.h"
+
+// Values below TRACE_SUB get a bin each; each power of two from TRACE_SUB
+// up is split into TRACE_SUB bins.  The top power of two, 2^63, ends at
+// bin (63 - 3) * 16 + 15.
+#define TRACE_SUB_BITS 4
+#define TRACE_SUB (1 << TRACE_SUB_BITS)
+#define TRACE_BINS ((64 - TRACE_SUB_BITS + 1) * TRACE_SUB)
+
+static uint64_t trace_hist[TRACE_NUM_OPS][TRACE_BINS];
+
+// The largest value that falls in bin b.
+static uint64_t TraceBinMax(int b) {
+  int shift;
+
+  if (b < TRACE_SUB) {
+    return (uint64_t) b;
+  }
+  shift = b / TRACE_SUB - 1;
+  return (((uint64_t) (TRACE_SUB + b % TRACE_SUB) + 1) << shift) - 1;
+}
+
+#ifdef HW1_TRACE
+uint64_t TraceClockNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// The bin that value v falls in.
+static int TraceBin(uint64_t v) {
+  int e;
+
+  if (v < TRACE_SUB) {
+    return (int) v;
+  }
+  e = 63 - __builtin_clzll(v);
+  return (e - TRACE_SUB_BITS + 1) * TRACE_SUB +
+         (int) ((v >> (e - TRACE_SUB_BITS)) & (TRACE_SUB - 1));
+}
+
+void TraceRecord(TraceOp_t op, uint64_t latency) {
+  __atomic_fetch_add(&trace_hist[op][TraceBin(latency)], 1,
+                     __ATOMIC_RELAXED);
+}
+#endif  // HW1_TRACE
+
+#ifdef TRACE_USE_TSC
+// Nanoseconds per TSC tick, measured once against clock_gettime the first
+// time a percentile is asked for.
+static double trace_ns_per_tick;
+static pthread_once_t trace_calibrate_once = PTHREAD_ONCE_INIT;
+
+static void TraceCalibrate(void) {
+  struct timespec pause = { 0, 20 * 1000 * 1000 };
+  uint64_t ns0 = TraceClockNs(), t0 = __rdtsc();
+  uint64_t ns1, t1;
+
+  nanosleep(&pause, NULL);
+  ns1 = TraceClockNs();
+  t1 = __rdtsc();
+  trace_ns_per_tick = (double) (ns1 - ns0) / (double) (t1 - t0);
+}
+
+static double TraceToNs(uint64_t ticks) {
+  pthread_once(&trace_calibrate_once, &TraceCalibrate);
+  return (double) ticks * trace_ns_per_tick;
+}
+#else
+static double TraceToNs(uint64_t ns) {
+  return (double) ns;
+}
+#endif  // TRACE_USE_TSC
+
+bool Trace_Enabled(void) {
+#ifdef HW1_TRACE
+  return true;
+#else
+  return false;
+#endif
+}
+
+uint64_t Trace_Count(TraceOp_t op) {
+  uint64_t count = 0;
+  int b;
+
+  Verify333(op >= 0 && op < TRACE_NUM_OPS);
+  for (b = 0; b < TRACE_BINS; b++) {
+    count += __atomic_load_n(&trace_hist[op][b], __ATOMIC_RELAXED);
+  }
+  return count;
+}
+
+double Trace_Percentile(TraceOp_t op, double p) {
+  uint64_t count, rank, seen = 0;
+  int b;
+
+  Verify333(op >= 0 && op < TRACE_NUM_OPS);
+  Verify333(p >= 0.0 && p <= 1.0);
+  count = Trace_Count(op);
+  if (count == 0) {
+    return 0.0;
+  }
+
+  // The smallest bin by which at least p of the values have been seen.
+  rank = (uint64_t) (p * (double) count + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (b = 0; b < TRACE_BINS; b++) {
+    seen += __atomic_load_n(&trace_hist[op][b], __ATOMIC_RELAXED);
+    if (seen >= rank) {
+      break;
+    }
+  }
+  if (b == TRACE_BINS) {
+    // The histogram grew while we looked; report the top non-empty bin.
+    for (b = TRACE_BINS - 1; b > 0; b--) {
+      if (__atomic_load_n(&trace_hist[op][b], __ATOMIC_RELAXED) != 0) {
+        break;
+      }
+    }
+  }
+  return TraceToNs(TraceBinMax(b));
+}
+
+void Trace_Reset(void) {
+  int op, b;
+
+  for (op = 0; op < TRACE_NUM_OPS; op++) {
+    for (b = 0; b < TRACE_BINS; b++) {
+      __atomic_store_n(&trace_hist[op][b], 0, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// The empty asm keeps the compiler from deciding that a call to a function
+// that does nothing can be dropped, even with link-time optimization.
+__attribute__((noinline, used))
+void Trace_ProbeStart(int op, uint64_t arg) {
+  __asm__ volatile("" : : "r"(op), "r"(arg) : "memory");
+}
+
+__attribute__((noinline, used))
+void Trace_ProbeDone(int op, uint64_t latency) {
+  __asm__ volatile("" : : "r"(op), "r"(latency) : "memory");
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW1_TRACE_H_
+#define HW1_TRACE_H_
+
+#include <stdbool.h>  // for bool
+#include <stdint.h>   // for uint64_t
+
+///////////////////////////////////////////////////////////////////////////////
+// Optional latency tracing.
+//
+// When the library is built with HW1_TRACE defined ("make TRACE=1"), each
+// traced operation records its latency in a histogram, and fires a static
+// probe as it starts and as it finishes that perf or bpftrace can attach
+// to.  Without HW1_TRACE, the TRACE_SCOPE markers in the library expand to
+// nothing, so there is no cost at all; the functions below still exist,
+// but there is never anything recorded for them to report.
+//
+// Latencies are measured with clock_gettime(CLOCK_MONOTONIC), or, if
+// HW1_TRACE_TSC is also defined on x86, with the timestamp counter, which
+// is cheaper to read and is converted to nanoseconds when reported.
+//
+// The histograms are HDR-style: values below 16 get a bin each, and every
+// power of two above that is split into 16 bins, so any recorded latency
+// is reported to within 1/16 (about 6%) of its true value, from a
+// nanosecond up to centuries.  There is one histogram per operation,
+// shared by every thread, and bins are bumped with relaxed atomic adds.
+//
+// The probes, all in provider "hw1", are:
+//   op__start(op, arg)     as an operation starts; arg is the key (for
+//                          the HashTable operations), the bucket or slot
+//                          count (resize) or the list length (sort)
+//   op__done(op, latency)  as it finishes, with its latency in ns (or
+//                          TSC ticks)
+// where op is a TraceOp_t.  When <sys/sdt.h> is available they are real
+// USDT probes (a single nop each until something attaches); otherwise they
+// are calls to the non-inlined functions Trace_ProbeStart and
+// Trace_ProbeDone, which can be attached to as uprobes.
+
+// The traced operations.
+//
+// - TRACE_HT_INSERT, TRACE_HT_FIND, TRACE_HT_REMOVE: HashTable_Insert,
+//   HashTable_Find and HashTable_Remove, for any engine.
+// - TRACE_HT_RESIZE: each piece of resizing work that MaybeResize (or a
+//   shrink) sets off: starting a chained resize, one incremental migration
+//   step, or a whole Robin Hood, Swiss or read-mostly resize.  This is what
+//   an Insert or Remove that shows up in the tail was usually doing.
+// - TRACE_LL_SORT: LinkedList_Sort.
+typedef enum {
+  TRACE_HT_INSERT = 0,
+  TRACE_HT_FIND,
+  TRACE_HT_REMOVE,
+  TRACE_HT_RESIZE,
+  TRACE_LL_SORT,
+  TRACE_NUM_OPS
+} TraceOp_t;
+
+// Returns whether the library was built with HW1_TRACE.
+bool Trace_Enabled(void);
+
+// Returns how many times op has been recorded since the last reset.
+uint64_t Trace_Count(TraceOp_t op);
+
+// Returns the latency, in nanoseconds, that fraction p (between 0 and 1)
+// of op's recorded latencies are at or below: p = 0.5 is the median,
+// p = 1 the maximum.  Returns 0 if nothing has been recorded.
+double Trace_Percentile(TraceOp_t op, double p);
+
+// Clear every histogram.  Operations that are running at the time may or
+// may not be counted.
+void Trace_Reset(void);
+
+// The probe functions used when <sys/sdt.h> isn't available.  They do
+// nothing; they are only there to be attached to.
+void Trace_ProbeStart(int op, uint64_t arg);
+void Trace_ProbeDone(int op, uint64_t latency);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Instrumentation, for the library's own use.
+//
+// TRACE_SCOPE(op, arg) goes at the top of the block to be timed: it fires
+// op__start and starts a clock, and when the block is left, however it is
+// left, records the latency and fires op__done.
+
+#ifdef HW1_TRACE
+
+#if defined(HW1_TRACE_TSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define TRACE_USE_TSC 1
+#endif
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_USE_SDT 1
+#endif
+#endif
+
+#ifdef TRACE_USE_SDT
+#define TRACE_PROBE_START(op, arg) DTRACE_PROBE2(hw1, op__start, op, arg)
+#define TRACE_PROBE_DONE(op, lat) DTRACE_PROBE2(hw1, op__done, op, lat)
+#else
+#define TRACE_PROBE_START(op, arg) Trace_ProbeStart((op), (uint64_t) (arg))
+#define TRACE_PROBE_DONE(op, lat) Trace_ProbeDone((op), (lat))
+#endif
+
+// Add a latency (in clock units) to op's histogram.
+void TraceRecord(TraceOp_t op, uint64_t latency);
+
+// clock_gettime(CLOCK_MONOTONIC) in ns.  It lives in Trace.c so that the
+// files it is used in needn't ask for POSIX.
+uint64_t TraceClockNs(void);
+
+// Read the clock, in ns or TSC ticks.
+static inline uint64_t TraceNow(void) {
+#ifdef TRACE_USE_TSC
+  return __rdtsc();
+#else
+  return TraceClockNs();
+#endif
+}
+
+typedef struct {
+  TraceOp_t  op;
+  uint64_t   start;
+} TraceScope;
+
+static inline void TraceScopeEnd(TraceScope *scope) {
+  uint64_t latency = TraceNow() - scope->start;
+  TraceRecord(scope->op, latency);
+  TRACE_PROBE_DONE(scope->op, latency);
+}
+
+#define TRACE_SCOPE(op, arg)                                           \
+  TRACE_PROBE_START(op, arg);                                          \
+  TraceScope trace_scope_ __attribute__((cleanup(TraceScopeEnd))) =    \
+    { (op), TraceNow() }
+
+#else  // HW1_TRACE
+
+#define TRACE_SCOPE(op, arg) ((void) 0)
+
+#endif  // HW1_TRACE
+
+#endif  // HW1_TRACE_H_
@@ -0,0 +1,2185 @@
+/*
+ * Copyright ©2025 Hal Perkins.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "CSE333.h"
+#include "HashTable.h"
+#include "HashTable_priv.h"
+#include "HTHash.h"
+#include "HashTableLog.h"
+#include "HashTableSnapshot.h"
+#include "Interner.h"
+#include "LinkedList.h"
+#include "LockFreeHashTable.h"
+#include "ShardedHashTable.h"
+#include "StringHashTable.h"
+#include "Trace.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// HashTable benchmarks.
+//
+// Usage: ./bench_hashtable [benchmark ...]
+//
+// With no arguments every benchmark runs; otherwise only the named ones do.
+// The Makefile builds this program (and its own copy of the library) with
+// optimization turned on, since -O0 numbers aren't worth much.  Like the
+// unit tests, some benchmarks peek at HashTable_priv.h to pick settings
+// that customers can't.
+
+// A benchmark is just a named function.
+typedef struct {
+  const char *name;
+  void (*fn)(void);
+} Benchmark;
+
+// Return a monotonic timestamp in nanoseconds.
+static double NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// A small, fast, deterministic PRNG (splitmix64) for generating keys.
+static uint64_t NextRandom(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Fill keys[0..n) with distinct pseudo-random keys.
+static void RandomKeys(HTKey_t *keys, int n, uint64_t seed) {
+  int i;
+  for (i = 0; i < n; i++) {
+    keys[i] = NextRandom(&seed);
+  }
+}
+
+// Values in the benchmarks are never dereferenced.
+static void NoOpFree(HTValue_t value) { }
+
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// Sort samples[0..n) and print the interesting percentiles of it.
+static void PrintPercentiles(const char *label, double *samples, int n) {
+  qsort(samples, n, sizeof(double), &CompareDoubles);
+  printf("%-16s %9.0f %9.0f %9.0f %9.0f %11.0f\n", label,
+         samples[n / 2], samples[(int) (n * 0.99)],
+         samples[(int) (n * 0.999)], samples[(int) (n * 0.9999)],
+         samples[n - 1]);
+}
+
+static const char *EngineName(HTEngine_t engine) {
+  switch (engine) {
+    case HT_ENGINE_CHAINED:   return "chained";
+    case HT_ENGINE_ROBINHOOD: return "robinhood";
+    case HT_ENGINE_SWISS:     return "swiss";
+  }
+  return "?";
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// engines: compare the engines at fixed load factors.
+//
+// Each table is allocated with kSlots buckets/slots and filled to the target
+// load factor.  Only the Swiss table resizes during the run (above its 7/8
+// limit).  We report the cost of inserts, of successful and unsuccessful
+// lookups, and of removes.
+static void BenchEngines(void) {
+  static const int kSlots = 1 << 20;
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  static const double kLoads[] = { 0.5, 0.6, 0.7, 0.8, 0.9 };
+  int n_max = (int) (kSlots * 0.9);
+  HTKey_t *keys = (HTKey_t *) malloc(2 * n_max * sizeof(HTKey_t));
+  HTKey_t *misses = keys + n_max;
+  size_t e, l;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, 2 * n_max, 333);
+
+  printf("%-10s %5s %10s %10s %10s %10s   (ns/op)\n",
+         "engine", "load", "insert", "hit", "miss", "remove");
+  for (l = 0; l < sizeof(kLoads) / sizeof(kLoads[0]); l++) {
+    int n = (int) (kSlots * kLoads[l]);
+    for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+      HashTable *ht = HashTable_AllocateEngine(kSlots, kEngines[e]);
+      HTKeyValue_t kv, old;
+      double t0, t_ins, t_hit, t_miss, t_rem;
+      int i, found = 0;
+
+      t0 = NowNs();
+      for (i = 0; i < n; i++) {
+        kv.key = keys[i];
+        kv.value = (HTValue_t) &keys[i];
+        HashTable_Insert(ht, kv, &old);
+      }
+      t_ins = NowNs() - t0;
+
+      t0 = NowNs();
+      for (i = 0; i < n; i++) {
+        found += HashTable_Find(ht, keys[i], &kv);
+      }
+      t_hit = NowNs() - t0;
+
+      t0 = NowNs();
+      for (i = 0; i < n; i++) {
+        found += HashTable_Find(ht, misses[i], &kv);
+      }
+      t_miss = NowNs() - t0;
+      Verify333(found == n);
+
+      t0 = NowNs();
+      for (i = 0; i < n; i++) {
+        HashTable_Remove(ht, keys[i], &kv);
+      }
+      t_rem = NowNs() - t0;
+      Verify333(HashTable_NumElements(ht) == 0);
+
+      printf("%-10s %5.2f %10.1f %10.1f %10.1f %10.1f\n",
+             EngineName(kEngines[e]), kLoads[l], t_ins / n, t_hit / n,
+             t_miss / n, t_rem / n);
+      HashTable_Free(ht, &NoOpFree);
+    }
+  }
+  free(keys);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// resize: per-insert latency with stop-the-world vs incremental resizing.
+//
+// Both runs grow a chained table from a single bucket, so they go through
+// the same sequence of 9x resizes.  A migrate_step of 0 moves every bucket
+// in the insert that triggers the resize, which is the old behavior.  Each
+// run gets its own process: otherwise the second run's tail is dominated
+// by the kernel taking back the first run's freed memory.
+static void BenchResize(void) {
+  static const int kNumKeys = 1 << 22;
+  static const int kSteps[] = { 0, 8 };
+  HTKey_t *keys = (HTKey_t *) malloc(kNumKeys * sizeof(HTKey_t));
+  double *lat = (double *) malloc(kNumKeys * sizeof(double));
+  size_t s;
+
+  Verify333(keys != NULL && lat != NULL);
+  RandomKeys(keys, kNumKeys, 333);
+
+  printf("%d inserts into a chained table (ns):\n", kNumKeys);
+  printf("%-16s %9s %9s %9s %9s %11s\n",
+         "mode", "p50", "p99", "p99.9", "p99.99", "max");
+  fflush(stdout);
+  for (s = 0; s < sizeof(kSteps) / sizeof(kSteps[0]); s++) {
+    HashTable *ht;
+    HTKeyValue_t kv, old;
+    char label[32];
+    int i;
+    pid_t pid = fork();
+
+    Verify333(pid >= 0);
+    if (pid > 0) {
+      Verify333(waitpid(pid, NULL, 0) == pid);
+      continue;
+    }
+
+    ht = HashTable_Allocate(1);
+    ht->migrate_step = kSteps[s];
+    for (i = 0; i < kNumKeys; i++) {
+      double t0 = NowNs();
+      kv.key = keys[i];
+      kv.value = (HTValue_t) &keys[i];
+      HashTable_Insert(ht, kv, &old);
+      lat[i] = NowNs() - t0;
+    }
+    if (kSteps[s] == 0) {
+      snprintf(label, sizeof(label), "stop-the-world");
+    } else {
+      snprintf(label, sizeof(label), "incremental/%d", kSteps[s]);
+    }
+    PrintPercentiles(label, lat, kNumKeys);
+    HashTable_Free(ht, &NoOpFree);
+    exit(EXIT_SUCCESS);
+  }
+  free(lat);
+  free(keys);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// shrink: memory and iteration after a table fills up and drains.
+//
+// Each engine takes kNumKeys random keys and then has all but 1% of them
+// removed, three ways: reserved for the full size up front (so it never
+// shrinks, as before automatic shrinking), shrinking on its own, and
+// shrinking on its own followed by HashTable_ShrinkToFit.  We report the
+// heap the table still holds, the cost per Remove over the drain, and the
+// cost of iterating over what is left.  Each run is in its own process, so
+// the heap numbers don't include an earlier run's leftovers.
+static size_t HeapInUse(void) {
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+static void BenchShrink(void) {
+  static const int kNumKeys = 1 << 22;
+  static const int kNumLeft = kNumKeys / 100;
+  static const struct {
+    const char *name;
+    HTEngine_t  engine;
+  } kEngines[] = {
+    { "chained", HT_ENGINE_CHAINED },
+    { "robinhood", HT_ENGINE_ROBINHOOD },
+    { "swiss", HT_ENGINE_SWISS },
+  };
+  static const char *kModes[] = { "never", "auto", "auto+fit" };
+  HTKey_t *keys = (HTKey_t *) malloc(kNumKeys * sizeof(HTKey_t));
+  size_t e;
+  int m;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, kNumKeys, 335);
+
+  printf("%d keys, drained to %d:\n", kNumKeys, kNumLeft);
+  printf("%-10s %-9s %10s %10s %12s %12s\n", "engine", "shrink",
+         "full MB", "left MB", "ns/remove", "ns/iterated");
+  fflush(stdout);
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    for (m = 0; m < 3; m++) {
+      HashTable *ht;
+      HTIterator *it;
+      HTKeyValue_t kv, old;
+      size_t base, full, left;
+      double t0, remove_ns, iter_ns;
+      int i, n;
+      pid_t pid = fork();
+
+      Verify333(pid >= 0);
+      if (pid > 0) {
+        Verify333(waitpid(pid, NULL, 0) == pid);
+        continue;
+      }
+
+      base = HeapInUse();
+      ht = HashTable_AllocateEngine(1, kEngines[e].engine);
+      if (m == 0) {
+        HashTable_Reserve(ht, kNumKeys);
+      }
+      for (i = 0; i < kNumKeys; i++) {
+        kv.key = keys[i];
+        kv.value = (HTValue_t) &keys[i];
+        HashTable_Insert(ht, kv, &old);
+      }
+      full = HeapInUse() - base;
+
+      t0 = NowNs();
+      for (i = kNumLeft; i < kNumKeys; i++) {
+        HashTable_Remove(ht, keys[i], &kv);
+      }
+      remove_ns = (NowNs() - t0) / (kNumKeys - kNumLeft);
+      if (m == 2) {
+        HashTable_ShrinkToFit(ht);
+      }
+      left = HeapInUse() - base;
+
+      t0 = NowNs();
+      n = 0;
+      it = HTIterator_Allocate(ht);
+      for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+        n++;
+      }
+      HTIterator_Free(it);
+      iter_ns = (NowNs() - t0) / n;
+      Verify333(n == HashTable_NumElements(ht));
+
+      printf("%-10s %-9s %10.1f %10.1f %12.1f %12.1f\n", kEngines[e].name,
+             kModes[m], full / 1048576.0, left / 1048576.0, remove_ns,
+             iter_ns);
+      HashTable_Free(ht, &NoOpFree);
+      exit(EXIT_SUCCESS);
+    }
+  }
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// iterate: a full iteration over a chained table at several occupancies.
+//
+// A table of kIterBuckets buckets gets enough random keys for about 1%,
+// 10% or 100% of its buckets to be non-empty (the last at load factor 3,
+// where it would grow, so really 95%).  We time finding every non-empty
+// bucket the old way, by looking at each bucket's LinkedList in turn, and
+// with the occupancy bitmap, a word at a time, and then a whole HTIterator
+// walk, which uses the bitmap.
+static void BenchIterate(void) {
+  static const int kIterBuckets = 1 << 22;
+  static const struct {
+    const char *name;
+    int         num_keys;
+  } kFills[] = {
+    { "1%", kIterBuckets / 100 },
+    { "10%", kIterBuckets / 10 + kIterBuckets / 200 },
+    { "100%", kIterBuckets * 3 - 1 },
+  };
+  HTKey_t *keys = (HTKey_t *) malloc(kIterBuckets * 3 * sizeof(HTKey_t));
+  size_t f;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, kIterBuckets * 3, 336);
+
+  printf("%d buckets, full iteration (ms):\n", kIterBuckets);
+  printf("%-6s %10s %10s %10s %10s %10s\n", "fill", "keys", "occupied",
+         "scan all", "bitmap", "iterator");
+  for (f = 0; f < sizeof(kFills) / sizeof(kFills[0]); f++) {
+    HashTable *ht = HashTable_Allocate(kIterBuckets);
+    HTIterator *it;
+    HTKeyValue_t kv, old;
+    double t0, scan_ms, bitmap_ms, iter_ms;
+    int i, w, occupied = 0, found = 0, n = 0;
+
+    for (i = 0; i < kFills[f].num_keys; i++) {
+      kv.key = keys[i];
+      kv.value = (HTValue_t) &keys[i];
+      HashTable_Insert(ht, kv, &old);
+    }
+    Verify333(ht->num_buckets == kIterBuckets && ht->old_buckets == NULL);
+
+    t0 = NowNs();
+    for (i = 0; i < ht->num_buckets; i++) {
+      occupied += LinkedList_NumElements(ht->buckets[i]) > 0;
+    }
+    scan_ms = (NowNs() - t0) / 1e6;
+
+    t0 = NowNs();
+    for (w = 0; w < (ht->num_buckets + 63) / 64; w++) {
+      uint64_t word = ht->occupied[w];
+      for (; word != 0; word &= word - 1) {
+        found += LinkedList_NumElements(
+            ht->buckets[w * 64 + __builtin_ctzll(word)]) > 0;
+      }
+    }
+    bitmap_ms = (NowNs() - t0) / 1e6;
+    Verify333(found == occupied);
+
+    t0 = NowNs();
+    it = HTIterator_Allocate(ht);
+    for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+      n++;
+    }
+    HTIterator_Free(it);
+    iter_ms = (NowNs() - t0) / 1e6;
+    Verify333(n == HashTable_NumElements(ht));
+
+    printf("%-6s %10d %9.1f%% %10.2f %10.2f %10.2f\n", kFills[f].name, n,
+           100.0 * occupied / ht->num_buckets, scan_ms, bitmap_ms, iter_ms);
+    HashTable_Free(ht, &NoOpFree);
+  }
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sweep: expiring half of a table.
+//
+// Each engine gets kSweepKeys random keys, and then every key with its
+// low bit set is removed three ways: by HashTable_Remove on each key in
+// turn (what a sweep that collected its keys first would do), by walking
+// an HTIterator and calling HTIterator_Remove on the matches, and by
+// HashTable_RemoveIf.  Tables are reserved for the full size so that
+// none of them shrinks part way through.
+static bool SweepOdd(HTKeyValue_t kv, void *arg) {
+  return (kv.key & 1) != 0;
+}
+
+static void BenchSweep(void) {
+  static const int kSweepKeys = 1 << 22;
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  static const char *kModes[] = { "Remove", "iterator", "RemoveIf" };
+  HTKey_t *keys = (HTKey_t *) malloc(kSweepKeys * sizeof(HTKey_t));
+  size_t e;
+  int m;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, kSweepKeys, 337);
+
+  printf("%d keys, removing about half (ns/removed):\n", kSweepKeys);
+  printf("%-10s %10s %10s %10s\n", "engine", kModes[0], kModes[1], kModes[2]);
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    printf("%-10s", EngineName(kEngines[e]));
+    for (m = 0; m < 3; m++) {
+      HashTable *ht = HashTable_AllocateEngine(1, kEngines[e]);
+      HTIterator *it;
+      HTKeyValue_t kv, old;
+      double t0;
+      int i, n = 0;
+
+      HashTable_Reserve(ht, kSweepKeys);
+      for (i = 0; i < kSweepKeys; i++) {
+        kv.key = keys[i];
+        kv.value = (HTValue_t) &keys[i];
+        HashTable_Insert(ht, kv, &old);
+      }
+
+      t0 = NowNs();
+      if (m == 0) {
+        for (i = 0; i < kSweepKeys; i++) {
+          if (SweepOdd((HTKeyValue_t) { keys[i], NULL }, NULL)) {
+            n += HashTable_Remove(ht, keys[i], &kv);
+          }
+        }
+      } else if (m == 1) {
+        it = HTIterator_Allocate(ht);
+        while (HTIterator_Get(it, &kv)) {
+          if (SweepOdd(kv, NULL)) {
+            HTIterator_Remove(it, &kv);
+            n++;
+          } else {
+            HTIterator_Next(it);
+          }
+        }
+        HTIterator_Free(it);
+      } else {
+        n = HashTable_RemoveIf(ht, &SweepOdd, NULL, &NoOpFree);
+      }
+      printf(" %10.1f", (NowNs() - t0) / n);
+      fflush(stdout);
+      HashTable_Free(ht, &NoOpFree);
+    }
+    printf("\n");
+  }
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stats: what HashTable_GetStats reports, and what it costs.
+//
+// Each engine gets kStatsKeys random keys.  We print the stats, check the
+// byte count against what malloc says the table is holding (the
+// difference is malloc's per-block overhead), and time the call.
+static void BenchStats(void) {
+  static const int kStatsKeys = 1 << 22;
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  HTKey_t *keys = (HTKey_t *) malloc(kStatsKeys * sizeof(HTKey_t));
+  size_t e;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, kStatsKeys, 338);
+
+  printf("%d keys:\n", kStatsKeys);
+  printf("%-10s %9s %8s %8s %7s %8s %9s %9s %9s %10s\n", "engine",
+         "buckets", "empty", "resizes", "max", "mean", "MB", "heap MB",
+         "B/entry", "ms/call");
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    size_t base = HeapInUse();
+    HashTable *ht = HashTable_AllocateEngine(1, kEngines[e]);
+    HTKeyValue_t kv, old;
+    HTStats stats;
+    double t0;
+    int i;
+
+    for (i = 0; i < kStatsKeys; i++) {
+      kv.key = keys[i];
+      kv.value = (HTValue_t) &keys[i];
+      HashTable_Insert(ht, kv, &old);
+    }
+
+    t0 = NowNs();
+    for (i = 0; i < 10; i++) {
+      HashTable_GetStats(ht, &stats);
+    }
+    printf("%-10s %9d %8d %8" PRIu64 " %7d %8.2f %9.1f %9.1f %9.1f %10.2f\n",
+           EngineName(kEngines[e]), stats.num_buckets, stats.empty_buckets,
+           stats.num_resizes, stats.max_probe, stats.mean_probe,
+           stats.total_bytes / 1048576.0,
+           (HeapInUse() - base) / 1048576.0, stats.bytes_per_entry,
+           (NowNs() - t0) / 10 / 1e6);
+    HashTable_Free(ht, &NoOpFree);
+  }
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// trace: per-operation latency percentiles.
+//
+// Each engine, starting from one bucket, gets kTraceKeys random keys and
+// then looks each of them up.  The mean ns/op is printed either way; run
+// it once from a plain build and once from "make TRACE=1" to see what the
+// instrumentation costs.  In a traced build we also print the latency
+// percentiles that Trace recorded, which show the resize spikes that the
+// mean hides.
+static void BenchTrace(void) {
+  static const int kTraceKeys = 1 << 20;
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  static const TraceOp_t kOps[] = {
+    TRACE_HT_INSERT, TRACE_HT_FIND, TRACE_HT_RESIZE
+  };
+  static const char *kOpNames[] = { "insert", "find", "resize" };
+  HTKey_t *keys = (HTKey_t *) malloc(kTraceKeys * sizeof(HTKey_t));
+  size_t e, o;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, kTraceKeys, 339);
+
+  printf("%d keys, tracing %s:\n", kTraceKeys,
+         Trace_Enabled() ? "on" : "off");
+  printf("%-10s %-7s %9s %9s %9s %9s %11s %9s\n", "engine", "op", "ns/op",
+         "p50", "p99", "p99.9", "max", "count");
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    HashTable *ht = HashTable_AllocateEngine(1, kEngines[e]);
+    HTKeyValue_t kv, old;
+    double ns[2], t0;
+    int i;
+
+    Trace_Reset();
+    t0 = NowNs();
+    for (i = 0; i < kTraceKeys; i++) {
+      kv.key = keys[i];
+      kv.value = (HTValue_t) &keys[i];
+      HashTable_Insert(ht, kv, &old);
+    }
+    ns[0] = (NowNs() - t0) / kTraceKeys;
+    t0 = NowNs();
+    for (i = 0; i < kTraceKeys; i++) {
+      Verify333(HashTable_Find(ht, keys[i], &kv));
+    }
+    ns[1] = (NowNs() - t0) / kTraceKeys;
+
+    for (o = 0; o < sizeof(kOps) / sizeof(kOps[0]); o++) {
+      printf("%-10s %-7s", EngineName(kEngines[e]), kOpNames[o]);
+      if (o < 2) {
+        printf(" %9.1f", ns[o]);
+      } else {
+        printf(" %9s", "-");
+      }
+      if (Trace_Enabled()) {
+        printf(" %9.0f %9.0f %9.0f %11.0f %9" PRIu64,
+               Trace_Percentile(kOps[o], 0.5),
+               Trace_Percentile(kOps[o], 0.99),
+               Trace_Percentile(kOps[o], 0.999),
+               Trace_Percentile(kOps[o], 1.0), Trace_Count(kOps[o]));
+      }
+      printf("\n");
+    }
+    HashTable_Free(ht, &NoOpFree);
+  }
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// chains: self-organizing chains under Zipf-distributed lookups.
+//
+// A chained table of kChainBuckets buckets is loaded to load factors 1
+// to 3 (where it would grow) with keys inserted hottest first, so that
+// the hot keys start out at the backs of their chains.  Then kZipfLookups
+// lookups drawn from Zipf(0.99) over those keys run under each chain
+// policy: a first pass lets the chains settle, and a second is timed.
+#define ZIPF_S 0.99
+
+// Fill samples[0..num_samples) with ranks in [0, n) drawn from Zipf(s).
+static void ZipfSamples(int *samples, int num_samples, int n, uint64_t seed) {
+  double *cdf = (double *) malloc(n * sizeof(double));
+  double sum = 0;
+  int i;
+
+  Verify333(cdf != NULL);
+  for (i = 0; i < n; i++) {
+    sum += 1.0 / pow(i + 1, ZIPF_S);
+    cdf[i] = sum;
+  }
+  for (i = 0; i < num_samples; i++) {
+    double u = (NextRandom(&seed) >> 11) * (1.0 / (1ULL << 53)) * sum;
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < u) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    samples[i] = lo;
+  }
+  free(cdf);
+}
+
+static void BenchChains(void) {
+  static const int kChainBuckets = 1 << 18;
+  static const int kZipfLookups = 1 << 23;
+  static const struct {
+    const char      *name;
+    HTChainPolicy_t  policy;
+  } kPolicies[] = {
+    { "fixed", HT_CHAIN_FIXED },
+    { "move-to-front", HT_CHAIN_MOVE_TO_FRONT },
+    { "transpose", HT_CHAIN_TRANSPOSE },
+  };
+  int max_keys = 3 * kChainBuckets;
+  HTKey_t *keys = (HTKey_t *) malloc(max_keys * sizeof(HTKey_t));
+  HTKey_t *lookups = (HTKey_t *) malloc(kZipfLookups * sizeof(HTKey_t));
+  int *ranks = (int *) malloc(kZipfLookups * sizeof(int));
+  int load;
+  size_t p;
+
+  Verify333(keys != NULL && lookups != NULL && ranks != NULL);
+  RandomKeys(keys, max_keys, 336);
+
+  printf("%d Zipf(%.2f) lookups, %d buckets:\n", kZipfLookups, ZIPF_S,
+         kChainBuckets);
+  printf("%-6s %-14s %10s %12s\n", "load", "policy", "ns/find", "probe depth");
+  for (load = 1; load <= 3; load++) {
+    int num_keys = load * kChainBuckets;
+    int i;
+
+    ZipfSamples(ranks, kZipfLookups, num_keys, 337);
+    for (i = 0; i < kZipfLookups; i++) {
+      lookups[i] = keys[ranks[i]];
+    }
+    for (p = 0; p < sizeof(kPolicies) / sizeof(kPolicies[0]); p++) {
+      HashTable *ht = HashTable_Allocate(kChainBuckets);
+      HTKeyValue_t kv, old;
+      double t0, ns;
+      int found = 0;
+
+      for (i = 0; i < num_keys; i++) {
+        kv.key = keys[i];
+        kv.value = (HTValue_t) &keys[i];
+        HashTable_Insert(ht, kv, &old);
+      }
+      Verify333(ht->num_buckets == kChainBuckets);
+      HashTable_SetChainPolicy(ht, kPolicies[p].policy);
+      for (i = 0; i < kZipfLookups; i++) {
+        found += HashTable_Find(ht, lookups[i], &kv);
+      }
+      HashTable_ProbeDepth(ht, true);
+
+      t0 = NowNs();
+      for (i = 0; i < kZipfLookups; i++) {
+        found += HashTable_Find(ht, lookups[i], &kv);
+      }
+      ns = (NowNs() - t0) / kZipfLookups;
+      Verify333(found == 2 * kZipfLookups);
+      printf("%-6d %-14s %10.1f %12.2f\n", load, kPolicies[p].name, ns,
+             HashTable_ProbeDepth(ht, false));
+      HashTable_Free(ht, &NoOpFree);
+    }
+  }
+  free(ranks);
+  free(lookups);
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// hashing: chain lengths and throughput for structured key sets.
+//
+// For each key set we print the distribution of chain lengths two ways:
+// under the plain "key % num_buckets" mapping on a table of kBuckets
+// buckets (the original scheme, simulated here), and in a real chained
+// table asked for kBuckets buckets (which rounds up to a power of two and
+// mixes keys).  Then we time inserting and finding every key.
+#define HIST_MAX 8  // chains this long or longer share the last column
+
+// Print one row: how many buckets have 0, 1, ... HIST_MAX+ elements.
+static void PrintChainHistogram(const char *label, const int *lengths,
+                                int num_buckets) {
+  int hist[HIST_MAX + 1] = { 0 };
+  int i, longest = 0;
+
+  for (i = 0; i < num_buckets; i++) {
+    hist[lengths[i] < HIST_MAX ? lengths[i] : HIST_MAX]++;
+    if (lengths[i] > longest) {
+      longest = lengths[i];
+    }
+  }
+  printf("  %-8s", label);
+  for (i = 0; i <= HIST_MAX; i++) {
+    printf(" %6.1f%%", 100.0 * hist[i] / num_buckets);
+  }
+  printf(" %8d\n", longest);
+}
+
+static void BenchHashing(void) {
+  static const int kBuckets = 100000;
+  static const int kNumKeys = 3 * kBuckets - 1;  // just under the threshold
+  static const char *kSets[] = { "sequential", "stride 2^16", "random" };
+  HTKey_t *keys = (HTKey_t *) malloc(kNumKeys * sizeof(HTKey_t));
+  int *lengths = (int *) malloc(2 * kBuckets * sizeof(int));
+  size_t k;
+  int i;
+
+  Verify333(keys != NULL && lengths != NULL);
+  for (k = 0; k < sizeof(kSets) / sizeof(kSets[0]); k++) {
+    HashTable *ht = HashTable_Allocate(kBuckets);
+    HTKeyValue_t kv, old;
+    double t0, t_ins, t_find;
+    int found = 0;
+
+    for (i = 0; i < kNumKeys; i++) {
+      if (k == 0) {
+        keys[i] = i;
+      } else if (k == 1) {
+        keys[i] = (HTKey_t) i << 16;
+      }
+    }
+    if (k == 2) {
+      RandomKeys(keys, kNumKeys, 333);
+    }
+
+    printf("%s keys, %d keys, %d buckets requested:\n", kSets[k],
+           kNumKeys, kBuckets);
+    printf("  %-8s", "chains");
+    for (i = 0; i < HIST_MAX; i++) {
+      printf(" %7d", i);
+    }
+    printf(" %6d+ %8s\n", HIST_MAX, "longest");
+
+    memset(lengths, 0, kBuckets * sizeof(int));
+    for (i = 0; i < kNumKeys; i++) {
+      lengths[keys[i] % kBuckets]++;
+    }
+    PrintChainHistogram("modulo", lengths, kBuckets);
+
+    t0 = NowNs();
+    for (i = 0; i < kNumKeys; i++) {
+      kv.key = keys[i];
+      kv.value = (HTValue_t) &keys[i];
+      HashTable_Insert(ht, kv, &old);
+    }
+    t_ins = NowNs() - t0;
+    t0 = NowNs();
+    for (i = 0; i < kNumKeys; i++) {
+      found += HashTable_Find(ht, keys[i], &kv);
+    }
+    t_find = NowNs() - t0;
+    Verify333(found == kNumKeys);
+
+    Verify333(ht->num_buckets <= 2 * kBuckets);
+    for (i = 0; i < ht->num_buckets; i++) {
+      lengths[i] = LinkedList_NumElements(ht->buckets[i]);
+    }
+    PrintChainHistogram("mixed", lengths, ht->num_buckets);
+    printf("  insert %.1f ns/op, find %.1f ns/op\n", t_ins / kNumKeys,
+           t_find / kNumKeys);
+    HashTable_Free(ht, &NoOpFree);
+  }
+  free(lengths);
+  free(keys);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// hashfn: the cost per byte of hashing keys of 8 bytes to 4 KB.
+//
+// Keys are taken at varying offsets of a buffer small enough to stay in
+// L1/L2 cache, so this measures the hash functions themselves.  Each
+// length hashes about kHashBytes bytes in total with FNVHash64, HTHash64,
+// HTHash64 through an HTHashState (one Update of the whole key), and
+// HTHash64_Batch in batches of kHashBatch keys.  The hashes are summed so
+// that none of the work can be optimized away.
+static void BenchHashFn(void) {
+  static const int kLens[] = { 8, 16, 24, 32, 64, 256, 1024, 4096 };
+  static const int kHashBytes = 1 << 28;
+  static const int kBufSize = 1 << 16;
+  enum { kHashBatch = 64 };
+  unsigned char *buf = (unsigned char *) malloc(kBufSize + 4096);
+  const void *ptrs[kHashBatch];
+  size_t lens[kHashBatch];
+  HTKey_t hashes[kHashBatch];
+  volatile HTKey_t sink = 0;
+  uint64_t seed = 337;
+  size_t l;
+  int i, j;
+
+  Verify333(buf != NULL);
+  for (i = 0; i < kBufSize + 4096; i++) {
+    buf[i] = (unsigned char) NextRandom(&seed);
+  }
+
+  printf("ns/byte (ns/key)\n");
+  printf("%6s %18s %18s %18s %18s\n", "bytes", "FNVHash64", "HTHash64",
+         "incremental", "batch");
+  for (l = 0; l < sizeof(kLens) / sizeof(kLens[0]); l++) {
+    int len = kLens[l];
+    int n = kHashBytes / len;
+    double t[4], t0;
+    HTKey_t sum = 0;
+
+    n -= n % kHashBatch;
+    t0 = NowNs();
+    for (i = 0; i < n; i++) {
+      sum += FNVHash64(buf + (i * 61) % kBufSize, len);
+    }
+    t[0] = NowNs() - t0;
+
+    t0 = NowNs();
+    for (i = 0; i < n; i++) {
+      sum += HTHash64(buf + (i * 61) % kBufSize, len, 0);
+    }
+    t[1] = NowNs() - t0;
+
+    t0 = NowNs();
+    for (i = 0; i < n; i++) {
+      HTHashState state;
+      HTHash64_Init(&state, 0);
+      HTHash64_Update(&state, buf + (i * 61) % kBufSize, len);
+      sum += HTHash64_Final(&state);
+    }
+    t[2] = NowNs() - t0;
+
+    t0 = NowNs();
+    for (i = 0; i < n; i += kHashBatch) {
+      for (j = 0; j < kHashBatch; j++) {
+        ptrs[j] = buf + ((i + j) * 61) % kBufSize;
+        lens[j] = len;
+      }
+      HTHash64_Batch(ptrs, lens, kHashBatch, 0, hashes);
+      for (j = 0; j < kHashBatch; j++) {
+        sum += hashes[j];
+      }
+    }
+    t[3] = NowNs() - t0;
+    sink += sum;
+
+    printf("%6d", len);
+    for (j = 0; j < 4; j++) {
+      printf("   %6.3f (%7.1f)", t[j] / n / len, t[j] / n);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+  free(buf);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// strings: string keys in a StrHashTable vs. hashed into a HashTable.
+//
+// kStrKeys random strings of 12 to 40 bytes.  The HashTable way keys each
+// string by its FNVHash64 and keeps the string in a separate record that
+// the value points at, so every Find also has to read that record to
+// check that it found the right string (rather than a 64-bit collision).
+// The StrHashTable keeps the string in the entry.  Finds look up every key
+// in a random order, and misses look up strings that aren't there.
+typedef struct {
+  const char  *str;
+  size_t       len;
+} BenchString;
+
+static void BenchStrings(void) {
+  static const int kStrKeys = 1 << 20;
+  BenchString *strs = (BenchString *) malloc(2 * kStrKeys * sizeof(*strs));
+  char *arena = (char *) malloc(2 * kStrKeys * 40);
+  int *order = (int *) malloc(kStrKeys * sizeof(int));
+  uint64_t *hashes = (uint64_t *) malloc(kStrKeys * sizeof(uint64_t));
+  HashTable *ht;
+  StrHashTable *st;
+  HTKeyValue_t kv, old;
+  HTValue_t value;
+  uint64_t seed = 338;
+  double t0;
+  int i, j, found;
+  char *next;
+
+  Verify333(strs != NULL && arena != NULL && order != NULL &&
+            hashes != NULL);
+  // The first kStrKeys strings are inserted; the rest are misses.
+  next = arena;
+  for (i = 0; i < 2 * kStrKeys; i++) {
+    size_t len = 12 + NextRandom(&seed) % 29;
+    for (j = 0; j < (int) len; j++) {
+      next[j] = 'a' + NextRandom(&seed) % 26;
+    }
+    strs[i].str = next;
+    strs[i].len = len;
+    next += len;
+  }
+  for (i = 0; i < kStrKeys; i++) {
+    order[i] = i;
+  }
+  for (i = kStrKeys - 1; i > 0; i--) {
+    int k = NextRandom(&seed) % (uint64_t) (i + 1);
+    int tmp = order[i];
+    order[i] = order[k];
+    order[k] = tmp;
+  }
+
+  printf("%d keys (ns/op)     %8s %8s %8s\n", kStrKeys, "insert", "find",
+         "miss");
+
+  ht = HashTable_Allocate(16);
+  t0 = NowNs();
+  for (i = 0; i < kStrKeys; i++) {
+    kv.key = FNVHash64((unsigned char *) strs[i].str, (int) strs[i].len);
+    kv.value = &strs[i];
+    HashTable_Insert(ht, kv, &old);
+  }
+  printf("%-24s %8.1f", "FNVHash64 + HashTable", (NowNs() - t0) / kStrKeys);
+  for (j = 0; j < 2; j++) {
+    t0 = NowNs();
+    found = 0;
+    for (i = 0; i < kStrKeys; i++) {
+      const BenchString *s = &strs[j * kStrKeys + order[i]];
+      if (HashTable_Find(ht,
+                         FNVHash64((unsigned char *) s->str, (int) s->len),
+                         &kv)) {
+        const BenchString *rec = (const BenchString *) kv.value;
+        found += rec->len == s->len && memcmp(rec->str, s->str, s->len) == 0;
+      }
+    }
+    printf(" %8.1f", (NowNs() - t0) / kStrKeys);
+    Verify333(found == (j == 0 ? kStrKeys : 0));
+  }
+  printf("\n");
+  HashTable_Free(ht, &NoOpFree);
+
+  st = StrHashTable_Allocate(16);
+  t0 = NowNs();
+  for (i = 0; i < kStrKeys; i++) {
+    StrHashTable_Insert(st, strs[i].str, strs[i].len, &strs[i], &value);
+  }
+  printf("%-24s %8.1f", "StrHashTable", (NowNs() - t0) / kStrKeys);
+  for (j = 0; j < 2; j++) {
+    t0 = NowNs();
+    found = 0;
+    for (i = 0; i < kStrKeys; i++) {
+      const BenchString *s = &strs[j * kStrKeys + order[i]];
+      found += StrHashTable_Find(st, s->str, s->len, &value);
+    }
+    printf(" %8.1f", (NowNs() - t0) / kStrKeys);
+    Verify333(found == (j == 0 ? kStrKeys : 0));
+  }
+  printf("\n");
+
+  // FindHashed, with each hash worked out ahead of time.
+  for (i = 0; i < kStrKeys; i++) {
+    const BenchString *s = &strs[order[i]];
+    hashes[i] = StrHashTable_Hash(s->str, s->len);
+  }
+  t0 = NowNs();
+  found = 0;
+  for (i = 0; i < kStrKeys; i++) {
+    const BenchString *s = &strs[order[i]];
+    found += StrHashTable_FindHashed(st, hashes[i], s->str, s->len, &value);
+  }
+  printf("%-24s %8s %8.1f\n", "StrHashTable FindHashed", "",
+         (NowNs() - t0) / kStrKeys);
+  Verify333(found == kStrKeys);
+  StrHashTable_Free(st, &NoOpFree);
+
+  free(hashes);
+  free(order);
+  free(arena);
+  free(strs);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// intern: interning a stream of strings with many repeats.
+//
+// kInternStream strings, each picked at random from kInternDistinct
+// distinct strings of 12 to 40 bytes (so every string repeats about 40
+// times), are interned one at a time, in batches of kInternBatch, and in
+// batches from 1 to every core's worth of threads sharing one Interner.
+// We then compare the memory of keeping a copy of every string with that
+// of the arena plus a 4-byte ID per string, and the cost of comparing
+// pairs of strings with comparing their IDs.
+#define INTERN_STREAM (1 << 22)
+#define INTERN_BATCH 256
+
+typedef struct {
+  Interner      *in;
+  const char   **ptrs;   // this thread's slice of the stream
+  const size_t  *lens;
+  InternId      *ids;
+  int            n;
+} InternArgs;
+
+static void *InternWorker(void *arg) {
+  InternArgs *a = (InternArgs *) arg;
+  int i;
+
+  for (i = 0; i < a->n; i += INTERN_BATCH) {
+    int n = a->n - i < INTERN_BATCH ? a->n - i : INTERN_BATCH;
+    Interner_InternBatch(a->in, a->ptrs + i, a->lens + i, n, a->ids + i);
+  }
+  return NULL;
+}
+
+static void BenchIntern(void) {
+  static const int kInternDistinct = 100000;
+  static const int kCompares = 1 << 24;
+  int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  char *arena = (char *) malloc((size_t) kInternDistinct * 40);
+  const char **distinct =
+    (const char **) malloc(kInternDistinct * sizeof(char *));
+  size_t *distinct_lens = (size_t *) malloc(kInternDistinct * sizeof(size_t));
+  const char **ptrs = (const char **) malloc(INTERN_STREAM * sizeof(char *));
+  size_t *lens = (size_t *) malloc(INTERN_STREAM * sizeof(size_t));
+  InternId *ids = (InternId *) malloc(INTERN_STREAM * sizeof(InternId));
+  size_t copy_bytes = 0, arena_bytes = 0;
+  uint64_t seed = 339;
+  Interner *in;
+  double t0;
+  int i, j, n, equal;
+  char *next = arena;
+
+  Verify333(arena != NULL && distinct != NULL && distinct_lens != NULL &&
+            ptrs != NULL && lens != NULL && ids != NULL);
+  for (i = 0; i < kInternDistinct; i++) {
+    size_t len = 12 + NextRandom(&seed) % 29;
+    for (j = 0; j < (int) len; j++) {
+      next[j] = 'a' + NextRandom(&seed) % 26;
+    }
+    distinct[i] = next;
+    distinct_lens[i] = len;
+    arena_bytes += len + 1;
+    next += len;
+  }
+  for (i = 0; i < INTERN_STREAM; i++) {
+    int k = NextRandom(&seed) % (uint64_t) kInternDistinct;
+    ptrs[i] = distinct[k];
+    lens[i] = distinct_lens[k];
+    // A malloc'd copy costs its bytes rounded up to 16, plus 8 of header.
+    copy_bytes += ((lens[i] + 1 + 8 + 15) & ~(size_t) 15);
+  }
+
+  printf("%d strings, %d distinct (ns/string):\n", INTERN_STREAM,
+         kInternDistinct);
+  in = Interner_Allocate();
+  t0 = NowNs();
+  for (i = 0; i < INTERN_STREAM; i++) {
+    ids[i] = Interner_Intern(in, ptrs[i], lens[i]);
+  }
+  printf("%-24s %8.1f\n", "one at a time", (NowNs() - t0) / INTERN_STREAM);
+  Verify333(Interner_NumStrings(in) == kInternDistinct);
+  Interner_Free(in);
+
+  in = Interner_Allocate();
+  t0 = NowNs();
+  for (i = 0; i < INTERN_STREAM; i += INTERN_BATCH) {
+    Interner_InternBatch(in, ptrs + i, lens + i, INTERN_BATCH, ids + i);
+  }
+  printf("%-24s %8.1f\n", "batches of 256", (NowNs() - t0) / INTERN_STREAM);
+  Verify333(Interner_NumStrings(in) == kInternDistinct);
+  Interner_Free(in);
+
+  // 1, 2, 4, ... threads, finishing with exactly max_threads.
+  for (n = 1; ; n = (2 * n < max_threads) ? 2 * n : max_threads) {
+    pthread_t *tids = (pthread_t *) malloc(n * sizeof(pthread_t));
+    InternArgs *args = (InternArgs *) malloc(n * sizeof(InternArgs));
+    char label[32];
+
+    Verify333(tids != NULL && args != NULL);
+    in = Interner_Allocate();
+    t0 = NowNs();
+    for (i = 0; i < n; i++) {
+      int first = (int) ((int64_t) i * INTERN_STREAM / n);
+      args[i].in = in;
+      args[i].ptrs = ptrs + first;
+      args[i].lens = lens + first;
+      args[i].ids = ids + first;
+      args[i].n = (int) ((int64_t) (i + 1) * INTERN_STREAM / n) - first;
+      Verify333(pthread_create(&tids[i], NULL, &InternWorker, &args[i]) == 0);
+    }
+    for (i = 0; i < n; i++) {
+      Verify333(pthread_join(tids[i], NULL) == 0);
+    }
+    snprintf(label, sizeof(label), "%d thread(s), batched", n);
+    printf("%-24s %8.1f\n", label, (NowNs() - t0) / INTERN_STREAM);
+    Verify333(Interner_NumStrings(in) == kInternDistinct);
+    free(args);
+    free(tids);
+    if (n == max_threads) {
+      break;
+    }
+    Interner_Free(in);
+  }
+
+  printf("\nmemory (MB): a copy of each string %.1f, "
+         "arena %.1f + IDs %.1f\n", copy_bytes / 1048576.0,
+         arena_bytes / 1048576.0,
+         INTERN_STREAM * sizeof(InternId) / 1048576.0);
+
+  // Random pairs from the stream, compared as strings and as IDs.
+  seed = 340;
+  equal = 0;
+  t0 = NowNs();
+  for (i = 0; i < kCompares; i++) {
+    int a = NextRandom(&seed) % INTERN_STREAM;
+    int b = (a + 1 + (i & 1023)) % INTERN_STREAM;
+    equal += lens[a] == lens[b] && memcmp(ptrs[a], ptrs[b], lens[a]) == 0;
+  }
+  printf("compare (ns/pair): strings %.2f", (NowNs() - t0) / kCompares);
+  seed = 340;
+  t0 = NowNs();
+  for (i = 0; i < kCompares; i++) {
+    int a = NextRandom(&seed) % INTERN_STREAM;
+    int b = (a + 1 + (i & 1023)) % INTERN_STREAM;
+    equal -= ids[a] == ids[b];
+  }
+  printf(", IDs %.2f\n", (NowNs() - t0) / kCompares);
+  Verify333(equal == 0);
+
+  Interner_Free(in);
+  free(ids);
+  free(lens);
+  free(ptrs);
+  free(distinct_lens);
+  free(distinct);
+  free(arena);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// upsert: counting occurrences with Find + Insert, Upsert and FindOrInsert.
+//
+// kCountOps keys drawn at random from kCountKeys distinct keys are counted
+// into a table that starts out empty, with the count kept in the value
+// itself, so that only the lookups are being measured.
+static void CountUpsert(HTValue_t *value, bool exists, void *arg) {
+  *value = (HTValue_t) ((uintptr_t) *value + 1);
+}
+
+static void BenchUpsert(void) {
+  static const int kCountKeys = 1 << 20;
+  static const int kCountOps = 1 << 23;
+  static const struct {
+    const char *name;
+    HTEngine_t  engine;
+  } kEngines[] = {
+    { "chained", HT_ENGINE_CHAINED },
+    { "robinhood", HT_ENGINE_ROBINHOOD },
+    { "swiss", HT_ENGINE_SWISS },
+  };
+  HTKey_t *distinct = (HTKey_t *) malloc(kCountKeys * sizeof(HTKey_t));
+  HTKey_t *ops = (HTKey_t *) malloc(kCountOps * sizeof(HTKey_t));
+  uint64_t seed = 338;
+  size_t e;
+  int i;
+
+  Verify333(distinct != NULL && ops != NULL);
+  RandomKeys(distinct, kCountKeys, 337);
+  for (i = 0; i < kCountOps; i++) {
+    ops[i] = distinct[NextRandom(&seed) % kCountKeys];
+  }
+
+  printf("%d increments of %d keys (ns/increment):\n", kCountOps, kCountKeys);
+  printf("%-10s %14s %10s %14s\n", "engine", "Find+Insert", "Upsert",
+         "FindOrInsert");
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    double ns[3];
+    int mode;
+
+    for (mode = 0; mode < 3; mode++) {
+      HashTable *ht = HashTable_AllocateEngine(1, kEngines[e].engine);
+      HTKeyValue_t kv, old;
+      bool inserted;
+      double t0 = NowNs();
+
+      for (i = 0; i < kCountOps; i++) {
+        if (mode == 0) {
+          kv.value = NULL;
+          HashTable_Find(ht, ops[i], &kv);
+          kv.key = ops[i];
+          kv.value = (HTValue_t) ((uintptr_t) kv.value + 1);
+          HashTable_Insert(ht, kv, &old);
+        } else if (mode == 1) {
+          HashTable_Upsert(ht, ops[i], &CountUpsert, NULL);
+        } else {
+          HTValue_t *slot = HashTable_FindOrInsert(ht, ops[i], NULL,
+                                                   &inserted);
+          *slot = (HTValue_t) ((uintptr_t) *slot + 1);
+        }
+      }
+      ns[mode] = (NowNs() - t0) / kCountOps;
+      Verify333(HashTable_Find(ht, ops[0], &kv) && kv.value != NULL);
+      HashTable_Free(ht, &NoOpFree);
+    }
+    printf("%-10s %14.1f %10.1f %14.1f\n", kEngines[e].name, ns[0], ns[1],
+           ns[2]);
+  }
+  free(ops);
+  free(distinct);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// batch: the batch operations vs. a loop of single-key calls.
+//
+// Each engine gets two tables of kNumKeys random keys, far bigger than the
+// last-level cache, so nearly every lookup misses in cache.  One table is
+// built and used with single-key calls, the other with the batch calls in
+// batches of kBatch keys.  Every operation visits the keys in a random
+// order.
+static void BenchBatch(void) {
+  static const int kNumKeys = 1 << 22;
+  static const int kBatch = 256;
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  HTKey_t *keys = (HTKey_t *) malloc(2 * kNumKeys * sizeof(HTKey_t));
+  HTKey_t *misses = keys + kNumKeys;
+  HTKeyValue_t *kvs = (HTKeyValue_t *) malloc(kNumKeys * sizeof(HTKeyValue_t));
+  HTKeyValue_t *out = (HTKeyValue_t *) malloc(kBatch * sizeof(HTKeyValue_t));
+  bool flags[kBatch];
+  uint64_t seed = 334;
+  size_t e;
+  int i, j;
+
+  Verify333(keys != NULL && kvs != NULL && out != NULL);
+  RandomKeys(keys, 2 * kNumKeys, 333);
+  for (i = 0; i < kNumKeys; i++) {
+    kvs[i].key = keys[i];
+    kvs[i].value = (HTValue_t) &keys[i];
+  }
+
+  printf("%d keys, batches of %d (ns/op):\n", kNumKeys, kBatch);
+  printf("%-10s %-6s %10s %10s %10s %10s\n",
+         "engine", "mode", "insert", "hit", "miss", "remove");
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    HashTable *single = HashTable_AllocateEngine(1024, kEngines[e]);
+    HashTable *batch = HashTable_AllocateEngine(1024, kEngines[e]);
+    HTKeyValue_t kv;
+    double t[2][4], t0;
+    int found[2] = { 0, 0 };
+    int op, mode;
+
+    // Shuffle the keys for each engine so that the order of the inserts
+    // isn't the order of the lookups.
+    for (op = 0; op < 4; op++) {
+      for (i = kNumKeys - 1; i > 0; i--) {
+        HTKeyValue_t tmp = kvs[i];
+        j = (int) (NextRandom(&seed) % (uint64_t) (i + 1));
+        kvs[i] = kvs[j];
+        kvs[j] = tmp;
+      }
+      for (i = 0; i < kNumKeys; i++) {
+        keys[i] = kvs[i].key;
+      }
+
+      // Single-key calls.
+      t0 = NowNs();
+      for (i = 0; i < kNumKeys; i++) {
+        switch (op) {
+          case 0:
+            HashTable_Insert(single, kvs[i], &kv);
+            break;
+          case 1:
+            found[0] += HashTable_Find(single, keys[i], &kv);
+            break;
+          case 2:
+            found[0] += HashTable_Find(single, misses[i], &kv);
+            break;
+          default:
+            HashTable_Remove(single, keys[i], &kv);
+            break;
+        }
+      }
+      t[0][op] = NowNs() - t0;
+
+      // Batch calls.
+      t0 = NowNs();
+      for (i = 0; i < kNumKeys; i += kBatch) {
+        switch (op) {
+          case 0:
+            HashTable_InsertBatch(batch, kvs + i, kBatch, out, flags);
+            break;
+          case 1:
+            found[1] += HashTable_FindBatch(batch, keys + i, kBatch, out,
+                                            flags);
+            break;
+          case 2:
+            found[1] += HashTable_FindBatch(batch, misses + i, kBatch, out,
+                                            flags);
+            break;
+          default:
+            HashTable_RemoveBatch(batch, keys + i, kBatch, out, flags);
+            break;
+        }
+      }
+      t[1][op] = NowNs() - t0;
+    }
+    Verify333(found[0] == kNumKeys && found[1] == kNumKeys);
+    Verify333(HashTable_NumElements(single) == 0);
+    Verify333(HashTable_NumElements(batch) == 0);
+
+    for (mode = 0; mode < 2; mode++) {
+      printf("%-10s %-6s %10.1f %10.1f %10.1f %10.1f\n",
+             EngineName(kEngines[e]), mode == 0 ? "single" : "batch",
+             t[mode][0] / kNumKeys, t[mode][1] / kNumKeys,
+             t[mode][2] / kNumKeys, t[mode][3] / kNumKeys);
+    }
+    HashTable_Free(single, &NoOpFree);
+    HashTable_Free(batch, &NoOpFree);
+  }
+  free(out);
+  free(kvs);
+  free(keys);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// build: loading a big array of pairs into an empty table.
+//
+// For each engine we time four ways of loading the same kBuildKeys random
+// pairs: an Insert loop on a table allocated small (which grows and
+// rehashes its way up), an Insert loop after HashTable_Reserve, and
+// HashTable_Build with and without assume_unique.  The keys are random 64
+// bit values, so they are unique in practice.  As in BenchResize, each run
+// gets its own process.
+//
+// 10^8 pairs would be the natural size, but the input array alone is
+// 1.6 GB and a chained table of that many entries needs about 5 GB more,
+// so we load 10^7 and report per-pair costs.
+static const int kBuildKeys = 10000000;
+
+static void BenchBuild(void) {
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  static const char *kModes[] = { "insert", "reserve", "build", "unique" };
+  HTKey_t *keys = (HTKey_t *) malloc(kBuildKeys * sizeof(HTKey_t));
+  HTKeyValue_t *kvs =
+    (HTKeyValue_t *) malloc(kBuildKeys * sizeof(HTKeyValue_t));
+  size_t e;
+  int i, m;
+
+  Verify333(keys != NULL && kvs != NULL);
+  RandomKeys(keys, kBuildKeys, 333);
+  for (i = 0; i < kBuildKeys; i++) {
+    kvs[i].key = keys[i];
+    kvs[i].value = (HTValue_t) &keys[i];
+  }
+
+  printf("%d pairs (ns/pair):\n", kBuildKeys);
+  printf("%-10s %10s %10s %10s %10s\n",
+         "engine", kModes[0], kModes[1], kModes[2], kModes[3]);
+  fflush(stdout);
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    printf("%-10s", EngineName(kEngines[e]));
+    fflush(stdout);
+    for (m = 0; m < 4; m++) {
+      HashTable *ht;
+      HTKeyValue_t old;
+      double t0;
+      pid_t pid = fork();
+
+      Verify333(pid >= 0);
+      if (pid > 0) {
+        Verify333(waitpid(pid, NULL, 0) == pid);
+        continue;
+      }
+
+      t0 = NowNs();
+      if (m < 2) {
+        ht = HashTable_AllocateEngine(16, kEngines[e]);
+        if (m == 1) {
+          HashTable_Reserve(ht, kBuildKeys);
+        }
+        for (i = 0; i < kBuildKeys; i++) {
+          HashTable_Insert(ht, kvs[i], &old);
+        }
+      } else {
+        ht = HashTable_Build(kEngines[e], kvs, kBuildKeys, m == 3, &NoOpFree);
+      }
+      printf(" %10.1f", (NowNs() - t0) / kBuildKeys);
+      Verify333(HashTable_NumElements(ht) == kBuildKeys);
+      HashTable_Free(ht, &NoOpFree);
+      fflush(stdout);
+      exit(EXIT_SUCCESS);
+    }
+    printf("\n");
+  }
+  free(kvs);
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// parallel: HashTable_BuildParallel on the pairs from BenchBuild.
+//
+// We time a chained HashTable_Build on one thread, then
+// HashTable_BuildParallel from 1 thread up to the number of online cores,
+// with and without assume_unique, each run in its own process.
+static void BenchParallel(void) {
+  int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  HTKey_t *keys = (HTKey_t *) malloc(kBuildKeys * sizeof(HTKey_t));
+  HTKeyValue_t *kvs =
+    (HTKeyValue_t *) malloc(kBuildKeys * sizeof(HTKeyValue_t));
+  int i, n, unique;
+
+  Verify333(keys != NULL && kvs != NULL);
+  RandomKeys(keys, kBuildKeys, 333);
+  for (i = 0; i < kBuildKeys; i++) {
+    kvs[i].key = keys[i];
+    kvs[i].value = (HTValue_t) &keys[i];
+  }
+
+  printf("%d pairs into a chained table (ns/pair):\n", kBuildKeys);
+  printf("%-10s %7s %10s %10s\n", "mode", "threads", "build", "unique");
+  fflush(stdout);
+  // n == 0 is the serial HashTable_Build baseline.
+  for (n = 0; ; n = (n == 0) ? 1 :
+                    (2 * n < max_threads) ? 2 * n : max_threads) {
+    printf("%-10s %7d", n == 0 ? "serial" : "parallel", n == 0 ? 1 : n);
+    fflush(stdout);
+    for (unique = 0; unique < 2; unique++) {
+      HashTable *ht;
+      double t0;
+      pid_t pid = fork();
+
+      Verify333(pid >= 0);
+      if (pid > 0) {
+        Verify333(waitpid(pid, NULL, 0) == pid);
+        continue;
+      }
+
+      t0 = NowNs();
+      if (n == 0) {
+        ht = HashTable_Build(HT_ENGINE_CHAINED, kvs, kBuildKeys, unique,
+                             &NoOpFree);
+      } else {
+        ht = HashTable_BuildParallel(kvs, kBuildKeys, n, unique, &NoOpFree);
+      }
+      printf(" %10.1f", (NowNs() - t0) / kBuildKeys);
+      Verify333(HashTable_NumElements(ht) == kBuildKeys);
+      HashTable_Free(ht, &NoOpFree);
+      fflush(stdout);
+      exit(EXIT_SUCCESS);
+    }
+    printf("\n");
+    if (n == max_threads) {
+      break;
+    }
+  }
+  free(kvs);
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// aggregate: summing a whole table with HashTable_ParallelReduce.
+//
+// Each engine is loaded with the kBuildKeys random keys, and we sum the
+// low bits of every key: once with an HTIterator walk, and then with
+// HashTable_ParallelReduce from 1 thread up to the number of online cores.
+typedef struct {
+  uint64_t sum;
+  uint64_t count;
+} BenchTotals;
+
+static void BenchReduce(void *acc, HTKeyValue_t kv, void *arg) {
+  BenchTotals *t = (BenchTotals *) acc;
+  t->sum += kv.key & 0xFFFF;
+  t->count++;
+}
+
+static void BenchCombine(void *acc, const void *other, void *arg) {
+  BenchTotals *t = (BenchTotals *) acc;
+  const BenchTotals *o = (const BenchTotals *) other;
+  t->sum += o->sum;
+  t->count += o->count;
+}
+
+static void BenchAggregate(void) {
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  HTKey_t *keys = (HTKey_t *) malloc(kBuildKeys * sizeof(HTKey_t));
+  size_t e;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, kBuildKeys, 333);
+
+  printf("summing %d entries (ms):\n", kBuildKeys);
+  printf("%-10s %-10s %7s %10s\n", "engine", "mode", "threads", "ms");
+  fflush(stdout);
+  for (e = 0; e < sizeof(kEngines) / sizeof(kEngines[0]); e++) {
+    HashTable *ht = HashTable_AllocateEngine(1, kEngines[e]);
+    BenchTotals expect = { 0, 0 };
+    HTKeyValue_t kv, old;
+    HTIterator *it;
+    double t0;
+    int i, n;
+
+    for (i = 0; i < kBuildKeys; i++) {
+      kv.key = keys[i];
+      kv.value = (HTValue_t) &keys[i];
+      HashTable_Insert(ht, kv, &old);
+    }
+
+    t0 = NowNs();
+    it = HTIterator_Allocate(ht);
+    for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+      HTIterator_Get(it, &kv);
+      BenchReduce(&expect, kv, NULL);
+    }
+    HTIterator_Free(it);
+    printf("%-10s %-10s %7d %10.1f\n", EngineName(kEngines[e]), "iterator", 1,
+           (NowNs() - t0) / 1e6);
+    fflush(stdout);
+
+    for (n = 1; ; n = (2 * n < max_threads) ? 2 * n : max_threads) {
+      BenchTotals totals = { 0, 0 };
+      t0 = NowNs();
+      HashTable_ParallelReduce(ht, n, &totals, sizeof(totals), &BenchReduce,
+                               &BenchCombine, NULL);
+      printf("%-10s %-10s %7d %10.1f\n", EngineName(kEngines[e]), "reduce", n,
+             (NowNs() - t0) / 1e6);
+      fflush(stdout);
+      Verify333(totals.sum == expect.sum && totals.count == expect.count);
+      if (n == max_threads) {
+        break;
+      }
+    }
+    HashTable_Free(ht, &NoOpFree);
+  }
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// snapshot: saving a table and getting it back on restart.
+//
+// The kBuildKeys pairs from BenchBuild, with each value saved as the 8
+// bytes it points at.  We time the ways of getting the table back (an
+// Insert loop, HashTable_LoadSnapshot, and MappedHashTable_Open with and
+// without the checksum) and then Find on random keys in a chained table
+// vs. the mapping.  The file was just written, so it is in the page
+// cache; a cold start would also pay to read the pages, which the mapping
+// only does for the pages Find touches.
+#define SNAP_BENCH_PATH "/tmp/bench_hashtable.snap"
+
+static size_t SerializeWord(HTValue_t value, void *buf, size_t size) {
+  if (size >= sizeof(HTKey_t)) {
+    memcpy(buf, value, sizeof(HTKey_t));
+  }
+  return sizeof(HTKey_t);
+}
+
+static HTValue_t DeserializeWord(const void *bytes, size_t size) {
+  HTKey_t word;
+  memcpy(&word, bytes, sizeof(word));
+  return (HTValue_t) word;
+}
+
+static void BenchSnapshot(void) {
+  static const int kFinds = 1 << 22;
+  HTKey_t *keys = (HTKey_t *) malloc(kBuildKeys * sizeof(HTKey_t));
+  HTKeyValue_t *kvs =
+    (HTKeyValue_t *) malloc(kBuildKeys * sizeof(HTKeyValue_t));
+  HTKey_t *probes = (HTKey_t *) malloc(kFinds * sizeof(HTKey_t));
+  HashTable *ht;
+  MappedHashTable *mapped;
+  HTKeyValue_t kv, old;
+  uint64_t seed = 335;
+  double t0;
+  int i, found;
+
+  Verify333(keys != NULL && kvs != NULL && probes != NULL);
+  RandomKeys(keys, kBuildKeys, 333);
+  for (i = 0; i < kBuildKeys; i++) {
+    kvs[i].key = keys[i];
+    kvs[i].value = (HTValue_t) &keys[i];
+  }
+  for (i = 0; i < kFinds; i++) {
+    probes[i] = keys[NextRandom(&seed) % (uint64_t) kBuildKeys];
+  }
+
+  printf("%d pairs (s):\n", kBuildKeys);
+  t0 = NowNs();
+  ht = HashTable_Allocate(16);
+  for (i = 0; i < kBuildKeys; i++) {
+    HashTable_Insert(ht, kvs[i], &old);
+  }
+  printf("%-24s %8.3f\n", "insert loop", (NowNs() - t0) / 1e9);
+
+  t0 = NowNs();
+  Verify333(HashTable_SaveSnapshot(ht, SNAP_BENCH_PATH, &SerializeWord));
+  printf("%-24s %8.3f\n", "save", (NowNs() - t0) / 1e9);
+  HashTable_Free(ht, &NoOpFree);
+
+  t0 = NowNs();
+  ht = HashTable_LoadSnapshot(SNAP_BENCH_PATH, HT_ENGINE_CHAINED,
+                              &DeserializeWord);
+  printf("%-24s %8.3f\n", "load", (NowNs() - t0) / 1e9);
+  Verify333(ht != NULL && HashTable_NumElements(ht) == kBuildKeys);
+
+  t0 = NowNs();
+  mapped = MappedHashTable_Open(SNAP_BENCH_PATH, true);
+  printf("%-24s %8.3f\n", "map + checksum", (NowNs() - t0) / 1e9);
+  Verify333(mapped != NULL);
+  MappedHashTable_Close(mapped);
+
+  t0 = NowNs();
+  mapped = MappedHashTable_Open(SNAP_BENCH_PATH, false);
+  printf("%-24s %8.6f\n", "map", (NowNs() - t0) / 1e9);
+  Verify333(mapped != NULL);
+
+  printf("%d random hits (ns/op):\n", kFinds);
+  t0 = NowNs();
+  found = 0;
+  for (i = 0; i < kFinds; i++) {
+    found += HashTable_Find(ht, probes[i], &kv);
+  }
+  printf("%-24s %8.1f\n", "chained Find", (NowNs() - t0) / kFinds);
+  Verify333(found == kFinds);
+  t0 = NowNs();
+  found = 0;
+  for (i = 0; i < kFinds; i++) {
+    found += MappedHashTable_Find(mapped, probes[i], &kv, NULL);
+  }
+  printf("%-24s %8.1f\n", "mapped Find", (NowNs() - t0) / kFinds);
+  Verify333(found == kFinds);
+
+  MappedHashTable_Close(mapped);
+  HashTable_Free(ht, &NoOpFree);
+  remove(SNAP_BENCH_PATH);
+  free(probes);
+  free(kvs);
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// log: Insert throughput with a write-ahead log at several group-commit
+// settings, then recovery and compaction.
+//
+// Each setting inserts random keys (with 8-byte values, as in
+// BenchSnapshot) into a fresh table with a fresh log.  Syncing every
+// record is so slow that it only gets kLogSyncOps inserts.
+#define LOG_BENCH_PATH "/tmp/bench_hashtable.log"
+
+// DeserializeWord hands back the saved word itself as the value, so a
+// recovered table is saved by the value, not what it points at.
+static size_t SerializeValue(HTValue_t value, void *buf, size_t size) {
+  if (size >= sizeof(value)) {
+    memcpy(buf, &value, sizeof(value));
+  }
+  return sizeof(value);
+}
+
+static void BenchLog(void) {
+  static const int kLogOps = 1 << 20;
+  static const int kLogSyncOps = 2000;
+  static const struct { const char *label; int bytes, ms; } kSettings[] = {
+    { "no log", -1, -1 },
+    { "every record", 0, 0 },
+    { "4 KB", 4 << 10, 1000000 },
+    { "64 KB", 64 << 10, 1000000 },
+    { "1 MB", 1 << 20, 1000000 },
+    { "1 ms", 1 << 30, 1 },
+    { "10 ms", 1 << 30, 10 },
+  };
+  HTKey_t *keys = (HTKey_t *) malloc(kLogOps * sizeof(HTKey_t));
+  HashTable *ht;
+  HTKeyValue_t kv, old;
+  double t0;
+  size_t s;
+  int i;
+
+  Verify333(keys != NULL);
+  RandomKeys(keys, kLogOps, 333);
+
+  printf("%-14s %8s %12s\n", "group commit", "inserts", "Kops/s");
+  for (s = 0; s < sizeof(kSettings) / sizeof(kSettings[0]); s++) {
+    int n = kSettings[s].bytes == 0 ? kLogSyncOps : kLogOps;
+    HTLog *log = NULL;
+
+    remove(LOG_BENCH_PATH);
+    ht = HashTable_Allocate(16);
+    if (kSettings[s].bytes >= 0) {
+      log = HTLog_Open(LOG_BENCH_PATH, &SerializeWord, kSettings[s].bytes,
+                       kSettings[s].ms);
+      Verify333(log != NULL);
+      HashTable_AttachLog(ht, log);
+    }
+    t0 = NowNs();
+    for (i = 0; i < n; i++) {
+      kv.key = keys[i];
+      kv.value = (HTValue_t) &keys[i];
+      HashTable_Insert(ht, kv, &old);
+    }
+    if (log != NULL) {
+      Verify333(HTLog_Sync(log));
+    }
+    printf("%-14s %8d %12.1f\n", kSettings[s].label, n,
+           n / ((NowNs() - t0) / 1e9) / 1e3);
+    fflush(stdout);
+    if (log != NULL) {
+      HashTable_AttachLog(ht, NULL);
+      Verify333(HTLog_Close(log));
+    }
+    HashTable_Free(ht, &NoOpFree);
+  }
+
+  // The last log holds kLogOps inserts.
+  t0 = NowNs();
+  ht = HTLog_Recover(NULL, LOG_BENCH_PATH, HT_ENGINE_CHAINED,
+                     &DeserializeWord, &NoOpFree);
+  printf("recover %d records: %.3f s\n", kLogOps, (NowNs() - t0) / 1e9);
+  Verify333(ht != NULL && HashTable_NumElements(ht) == kLogOps);
+  {
+    HTLog *log = HTLog_Open(LOG_BENCH_PATH, &SerializeValue, 64 << 10, 10);
+    Verify333(log != NULL);
+    t0 = NowNs();
+    Verify333(HTLog_Compact(log, ht, SNAP_BENCH_PATH));
+    printf("compact: %.3f s\n", (NowNs() - t0) / 1e9);
+    Verify333(HTLog_Close(log));
+  }
+  HashTable_Free(ht, &NoOpFree);
+  remove(LOG_BENCH_PATH);
+  remove(SNAP_BENCH_PATH);
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// checkpoint: saving a table in a forked child while the parent writes.
+//
+// The kBuildKeys pairs from BenchSnapshot.  We time a blocking
+// HashTable_SaveSnapshot, then take checkpoints while the parent sits
+// idle, overwrites the values of a hot 1% of the keys, and overwrites
+// random keys, as fast as it can until the child is done.  Every page the
+// parent writes to is copied, so the copy-on-write overhead follows how
+// widely the writes are spread, not how many there are.  The entries were
+// allocated in insertion order, so the hot keys' entries share few pages.
+// Last, we compare the latency of the parent's writes during a checkpoint
+// with the same writes without one.
+static void BenchCheckpoint(void) {
+  static const int kMaxSamples = 1 << 24;
+  static const struct { const char *label; int key_range_pct; } kModes[] = {
+    { "idle", 0 },
+    { "hot 1% writes", 1 },
+    { "random writes", 100 },
+  };
+  HTKey_t *keys = (HTKey_t *) malloc(kBuildKeys * sizeof(HTKey_t));
+  double *lat = (double *) malloc(kMaxSamples * sizeof(double));
+  HashTable *ht;
+  HTKeyValue_t kv, old;
+  HTCheckpointStats stats;
+  double t0;
+  size_t m;
+  int i, n = 0;
+
+  Verify333(keys != NULL && lat != NULL);
+  RandomKeys(keys, kBuildKeys, 333);
+  ht = HashTable_Allocate(16);
+  for (i = 0; i < kBuildKeys; i++) {
+    kv.key = keys[i];
+    kv.value = (HTValue_t) &keys[i];
+    HashTable_Insert(ht, kv, &old);
+  }
+
+  t0 = NowNs();
+  Verify333(HashTable_SaveSnapshot(ht, SNAP_BENCH_PATH, &SerializeWord));
+  printf("%d pairs, blocking save: %.3f s\n\n", kBuildKeys,
+         (NowNs() - t0) / 1e9);
+
+  printf("%-14s %8s %8s %9s %10s\n", "parent", "fork ms", "total s",
+         "COW MB", "writes");
+  for (m = 0; m < sizeof(kModes) / sizeof(kModes[0]); m++) {
+    uint64_t seed = 336;
+    int range = (int) ((int64_t) kBuildKeys * kModes[m].key_range_pct / 100);
+    HTCheckpoint *checkpoint =
+      HashTable_StartCheckpoint(ht, SNAP_BENCH_PATH, &SerializeWord);
+
+    Verify333(checkpoint != NULL);
+    n = 0;
+    while (!HTCheckpoint_Done(checkpoint)) {
+      if (range == 0) {
+        struct timespec ms = { 0, 1000000 };
+        nanosleep(&ms, NULL);
+        continue;
+      }
+      kv.key = keys[NextRandom(&seed) % (uint64_t) range];
+      kv.value = (HTValue_t) &keys[n % kBuildKeys];
+      t0 = NowNs();
+      HashTable_Insert(ht, kv, &old);
+      if (n < kMaxSamples) {
+        lat[n] = NowNs() - t0;
+      }
+      n++;
+    }
+    Verify333(HTCheckpoint_Finish(checkpoint, &stats));
+    printf("%-14s %8.1f %8.3f %9.1f %10d\n", kModes[m].label,
+           stats.fork_ns / 1e6, stats.duration_ns / 1e9,
+           stats.cow_bytes / 1048576.0, n);
+    fflush(stdout);
+  }
+
+  // n and lat are left over from the random writes.
+  if (n > kMaxSamples) {
+    n = kMaxSamples;
+  }
+  printf("\nrandom write latency (ns):\n");
+  printf("%-16s %9s %9s %9s %9s %11s\n", "", "p50", "p99", "p99.9",
+         "p99.99", "max");
+  PrintPercentiles("checkpointing", lat, n);
+  {
+    uint64_t seed = 336;
+    for (i = 0; i < n; i++) {
+      kv.key = keys[NextRandom(&seed) % (uint64_t) kBuildKeys];
+      kv.value = (HTValue_t) &keys[i % kBuildKeys];
+      t0 = NowNs();
+      HashTable_Insert(ht, kv, &old);
+      lat[i] = NowNs() - t0;
+    }
+  }
+  PrintPercentiles("no checkpoint", lat, n);
+
+  HashTable_Free(ht, &NoOpFree);
+  remove(SNAP_BENCH_PATH);
+  free(lat);
+  free(keys);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// threads: throughput of one mutex around a table vs. a ShardedHashTable
+// vs. a LFHashTable.
+//
+// Each thread does kOpsPerThread operations on random keys drawn from
+// kKeySpace keys, of which about half are in the table.  A read is a Find;
+// a write is an Insert or a Remove (half each), so the table size holds
+// steady.  We run from 1 thread up to the number of online cores, doubling
+// each time, for a few read ratios.
+typedef struct {
+  HashTable        *global;   // the table, when using a global mutex
+  pthread_mutex_t  *mutex;    // ... and that mutex
+  ShardedHashTable *sharded;  // the table, when sharded
+  LFHashTable      *lockfree; // the table, when lock-free
+  int               read_pct;
+  uint64_t          seed;
+} ThreadArgs;
+
+static const int kThreadsKeySpace = 1 << 20;
+static const int kOpsPerThread = 1 << 20;
+
+static void *ThreadWorker(void *arg) {
+  ThreadArgs *a = (ThreadArgs *) arg;
+  HTKeyValue_t kv, old;
+  int i;
+
+  for (i = 0; i < kOpsPerThread; i++) {
+    uint64_t r = NextRandom(&a->seed);
+    int dice = (int) (r % 100);
+    HTKey_t key = (r >> 8) % kThreadsKeySpace;
+
+    kv.key = key;
+    kv.value = NULL;
+    if (a->sharded != NULL) {
+      if (dice < a->read_pct) {
+        ShardedHashTable_Find(a->sharded, key, &old);
+      } else if (dice % 2 == 0) {
+        ShardedHashTable_Insert(a->sharded, kv, &old);
+      } else {
+        ShardedHashTable_Remove(a->sharded, key, &old);
+      }
+    } else if (a->lockfree != NULL) {
+      if (dice < a->read_pct) {
+        LFHashTable_Find(a->lockfree, key, &old);
+      } else if (dice % 2 == 0) {
+        LFHashTable_Insert(a->lockfree, kv, &old);
+      } else {
+        LFHashTable_Remove(a->lockfree, key, &old);
+      }
+    } else {
+      pthread_mutex_lock(a->mutex);
+      if (dice < a->read_pct) {
+        HashTable_Find(a->global, key, &old);
+      } else if (dice % 2 == 0) {
+        HashTable_Insert(a->global, kv, &old);
+      } else {
+        HashTable_Remove(a->global, key, &old);
+      }
+      pthread_mutex_unlock(a->mutex);
+    }
+  }
+  return NULL;
+}
+
+static void BenchThreads(void) {
+  static const int kReadPcts[] = { 50, 90, 99 };
+  static const int kShards = 64;
+  int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  size_t r;
+  int n, i, mode;
+
+  printf("%d ops/thread, %d keys, %d shards (Mops/s):\n", kOpsPerThread,
+         kThreadsKeySpace, kShards);
+  printf("%-8s %7s %12s %12s %12s\n", "reads", "threads", "global-lock",
+         "sharded", "lock-free");
+  for (r = 0; r < sizeof(kReadPcts) / sizeof(kReadPcts[0]); r++) {
+    // 1, 2, 4, ... threads, finishing with exactly max_threads.
+    for (n = 1; ; n = (2 * n < max_threads) ? 2 * n : max_threads) {
+      pthread_t *tids = (pthread_t *) malloc(n * sizeof(pthread_t));
+      ThreadArgs *args = (ThreadArgs *) malloc(n * sizeof(ThreadArgs));
+      double mops[3];
+
+      Verify333(tids != NULL && args != NULL);
+      for (mode = 0; mode < 3; mode++) {
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        HashTable *global = NULL;
+        ShardedHashTable *sharded = NULL;
+        LFHashTable *lockfree = NULL;
+        HTKeyValue_t kv, old;
+        double t0;
+
+        if (mode == 0) {
+          global = HashTable_Allocate(kThreadsKeySpace / 4);
+        } else if (mode == 1) {
+          sharded = ShardedHashTable_Allocate(kShards,
+                                              kThreadsKeySpace / 4 / kShards,
+                                              HT_ENGINE_CHAINED);
+        } else {
+          lockfree = LFHashTable_Allocate(kThreadsKeySpace / 4);
+        }
+        for (i = 0; i < kThreadsKeySpace; i += 2) {
+          kv.key = i;
+          kv.value = NULL;
+          if (mode == 0) {
+            HashTable_Insert(global, kv, &old);
+          } else if (mode == 1) {
+            ShardedHashTable_Insert(sharded, kv, &old);
+          } else {
+            LFHashTable_Insert(lockfree, kv, &old);
+          }
+        }
+
+        t0 = NowNs();
+        for (i = 0; i < n; i++) {
+          args[i].global = global;
+          args[i].mutex = &mutex;
+          args[i].sharded = sharded;
+          args[i].lockfree = lockfree;
+          args[i].read_pct = kReadPcts[r];
+          args[i].seed = 333 + i;
+          Verify333(pthread_create(&tids[i], NULL, &ThreadWorker,
+                                   &args[i]) == 0);
+        }
+        for (i = 0; i < n; i++) {
+          Verify333(pthread_join(tids[i], NULL) == 0);
+        }
+        mops[mode] = (double) n * kOpsPerThread / (NowNs() - t0) * 1e3;
+
+        if (mode == 0) {
+          HashTable_Free(global, &NoOpFree);
+        } else if (mode == 1) {
+          ShardedHashTable_Free(sharded, &NoOpFree);
+        } else {
+          LFHashTable_Free(lockfree, &NoOpFree);
+        }
+      }
+      printf("%6d%% %8d %12.2f %12.2f %12.2f\n", kReadPcts[r], n, mops[0],
+             mops[1], mops[2]);
+      free(args);
+      free(tids);
+      if (n == max_threads) {
+        break;
+      }
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// readers: Find throughput with one writer running alongside.
+//
+// kReadersKeys keys are loaded up front.  Then 1 to all-cores reader
+// threads each do kReadsPerThread Finds of random loaded keys, while one
+// writer thread keeps inserting and removing other keys.  We compare a
+// table behind a single reader-writer lock (a one-shard ShardedHashTable)
+// with a read-mostly HashTable, where readers take no lock at all.
+typedef struct {
+  HashTable        *read_mostly;  // the table, when read-mostly
+  ShardedHashTable *locked;       // the table, when behind a rwlock
+  uint64_t          seed;
+  _Atomic int      *done;         // (writer) set once the readers finish
+} ReaderArgs;
+
+static const int kReadersKeys = 1 << 20;
+static const int kReadsPerThread = 1 << 21;
+
+static void *ReaderWorker(void *arg) {
+  ReaderArgs *a = (ReaderArgs *) arg;
+  HTKeyValue_t kv;
+  int i;
+
+  for (i = 0; i < kReadsPerThread; i++) {
+    HTKey_t key = NextRandom(&a->seed) % kReadersKeys;
+    if (a->read_mostly != NULL) {
+      HashTable_Find(a->read_mostly, key, &kv);
+    } else {
+      ShardedHashTable_Find(a->locked, key, &kv);
+    }
+  }
+  return NULL;
+}
+
+static void *WriterWorker(void *arg) {
+  ReaderArgs *a = (ReaderArgs *) arg;
+  HTKeyValue_t kv, old;
+  HTKey_t key = kReadersKeys;
+
+  kv.value = NULL;
+  while (!atomic_load(a->done)) {
+    kv.key = key;
+    if (a->read_mostly != NULL) {
+      HashTable_Insert(a->read_mostly, kv, &old);
+      HashTable_Remove(a->read_mostly, key, &old);
+    } else {
+      ShardedHashTable_Insert(a->locked, kv, &old);
+      ShardedHashTable_Remove(a->locked, key, &old);
+    }
+    key++;
+  }
+  return NULL;
+}
+
+static void BenchReaders(void) {
+  int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  int n, i, mode;
+
+  printf("%d reads/thread, %d keys, 1 writer (reader Mops/s):\n",
+         kReadsPerThread, kReadersKeys);
+  printf("%7s %12s %12s\n", "readers", "rwlock", "read-mostly");
+  // 1, 2, 4, ... readers, finishing with exactly max_threads.
+  for (n = 1; ; n = (2 * n < max_threads) ? 2 * n : max_threads) {
+    pthread_t *tids = (pthread_t *) malloc((n + 1) * sizeof(pthread_t));
+    ReaderArgs *args = (ReaderArgs *) malloc((n + 1) * sizeof(ReaderArgs));
+    double mops[2];
+
+    Verify333(tids != NULL && args != NULL);
+    for (mode = 0; mode < 2; mode++) {
+      HashTable *read_mostly = NULL;
+      ShardedHashTable *locked = NULL;
+      _Atomic int done = 0;
+      HTKeyValue_t kv, old;
+      double t0;
+
+      if (mode == 0) {
+        locked = ShardedHashTable_Allocate(1, kReadersKeys / 2,
+                                           HT_ENGINE_CHAINED);
+      } else {
+        read_mostly = HashTable_AllocateReadMostly(kReadersKeys / 2);
+      }
+      kv.value = NULL;
+      for (i = 0; i < kReadersKeys; i++) {
+        kv.key = i;
+        if (mode == 0) {
+          ShardedHashTable_Insert(locked, kv, &old);
+        } else {
+          HashTable_Insert(read_mostly, kv, &old);
+        }
+      }
+
+      for (i = 0; i <= n; i++) {
+        args[i].read_mostly = read_mostly;
+        args[i].locked = locked;
+        args[i].seed = 333 + i;
+        args[i].done = &done;
+      }
+      Verify333(pthread_create(&tids[n], NULL, &WriterWorker, &args[n]) == 0);
+      t0 = NowNs();
+      for (i = 0; i < n; i++) {
+        Verify333(pthread_create(&tids[i], NULL, &ReaderWorker,
+                                 &args[i]) == 0);
+      }
+      for (i = 0; i < n; i++) {
+        Verify333(pthread_join(tids[i], NULL) == 0);
+      }
+      mops[mode] = (double) n * kReadsPerThread / (NowNs() - t0) * 1e3;
+      atomic_store(&done, 1);
+      Verify333(pthread_join(tids[n], NULL) == 0);
+
+      if (mode == 0) {
+        ShardedHashTable_Free(locked, &NoOpFree);
+      } else {
+        HashTable_Free(read_mostly, &NoOpFree);
+      }
+    }
+    printf("%7d %12.2f %12.2f\n", n, mops[0], mops[1]);
+    free(args);
+    free(tids);
+    if (n == max_threads) {
+      break;
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+
+static const Benchmark kBenchmarks[] = {
+  { "engines", &BenchEngines },
+  { "resize", &BenchResize },
+  { "shrink", &BenchShrink },
+  { "iterate", &BenchIterate },
+  { "sweep", &BenchSweep },
+  { "stats", &BenchStats },
+  { "trace", &BenchTrace },
+  { "chains", &BenchChains },
+  { "hashing", &BenchHashing },
+  { "hashfn", &BenchHashFn },
+  { "strings", &BenchStrings },
+  { "intern", &BenchIntern },
+  { "upsert", &BenchUpsert },
+  { "batch", &BenchBatch },
+  { "build", &BenchBuild },
+  { "parallel", &BenchParallel },
+  { "aggregate", &BenchAggregate },
+  { "snapshot", &BenchSnapshot },
+  { "log", &BenchLog },
+  { "checkpoint", &BenchCheckpoint },
+  { "threads", &BenchThreads },
+  { "readers", &BenchReaders },
+};
+static const int kNumBenchmarks = sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+
+int main(int argc, char **argv) {
+  int i, j;
+
+  if (argc == 1) {
+    for (i = 0; i < kNumBenchmarks; i++) {
+      printf("== %s\n", kBenchmarks[i].name);
+      kBenchmarks[i].fn();
+    }
+    return EXIT_SUCCESS;
+  }
+
+  for (j = 1; j < argc; j++) {
+    for (i = 0; i < kNumBenchmarks; i++) {
+      if (strcmp(argv[j], kBenchmarks[i].name) == 0) {
+        break;
+      }
+    }
+    if (i == kNumBenchmarks) {
+      fprintf(stderr, "unknown benchmark: %s\n", argv[j]);
+      return EXIT_FAILURE;
+    }
+    printf("== %s\n", kBenchmarks[i].name);
+    kBenchmarks[i].fn();
+  }
+  return EXIT_SUCCESS;
+}
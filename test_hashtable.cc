@@ -9,8 +9,15 @@
  * author.
  */
 
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -19,11 +26,24 @@ extern "C" {
   #include "./HashTable_priv.h"
   #include "./LinkedList.h"
   #include "./LinkedList_priv.h"
+  #include "./ShardedHashTable.h"
+  #include "./ShardedHashTable_priv.h"
+  #include "./LockFreeHashTable.h"
+  #include "./HashTableSnapshot.h"
+  #include "./HashTableLog.h"
+  #include "./HTHash.h"
+  #include "./StringHashTable.h"
+  #include "./StringHashTable_priv.h"
+  #include "./Interner.h"
+  #include "./Interner_priv.h"
+  #include "./Trace.h"
 }
 #include "./test_suite.h"
 
 using std::set;
 using std::string;
+using std::thread;
+using std::vector;
 
 namespace hw1 {
 
@@ -63,6 +83,16 @@ static void FreeValue(HTValue_t v) {
   free(static_cast<TestPayload *>(v));
 }
 
+// Return the smallest key greater than 'after' that the table maps to
+// bucket 'idx'.
+static HTKey_t NextKeyInBucket(HashTable *table, HTKey_t after, int idx) {
+  HTKey_t k = after + 1;
+  while (HashKeyToBucketNum(table, k) != idx) {
+    k++;
+  }
+  return k;
+}
+
 static void Reset(HTKeyValue_t *kv) {
   // We frequently need to initialize a HTKeyValue to a "known bad" value
   // to ensure that it's being overwritten later
@@ -245,14 +275,16 @@ static void TestRemove(HashTable *table, HTKey_t k, int k_idx,
 TEST_F(Test_HashTable, AllocFree) {
   HW1Environment::OpenTestCase();
 
+  // Bucket counts are rounded up to a power of two.
   HashTable *ht = HashTable_Allocate(3);
   ASSERT_EQ(0, ht->num_elements);
-  ASSERT_EQ(3, ht->num_buckets);
+  ASSERT_EQ(4, ht->num_buckets);
 
   ASSERT_TRUE(ht->buckets != NULL);
   ASSERT_EQ(0, LinkedList_NumElements(ht->buckets[0]));
   ASSERT_EQ(0, LinkedList_NumElements(ht->buckets[1]));
   ASSERT_EQ(0, LinkedList_NumElements(ht->buckets[2]));
+  ASSERT_EQ(0, LinkedList_NumElements(ht->buckets[3]));
   HashTable_Free(ht, &Test_HashTable::VerifiedFree);
 
   HW1Environment::AddPoints(10);
@@ -262,7 +294,7 @@ TEST_F(Test_HashTable, InsertFind_Single) {
   HW1Environment::OpenTestCase();
   HashTable *table = HashTable_Allocate(8);
 
-  TestInsertAndFind(table, 3, 3);
+  TestInsertAndFind(table, 3, HashKeyToBucketNum(table, 3));
 
   HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
   ASSERT_EQ(1, freeInvocations_);
@@ -270,7 +302,7 @@ TEST_F(Test_HashTable, InsertFind_Single) {
 }
 
 TEST_F(Test_HashTable, InsertFind_Multiple_AllBuckets) {
-  static const int kTableSize = 10;
+  static const int kTableSize = 16;
   static const int kNumIterations = kTableSize * 2.5;  // < resize_threshhold
 
   HW1Environment::OpenTestCase();
@@ -278,7 +310,7 @@ TEST_F(Test_HashTable, InsertFind_Multiple_AllBuckets) {
 
   for (int i = 0; i < kNumIterations; i++) {
     SCOPED_TRACE(i);
-    TestInsertAndFind(table, i, i % kTableSize);
+    TestInsertAndFind(table, i, HashKeyToBucketNum(table, i));
   }
 
   HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
@@ -289,9 +321,12 @@ TEST_F(Test_HashTable, InsertFind_Multiple_AllBuckets) {
 TEST_F(Test_HashTable, Remove_Single) {
   HW1Environment::OpenTestCase();
   HashTable *table = HashTable_Allocate(12);
+  int idx = HashKeyToBucketNum(table, 17);
+  HTKey_t k2 = NextKeyInBucket(table, 17, idx);
+  HTKey_t k3 = NextKeyInBucket(table, k2, idx);
 
-  TestRemove(table, 17 /* key */, 5 /* idx */,
-             29, 41);  // other keys that hash to the same index
+  TestRemove(table, 17 /* key */, idx,
+             k2, k3);  // other keys that hash to the same index
 
   HashTable_Free(table, &Test_HashTable::VerifiedFree);
   HW1Environment::AddPoints(10);
@@ -305,12 +340,18 @@ TEST_F(Test_HashTable, Remove_MultipleKVs_OneBucket) {
   HW1Environment::OpenTestCase();
   HashTable *table = HashTable_Allocate(kTableSize);
 
-  // See previous test for explanation for why we start at i==1
-  for (int i = 1; i < kNumIterations + 1; i++) {
+  // Collect enough keys that land in kBucketIdx.
+  HTKey_t keys[kNumIterations + 2];
+  keys[0] = NextKeyInBucket(table, 0, kBucketIdx);
+  for (int i = 1; i < kNumIterations + 2; i++) {
+    keys[i] = NextKeyInBucket(table, keys[i - 1], kBucketIdx);
+  }
+
+  for (int i = 0; i < kNumIterations; i++) {
     SCOPED_TRACE(i);
-    TestRemove(table, i*kTableSize + kBucketIdx, kBucketIdx,  // key and idx
-               (i+1) * kTableSize + kBucketIdx,  // two other keys
-               (i+2) * kTableSize + kBucketIdx);
+    TestRemove(table, keys[i], kBucketIdx,  // key and idx
+               keys[i + 1],  // two other keys
+               keys[i + 2]);
   }
 
   HashTable_Free(table, &Test_HashTable::VerifiedFree);
@@ -391,10 +432,10 @@ TEST_F(Test_HashTable, Iterator_Navigate_ContiguousBuckets) {
 }
 
 TEST_F(Test_HashTable, Iterator_Navigate_BucketListHasHoles) {
-  // This table has 5 buckets, but the 0th, 2nd, and 3rd are empty (we only
-  // inserted values into the 1st and 4th buckets).  This ensures that our
-  // iterator can skip over "holes" in the bucket list.
-  static const int kTableSize = 5;
+  // This table has 8 buckets, but all except the 1st and 4th are empty (we
+  // only inserted values into the 1st and 4th buckets).  This ensures that
+  // our iterator can skip over "holes" in the bucket list.
+  static const int kTableSize = 8;
   static const int kChainLength = 3;
   static const int kNumKeys = kChainLength * 2;
 
@@ -404,9 +445,17 @@ TEST_F(Test_HashTable, Iterator_Navigate_BucketListHasHoles) {
   // remember the values that we added.
   HashTable *table = HashTable_Allocate(kTableSize);
 
+  HTKey_t k1 = 0, k4 = 0;
   for (int i = 0; i < kChainLength; i++) {
-    InsertElement(table, i * kTableSize + 1);
-    InsertElement(table, i * kTableSize + 4);
+    k1 = NextKeyInBucket(table, k1, 1);
+    k4 = NextKeyInBucket(table, k4, 4);
+    InsertElement(table, k1);
+    InsertElement(table, k4);
+  }
+  for (int i = 0; i < kTableSize; i++) {
+    if (i != 1 && i != 4) {
+      ASSERT_EQ(0, LinkedList_NumElements(table->buckets[i]));
+    }
   }
 
   // Use the iterator to navigate through the values we added, verifying
@@ -450,14 +499,16 @@ TEST_F(Test_HashTable, Iterator_Navigate_BucketListHasHoles) {
 }
 
 TEST_F(Test_HashTable, Iterator_Removal_FirstElementOfChain) {
-  static const int kTableSize = 3;
+  static const int kTableSize = 4;
 
   HW1Environment::OpenTestCase();
 
-  // Create a table with two elements in the middleth chain.
+  // Create a table with two elements in the 1st chain.
   HashTable *ht = HashTable_Allocate(kTableSize);
-  InsertElement(ht, 1);
-  InsertElement(ht, 1 + kTableSize);
+  HTKey_t first = NextKeyInBucket(ht, 0, 1);
+  HTKey_t second = NextKeyInBucket(ht, first, 1);
+  InsertElement(ht, first);
+  InsertElement(ht, second);
   LinkedList *pl = ht->buckets[1];
   ASSERT_EQ(2, LinkedList_NumElements(pl));
 
@@ -471,10 +522,10 @@ TEST_F(Test_HashTable, Iterator_Removal_FirstElementOfChain) {
   ASSERT_TRUE(HTIterator_Get(it, &oldkv));
   HTKey_t removed = oldkv.key;
   HTKey_t remaining;
-  if (removed == 1) {
-    remaining = removed + kTableSize;
+  if (removed == first) {
+    remaining = second;
   } else {
-    remaining = 1;
+    remaining = first;
   }
 
   // Now, do the deletion.
@@ -501,6 +552,77 @@ TEST_F(Test_HashTable, Iterator_Removal_FirstElementOfChain) {
   HW1Environment::AddPoints(5);
 }
 
+static bool KeyIsEven(HTKeyValue_t kv, void *arg) {
+  (*static_cast<int *>(arg))++;
+  return kv.key % 2 == 0;
+}
+
+TEST_F(Test_HashTable, RemoveIf_AllEngines) {
+  static const int kNumKeys = 1700;  // mid-way through a chained resize
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  HTKeyValue_t kv;
+  HW1Environment::OpenTestCase();
+
+  for (HTEngine_t engine : kEngines) {
+    HashTable *table = HashTable_AllocateEngine(1, engine);
+    if (engine == HT_ENGINE_CHAINED) {
+      // Sweep both arrays of a resize that is under way.
+      table->migrate_step = 1;
+    }
+    for (int i = 0; i < kNumKeys; i++) {
+      InsertElement(table, i);
+    }
+    if (engine == HT_ENGINE_CHAINED) {
+      ASSERT_TRUE(table->old_buckets != NULL);
+    }
+
+    // The predicate sees every element once, and the evens go.
+    int calls = 0;
+    freeInvocations_ = 0;
+    ASSERT_EQ(kNumKeys / 2, HashTable_RemoveIf(table, &KeyIsEven, &calls,
+                                 &Test_HashTable::InstrumentedVerifiedFree));
+    ASSERT_EQ(kNumKeys, calls);
+    ASSERT_EQ(kNumKeys / 2, freeInvocations_);
+    ASSERT_EQ(kNumKeys / 2, HashTable_NumElements(table));
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_EQ(i % 2 == 1, HashTable_Find(table, i, &kv));
+    }
+    if (engine == HT_ENGINE_CHAINED && table->old_buckets != NULL) {
+      for (int i = 0; i < table->old_num_buckets; i++) {
+        LinkedList *chain = table->old_buckets[i];
+        bool set = (table->old_occupied[i >> 6] >> (i & 63)) & 1;
+        ASSERT_EQ(chain != NULL && LinkedList_NumElements(chain) > 0, set);
+      }
+    }
+
+    // Nothing left matches, so a second sweep removes nothing.
+    calls = 0;
+    ASSERT_EQ(0, HashTable_RemoveIf(table, &KeyIsEven, &calls, &FreeValue));
+    ASSERT_EQ(kNumKeys / 2, calls);
+
+    // Iterator removal takes the entry it is on, and moves on.
+    int removed = 0;
+    HTIterator *it = HTIterator_Allocate(table);
+    while (HTIterator_IsValid(it)) {
+      HTKeyValue_t cur;
+      ASSERT_TRUE(HTIterator_Get(it, &cur));
+      ASSERT_TRUE(HTIterator_Remove(it, &kv));
+      ASSERT_EQ(cur.key, kv.key);
+      ASSERT_EQ(cur.value, kv.value);
+      ASSERT_FALSE(HashTable_Find(table, kv.key, &cur));
+      FreeValue(kv.value);
+      removed++;
+    }
+    HTIterator_Free(it);
+    ASSERT_EQ(kNumKeys / 2, removed);
+    ASSERT_EQ(0, HashTable_NumElements(table));
+    HashTable_Free(table, &FreeValue);
+  }
+  HW1Environment::AddPoints(10);
+}
+
 TEST_F(Test_HashTable, Resize) {
   static const int kInitialNumBuckets = 2;
   static const int kFinalNumElements = 100;
@@ -535,4 +657,2245 @@ TEST_F(Test_HashTable, Resize) {
   HW1Environment::AddPoints(5);
 }
 
+TEST_F(Test_HashTable, Resize_Incremental) {
+  static const int kTableSize = 16;
+  static const int kFirstBatch = kTableSize * 3;  // fills to the threshold
+
+  HW1Environment::OpenTestCase();
+
+  // Migrate one bucket per operation so we can watch the resize progress.
+  HashTable *table = HashTable_Allocate(kTableSize);
+  table->migrate_step = 1;
+  for (int i = 0; i < kFirstBatch; i++) {
+    InsertElement(table, i);
+  }
+  ASSERT_TRUE(table->old_buckets == NULL);
+  ASSERT_EQ(kTableSize, table->num_buckets);
+
+  // The next insert starts the resize and migrates old bucket 0, which
+  // creates exactly the new buckets that old bucket 0 feeds.
+  InsertElement(table, kFirstBatch);
+  ASSERT_TRUE(table->old_buckets != NULL);
+  ASSERT_EQ(kTableSize, table->old_num_buckets);
+  ASSERT_EQ(kTableSize * 8, table->num_buckets);
+  ASSERT_EQ(1, table->migrate_idx);
+  ASSERT_TRUE(table->old_buckets[0] == NULL);
+  for (int i = 0; i < table->num_buckets; i++) {
+    ASSERT_EQ(i % kTableSize == 0, table->buckets[i] != NULL);
+  }
+
+  // Every key is still findable, whichever array it's in.
+  HTKeyValue_t kv;
+  for (int i = 0; i <= kFirstBatch; i++) {
+    Reset(&kv);
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+  ASSERT_EQ(1, table->migrate_idx);  // lookups don't migrate
+
+  // Pick a key from old bucket 0 (migrated) and two from elsewhere.
+  int migrated = -1, unmigrated = -1, other = -1;
+  for (int k = 0; k <= kFirstBatch; k++) {
+    if (HashKeyToBucketNum(table, k) % kTableSize == 0) {
+      migrated = k;
+    } else if (unmigrated == -1) {
+      unmigrated = k;
+    } else {
+      other = k;
+    }
+  }
+  ASSERT_NE(-1, migrated);
+  ASSERT_NE(-1, unmigrated);
+  ASSERT_NE(-1, other);
+
+  // Iterate across both arrays, removing the migrated and unmigrated keys
+  // along the way.  Neither removal may move buckets under the iterator.
+  set<int> seen;
+  HTIterator *it = HTIterator_Allocate(table);
+  while (HTIterator_IsValid(it)) {
+    ASSERT_TRUE(HTIterator_Get(it, &kv));
+    int key = static_cast<int>(kv.key);
+    ASSERT_EQ(0LU, seen.count(key));
+    seen.insert(key);
+    if (key == migrated || key == unmigrated) {
+      HTKeyValue_t removed;
+      ASSERT_TRUE(HTIterator_Remove(it, &removed));
+      FreeValue(removed.value);
+    } else {
+      HTIterator_Next(it);
+    }
+  }
+  HTIterator_Free(it);
+  ASSERT_EQ(static_cast<size_t>(kFirstBatch + 1), seen.size());
+  ASSERT_EQ(1, table->migrate_idx);
+  ASSERT_EQ(kFirstBatch - 1, HashTable_NumElements(table));
+
+  // Removes do help the resize along.
+  ASSERT_TRUE(HashTable_Remove(table, other, &kv));
+  FreeValue(kv.value);
+  ASSERT_EQ(2, table->migrate_idx);
+
+  // Enough inserts finish the resize off.
+  for (int i = kFirstBatch + 1; i < kFirstBatch + kTableSize; i++) {
+    InsertElement(table, i);
+  }
+  ASSERT_TRUE(table->old_buckets == NULL);
+  ASSERT_EQ(0, table->old_num_buckets);
+  for (int i = 0; i < table->num_buckets; i++) {
+    ASSERT_TRUE(table->buckets[i] != NULL);
+  }
+  for (int i = 0; i < kFirstBatch + kTableSize; i++) {
+    bool removed = (i == migrated || i == unmigrated || i == other);
+    ASSERT_EQ(!removed, HashTable_Find(table, i, &kv));
+  }
+
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(kFirstBatch + kTableSize - 3, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+TEST_F(Test_HashTable, Resize_FreeMidMigration) {
+  HW1Environment::OpenTestCase();
+
+  // Freeing a table part way through a resize must free both arrays.
+  HashTable *table = HashTable_Allocate(4);
+  table->migrate_step = 1;
+  for (int i = 0; i < 13; i++) {
+    InsertElement(table, i);
+  }
+  ASSERT_TRUE(table->old_buckets != NULL);
+
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(13, freeInvocations_);
+  HW1Environment::AddPoints(5);
+}
+
+// Does every occupancy bit agree with its bucket?
+static bool OccupancyMatches(const uint64_t *bits, LinkedList **buckets,
+                             int num_buckets) {
+  for (int i = 0; i < num_buckets; i++) {
+    bool set = (bits[i >> 6] >> (i & 63)) & 1;
+    if (set != (buckets[i] != NULL && LinkedList_NumElements(buckets[i]) > 0))
+      return false;
+  }
+  return true;
+}
+
+TEST_F(Test_HashTable, Iterator_OccupancyBitmap) {
+  static const int kNumKeys = 200;
+
+  HW1Environment::OpenTestCase();
+
+  // A big, sparse table: most bitmap words are empty.
+  HashTable *table = HashTable_Allocate(4096);
+  for (int i = 0; i < kNumKeys; i++) {
+    InsertElement(table, i * 7);
+  }
+  ASSERT_TRUE(OccupancyMatches(table->occupied, table->buckets,
+                               table->num_buckets));
+
+  // Removes clear the bits of chains they empty.
+  HTKeyValue_t kv;
+  for (int i = 0; i < kNumKeys; i += 2) {
+    ASSERT_TRUE(HashTable_Remove(table, i * 7, &kv));
+    FreeValue(kv.value);
+  }
+  ASSERT_TRUE(OccupancyMatches(table->occupied, table->buckets,
+                               table->num_buckets));
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+
+  // Part way through a resize, both arrays' bitmaps are kept up to date,
+  // and the iterator still visits every key exactly once.
+  table = HashTable_Allocate(16);
+  table->migrate_step = 1;
+  for (int i = 0; i <= 16 * 3; i++) {
+    InsertElement(table, i);
+  }
+  ASSERT_TRUE(table->old_buckets != NULL);
+  ASSERT_TRUE(OccupancyMatches(table->old_occupied, table->old_buckets,
+                               table->old_num_buckets));
+  ASSERT_TRUE(OccupancyMatches(table->occupied, table->buckets,
+                               table->num_buckets));
+  set<int> seen;
+  HTIterator *it = HTIterator_Allocate(table);
+  for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+    ASSERT_TRUE(HTIterator_Get(it, &kv));
+    seen.insert(static_cast<int>(kv.key));
+  }
+  HTIterator_Free(it);
+  ASSERT_EQ(static_cast<size_t>(16 * 3 + 1), seen.size());
+
+  HashTable_ShrinkToFit(table);
+  ASSERT_TRUE(table->old_occupied == NULL);
+  ASSERT_TRUE(OccupancyMatches(table->occupied, table->buckets,
+                               table->num_buckets));
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, Chained_EntriesAreIntrusive) {
+  HW1Environment::OpenTestCase();
+
+  // Each chain node is the start of an HTEntry whose payload is its own kv,
+  // and a resize relinks those same entries rather than copying them.
+  HashTable *table = HashTable_Allocate(2);
+  InsertElement(table, 42);
+  LinkedList *chain = table->buckets[HashKeyToBucketNum(table, 42)];
+  HTEntry *entry = reinterpret_cast<HTEntry *>(chain->head);
+  ASSERT_EQ(&entry->kv, chain->head->payload);
+  ASSERT_EQ(static_cast<HTKey_t>(42), entry->kv.key);
+
+  table->migrate_step = 0;
+  for (int i = 0; i < 10; i++) {
+    InsertElement(table, 100 + i);
+  }
+  ASSERT_TRUE(table->old_buckets == NULL);
+  ASSERT_EQ(16, table->num_buckets);
+  chain = table->buckets[HashKeyToBucketNum(table, 42)];
+  bool found = false;
+  for (LinkedListNode *n = chain->head; n != NULL; n = n->next) {
+    found |= (reinterpret_cast<HTEntry *>(n) == entry);
+  }
+  ASSERT_TRUE(found);
+  ASSERT_EQ(static_cast<HTKey_t>(42), entry->kv.key);
+  HW1Environment::AddPoints(5);
+
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(11, freeInvocations_);
+  HW1Environment::AddPoints(5);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Open-addressing engine tests
+///////////////////////////////////////////////////////////////////////////////
+
+// Insert, replace, find and remove a batch of keys in a table using the
+// given engine.  The table starts tiny so that it has to grow several times.
+// The table is freed with free_fn once it has been drained.
+static void TestEngineInsertFindRemove(HTEngine_t engine,
+                                       ValueFreeFnPtr free_fn) {
+  static const int kNumKeys = 1000;
+  int free_count = 0;
+
+  HashTable *table = HashTable_AllocateEngine(3, engine);
+  ASSERT_EQ(engine, table->engine);
+  ASSERT_TRUE(table->buckets == NULL);
+
+  for (int i = 0; i < kNumKeys; i++) {
+    InsertElement(table, i * 17);
+  }
+  ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+  ASSERT_LE(kNumKeys, table->num_buckets);
+
+  HTKeyValue_t oldkv, newkv;
+  for (int i = 0; i < kNumKeys; i++) {
+    Reset(&oldkv);
+    ASSERT_TRUE(HashTable_Find(table, i * 17, &oldkv));
+    ASSERT_EQ(static_cast<HTKey_t>(i * 17), oldkv.key);
+    ASSERT_EQ(static_cast<HTKey_t>(i * 17), AsKeyType(oldkv.value));
+    ASSERT_FALSE(HashTable_Find(table, i * 17 + 1, &oldkv));
+  }
+
+  // Replacing a key hands back the old value and doesn't add an element.
+  newkv.key = 34;
+  newkv.value = NewPayload(34);
+  ASSERT_TRUE(HashTable_Insert(table, newkv, &oldkv));
+  ASSERT_EQ(static_cast<HTKey_t>(34), oldkv.key);
+  ASSERT_NE(newkv.value, oldkv.value);
+  FreeValue(oldkv.value);
+  ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+
+  // Remove the even keys; the odd ones must stay findable.
+  for (int i = 0; i < kNumKeys; i += 2) {
+    Reset(&oldkv);
+    ASSERT_TRUE(HashTable_Remove(table, i * 17, &oldkv));
+    ASSERT_EQ(static_cast<HTKey_t>(i * 17), AsKeyType(oldkv.value));
+    FreeValue(oldkv.value);
+    ASSERT_FALSE(HashTable_Remove(table, i * 17, &oldkv));
+  }
+  ASSERT_EQ(kNumKeys / 2, HashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(i % 2 == 1, HashTable_Find(table, i * 17, &oldkv));
+  }
+
+  // Drain the table through the iterator to count what's left.
+  HTIterator *it = HTIterator_Allocate(table);
+  while (HTIterator_IsValid(it)) {
+    ASSERT_TRUE(HTIterator_Remove(it, &oldkv));
+    FreeValue(oldkv.value);
+    free_count++;
+  }
+  HTIterator_Free(it);
+  ASSERT_EQ(kNumKeys / 2, free_count);
+  ASSERT_EQ(0, HashTable_NumElements(table));
+
+  HashTable_Free(table, free_fn);
+}
+
+// Remove every other element of a table through the iterator, checking that
+// nothing is skipped or visited twice, then check that a second pass sees
+// exactly the survivors.  The survivors are freed with free_fn, and their
+// number is returned through num_kept.
+static void TestEngineIterator(HTEngine_t engine, ValueFreeFnPtr free_fn,
+                               int *num_kept) {
+  static const int kNumKeys = 500;
+
+  HashTable *table = HashTable_AllocateEngine(8, engine);
+  HTIterator *it = HTIterator_Allocate(table);
+  ASSERT_FALSE(HTIterator_IsValid(it));
+  HTIterator_Free(it);
+
+  for (int i = 0; i < kNumKeys; i++) {
+    InsertElement(table, i);
+  }
+
+  set<int> seen, kept;
+  HTKeyValue_t kv;
+  bool remove = false;
+  it = HTIterator_Allocate(table);
+  while (HTIterator_IsValid(it)) {
+    ASSERT_TRUE(HTIterator_Get(it, &kv));
+    int key = static_cast<int>(kv.key);
+    ASSERT_EQ(0LU, seen.count(key));
+    seen.insert(key);
+    if (remove) {
+      HTKeyValue_t removed;
+      ASSERT_TRUE(HTIterator_Remove(it, &removed));
+      ASSERT_EQ(kv.key, removed.key);
+      ASSERT_EQ(kv.value, removed.value);
+      FreeValue(removed.value);
+    } else {
+      kept.insert(key);
+      HTIterator_Next(it);
+    }
+    remove = !remove;
+  }
+  ASSERT_FALSE(HTIterator_Get(it, &kv));
+  ASSERT_FALSE(HTIterator_Next(it));
+  HTIterator_Free(it);
+  ASSERT_EQ(static_cast<size_t>(kNumKeys), seen.size());
+  ASSERT_EQ(static_cast<int>(kept.size()), HashTable_NumElements(table));
+
+  set<int> seen_again;
+  for (it = HTIterator_Allocate(table); HTIterator_IsValid(it);
+       HTIterator_Next(it)) {
+    ASSERT_TRUE(HTIterator_Get(it, &kv));
+    ASSERT_EQ(0LU, seen_again.count(static_cast<int>(kv.key)));
+    seen_again.insert(static_cast<int>(kv.key));
+  }
+  HTIterator_Free(it);
+  ASSERT_TRUE(kept == seen_again);
+
+  *num_kept = kept.size();
+  HashTable_Free(table, free_fn);
+}
+
+TEST_F(Test_HashTable, RobinHood_InsertFindRemove) {
+  HW1Environment::OpenTestCase();
+
+  // Slot counts are rounded up to a power of two.
+  HashTable *table = HashTable_AllocateEngine(3, HT_ENGINE_ROBINHOOD);
+  ASSERT_EQ(4, table->num_buckets);
+  HashTable_Free(table, &Test_HashTable::VerifiedFree);
+
+  TestEngineInsertFindRemove(HT_ENGINE_ROBINHOOD,
+                             &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(0, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+TEST_F(Test_HashTable, RobinHood_Iterator) {
+  HW1Environment::OpenTestCase();
+  int num_kept = 0;
+  TestEngineIterator(HT_ENGINE_ROBINHOOD,
+                     &Test_HashTable::InstrumentedVerifiedFree, &num_kept);
+  ASSERT_EQ(num_kept, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+TEST_F(Test_HashTable, Swiss_InsertFindRemove) {
+  HW1Environment::OpenTestCase();
+
+  // Slot counts are rounded up to a power of two of at least one group.
+  HashTable *table = HashTable_AllocateEngine(3, HT_ENGINE_SWISS);
+  ASSERT_EQ(16, table->num_buckets);
+  HashTable_Free(table, &Test_HashTable::VerifiedFree);
+
+  TestEngineInsertFindRemove(HT_ENGINE_SWISS,
+                             &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(0, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+TEST_F(Test_HashTable, Swiss_Iterator) {
+  HW1Environment::OpenTestCase();
+  int num_kept = 0;
+  TestEngineIterator(HT_ENGINE_SWISS,
+                     &Test_HashTable::InstrumentedVerifiedFree, &num_kept);
+  ASSERT_EQ(num_kept, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+TEST_F(Test_HashTable, Swiss_TombstoneChurn) {
+  static const int kLive = 100;
+  static const int kRounds = 10000;
+
+  HW1Environment::OpenTestCase();
+
+  // Keep the table at a steady size while cycling through many distinct
+  // keys.  Tombstones must be reclaimed without the table growing forever.
+  HashTable *table = HashTable_AllocateEngine(256, HT_ENGINE_SWISS);
+  HTKeyValue_t oldkv;
+  for (int i = 0; i < kLive; i++) {
+    InsertElement(table, i);
+  }
+  for (int i = kLive; i < kRounds; i++) {
+    ASSERT_TRUE(HashTable_Remove(table, i - kLive, &oldkv));
+    FreeValue(oldkv.value);
+    InsertElement(table, i);
+    ASSERT_EQ(kLive, HashTable_NumElements(table));
+  }
+  ASSERT_EQ(256, table->num_buckets);
+  for (int i = 0; i < kRounds; i++) {
+    ASSERT_EQ(i >= kRounds - kLive, HashTable_Find(table, i, &oldkv));
+  }
+
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(kLive, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch operation tests
+///////////////////////////////////////////////////////////////////////////////
+
+// Run a table through InsertBatch, FindBatch and RemoveBatch, checking each
+// result against what the single-key functions would have done.  The
+// batches are longer than the prefetch group and not a multiple of it, and
+// the table starts tiny so that the inserts resize it part way through a
+// batch.  The remaining values are freed with free_fn; there are kNumKeys/2
+// of them.
+static void TestEngineBatch(HTEngine_t engine, ValueFreeFnPtr free_fn) {
+  static const int kNumKeys = 301;
+  HTKeyValue_t newkvs[kNumKeys], outkvs[2 * kNumKeys];
+  HTKey_t keys[2 * kNumKeys];
+  bool flags[2 * kNumKeys];
+
+  HashTable *table = HashTable_AllocateEngine(2, engine);
+  for (int i = 0; i < kNumKeys; i++) {
+    newkvs[i].key = i * 7;
+    newkvs[i].value = NewPayload(i * 7);
+  }
+  ASSERT_EQ(0, HashTable_InsertBatch(table, newkvs, kNumKeys, outkvs, flags));
+  ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_FALSE(flags[i]);
+  }
+
+  // A batch may repeat a key: the second insert replaces the first.
+  newkvs[0].key = 1;
+  newkvs[0].value = NewPayload(1);
+  newkvs[1].key = 7;
+  newkvs[1].value = NewPayload(7);
+  newkvs[2].key = 1;
+  newkvs[2].value = NewPayload(1);
+  ASSERT_EQ(2, HashTable_InsertBatch(table, newkvs, 3, outkvs, flags));
+  ASSERT_FALSE(flags[0]);
+  ASSERT_TRUE(flags[1]);
+  ASSERT_TRUE(flags[2]);
+  ASSERT_EQ(static_cast<HTKey_t>(7), outkvs[1].key);
+  ASSERT_EQ(static_cast<HTKey_t>(7), AsKeyType(outkvs[1].value));
+  ASSERT_EQ(newkvs[0].value, outkvs[2].value);
+  FreeValue(outkvs[1].value);
+  FreeValue(outkvs[2].value);
+  ASSERT_EQ(kNumKeys + 1, HashTable_NumElements(table));
+  HTKeyValue_t kv;
+  ASSERT_TRUE(HashTable_Remove(table, 1, &kv));
+  FreeValue(kv.value);
+
+  // Look up every key and its neighbour; only the multiples of 7 are there.
+  for (int i = 0; i < kNumKeys; i++) {
+    keys[i] = (i % 2 == 0) ? (i / 2) * 7 : (i / 2) * 7 + 1;
+  }
+  ASSERT_EQ((kNumKeys + 1) / 2,
+            HashTable_FindBatch(table, keys, kNumKeys, outkvs, flags));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(i % 2 == 0, flags[i]);
+    if (flags[i]) {
+      ASSERT_EQ(keys[i], outkvs[i].key);
+      ASSERT_EQ(keys[i], AsKeyType(outkvs[i].value));
+    }
+  }
+
+  // Remove the even keys, each twice; the repeat finds nothing.
+  int n = 0;
+  for (int i = 0; i < kNumKeys; i += 2) {
+    keys[n++] = i * 7;
+    keys[n++] = i * 7;
+  }
+  ASSERT_EQ((kNumKeys + 1) / 2,
+            HashTable_RemoveBatch(table, keys, n, outkvs, flags));
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(i % 2 == 0, flags[i]);
+    if (flags[i]) {
+      ASSERT_EQ(keys[i], AsKeyType(outkvs[i].value));
+      FreeValue(outkvs[i].value);
+    }
+  }
+  ASSERT_EQ(kNumKeys / 2, HashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(i % 2 == 1, HashTable_Find(table, i * 7, &kv));
+  }
+
+  HashTable_Free(table, free_fn);
+}
+
+TEST_F(Test_HashTable, Batch_AllEngines) {
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  HW1Environment::OpenTestCase();
+
+  for (HTEngine_t engine : kEngines) {
+    freeInvocations_ = 0;
+    TestEngineBatch(engine, &Test_HashTable::InstrumentedVerifiedFree);
+    ASSERT_EQ(301 / 2, freeInvocations_);
+    HW1Environment::AddPoints(5);
+  }
+}
+
+static void TestEngineReserveBuild(HTEngine_t engine, ValueFreeFnPtr free_fn) {
+  static const int kNumKeys = 1000;
+  HTKeyValue_t kvs[kNumKeys + 100];
+  HTKeyValue_t kv;
+
+  // A reserved table never grows while it fills up, and never shrinks.
+  HashTable *table = HashTable_AllocateEngine(1, engine);
+  HashTable_Reserve(table, kNumKeys);
+  int num_buckets = table->num_buckets;
+  for (int i = 0; i < kNumKeys; i++) {
+    InsertElement(table, i);
+  }
+  ASSERT_EQ(num_buckets, table->num_buckets);
+  ASSERT_EQ(nullptr, table->old_buckets);
+  HashTable_Reserve(table, 10);
+  ASSERT_EQ(num_buckets, table->num_buckets);
+
+  // Reserving more keeps everything that's already there.
+  HashTable_Reserve(table, 8 * kNumKeys);
+  ASSERT_LT(num_buckets, table->num_buckets);
+  ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+  HashTable_Free(table, free_fn);
+
+  // Build from unique keys.
+  for (int i = 0; i < kNumKeys; i++) {
+    kvs[i].key = i * 13;
+    kvs[i].value = NewPayload(i * 13);
+  }
+  table = HashTable_Build(engine, kvs, kNumKeys, true, nullptr);
+  ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i * 13, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i * 13), AsKeyType(kv.value));
+    ASSERT_FALSE(HashTable_Find(table, i * 13 + 1, &kv));
+  }
+  HashTable_Free(table, free_fn);
+
+  // Without assume_unique, the last copy of a key wins and the values it
+  // replaces are freed.  Keys [0, 100) appear twice here.
+  for (int i = 0; i < kNumKeys + 100; i++) {
+    kvs[i].key = i % kNumKeys;
+    kvs[i].value = NewPayload(i);
+  }
+  table = HashTable_Build(engine, kvs, kNumKeys + 100, false, &FreeValue);
+  ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i < 100 ? i + kNumKeys : i),
+              AsKeyType(kv.value));
+  }
+  HashTable_Free(table, free_fn);
+
+  // An empty build is an empty table.
+  table = HashTable_Build(engine, kvs, 0, true, nullptr);
+  ASSERT_EQ(0, HashTable_NumElements(table));
+  HashTable_Free(table, free_fn);
+}
+
+TEST_F(Test_HashTable, ReserveBuild_AllEngines) {
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  HW1Environment::OpenTestCase();
+
+  for (HTEngine_t engine : kEngines) {
+    freeInvocations_ = 0;
+    TestEngineReserveBuild(engine, &Test_HashTable::InstrumentedVerifiedFree);
+    ASSERT_EQ(3000, freeInvocations_);
+    HW1Environment::AddPoints(5);
+  }
+}
+
+TEST_F(Test_HashTable, Reserve_MidMigration) {
+  HTKeyValue_t kv;
+  HW1Environment::OpenTestCase();
+
+  // Reserving while an incremental resize is under way finishes it.
+  HashTable *table = HashTable_Allocate(32);
+  for (int i = 0; i < 97; i++) {
+    InsertElement(table, i);
+  }
+  ASSERT_NE(nullptr, table->old_buckets);
+  HashTable_Reserve(table, 10000);
+  ASSERT_EQ(nullptr, table->old_buckets);
+  ASSERT_EQ(4096, table->num_buckets);
+  for (int i = 0; i < 97; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+  HashTable_Free(table, &FreeValue);
+
+  // A read-mostly table swaps in the bigger array for its readers.
+  table = HashTable_AllocateReadMostly(32);
+  for (int i = 0; i < 97; i++) {
+    InsertElement(table, i);
+  }
+  HashTable_Reserve(table, 10000);
+  ASSERT_EQ(4096, table->num_buckets);
+  ASSERT_EQ(4096, table->snapshot->num_buckets);
+  for (int i = 0; i < 97; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+  }
+  HashTable_Free(table, &FreeValue);
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, BuildParallel) {
+  static const int kNumKeys = 5000;
+  static const int kThreads[] = { 1, 3, 4, 16 };
+  static HTKeyValue_t kvs[kNumKeys + 500];
+  HTKeyValue_t kv;
+  HW1Environment::OpenTestCase();
+
+  for (int num_threads : kThreads) {
+    // Keys [0, 500) appear twice; the second copy wins.
+    for (int i = 0; i < kNumKeys + 500; i++) {
+      kvs[i].key = i % kNumKeys;
+      kvs[i].value = NewPayload(i);
+    }
+    freeInvocations_ = 0;
+    HashTable *table = HashTable_BuildParallel(kvs, kNumKeys + 500,
+                                               num_threads, false,
+                                               &FreeValue);
+    ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+    ASSERT_EQ(BucketsForElements(kNumKeys + 500), table->num_buckets);
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_TRUE(HashTable_Find(table, i, &kv));
+      ASSERT_EQ(static_cast<HTKey_t>(i < 500 ? i + kNumKeys : i),
+                AsKeyType(kv.value));
+    }
+
+    // It's an ordinary table afterwards.
+    ASSERT_TRUE(HashTable_Remove(table, 7, &kv));
+    FreeValue(kv.value);
+    InsertElement(table, kNumKeys);
+    int count = 0;
+    HTIterator *it = HTIterator_Allocate(table);
+    for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+      count++;
+    }
+    HTIterator_Free(it);
+    ASSERT_EQ(kNumKeys, count);
+    HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+    ASSERT_EQ(kNumKeys, freeInvocations_);
+
+    // And with assume_unique.
+    for (int i = 0; i < kNumKeys; i++) {
+      kvs[i].key = i * 3;
+      kvs[i].value = NewPayload(i * 3);
+    }
+    table = HashTable_BuildParallel(kvs, kNumKeys, num_threads, true,
+                                    nullptr);
+    ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_TRUE(HashTable_Find(table, i * 3, &kv));
+      ASSERT_EQ(static_cast<HTKey_t>(i * 3), AsKeyType(kv.value));
+      ASSERT_FALSE(HashTable_Find(table, i * 3 + 1, &kv));
+    }
+    HashTable_Free(table, &FreeValue);
+  }
+
+  // More threads than pairs (or buckets) is fine.
+  HashTable *table = HashTable_BuildParallel(kvs, 0, 4, true, nullptr);
+  ASSERT_EQ(0, HashTable_NumElements(table));
+  HashTable_Free(table, &FreeValue);
+
+  // Big enough that each thread fills several bucket ranges.
+  vector<HTKeyValue_t> big(200000);
+  for (size_t i = 0; i < big.size(); i++) {
+    big[i].key = i;
+    big[i].value = reinterpret_cast<HTValue_t>(i);
+  }
+  table = HashTable_BuildParallel(big.data(), big.size(), 3, true, nullptr);
+  ASSERT_EQ(static_cast<int>(big.size()), HashTable_NumElements(table));
+  for (size_t i = 0; i < big.size(); i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(reinterpret_cast<HTValue_t>(i), kv.value);
+  }
+  HashTable_Free(table, [](HTValue_t) { });
+  HW1Environment::AddPoints(10);
+}
+
+// What HashTable_ParallelReduce folds the table down to.
+struct ScanTotals {
+  uint64_t sum;    // of keys
+  uint64_t count;  // of entries
+  uint64_t max;    // key
+};
+
+static void ReduceTotals(void *acc, HTKeyValue_t kv, void *arg) {
+  ScanTotals *t = static_cast<ScanTotals *>(acc);
+  t->sum += kv.key;
+  t->count++;
+  t->max = kv.key > t->max ? kv.key : t->max;
+}
+
+static void CombineTotals(void *acc, const void *other, void *arg) {
+  ScanTotals *t = static_cast<ScanTotals *>(acc);
+  const ScanTotals *o = static_cast<const ScanTotals *>(other);
+  t->sum += o->sum;
+  t->count += o->count;
+  t->max = o->max > t->max ? o->max : t->max;
+  (*static_cast<int *>(arg))++;
+}
+
+static void VisitSum(HTKeyValue_t kv, void *arg) {
+  // Values are the keys, as values.
+  ASSERT_EQ(kv.key, reinterpret_cast<HTKey_t>(kv.value));
+  static_cast<std::atomic<uint64_t> *>(arg)->fetch_add(kv.key);
+}
+
+TEST_F(Test_HashTable, ParallelForEachReduce) {
+  static const int kNumKeys = 100000;
+  static const uint64_t kSum = (uint64_t) kNumKeys * (kNumKeys - 1) / 2;
+  static const int kThreads[] = { 1, 3, 16 };
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  HTKeyValue_t kv, old;
+  HW1Environment::OpenTestCase();
+
+  for (HTEngine_t engine : kEngines) {
+    HashTable *table = HashTable_AllocateEngine(1, engine);
+    for (int i = 0; i < kNumKeys; i++) {
+      kv.key = i;
+      kv.value = reinterpret_cast<HTValue_t>(kv.key);
+      HashTable_Insert(table, kv, &old);
+    }
+    for (int num_threads : kThreads) {
+      std::atomic<uint64_t> sum(0);
+      HashTable_ParallelForEach(table, num_threads, &VisitSum, &sum);
+      ASSERT_EQ(kSum, sum.load());
+
+      ScanTotals totals = { 0, 0, 0 };
+      int combines = 0;
+      HashTable_ParallelReduce(table, num_threads, &totals, sizeof(totals),
+                               &ReduceTotals, &CombineTotals, &combines);
+      ASSERT_EQ(kSum, totals.sum);
+      ASSERT_EQ(static_cast<uint64_t>(kNumKeys), totals.count);
+      ASSERT_EQ(static_cast<uint64_t>(kNumKeys - 1), totals.max);
+      ASSERT_LE(1, combines);
+      ASSERT_GE(num_threads, combines);
+    }
+    HashTable_Free(table, [](HTValue_t) { });
+  }
+
+  // A chained table part way through a resize is visited across both
+  // bucket arrays, and a table with a single bucket needs a single thread.
+  HashTable *table = HashTable_Allocate(4096);
+  table->migrate_step = 1;
+  for (int i = 0; i <= 4096 * 3; i++) {
+    kv.key = i;
+    kv.value = reinterpret_cast<HTValue_t>(kv.key);
+    HashTable_Insert(table, kv, &old);
+  }
+  ASSERT_TRUE(table->old_buckets != NULL);
+  ScanTotals totals = { 0, 0, 0 };
+  int combines = 0;
+  HashTable_ParallelReduce(table, 4, &totals, sizeof(totals),
+                           &ReduceTotals, &CombineTotals, &combines);
+  ASSERT_EQ(static_cast<uint64_t>(4096 * 3 + 1), totals.count);
+  ASSERT_EQ((uint64_t) 4096 * 3 * (4096 * 3 + 1) / 2, totals.sum);
+  HashTable_Free(table, [](HTValue_t) { });
+
+  table = HashTable_Allocate(1);
+  totals = { 0, 0, 0 };
+  combines = 0;
+  HashTable_ParallelReduce(table, 8, &totals, sizeof(totals),
+                           &ReduceTotals, &CombineTotals, &combines);
+  ASSERT_EQ(0U, totals.count);
+  ASSERT_EQ(1, combines);
+  HashTable_Free(table, [](HTValue_t) { });
+  HW1Environment::AddPoints(10);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Snapshot tests
+///////////////////////////////////////////////////////////////////////////////
+
+// A TestPayload is saved as its payload followed by (payload % 300) filler
+// bytes, so some values are bigger than SaveSnapshot's first buffer.
+static size_t SerializePayload(HTValue_t v, void *buf, size_t size) {
+  int p = static_cast<TestPayload *>(v)->payload;
+  size_t need = sizeof(int) + p % 300;
+
+  if (need <= size) {
+    memcpy(buf, &p, sizeof(int));
+    memset(static_cast<char *>(buf) + sizeof(int), p & 0x7F, p % 300);
+  }
+  return need;
+}
+
+static int SavedPayload(const void *bytes, size_t size) {
+  int p;
+  memcpy(&p, bytes, sizeof(int));
+  EXPECT_EQ(sizeof(int) + p % 300, size);
+  for (size_t i = sizeof(int); i < size; i++) {
+    EXPECT_EQ(p & 0x7F, static_cast<const char *>(bytes)[i]);
+  }
+  return p;
+}
+
+static HTValue_t DeserializePayload(const void *bytes, size_t size) {
+  return NewPayload(SavedPayload(bytes, size));
+}
+
+static std::string ReadFile(const std::string &path) {
+  std::string data;
+  FILE *f = fopen(path.c_str(), "rb");
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    data.append(buf, n);
+  }
+  fclose(f);
+  return data;
+}
+
+static void WriteFile(const std::string &path, const std::string &data) {
+  FILE *f = fopen(path.c_str(), "wb");
+  fwrite(data.data(), 1, data.size(), f);
+  fclose(f);
+}
+
+TEST_F(Test_HashTable, Snapshot_SaveMapLoad) {
+  static const int kNumKeys = 1000;
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  std::string path = testing::TempDir() + "hw1_snapshot_test";
+  HTKeyValue_t kv;
+  size_t size;
+  HW1Environment::OpenTestCase();
+
+  HashTable *table = HashTable_AllocateEngine(16, HT_ENGINE_SWISS);
+  for (int i = 0; i < kNumKeys; i++) {
+    InsertElement(table, i * 5);
+  }
+  ASSERT_TRUE(HashTable_SaveSnapshot(table, path.c_str(), &SerializePayload));
+  HashTable_Free(table, &FreeValue);
+
+  // Find works straight off the mapping.
+  MappedHashTable *mapped = MappedHashTable_Open(path.c_str(), true);
+  ASSERT_NE(nullptr, mapped);
+  ASSERT_EQ(kNumKeys, MappedHashTable_NumElements(mapped));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_TRUE(MappedHashTable_Find(mapped, i * 5, &kv, &size));
+    ASSERT_EQ(static_cast<HTKey_t>(i * 5), kv.key);
+    ASSERT_EQ(0U, reinterpret_cast<uintptr_t>(kv.value) % 8);
+    ASSERT_EQ(i * 5, SavedPayload(kv.value, size));
+    ASSERT_FALSE(MappedHashTable_Find(mapped, i * 5 + 1, &kv, nullptr));
+  }
+  MappedHashTable_Close(mapped);
+
+  // And it loads back into a table of any engine.
+  for (HTEngine_t engine : kEngines) {
+    table = HashTable_LoadSnapshot(path.c_str(), engine, &DeserializePayload);
+    ASSERT_NE(nullptr, table);
+    ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_TRUE(HashTable_Find(table, i * 5, &kv));
+      ASSERT_EQ(static_cast<HTKey_t>(i * 5), AsKeyType(kv.value));
+    }
+    freeInvocations_ = 0;
+    HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+    ASSERT_EQ(kNumKeys, freeInvocations_);
+  }
+  HW1Environment::AddPoints(10);
+
+  // A flipped byte fails the checksum.  Without the check, the header is
+  // still fine, so the file maps.
+  std::string data = ReadFile(path);
+  std::string bad = path + ".bad";
+  data[data.size() / 2] ^= 0x10;
+  WriteFile(bad, data);
+  ASSERT_EQ(nullptr, MappedHashTable_Open(bad.c_str(), true));
+  ASSERT_EQ(nullptr, HashTable_LoadSnapshot(bad.c_str(), HT_ENGINE_CHAINED,
+                                            &DeserializePayload));
+  mapped = MappedHashTable_Open(bad.c_str(), false);
+  ASSERT_NE(nullptr, mapped);
+  MappedHashTable_Close(mapped);
+
+  // Truncated files, other versions and missing files don't open at all.
+  data[data.size() / 2] ^= 0x10;
+  WriteFile(bad, data.substr(0, data.size() - 8));
+  ASSERT_EQ(nullptr, MappedHashTable_Open(bad.c_str(), false));
+  data[8] ^= 0x02;  // the version
+  WriteFile(bad, data);
+  ASSERT_EQ(nullptr, MappedHashTable_Open(bad.c_str(), false));
+  remove(bad.c_str());
+  ASSERT_EQ(nullptr, MappedHashTable_Open(bad.c_str(), false));
+
+  // An empty table round trips, and a save that can't be written fails.
+  table = HashTable_Allocate(1);
+  ASSERT_TRUE(HashTable_SaveSnapshot(table, path.c_str(), &SerializePayload));
+  ASSERT_FALSE(HashTable_SaveSnapshot(table, "/nonexistent/dir/snapshot",
+                                      &SerializePayload));
+  HashTable_Free(table, &FreeValue);
+  mapped = MappedHashTable_Open(path.c_str(), true);
+  ASSERT_NE(nullptr, mapped);
+  ASSERT_EQ(0, MappedHashTable_NumElements(mapped));
+  ASSERT_FALSE(MappedHashTable_Find(mapped, 0, &kv, nullptr));
+  MappedHashTable_Close(mapped);
+  table = HashTable_LoadSnapshot(path.c_str(), HT_ENGINE_CHAINED,
+                                 &DeserializePayload);
+  ASSERT_EQ(0, HashTable_NumElements(table));
+  HashTable_Free(table, &FreeValue);
+  remove(path.c_str());
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, Snapshot_Checkpoint) {
+  static const int kNumKeys = 1000;
+  std::string path = testing::TempDir() + "hw1_checkpoint_test";
+  HTKeyValue_t kv, old;
+  HTCheckpointStats stats;
+  HW1Environment::OpenTestCase();
+
+  HashTable *table = HashTable_Allocate(16);
+  for (int i = 0; i < kNumKeys; i++) {
+    InsertElement(table, i);
+  }
+  HTCheckpoint *checkpoint =
+    HashTable_StartCheckpoint(table, path.c_str(), &SerializePayload);
+  ASSERT_NE(nullptr, checkpoint);
+
+  // Change the table (and free what comes out of it) while the child
+  // saves it.  The snapshot still holds the table as it was at the start.
+  for (int i = 0; i < kNumKeys; i += 2) {
+    ASSERT_TRUE(HashTable_Remove(table, i, &old));
+    FreeValue(old.value);
+  }
+  for (int i = kNumKeys; i < 2 * kNumKeys; i++) {
+    InsertElement(table, i);
+  }
+  ASSERT_TRUE(HTCheckpoint_Finish(checkpoint, &stats));
+  ASSERT_GT(stats.fork_ns, 0);
+  ASSERT_GE(stats.duration_ns, stats.fork_ns);
+  ASSERT_GT(stats.cow_bytes, 0);
+  ASSERT_EQ(1500, HashTable_NumElements(table));
+  HashTable_Free(table, &FreeValue);
+
+  table = HashTable_LoadSnapshot(path.c_str(), HT_ENGINE_CHAINED,
+                                 &DeserializePayload);
+  ASSERT_NE(nullptr, table);
+  ASSERT_EQ(kNumKeys, HashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+  HW1Environment::AddPoints(10);
+
+  // A checkpoint that can't write its file fails, and Done can be polled
+  // until it is over.
+  checkpoint = HashTable_StartCheckpoint(table, "/nonexistent/dir/checkpoint",
+                                         &SerializePayload);
+  ASSERT_NE(nullptr, checkpoint);
+  while (!HTCheckpoint_Done(checkpoint)) {
+    std::this_thread::yield();
+  }
+  ASSERT_TRUE(HTCheckpoint_Done(checkpoint));
+  ASSERT_FALSE(HTCheckpoint_Finish(checkpoint, nullptr));
+  HashTable_Free(table, &FreeValue);
+  remove(path.c_str());
+  HW1Environment::AddPoints(5);
+}
+
+// Check that table holds exactly the odd keys in [0, 1000) except 1, with
+// key 5 mapped to 5000, plus the keys in extra (each mapped to itself).
+static void VerifyLoggedTable(HashTable *table, const vector<int> &extra) {
+  HTKeyValue_t kv;
+
+  ASSERT_EQ(499 + static_cast<int>(extra.size()),
+            HashTable_NumElements(table));
+  for (int i = 0; i < 1000; i++) {
+    if (i % 2 == 0 || i == 1) {
+      ASSERT_FALSE(HashTable_Find(table, i, &kv));
+    } else {
+      ASSERT_TRUE(HashTable_Find(table, i, &kv));
+      ASSERT_EQ(static_cast<HTKey_t>(i == 5 ? 5000 : i), AsKeyType(kv.value));
+    }
+  }
+  for (int e : extra) {
+    ASSERT_TRUE(HashTable_Find(table, e, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(e), AsKeyType(kv.value));
+  }
+}
+
+static off_t FileSize(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+TEST_F(Test_HashTable, Log_RecoverAndCompact) {
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  std::string snap = testing::TempDir() + "hw1_log_test.snap";
+  std::string log_path = testing::TempDir() + "hw1_log_test.log";
+  HTKeyValue_t kv, old;
+  HW1Environment::OpenTestCase();
+
+  for (HTEngine_t engine : kEngines) {
+    remove(snap.c_str());
+    remove(log_path.c_str());
+
+    // With nothing on disk, recovery gives an empty table.
+    HashTable *table = HTLog_Recover(snap.c_str(), log_path.c_str(), engine,
+                                     &DeserializePayload, &FreeValue);
+    ASSERT_NE(nullptr, table);
+    ASSERT_EQ(0, HashTable_NumElements(table));
+
+    // The groups are big enough that nothing reaches the file until Close.
+    HTLog *log = HTLog_Open(log_path.c_str(), &SerializePayload, 1 << 20,
+                            1000000);
+    ASSERT_NE(nullptr, log);
+    HashTable_AttachLog(table, log);
+    for (int i = 0; i < 1000; i++) {
+      InsertElement(table, i);
+    }
+    kv.key = 5;
+    kv.value = NewPayload(5000);
+    ASSERT_TRUE(HashTable_Insert(table, kv, &old));
+    FreeValue(old.value);
+    for (int i = 0; i < 1000; i += 2) {
+      ASSERT_TRUE(HashTable_Remove(table, i, &kv));
+      FreeValue(kv.value);
+    }
+    ASSERT_FALSE(HashTable_Remove(table, 0, &kv));  // not logged
+    HTIterator *it = HTIterator_Allocate(table);
+    while (HTIterator_Get(it, &kv) && kv.key != 1) {
+      HTIterator_Next(it);
+    }
+    ASSERT_TRUE(HTIterator_Remove(it, &kv));
+    FreeValue(kv.value);
+    HTIterator_Free(it);
+    ASSERT_EQ(16, FileSize(log_path));
+    HashTable_AttachLog(table, nullptr);
+    ASSERT_TRUE(HTLog_Close(log));
+    HashTable_Free(table, &FreeValue);
+
+    // Replaying the log gives the same table, even with a torn record on
+    // the end, which recovery cuts off.
+    off_t size = FileSize(log_path);
+    std::string data = ReadFile(log_path);
+    WriteFile(log_path, data + data.substr(16, 30));
+    table = HTLog_Recover(snap.c_str(), log_path.c_str(), engine,
+                          &DeserializePayload, &FreeValue);
+    ASSERT_NE(nullptr, table);
+    VerifyLoggedTable(table, {});
+    ASSERT_EQ(size, FileSize(log_path));
+
+    // Compaction moves everything into the snapshot and empties the log.
+    log = HTLog_Open(log_path.c_str(), &SerializePayload, 0, 0);
+    ASSERT_NE(nullptr, log);
+    HashTable_AttachLog(table, log);
+    InsertElement(table, 2000);
+    ASSERT_LT(size, FileSize(log_path));  // synced straight away
+    ASSERT_TRUE(HTLog_Compact(log, table, snap.c_str()));
+    ASSERT_EQ(16, FileSize(log_path));
+    InsertElement(table, 2001);
+    HashTable_AttachLog(table, nullptr);
+    ASSERT_TRUE(HTLog_Close(log));
+    HashTable_Free(table, &FreeValue);
+
+    table = HTLog_Recover(snap.c_str(), log_path.c_str(), engine,
+                          &DeserializePayload, &FreeValue);
+    ASSERT_NE(nullptr, table);
+    VerifyLoggedTable(table, {2000, 2001});
+    HashTable_Free(table, &FreeValue);
+
+    // Many updates to a few keys recover into a table no bigger than the
+    // live one needs, which can still shrink once its keys are removed.
+    remove(snap.c_str());
+    remove(log_path.c_str());
+    HashTable *live = HashTable_AllocateEngine(1, engine);
+    log = HTLog_Open(log_path.c_str(), &SerializePayload, 1 << 20, 1000000);
+    ASSERT_NE(nullptr, log);
+    HashTable_AttachLog(live, log);
+    for (int round = 0; round < 1000; round++) {
+      for (int i = 0; i < 10; i++) {
+        kv.key = i;
+        kv.value = NewPayload(round);
+        if (HashTable_Insert(live, kv, &old)) {
+          FreeValue(old.value);
+        }
+      }
+    }
+    HashTable_AttachLog(live, nullptr);
+    ASSERT_TRUE(HTLog_Close(log));
+    table = HTLog_Recover(snap.c_str(), log_path.c_str(), engine,
+                          &DeserializePayload, &FreeValue);
+    ASSERT_NE(nullptr, table);
+    ASSERT_EQ(10, HashTable_NumElements(table));
+    HashTable_ShrinkToFit(live);
+    ASSERT_EQ(live->num_buckets, table->num_buckets);
+    ASSERT_EQ(1, table->min_buckets);
+    HashTable_Free(live, &FreeValue);
+    HashTable_Free(table, &FreeValue);
+    HW1Environment::AddPoints(5);
+  }
+
+  // A file that isn't a log is rejected.
+  WriteFile(log_path, std::string(64, 'x'));
+  ASSERT_EQ(nullptr, HTLog_Open(log_path.c_str(), &SerializePayload, 0, 0));
+  ASSERT_EQ(nullptr, HTLog_Recover(nullptr, log_path.c_str(),
+                                   HT_ENGINE_CHAINED, &DeserializePayload,
+                                   &FreeValue));
+  remove(snap.c_str());
+  remove(log_path.c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sharded table tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(Test_HashTable, Hash_OneShotIncrementalBatch) {
+  static const char kFox[] = "The quick brown fox jumps over the lazy dog";
+  unsigned char bytes[300];
+  HW1Environment::OpenTestCase();
+
+  // FNVHash64 is unchanged (these are the published FNV-1a values), and
+  // HTHash64 matches the reference xxHash64.
+  ASSERT_EQ(0xcbf29ce484222325ULL, FNVHash64(bytes, 0));
+  ASSERT_EQ(0xaf63dc4c8601ec8cULL,
+            FNVHash64((unsigned char *) const_cast<char *>("a"), 1));
+  ASSERT_EQ(0xef46db3751d8e999ULL, HTHash64("", 0, 0));
+  ASSERT_EQ(0xd24ec4f1a98c6e5bULL, HTHash64("a", 1, 0));
+  ASSERT_EQ(0x44bc2cf5ad770999ULL, HTHash64("abc", 3, 0));
+  ASSERT_EQ(0x0b242d361fda71bcULL, HTHash64(kFox, strlen(kFox), 0));
+  ASSERT_EQ(0xf63d191bd747f18cULL, HTHash64(kFox, strlen(kFox), 333));
+  for (int i = 0; i < 300; i++) {
+    bytes[i] = static_cast<unsigned char>(i);
+  }
+  ASSERT_EQ(0x6ac1e58032166597ULL, HTHash64(bytes, 100, 0));
+  ASSERT_EQ(0x4cf959d8316fe07dULL, HTHash64(bytes, 100, 333));
+  HW1Environment::AddPoints(5);
+
+  // Feeding a key in pieces of any size gives the same hash as all at once.
+  for (size_t len = 0; len <= 300; len += 7) {
+    for (size_t piece = 1; piece <= 40; piece += 3) {
+      HTHashState state;
+      HTHash64_Init(&state, 333);
+      for (size_t off = 0; off < len; off += piece) {
+        HTHash64_Update(&state, bytes + off,
+                        piece < len - off ? piece : len - off);
+      }
+      ASSERT_EQ(HTHash64(bytes, len, 333), HTHash64_Final(&state));
+    }
+  }
+  HW1Environment::AddPoints(5);
+
+  // So does a batch, with any mix of lengths and any number of keys.  Most
+  // keys come in runs of four of the same length, which are hashed in
+  // lock step.
+  vector<const void *> buffers;
+  vector<size_t> lens;
+  for (int i = 0; i < 203; i++) {
+    size_t len = (i % 9 == 0) ? (i * 13) % 100 : (i / 4 * 7) % 32;
+    buffers.push_back(bytes + i);
+    lens.push_back(len);
+  }
+  for (int n = 0; n <= 203; n += (n < 10) ? 1 : 37) {
+    vector<HTKey_t> hashes(n + 1, 0);
+    HTHash64_Batch(buffers.data(), lens.data(), n, 333, hashes.data());
+    for (int i = 0; i < n; i++) {
+      ASSERT_EQ(HTHash64(buffers[i], lens[i], 333), hashes[i]);
+    }
+    ASSERT_EQ(0U, hashes[n]);
+  }
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, String_InsertFindRemove) {
+  static const int kNumKeys = 1000;
+  // Keys that differ only in length, in a '\0', or past the small-key
+  // slot, plus the empty key.
+  const string kTricky[] = {
+    string(""), string("a"), string("a\0", 2), string("ab"),
+    string(16, 'x'), string(17, 'x'), string(15, 'x') + string("y"),
+    string(100, 'z'), string(99, 'z') + string("\0", 1),
+  };
+  HTValue_t value;
+  HW1Environment::OpenTestCase();
+
+  StrHashTable *table = StrHashTable_Allocate(4);
+  for (size_t i = 0; i < sizeof(kTricky) / sizeof(kTricky[0]); i++) {
+    const string &k = kTricky[i];
+    ASSERT_FALSE(StrHashTable_Insert(table, k.data(), k.size(),
+                                     NewPayload(i), &value));
+  }
+  for (int i = 0; i < kNumKeys; i++) {
+    string k = "key number " + std::to_string(i);
+    ASSERT_FALSE(StrHashTable_Insert(table, k.data(), k.size(),
+                                     NewPayload(1000 + i), &value));
+  }
+  const int kTotal = kNumKeys + sizeof(kTricky) / sizeof(kTricky[0]);
+  ASSERT_EQ(kTotal, StrHashTable_NumElements(table));
+  // The table grew to keep chains short, relinking entries by their cached
+  // hashes.
+  ASSERT_GE(table->num_buckets, kTotal);
+  for (int b = 0; b < table->num_buckets; b++) {
+    for (StrEntry *e = table->buckets[b]; e != nullptr; e = e->next) {
+      ASSERT_EQ(static_cast<uint64_t>(b), e->hash & (table->num_buckets - 1));
+      ASSERT_EQ(StrHashTable_Hash(reinterpret_cast<char *>(StrEntryKey(e)), e->len),
+                e->hash);
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(kTricky) / sizeof(kTricky[0]); i++) {
+    const string &k = kTricky[i];
+    ASSERT_TRUE(StrHashTable_Find(table, k.data(), k.size(), &value));
+    ASSERT_EQ(i, AsKeyType(value));
+  }
+  for (int i = 0; i < kNumKeys; i++) {
+    string k = "key number " + std::to_string(i);
+    uint64_t hash = StrHashTable_Hash(k.data(), k.size());
+    ASSERT_TRUE(StrHashTable_FindHashed(table, hash, k.data(), k.size(),
+                                        &value));
+    ASSERT_EQ(static_cast<HTKey_t>(1000 + i), AsKeyType(value));
+    ASSERT_FALSE(StrHashTable_FindHashed(table, hash + 1, k.data(),
+                                         k.size(), &value));
+  }
+  ASSERT_FALSE(StrHashTable_Find(table, "key number", 10, &value));
+  ASSERT_FALSE(StrHashTable_Find(table, "b", 1, &value));
+  HW1Environment::AddPoints(10);
+
+  // Replacing and removing.
+  HTValue_t fresh = NewPayload(7);
+  ASSERT_TRUE(StrHashTable_Insert(table, "a\0", 2, fresh, &value));
+  ASSERT_EQ(2U, AsKeyType(value));
+  FreeValue(value);
+  ASSERT_TRUE(StrHashTable_Find(table, "a\0", 2, &value));
+  ASSERT_EQ(fresh, value);
+  ASSERT_TRUE(StrHashTable_Find(table, "a", 1, &value));
+  ASSERT_EQ(1U, AsKeyType(value));
+  for (int i = 0; i < kNumKeys; i += 2) {
+    string k = "key number " + std::to_string(i);
+    ASSERT_TRUE(StrHashTable_Remove(table, k.data(), k.size(), &value));
+    ASSERT_EQ(static_cast<HTKey_t>(1000 + i), AsKeyType(value));
+    FreeValue(value);
+    ASSERT_FALSE(StrHashTable_Remove(table, k.data(), k.size(), &value));
+  }
+  ASSERT_TRUE(StrHashTable_Remove(table, "", 0, &value));
+  FreeValue(value);
+  ASSERT_FALSE(StrHashTable_Find(table, "", 0, &value));
+  ASSERT_EQ(kTotal - kNumKeys / 2 - 1, StrHashTable_NumElements(table));
+  for (int i = 1; i < kNumKeys; i += 2) {
+    string k = "key number " + std::to_string(i);
+    ASSERT_TRUE(StrHashTable_Find(table, k.data(), k.size(), &value));
+  }
+
+  freeInvocations_ = 0;
+  StrHashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(kTotal - kNumKeys / 2 - 1, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+TEST_F(Test_HashTable, Interner_Basic) {
+  size_t len;
+  InternId id;
+  HW1Environment::OpenTestCase();
+
+  Interner *in = Interner_Allocate();
+  ASSERT_EQ(0, Interner_NumStrings(in));
+  ASSERT_EQ(0U, Interner_Intern(in, "apple", 5));
+  ASSERT_EQ(1U, Interner_Intern(in, "banana", 6));
+  ASSERT_EQ(2U, Interner_Intern(in, "", 0));
+  ASSERT_EQ(3U, Interner_Intern(in, "apple\0", 6));
+  ASSERT_EQ(0U, Interner_Intern(in, "apple", 5));
+  ASSERT_EQ(2U, Interner_Intern(in, nullptr, 0));
+  ASSERT_EQ(4, Interner_NumStrings(in));
+
+  // The arena's copies are '\0'-terminated and stay put.
+  const char *apple = Interner_String(in, 0, &len);
+  ASSERT_EQ(5U, len);
+  ASSERT_STREQ("apple", apple);
+  ASSERT_EQ(0, memcmp("apple\0", Interner_String(in, 3, &len), 7));
+  ASSERT_EQ(6U, len);
+  ASSERT_STREQ("", Interner_String(in, 2, nullptr));
+
+  ASSERT_TRUE(Interner_Find(in, "banana", 6, &id));
+  ASSERT_EQ(1U, id);
+  ASSERT_FALSE(Interner_Find(in, "cherry", 6, &id));
+  ASSERT_EQ(4, Interner_NumStrings(in));
+
+  // A batch, with repeats within it and with earlier strings, spanning
+  // several groups, gives the same IDs as interning one at a time.
+  vector<string> strs;
+  for (int i = 0; i < 1000; i++) {
+    strs.push_back("string " + std::to_string(i % 300));
+  }
+  strs.push_back("apple");
+  strs.push_back(string(5000, 'q'));
+  vector<const char *> ptrs;
+  vector<size_t> lens;
+  for (const string &str : strs) {
+    ptrs.push_back(str.data());
+    lens.push_back(str.size());
+  }
+  vector<InternId> ids(strs.size());
+  Interner_InternBatch(in, ptrs.data(), lens.data(), strs.size(), ids.data());
+  ASSERT_EQ(4 + 300 + 1, Interner_NumStrings(in));
+  for (size_t i = 0; i < strs.size(); i++) {
+    ASSERT_EQ(Interner_Intern(in, ptrs[i], lens[i]), ids[i]);
+    const char *copy = Interner_String(in, ids[i], &len);
+    ASSERT_EQ(strs[i], string(copy, len));
+  }
+  ASSERT_EQ(4U + 299U, ids[299]);
+  ASSERT_EQ(0U, ids[1000]);
+  ASSERT_EQ(apple, Interner_String(in, 0, nullptr));
+  HW1Environment::AddPoints(10);
+
+  // Fake a 64-bit hash collision: make cherry's hash point at apple.  The
+  // search steps past it, and cherry goes in the next key.
+  HTKeyValue_t kv, old;
+  kv.key = HTHash64("cherry", 6, 0);
+  kv.value = reinterpret_cast<HTValue_t>(static_cast<uintptr_t>(0));
+  ASSERT_FALSE(HashTable_Insert(in->table, kv, &old));
+  ASSERT_FALSE(Interner_Find(in, "cherry", 6, &id));
+  id = Interner_Intern(in, "cherry", 6);
+  ASSERT_EQ(static_cast<InternId>(Interner_NumStrings(in) - 1), id);
+  ASSERT_TRUE(HashTable_Find(in->table, kv.key + 1, &kv));
+  ASSERT_EQ(id, static_cast<InternId>(reinterpret_cast<uintptr_t>(kv.value)));
+  ASSERT_EQ(id, Interner_Intern(in, "cherry", 6));
+  ASSERT_EQ(0U, Interner_Intern(in, "apple", 5));
+  Interner_Free(in);
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, Interner_ConcurrentBatch) {
+  static const int kNumThreads = 4;
+  static const int kNumStrings = 5000;
+  static const int kStride[kNumThreads] = { 1, 3, 7, 9 };
+  HW1Environment::OpenTestCase();
+
+  vector<string> strs;
+  for (int i = 0; i < kNumStrings; i++) {
+    strs.push_back("concurrent " + std::to_string(i));
+  }
+  Interner *in = Interner_Allocate();
+  vector<vector<InternId>> ids(kNumThreads, vector<InternId>(kNumStrings));
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      // Each thread interns every string, in its own order, in batches.
+      vector<const char *> ptrs;
+      vector<size_t> lens;
+      vector<InternId> out(kNumStrings);
+      for (int i = 0; i < kNumStrings; i++) {
+        const string &str = strs[(i * kStride[t]) % kNumStrings];
+        ptrs.push_back(str.data());
+        lens.push_back(str.size());
+      }
+      for (int i = 0; i < kNumStrings; i += 100) {
+        Interner_InternBatch(in, &ptrs[i], &lens[i], 100, &out[i]);
+      }
+      for (int i = 0; i < kNumStrings; i++) {
+        ids[t][(i * kStride[t]) % kNumStrings] = out[i];
+      }
+    });
+  }
+  for (thread &th : threads) {
+    th.join();
+  }
+
+  // Every thread got the same ID for each string, and the IDs are dense.
+  ASSERT_EQ(kNumStrings, Interner_NumStrings(in));
+  set<InternId> seen;
+  for (int i = 0; i < kNumStrings; i++) {
+    for (int t = 1; t < kNumThreads; t++) {
+      ASSERT_EQ(ids[0][i], ids[t][i]);
+    }
+    ASSERT_STREQ(strs[i].c_str(), Interner_String(in, ids[0][i], nullptr));
+    seen.insert(ids[0][i]);
+  }
+  ASSERT_EQ(static_cast<size_t>(kNumStrings), seen.size());
+  ASSERT_EQ(static_cast<InternId>(kNumStrings - 1), *seen.rbegin());
+  Interner_Free(in);
+  HW1Environment::AddPoints(10);
+}
+
+static void TestEngineShrink(HTEngine_t engine, int (*size_for)(int),
+                             ValueFreeFnPtr free_fn) {
+  static const int kNumKeys = 20000;
+  static const int kKeep = 100;
+  HTKeyValue_t kv;
+
+  // Fill a small table and drain it.  Right after each shrink, inserting
+  // and removing a key over and over neither grows nor shrinks it again.
+  HashTable *table = HashTable_AllocateEngine(1, engine);
+  table->migrate_step = 0;
+  for (int i = 0; i < kNumKeys; i++) {
+    InsertElement(table, i);
+  }
+  int full = table->num_buckets;
+  int num_shrinks = 0;
+  for (int i = kNumKeys - 1; i >= kKeep; i--) {
+    int before = table->num_buckets;
+    ASSERT_TRUE(HashTable_Remove(table, i, &kv));
+    FreeValue(kv.value);
+    if (table->num_buckets == before) {
+      continue;
+    }
+    ASSERT_GT(before, table->num_buckets);
+    num_shrinks++;
+    int shrunk = table->num_buckets;
+    for (int j = 0; j < 100; j++) {
+      InsertElement(table, i);
+      ASSERT_TRUE(HashTable_Remove(table, i, &kv));
+      FreeValue(kv.value);
+      ASSERT_EQ(shrunk, table->num_buckets);
+    }
+  }
+  ASSERT_LT(0, num_shrinks);
+  ASSERT_GT(full, table->num_buckets);
+  ASSERT_LE(size_for(kKeep), table->num_buckets);
+  ASSERT_GT(16 * size_for(kKeep), table->num_buckets);
+  for (int i = 0; i < kKeep; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+
+  // ShrinkToFit takes it down to exactly the size it needs.
+  HashTable_ShrinkToFit(table);
+  ASSERT_EQ(size_for(kKeep), table->num_buckets);
+  ASSERT_EQ(kKeep, HashTable_NumElements(table));
+  for (int i = 0; i < kKeep; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+  HashTable_Free(table, free_fn);
+
+  // A table doesn't shrink itself below its allocated or reserved size,
+  // but ShrinkToFit does.
+  table = HashTable_AllocateEngine(4096, engine);
+  int allocated = table->num_buckets;
+  for (int i = 0; i < 1000; i++) {
+    InsertElement(table, i);
+  }
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(HashTable_Remove(table, i, &kv));
+    FreeValue(kv.value);
+  }
+  ASSERT_EQ(allocated, table->num_buckets);
+  HashTable_Reserve(table, 100000);
+  int reserved = table->num_buckets;
+  InsertElement(table, 1);
+  ASSERT_TRUE(HashTable_Remove(table, 1, &kv));
+  FreeValue(kv.value);
+  ASSERT_EQ(reserved, table->num_buckets);
+  HashTable_ShrinkToFit(table);
+  ASSERT_EQ(size_for(0), table->num_buckets);
+  HashTable_Free(table, free_fn);
+}
+
+TEST_F(Test_HashTable, Shrink_AllEngines) {
+  HW1Environment::OpenTestCase();
+
+  freeInvocations_ = 0;
+  TestEngineShrink(HT_ENGINE_CHAINED, &BucketsForElements,
+                   &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(100, freeInvocations_);
+  HW1Environment::AddPoints(5);
+
+  freeInvocations_ = 0;
+  TestEngineShrink(HT_ENGINE_ROBINHOOD, &RHSlotsForElements,
+                   &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(100, freeInvocations_);
+  HW1Environment::AddPoints(5);
+
+  freeInvocations_ = 0;
+  TestEngineShrink(HT_ENGINE_SWISS, &SWSlotsForElements,
+                   &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(100, freeInvocations_);
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, Shrink_Incremental) {
+  HTKeyValue_t kv;
+  HW1Environment::OpenTestCase();
+
+  // A chained table shrinks incrementally, like it grows.
+  HashTable *table = HashTable_Allocate(1);
+  table->migrate_step = 0;
+  for (int i = 0; i < 5000; i++) {
+    InsertElement(table, i);
+  }
+  table->migrate_step = 1;
+  int remaining = 5000;
+  while (table->old_buckets == NULL) {
+    ASSERT_TRUE(HashTable_Remove(table, remaining - 1, &kv));
+    FreeValue(kv.value);
+    remaining--;
+  }
+  ASSERT_GT(table->old_num_buckets, table->num_buckets);
+  ASSERT_LT(0, table->migrate_idx);
+
+  // Mid-shrink, every key is findable and iteration sees each once.
+  for (int i = 0; i < remaining; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+  set<HTKey_t> seen;
+  HTIterator *it = HTIterator_Allocate(table);
+  for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+    ASSERT_TRUE(HTIterator_Get(it, &kv));
+    ASSERT_EQ(0LU, seen.count(kv.key));
+    seen.insert(kv.key);
+  }
+  HTIterator_Free(it);
+  ASSERT_EQ(static_cast<size_t>(remaining), seen.size());
+
+  // Each Insert or Remove moves (old / new) old buckets, so it takes about
+  // as many operations as there are new buckets to finish.
+  int ops = 0;
+  while (table->old_buckets != NULL) {
+    InsertElement(table, remaining);
+    remaining++;
+    ops++;
+  }
+  ASSERT_GE(table->num_buckets, ops);
+  for (int i = 0; i < table->num_buckets; i++) {
+    ASSERT_TRUE(table->buckets[i] != NULL);
+  }
+  for (int i = 0; i < remaining; i++) {
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(remaining, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+// Return the keys of a chain, head first.
+static vector<HTKey_t> ChainKeys(LinkedList *chain) {
+  vector<HTKey_t> keys;
+  for (LinkedListNode *n = chain->head; n != NULL; n = n->next) {
+    keys.push_back(reinterpret_cast<HTEntry *>(n)->kv.key);
+  }
+  return keys;
+}
+
+TEST_F(Test_HashTable, Chain_SelfOrganizing) {
+  HTKeyValue_t kv;
+  HW1Environment::OpenTestCase();
+
+  // One bucket holding 0, 1, 2; inserts go on at the head.
+  HashTable *table = HashTable_Allocate(1);
+  for (int i = 0; i < 3; i++) {
+    InsertElement(table, i);
+  }
+  LinkedList *chain = table->buckets[0];
+  ASSERT_EQ(vector<HTKey_t>({2, 1, 0}), ChainKeys(chain));
+
+  // Move-to-front: one hit brings a key to the head.
+  HashTable_SetChainPolicy(table, HT_CHAIN_MOVE_TO_FRONT);
+  ASSERT_EQ(0.0, HashTable_ProbeDepth(table, false));
+  ASSERT_TRUE(HashTable_Find(table, 0, &kv));
+  ASSERT_EQ(static_cast<HTKey_t>(0), AsKeyType(kv.value));
+  ASSERT_EQ(vector<HTKey_t>({0, 2, 1}), ChainKeys(chain));
+  ASSERT_TRUE(HashTable_Find(table, 0, &kv));
+  ASSERT_EQ(static_cast<HTKey_t>(0), AsKeyType(kv.value));
+  ASSERT_FALSE(HashTable_Find(table, 99, &kv));
+  ASSERT_EQ(vector<HTKey_t>({0, 2, 1}), ChainKeys(chain));
+  // 3 probes, then 1, then 3 for the miss.
+  ASSERT_DOUBLE_EQ(7.0 / 3, HashTable_ProbeDepth(table, true));
+  ASSERT_EQ(0.0, HashTable_ProbeDepth(table, false));
+
+  // Transpose: each hit moves a key up one place, value and all.
+  HashTable_SetChainPolicy(table, HT_CHAIN_TRANSPOSE);
+  ASSERT_TRUE(HashTable_Find(table, 1, &kv));
+  ASSERT_EQ(vector<HTKey_t>({0, 1, 2}), ChainKeys(chain));
+  ASSERT_TRUE(HashTable_Find(table, 1, &kv));
+  ASSERT_EQ(vector<HTKey_t>({1, 0, 2}), ChainKeys(chain));
+  ASSERT_TRUE(HashTable_Find(table, 1, &kv));
+  ASSERT_EQ(vector<HTKey_t>({1, 0, 2}), ChainKeys(chain));
+  ASSERT_DOUBLE_EQ(2.0, HashTable_ProbeDepth(table, false));
+  for (LinkedListNode *n = chain->head; n != NULL; n = n->next) {
+    HTEntry *entry = reinterpret_cast<HTEntry *>(n);
+    ASSERT_EQ(&entry->kv, n->payload);
+    ASSERT_EQ(entry->kv.key, AsKeyType(entry->kv.value));
+  }
+
+  // A transposing Find leaves FindOrInsert pointers at their own keys.
+  bool inserted;
+  HTValue_t *value0 = HashTable_FindOrInsert(table, 0, nullptr, &inserted);
+  ASSERT_FALSE(inserted);
+  ASSERT_TRUE(HashTable_Find(table, 0, &kv));
+  ASSERT_EQ(vector<HTKey_t>({0, 1, 2}), ChainKeys(chain));
+  ASSERT_EQ(static_cast<HTKey_t>(0), AsKeyType(*value0));
+  free(*value0);
+  *value0 = NewPayload(100);
+  ASSERT_TRUE(HashTable_Find(table, 0, &kv));
+  ASSERT_EQ(static_cast<HTKey_t>(100), AsKeyType(kv.value));
+  ASSERT_TRUE(HashTable_Find(table, 1, &kv));
+  ASSERT_EQ(static_cast<HTKey_t>(1), AsKeyType(kv.value));
+  ASSERT_EQ(vector<HTKey_t>({1, 0, 2}), ChainKeys(chain));
+
+  // Fixed: counts probes without reordering.
+  HashTable_SetChainPolicy(table, HT_CHAIN_FIXED);
+  ASSERT_TRUE(HashTable_Find(table, 2, &kv));
+  ASSERT_EQ(vector<HTKey_t>({1, 0, 2}), ChainKeys(chain));
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(3, freeInvocations_);
+
+  // Lots of reordering, including across resizes, loses nothing.
+  static const HTChainPolicy_t kPolicies[] = { HT_CHAIN_MOVE_TO_FRONT,
+                                               HT_CHAIN_TRANSPOSE };
+  for (HTChainPolicy_t policy : kPolicies) {
+    table = HashTable_Allocate(4);
+    HashTable_SetChainPolicy(table, policy);
+    for (int i = 0; i < 1000; i++) {
+      InsertElement(table, i);
+      for (int j = 0; j <= i; j += 7) {
+        ASSERT_TRUE(HashTable_Find(table, (i * 31 + j) % (i + 1), &kv));
+        ASSERT_EQ(static_cast<HTKey_t>((i * 31 + j) % (i + 1)),
+                  AsKeyType(kv.value));
+      }
+    }
+    ASSERT_LT(0.0, HashTable_ProbeDepth(table, false));
+    set<HTKey_t> seen;
+    HTIterator *it = HTIterator_Allocate(table);
+    for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+      ASSERT_TRUE(HTIterator_Get(it, &kv));
+      ASSERT_EQ(kv.key, AsKeyType(kv.value));
+      seen.insert(kv.key);
+    }
+    HTIterator_Free(it);
+    ASSERT_EQ(1000LU, seen.size());
+    HashTable_Free(table, &FreeValue);
+  }
+  HW1Environment::AddPoints(10);
+}
+
+// An HTUpsertFnPtr that counts, keeping the count in the value itself.
+// arg points at an int that counts the calls.
+static void CountingUpsert(HTValue_t *value, bool exists, void *arg) {
+  ++*static_cast<int *>(arg);
+  if (!exists) {
+    EXPECT_EQ(nullptr, *value);
+  }
+  *value = reinterpret_cast<HTValue_t>(reinterpret_cast<uintptr_t>(*value) + 1);
+}
+
+TEST_F(Test_HashTable, Upsert_FindOrInsert) {
+  static const HTEngine_t kEngines[] = { HT_ENGINE_CHAINED,
+                                         HT_ENGINE_ROBINHOOD,
+                                         HT_ENGINE_SWISS };
+  static const int kNumKeys = 1000;
+  static const int kRepeats = 10;
+  HTKeyValue_t kv;
+  HW1Environment::OpenTestCase();
+
+  for (HTEngine_t engine : kEngines) {
+    HashTable *table = HashTable_AllocateEngine(1, engine);
+    vector<int> counts(2 * kNumKeys, 0);
+    int calls = 0;
+
+    // Count each key kRepeats times, in a scrambled order, both ways.
+    for (int i = 0; i < kNumKeys * kRepeats; i++) {
+      int key = (i * 7919) % kNumKeys;
+      ASSERT_EQ(counts[key] > 0,
+                HashTable_Upsert(table, key, &CountingUpsert, &calls));
+      counts[key]++;
+
+      bool inserted;
+      key += kNumKeys;
+      HTValue_t *slot = HashTable_FindOrInsert(table, key, nullptr, &inserted);
+      ASSERT_EQ(counts[key] == 0, inserted);
+      ASSERT_EQ(static_cast<uintptr_t>(counts[key]),
+                reinterpret_cast<uintptr_t>(*slot));
+      *slot = reinterpret_cast<HTValue_t>(reinterpret_cast<uintptr_t>(*slot) +
+                                          1);
+      counts[key]++;
+    }
+    ASSERT_EQ(kNumKeys * kRepeats, calls);
+    ASSERT_EQ(2 * kNumKeys, HashTable_NumElements(table));
+    for (int key = 0; key < 2 * kNumKeys; key++) {
+      ASSERT_TRUE(HashTable_Find(table, key, &kv));
+      ASSERT_EQ(static_cast<uintptr_t>(kRepeats),
+                reinterpret_cast<uintptr_t>(kv.value));
+    }
+
+    // Keys removed and added back (into tombstones, for Swiss) are new.
+    for (int key = 0; key < kNumKeys; key++) {
+      ASSERT_TRUE(HashTable_Remove(table, key, &kv));
+    }
+    for (int key = 0; key < kNumKeys; key++) {
+      bool inserted;
+      HTValue_t *slot = HashTable_FindOrInsert(table, key,
+                                               reinterpret_cast<HTValue_t>(1),
+                                               &inserted);
+      ASSERT_TRUE(inserted);
+      ASSERT_EQ(reinterpret_cast<HTValue_t>(1), *slot);
+    }
+    for (int key = 0; key < 2 * kNumKeys; key++) {
+      ASSERT_TRUE(HashTable_Find(table, key, &kv));
+      ASSERT_EQ(static_cast<uintptr_t>(key < kNumKeys ? 1 : kRepeats),
+                reinterpret_cast<uintptr_t>(kv.value));
+    }
+    HashTable_Free(table, [](HTValue_t) { });
+  }
+  HW1Environment::AddPoints(10);
+
+  // A chained table only helps a resize along when a key is added.
+  HashTable *table = HashTable_Allocate(16);
+  table->migrate_step = 1;
+  int calls = 0;
+  for (int key = 0; key <= 16 * 3; key++) {
+    ASSERT_FALSE(HashTable_Upsert(table, key, &CountingUpsert, &calls));
+  }
+  ASSERT_TRUE(table->old_buckets != NULL);
+  ASSERT_EQ(1, table->migrate_idx);
+  bool inserted;
+  ASSERT_TRUE(HashTable_Upsert(table, 0, &CountingUpsert, &calls));
+  HashTable_FindOrInsert(table, 1, nullptr, &inserted);
+  ASSERT_FALSE(inserted);
+  ASSERT_EQ(1, table->migrate_idx);
+  ASSERT_FALSE(HashTable_Upsert(table, 100, &CountingUpsert, &calls));
+  ASSERT_EQ(2, table->migrate_idx);
+  HashTable_FindOrInsert(table, 101, nullptr, &inserted);
+  ASSERT_TRUE(inserted);
+  ASSERT_EQ(3, table->migrate_idx);
+  HashTable_Free(table, [](HTValue_t) { });
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, GetStats) {
+  static const int kNumKeys = 2000;
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  HTKeyValue_t kv, old;
+  HTStats stats;
+  HW1Environment::OpenTestCase();
+
+  for (HTEngine_t engine : kEngines) {
+    HashTable *table = HashTable_AllocateEngine(1, engine);
+    HashTable_GetStats(table, &stats);
+    ASSERT_EQ(engine, stats.engine);
+    ASSERT_EQ(0, stats.num_elements);
+    ASSERT_EQ(stats.num_buckets, stats.empty_buckets);
+    ASSERT_EQ(0U, stats.num_resizes);
+    ASSERT_EQ(0.0, stats.bytes_per_entry);
+
+    if (engine == HT_ENGINE_CHAINED) {
+      // Stop part way through a resize.
+      table->migrate_step = 1;
+    }
+    for (int i = 0; i < kNumKeys; i++) {
+      kv.key = i;
+      kv.value = nullptr;
+      HashTable_Insert(table, kv, &old);
+    }
+    if (engine == HT_ENGINE_CHAINED) {
+      ASSERT_TRUE(table->old_buckets != NULL);
+    }
+    HashTable_GetStats(table, &stats);
+    ASSERT_EQ(kNumKeys, stats.num_elements);
+    ASSERT_LT(0U, stats.num_resizes);
+    ASSERT_LE(1, stats.max_probe);
+    ASSERT_LE(1.0, stats.mean_probe);
+    ASSERT_GE(stats.max_probe, stats.mean_probe);
+    ASSERT_EQ(stats.table_bytes + stats.bucket_bytes + stats.header_bytes +
+              stats.node_bytes + stats.kv_bytes, stats.total_bytes);
+    ASSERT_EQ(static_cast<double>(stats.total_bytes) / kNumKeys,
+              stats.bytes_per_entry);
+
+    uint64_t binned = 0;
+    for (int i = 0; i < HT_STATS_HIST; i++) {
+      binned += stats.length_hist[i];
+    }
+    if (engine != HT_ENGINE_CHAINED) {
+      // One bin per entry, and every slot is either full or empty.
+      ASSERT_EQ(static_cast<uint64_t>(kNumKeys), binned);
+      ASSERT_EQ(stats.num_buckets - kNumKeys, stats.empty_buckets);
+      ASSERT_EQ(0U, stats.header_bytes + stats.node_bytes + stats.kv_bytes);
+      HashTable_Free(table, [](HTValue_t) { });
+      continue;
+    }
+
+    // One bin per bucket of both arrays, and the chains add up.
+    ASSERT_EQ(static_cast<uint64_t>(stats.num_buckets), binned);
+    ASSERT_EQ(stats.length_hist[0], static_cast<uint64_t>(stats.empty_buckets));
+    int max_len = 0, counted = 0;
+    uint64_t depth = 0;
+    for (int i = 0; i < table->old_num_buckets + table->num_buckets; i++) {
+      LinkedList *chain = i < table->old_num_buckets ?
+                          table->old_buckets[i] :
+                          table->buckets[i - table->old_num_buckets];
+      int len = chain == NULL ? 0 : LinkedList_NumElements(chain);
+      max_len = len > max_len ? len : max_len;
+      depth += len * (len + 1) / 2;
+      counted += chain != NULL;
+    }
+    ASSERT_EQ(max_len, stats.max_probe);
+    ASSERT_DOUBLE_EQ(static_cast<double>(depth) / kNumKeys, stats.mean_probe);
+    ASSERT_EQ(counted * sizeof(LinkedList), stats.header_bytes);
+    ASSERT_EQ(kNumKeys * sizeof(HTEntry),
+              stats.node_bytes + stats.kv_bytes);
+
+    // A shrink counts as a resize too.
+    uint64_t resizes = stats.num_resizes;
+    HashTable_ShrinkToFit(table);
+    HashTable_GetStats(table, &stats);
+    ASSERT_LT(resizes, stats.num_resizes);
+    HashTable_Free(table, [](HTValue_t) { });
+  }
+
+  // A sharded table adds up its shards.
+  ShardedHashTable *sharded =
+    ShardedHashTable_Allocate(4, 16, HT_ENGINE_CHAINED);
+  for (int i = 0; i < kNumKeys; i++) {
+    kv.key = i;
+    kv.value = nullptr;
+    ShardedHashTable_Insert(sharded, kv, &old);
+  }
+  ShardedHashTable_GetStats(sharded, &stats);
+  ASSERT_EQ(kNumKeys, stats.num_elements);
+  HTStats shard;
+  int num_buckets = 0;
+  for (int i = 0; i < 4; i++) {
+    HashTable_GetStats(sharded->shards[i].table, &shard);
+    num_buckets += shard.num_buckets;
+    ASSERT_GE(stats.max_probe, shard.max_probe);
+  }
+  ASSERT_EQ(num_buckets, stats.num_buckets);
+  ShardedHashTable_Free(sharded, [](HTValue_t) { });
+  HW1Environment::AddPoints(10);
+}
+
+TEST_F(Test_HashTable, Trace) {
+  static const int kNumKeys = 1000;
+  static const HTEngine_t kEngines[] = {
+    HT_ENGINE_CHAINED, HT_ENGINE_ROBINHOOD, HT_ENGINE_SWISS
+  };
+  HTKeyValue_t kv, old;
+  HW1Environment::OpenTestCase();
+
+  Trace_Reset();
+  for (HTEngine_t engine : kEngines) {
+    HashTable *table = HashTable_AllocateEngine(1, engine);
+    for (int i = 0; i < kNumKeys; i++) {
+      kv.key = i;
+      kv.value = nullptr;
+      HashTable_Insert(table, kv, &old);
+    }
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    }
+    for (int i = 0; i < kNumKeys; i += 2) {
+      ASSERT_TRUE(HashTable_Remove(table, i, &kv));
+    }
+    HashTable_Free(table, [](HTValue_t) { });
+  }
+  LinkedList *list = LinkedList_Allocate();
+  for (intptr_t i = 0; i < 100; i++) {
+    LinkedList_Push(list, reinterpret_cast<LLPayload_t>(i));
+  }
+  LinkedList_Sort(list, true, [](LLPayload_t a, LLPayload_t b) {
+    return static_cast<int>(reinterpret_cast<intptr_t>(a) -
+                            reinterpret_cast<intptr_t>(b));
+  });
+  LinkedList_Free(list, [](LLPayload_t) { });
+
+  if (!Trace_Enabled()) {
+    // Compiled out: nothing is recorded.
+    for (int op = 0; op < TRACE_NUM_OPS; op++) {
+      ASSERT_EQ(0U, Trace_Count(static_cast<TraceOp_t>(op)));
+      ASSERT_EQ(0.0, Trace_Percentile(static_cast<TraceOp_t>(op), 0.5));
+    }
+    HW1Environment::AddPoints(5);
+    return;
+  }
+
+  // Every call is counted once; resizes depend on the engine's growth.
+  uint64_t n = sizeof(kEngines) / sizeof(kEngines[0]) * kNumKeys;
+  ASSERT_EQ(n, Trace_Count(TRACE_HT_INSERT));
+  ASSERT_EQ(n, Trace_Count(TRACE_HT_FIND));
+  ASSERT_EQ(n / 2, Trace_Count(TRACE_HT_REMOVE));
+  ASSERT_LE(3U, Trace_Count(TRACE_HT_RESIZE));
+  ASSERT_EQ(1U, Trace_Count(TRACE_LL_SORT));
+  for (int op = 0; op < TRACE_NUM_OPS; op++) {
+    TraceOp_t t = static_cast<TraceOp_t>(op);
+    ASSERT_LE(Trace_Percentile(t, 0.0), Trace_Percentile(t, 0.5));
+    ASSERT_LE(Trace_Percentile(t, 0.5), Trace_Percentile(t, 0.99));
+    ASSERT_LE(Trace_Percentile(t, 0.99), Trace_Percentile(t, 1.0));
+  }
+  ASSERT_LT(0.0, Trace_Percentile(TRACE_LL_SORT, 1.0));
+
+  Trace_Reset();
+  ASSERT_EQ(0U, Trace_Count(TRACE_LL_SORT));
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, Sharded_Basic) {
+  static const int kNumKeys = 1000;
+
+  HW1Environment::OpenTestCase();
+
+  // Shard counts round up to a power of two, and keys spread over all of
+  // the shards.
+  ShardedHashTable *table = ShardedHashTable_Allocate(5, 4, HT_ENGINE_CHAINED);
+  ASSERT_EQ(8, table->num_shards);
+  HTKeyValue_t kv, oldkv;
+  for (int i = 0; i < kNumKeys; i++) {
+    kv.key = i;
+    kv.value = NewPayload(i);
+    ASSERT_FALSE(ShardedHashTable_Insert(table, kv, &oldkv));
+  }
+  ASSERT_EQ(kNumKeys, ShardedHashTable_NumElements(table));
+  for (int i = 0; i < table->num_shards; i++) {
+    ASSERT_LT(0, HashTable_NumElements(table->shards[i].table));
+  }
+  for (int i = 0; i < kNumKeys; i++) {
+    HashTable *shard = table->shards[ShardForKey(table, i)].table;
+    ASSERT_TRUE(HashTable_Find(shard, i, &kv));
+  }
+  HW1Environment::AddPoints(5);
+
+  // Replace, find and remove go through to the right shard.
+  kv.key = 7;
+  kv.value = NewPayload(7);
+  ASSERT_TRUE(ShardedHashTable_Insert(table, kv, &oldkv));
+  ASSERT_EQ(static_cast<HTKey_t>(7), AsKeyType(oldkv.value));
+  FreeValue(oldkv.value);
+  ASSERT_TRUE(ShardedHashTable_Find(table, 7, &oldkv));
+  ASSERT_EQ(kv.value, oldkv.value);
+  ASSERT_FALSE(ShardedHashTable_Find(table, kNumKeys, &oldkv));
+  ASSERT_TRUE(ShardedHashTable_Remove(table, 7, &oldkv));
+  FreeValue(oldkv.value);
+  ASSERT_FALSE(ShardedHashTable_Remove(table, 7, &oldkv));
+  ASSERT_EQ(kNumKeys - 1, ShardedHashTable_NumElements(table));
+
+  ShardedHashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(kNumKeys - 1, freeInvocations_);
+
+  // A single shard works too.
+  table = ShardedHashTable_Allocate(1, 4, HT_ENGINE_SWISS);
+  ASSERT_EQ(0, ShardForKey(table, 12345));
+  ShardedHashTable_Free(table, &Test_HashTable::VerifiedFree);
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, Sharded_Concurrent) {
+  static const int kNumThreads = 4;
+  static const int kKeysPerThread = 5000;
+
+  HW1Environment::OpenTestCase();
+
+  // Each writer inserts its own keys and removes every other one, while
+  // the readers look the writers' keys up.  Start small so the shards
+  // resize while all of this is going on.
+  ShardedHashTable *table =
+    ShardedHashTable_Allocate(kNumThreads, 1, HT_ENGINE_CHAINED);
+  vector<thread> threads;
+  vector<int> bad_reads(kNumThreads, 0);
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([table, t]() {
+      HTKeyValue_t kv, oldkv;
+      for (int i = 0; i < kKeysPerThread; i++) {
+        kv.key = t * kKeysPerThread + i;
+        kv.value = NewPayload(t * kKeysPerThread + i);
+        ShardedHashTable_Insert(table, kv, &oldkv);
+      }
+      for (int i = 0; i < kKeysPerThread; i += 2) {
+        if (ShardedHashTable_Remove(table, t * kKeysPerThread + i, &oldkv)) {
+          FreeValue(oldkv.value);
+        }
+      }
+    });
+    threads.emplace_back([table, t, &bad_reads]() {
+      HTKeyValue_t kv;
+      for (int i = 0; i < kKeysPerThread; i++) {
+        HTKey_t key = t * kKeysPerThread + i;
+        // A concurrent remove may free the value, so only check the key.
+        if (ShardedHashTable_Find(table, key, &kv) && kv.key != key) {
+          bad_reads[t]++;
+        }
+      }
+    });
+  }
+  for (thread &th : threads) {
+    th.join();
+  }
+  for (int t = 0; t < kNumThreads; t++) {
+    ASSERT_EQ(0, bad_reads[t]);
+  }
+
+  HTKeyValue_t kv;
+  ASSERT_EQ(kNumThreads * kKeysPerThread / 2,
+            ShardedHashTable_NumElements(table));
+  for (int i = 0; i < kNumThreads * kKeysPerThread; i++) {
+    ASSERT_EQ(i % 2 == 1, ShardedHashTable_Find(table, i, &kv));
+    if (i % 2 == 1) {
+      ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+    }
+  }
+  ShardedHashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(kNumThreads * kKeysPerThread / 2, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Read-mostly table tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(Test_HashTable, ReadMostly_Basic) {
+  HW1Environment::OpenTestCase();
+
+  // A read-mostly table resizes by swapping in a whole new bucket array.
+  HashTable *table = HashTable_AllocateReadMostly(2);
+  ASSERT_TRUE(table->read_mostly);
+  ASSERT_EQ(table->buckets, table->snapshot->buckets);
+  HTSnapshot *first = table->snapshot;
+  for (int i = 0; i < 100; i++) {
+    InsertElement(table, i);
+    ASSERT_TRUE(table->old_buckets == NULL);
+  }
+  ASSERT_NE(first, table->snapshot);
+  ASSERT_EQ(table->num_buckets, table->snapshot->num_buckets);
+  ASSERT_EQ(table->buckets, table->snapshot->buckets);
+
+  HTKeyValue_t kv, oldkv;
+  for (int i = 0; i < 100; i++) {
+    Reset(&kv);
+    ASSERT_TRUE(HashTable_Find(table, i, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+  }
+  kv.key = 5;
+  kv.value = NewPayload(5);
+  ASSERT_TRUE(HashTable_Insert(table, kv, &oldkv));
+  FreeValue(oldkv.value);
+  for (int i = 0; i < 100; i += 2) {
+    ASSERT_TRUE(HashTable_Remove(table, i, &oldkv));
+    FreeValue(oldkv.value);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(i % 2 == 1, HashTable_Find(table, i, &kv));
+  }
+
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(50, freeInvocations_);
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, ReadMostly_ConcurrentReaders) {
+  static const int kNumReaders = 3;
+  static const int kStable = 500;
+  static const int kChurn = 20000;
+
+  HW1Environment::OpenTestCase();
+
+  // The stable keys are in the table the whole time, and their values are
+  // never touched, so readers must always find them.  Meanwhile the writer
+  // adds enough churn keys to resize the table several times, replaces
+  // them, and removes them again.
+  HashTable *table = HashTable_AllocateReadMostly(1);
+  for (int i = 0; i < kStable; i++) {
+    InsertElement(table, i);
+  }
+
+  std::atomic<bool> done(false);
+  vector<thread> readers;
+  vector<int> misses(kNumReaders, 0);
+  for (int r = 0; r < kNumReaders; r++) {
+    readers.emplace_back([table, r, &done, &misses]() {
+      HTKeyValue_t kv;
+      int i = r;
+      do {
+        HTKey_t key = i % kStable;
+        if (!HashTable_Find(table, key, &kv) || kv.key != key ||
+            AsKeyType(kv.value) != key) {
+          misses[r]++;
+        }
+        key = kStable + i % kChurn;
+        if (HashTable_Find(table, key, &kv) && kv.key != key) {
+          misses[r]++;
+        }
+        i++;
+      } while (!done.load());
+    });
+  }
+
+  HTKeyValue_t kv, oldkv;
+  for (int i = kStable; i < kStable + kChurn; i++) {
+    InsertElement(table, i);
+  }
+  for (int i = kStable; i < kStable + kChurn; i++) {
+    kv.key = i;
+    kv.value = NewPayload(i);
+    ASSERT_TRUE(HashTable_Insert(table, kv, &oldkv));
+    FreeValue(oldkv.value);
+  }
+  for (int i = kStable; i < kStable + kChurn; i++) {
+    ASSERT_TRUE(HashTable_Remove(table, i, &oldkv));
+    FreeValue(oldkv.value);
+  }
+  done = true;
+  for (thread &th : readers) {
+    th.join();
+  }
+  for (int r = 0; r < kNumReaders; r++) {
+    ASSERT_EQ(0, misses[r]);
+  }
+
+  ASSERT_EQ(kStable, HashTable_NumElements(table));
+  HashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(kStable, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lock-free table tests
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(Test_HashTable, LockFree_Basic) {
+  static const int kNumKeys = 5000;
+
+  HW1Environment::OpenTestCase();
+
+  // Start with one bucket so the table has to grow many times over.
+  LFHashTable *table = LFHashTable_Allocate(1);
+  HTKeyValue_t kv, oldkv;
+  for (int i = 0; i < kNumKeys; i++) {
+    kv.key = i * 13;
+    kv.value = NewPayload(i * 13);
+    ASSERT_FALSE(LFHashTable_Insert(table, kv, &oldkv));
+  }
+  ASSERT_EQ(kNumKeys, LFHashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    Reset(&kv);
+    ASSERT_TRUE(LFHashTable_Find(table, i * 13, &kv));
+    ASSERT_EQ(static_cast<HTKey_t>(i * 13), kv.key);
+    ASSERT_EQ(static_cast<HTKey_t>(i * 13), AsKeyType(kv.value));
+    ASSERT_FALSE(LFHashTable_Find(table, i * 13 + 1, &kv));
+  }
+  HW1Environment::AddPoints(5);
+
+  // Replace, then remove the even keys.
+  kv.key = 13;
+  kv.value = NewPayload(13);
+  ASSERT_TRUE(LFHashTable_Insert(table, kv, &oldkv));
+  ASSERT_EQ(static_cast<HTKey_t>(13), oldkv.key);
+  ASSERT_NE(kv.value, oldkv.value);
+  FreeValue(oldkv.value);
+  for (int i = 0; i < kNumKeys; i += 2) {
+    ASSERT_TRUE(LFHashTable_Remove(table, i * 13, &oldkv));
+    ASSERT_EQ(static_cast<HTKey_t>(i * 13), AsKeyType(oldkv.value));
+    FreeValue(oldkv.value);
+    ASSERT_FALSE(LFHashTable_Remove(table, i * 13, &oldkv));
+  }
+  ASSERT_EQ(kNumKeys / 2, LFHashTable_NumElements(table));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(i % 2 == 1, LFHashTable_Find(table, i * 13, &kv));
+  }
+
+  // Removed keys can come back.
+  kv.key = 0;
+  kv.value = NewPayload(0);
+  ASSERT_FALSE(LFHashTable_Insert(table, kv, &oldkv));
+
+  LFHashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(kNumKeys / 2 + 1, freeInvocations_);
+  HW1Environment::AddPoints(5);
+}
+
+TEST_F(Test_HashTable, LockFree_Concurrent) {
+  static const int kNumThreads = 4;
+  static const int kNumKeys = 2000;
+  static const int kRounds = 5;
+
+  HW1Environment::OpenTestCase();
+
+  // Every thread inserts, replaces and removes the same keys at the same
+  // time.  Each value must end up owned by exactly one caller: either it is
+  // handed back by a replace or a remove, or it is still in the table at
+  // the end.  The count of values handed out must match.
+  LFHashTable *table = LFHashTable_Allocate(1);
+  vector<thread> threads;
+  vector<int> handed_back(kNumThreads, 0);
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([table, t, &handed_back]() {
+      HTKeyValue_t kv, oldkv;
+      for (int r = 0; r < kRounds; r++) {
+        for (int i = 0; i < kNumKeys; i++) {
+          kv.key = i;
+          kv.value = NewPayload(i);
+          if (LFHashTable_Insert(table, kv, &oldkv)) {
+            FreeValue(oldkv.value);
+            handed_back[t]++;
+          }
+        }
+        for (int i = t; i < kNumKeys; i += kNumThreads) {
+          if (LFHashTable_Remove(table, i, &oldkv)) {
+            FreeValue(oldkv.value);
+            handed_back[t]++;
+          }
+          LFHashTable_Find(table, (i + 1) % kNumKeys, &kv);
+        }
+      }
+    });
+  }
+  for (thread &th : threads) {
+    th.join();
+  }
+
+  int total = 0;
+  for (int t = 0; t < kNumThreads; t++) {
+    total += handed_back[t];
+  }
+  int left = LFHashTable_NumElements(table);
+  ASSERT_EQ(kNumThreads * kRounds * kNumKeys, total + left);
+  HTKeyValue_t kv;
+  int found = 0;
+  for (int i = 0; i < kNumKeys; i++) {
+    if (LFHashTable_Find(table, i, &kv)) {
+      ASSERT_EQ(static_cast<HTKey_t>(i), AsKeyType(kv.value));
+      found++;
+    }
+  }
+  ASSERT_EQ(left, found);
+
+  LFHashTable_Free(table, &Test_HashTable::InstrumentedVerifiedFree);
+  ASSERT_EQ(left, freeInvocations_);
+  HW1Environment::AddPoints(10);
+}
+
 }  // namespace hw1
@@ -27,7 +27,7 @@ class HW1Environment : public ::testing::Environment {
   static int total_points_;
   static int curr_test_points_;
 
-  static constexpr int HW1_MAXPOINTS = 260;
+  static constexpr int HW1_MAXPOINTS = 630;
 };
 
 